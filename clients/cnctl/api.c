@@ -201,6 +201,7 @@ cache_attr_strings(void)
 	size_t attr_count = 0;
 	const char **attr_str_list = NULL;
 	int *attr_val_list = NULL;
+	PWR_Obj ht = NULL;
 
 	TRACE1_ENTER("");
 
@@ -251,6 +252,13 @@ cache_attr_strings(void)
 		LOG_DBG("NOT REACHED");
 	}
 
+	/*
+	 * The attributes cnctl supports are all controlled through the
+	 * hyperthreads, so ask one which of them this node really has.
+	 */
+	if (find_object_of_type(entry, PWR_OBJ_HT, &ht) != PWR_RET_SUCCESS)
+		ht = NULL;
+
 	/* Copy only supported attributes to the cache.  */
 	for (i = 0, cattrs_count = 0; i < attr_count; i++) {
 		size_t j = 0;
@@ -261,6 +269,15 @@ cache_attr_strings(void)
 				break;
 		}
 
+		/* Skip it if the hardware doesn't have it */
+		if (attrs_supported[j] && ht &&
+				PWR_ObjAttrIsValid(ht, attr_val_list[i]) !=
+				PWR_RET_SUCCESS) {
+			LOG_DBG("%s not supported by this node",
+					attrs_supported[j]);
+			continue;
+		}
+
 		/* If attribute was supported, record it in the cache */
 		if (attrs_supported[j]) {
 			cattrs[cattrs_count].name_str = attrs_supported[j];
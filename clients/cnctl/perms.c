@@ -29,13 +29,22 @@
  * POSSIBILITY OF SUCH DAMAGE.
  *
  * Wrapper functions for the permissions file functions which translate the
- * result into json.
+ * result into json.  Changes are made by powerapid when it is running, so
+ * that its set of permitted uids and the file are updated together.
  *
  */
 
 #include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
 #include <permissions.h>
+#include <common.h>
 
 #include "log.h"
 #include "perms.h"
@@ -43,6 +52,128 @@
 
 int64_t specified_uid = -1;
 
+/*
+ * daemon_send - Send all of a buffer to powerapid, without raising
+ * SIGPIPE should powerapid have dropped the connection.
+ *
+ * Return Code(s):
+ *
+ *	0 - sent
+ *	1 - the connection failed or was closed
+ */
+static int
+daemon_send(int fd, const void *buf, size_t len)
+{
+	const char *ptr = buf;
+	ssize_t bytes;
+
+	while (len > 0) {
+		bytes = send(fd, ptr, len, MSG_NOSIGNAL);
+		if (bytes < 0 && errno == EINTR)
+			continue;
+		if (bytes <= 0) {
+			LOG_FAULT("Failed write to powerapid: %m");
+			return 1;
+		}
+		ptr += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
+
+/*
+ * daemon_recv - Receive all of a buffer from powerapid.
+ *
+ * Return Code(s):
+ *
+ *	0 - received
+ *	1 - the connection failed or was closed
+ */
+static int
+daemon_recv(int fd, void *buf, size_t len)
+{
+	char *ptr = buf;
+	ssize_t bytes;
+
+	while (len > 0) {
+		bytes = recv(fd, ptr, len, 0);
+		if (bytes < 0 && errno == EINTR)
+			continue;
+		if (bytes < 0) {
+			LOG_FAULT("Failed read from powerapid: %m");
+			return 1;
+		}
+		if (bytes == 0) {
+			LOG_FAULT("powerapid closed the connection");
+			return 1;
+		}
+		ptr += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
+
+/*
+ * daemon_perms_request - Ask powerapid to change the permitted uids.
+ *
+ * Argument(s):
+ *
+ *	op     - Permissions operation
+ *	uid    - Uid to add or remove
+ *	retval - Target memory to hold powerapid's return code
+ *
+ * Return Code(s):
+ *
+ *	0 - powerapid handled the request
+ *	1 - powerapid isn't running, change the file directly
+ */
+static int
+daemon_perms_request(powerapi_permsop_t op, unsigned int uid, int *retval)
+{
+	struct sockaddr_un saddr = { .sun_family = AF_UNIX };
+	powerapi_request_t req = { .ReqType = PwrPERMS };
+	powerapi_response_t resp = { 0 };
+	int status = 1;
+	int fd;
+
+	TRACE2_ENTER("op = %d, uid = %u, retval = %p", op, uid, retval);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		goto done;
+
+	g_strlcpy(saddr.sun_path, PWR_SOCKET_PATH, sizeof(saddr.sun_path));
+	if (connect(fd, (struct sockaddr *)&saddr, sizeof(saddr)) != 0) {
+		LOG_DBG("powerapid not running: %m");
+		goto done;
+	}
+
+	req.perms.op = op;
+	req.perms.uid = uid;
+
+	// powerapid is running, so from here on it's powerapid's answer
+	// that counts
+	status = 0;
+	if (daemon_send(fd, &req, sizeof(req)) != 0 ||
+			daemon_recv(fd, &resp, sizeof(resp)) != 0) {
+		LOG_FAULT("powerapid permissions request failed");
+		*retval = PWR_RET_FAILURE;
+		goto done;
+	}
+
+	*retval = resp.retval;
+
+done:
+	if (fd >= 0)
+		close(fd);
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
 void
 perms_add(void)
 {
@@ -50,7 +181,8 @@ perms_add(void)
 
 	TRACE2_ENTER("specified_uid = %lu", specified_uid);
 
-	retval = add_uid_permissions_file(specified_uid);
+	if (daemon_perms_request(PwrPERMS_ADD, specified_uid, &retval) != 0)
+		retval = add_uid_permissions_file(specified_uid);
 
 	if (retval)
 		set_json_ret_code(retval);
@@ -65,7 +197,8 @@ perms_remove(void)
 
 	TRACE2_ENTER("specified_uid = %lu", specified_uid);
 
-	retval = del_uid_permissions_file(specified_uid);
+	if (daemon_perms_request(PwrPERMS_REMOVE, specified_uid, &retval) != 0)
+		retval = del_uid_permissions_file(specified_uid);
 
 	if (retval)
 		set_json_ret_code(retval);
@@ -80,7 +213,8 @@ perms_clear(void)
 
 	TRACE2_ENTER("");
 
-	retval = clear_permissions_file();
+	if (daemon_perms_request(PwrPERMS_CLEAR, 0, &retval) != 0)
+		retval = clear_permissions_file();
 
 	if (retval)
 		set_json_ret_code(retval);
@@ -95,7 +229,8 @@ perms_restore(void)
 
 	TRACE2_ENTER("");
 
-	retval = restore_permissions_file();
+	if (daemon_perms_request(PwrPERMS_RESTORE, 0, &retval) != 0)
+		retval = restore_permissions_file();
 
 	if (retval)
 		set_json_ret_code(retval);
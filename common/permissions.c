@@ -239,12 +239,8 @@ del_uid_permissions_file(const unsigned int uid)
 	fclose(fp2);
 	fp1 = fp2 = NULL;
 
-	if (remove(CURR_PERMISSIONS_FILE) != 0) {
-		LOG_FAULT("unable to remove file %s: %m",
-				CURR_PERMISSIONS_FILE);
-		goto error_handling;
-	}
-
+	// rename replaces the current file atomically, so a reader never
+	// finds it missing
 	if (rename(TEMP_PERMISSIONS_FILE, CURR_PERMISSIONS_FILE) != 0) {
 		LOG_FAULT("unable to rename file %s to %s: %m",
 				TEMP_PERMISSIONS_FILE, CURR_PERMISSIONS_FILE);
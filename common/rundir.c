@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Find powerapid's named socket and working files.  They are under
+ * POWERAPI_RUNDIR_PATH, unless the PWR_RUNDIR environment variable names
+ * another directory, so that a test can run a powerapid of its own, for
+ * clients of its own, beside the system's.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <common.h>
+#include <log.h>
+
+static GMutex      rundir_lock;
+static GHashTable *rundir_paths = NULL;   // default path -> path used
+static const char *rundir = NULL;         // PWR_RUNDIR, or NULL if unset
+
+//
+// pwr_rundir_path - Map one of powerapid's paths under POWERAPI_RUNDIR_PATH
+// to the same path under PWR_RUNDIR.  The environment is looked at once,
+// so a process sees the same paths throughout.
+//
+// Argument(s):
+//
+//	path - Path under POWERAPI_RUNDIR_PATH
+//
+// Return Code(s):
+//
+//	const char * - Path to use, which is never freed
+//
+const char *
+pwr_rundir_path(const char *path)
+{
+	const size_t len = strlen(POWERAPI_RUNDIR_PATH);
+	const char *mapped = path;
+
+	TRACE3_ENTER("path = '%s'", path);
+
+	g_mutex_lock(&rundir_lock);
+
+	if (rundir_paths == NULL) {
+		rundir_paths = g_hash_table_new(g_str_hash, g_str_equal);
+		rundir = g_strdup(getenv(PWR_RUNDIR_ENV));
+		if (rundir && *rundir == '\0') {
+			rundir = NULL;
+		}
+	}
+
+	if (rundir == NULL || strncmp(path, POWERAPI_RUNDIR_PATH, len) != 0 ||
+			(path[len] != '/' && path[len] != '\0')) {
+		goto done;
+	}
+
+	mapped = g_hash_table_lookup(rundir_paths, path);
+	if (mapped == NULL) {
+		mapped = g_strconcat(rundir, path + len, NULL);
+		g_hash_table_insert(rundir_paths, g_strdup(path),
+				(gpointer)mapped);
+	}
+
+done:
+	g_mutex_unlock(&rundir_lock);
+
+	TRACE3_EXIT("mapped = '%s'", mapped);
+
+	return mapped;
+}
@@ -55,10 +55,12 @@ enum {
     cmdline_trace,
     cmdline_status,
     cmdline_dump,
+    cmdline_stats,
+    cmdline_stats_reset,
     cmdline_MAX
 };
 
-static const char *Short_Options = "hd::t::suDT";
+static const char *Short_Options = "hd::t::suSZDT";
 static struct option Long_Options[] = {
     { "help",       no_argument,        NULL, cmdline_help },
     { "clear",      no_argument,        NULL, cmdline_clear },
@@ -66,6 +68,8 @@ static struct option Long_Options[] = {
     { "trace",      optional_argument,  NULL, cmdline_trace },
     { "status",     no_argument,        NULL, cmdline_status },
     { "dump",       no_argument,        NULL, cmdline_dump },
+    { "stats",      no_argument,        NULL, cmdline_stats },
+    { "stats-reset", no_argument,       NULL, cmdline_stats_reset },
     { NULL }
 };
 
@@ -74,6 +78,8 @@ static int d_flag = -1;         // debug flag
 static int t_flag = -1;         // trace flag
 static int s_flag = 0;          // status flag
 static int u_flag = 0;          // dump flag
+static int S_flag = 0;          // stats flag
+static int Z_flag = 0;          // stats reset flag
 static int D_flag = 0;          // internal debug flag
 static int T_flag = 0;          // internal trace flag
 
@@ -95,7 +101,8 @@ usage(int exit_code)
     static const char *fmt =
         "\n"
         "Usage: %s [-h] [-d|--debug[=level]] [-t|--trace[=level]]\n"
-        "                [-c|--clear] [-s|--status] [-u|--dump] [-DT]\n"
+        "                [-c|--clear] [-s|--status] [-u|--dump]\n"
+        "                [-S|--stats] [-Z|--stats-reset] [-DT]\n"
         "\n"
         "Options:\n"
         "\n"
@@ -105,6 +112,8 @@ usage(int exit_code)
         "   -t/--trace[=level]  Increase or set daemon trace level\n"
         "   -s/--status         Report current daemon debug/trace levels\n"
         "   -u/--dump           Dump daemon internal state\n"
+        "   -S/--stats          Report daemon request statistics\n"
+        "   -Z/--stats-reset    Report, then clear, daemon request statistics\n"
         "   -D                  Increase debug level for control app (not daemon)\n"
         "   -T                  Increase trace level for control app (not daemon)\n"
 	"\n"
@@ -194,6 +203,14 @@ parse_cmd_line(int argc, char **argv)
         case 'u':
             u_flag++;
             break;
+        case cmdline_stats:
+        case 'S':
+            S_flag++;
+            break;
+        case cmdline_stats_reset:
+        case 'Z':
+            Z_flag++;
+            break;
         case 'D':
             D_flag++;
             break;
@@ -249,6 +266,11 @@ main(int argc, char *argv[])
         do_dump_request();
     }
 
+    if (S_flag || Z_flag) {
+        // Process the stats request
+        do_stats_request(Z_flag);
+    }
+
     // Disconnect from daemon
     daemon_disconnect();
 
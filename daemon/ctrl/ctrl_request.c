@@ -63,7 +63,7 @@
 void
 do_loglvl_request(int Dlevel, int Tlevel, int Sflag)
 {
-    powerapi_request_t req;
+    powerapi_request_t req = { 0 };
     powerapi_response_t resp;
 
     TRACE1_ENTER("Dlevel = %d, Tlevel = %d, Sflag = %d", Dlevel, Tlevel, Sflag);
@@ -111,7 +111,7 @@ do_loglvl_request(int Dlevel, int Tlevel, int Sflag)
 void
 do_dump_request(void)
 {
-    powerapi_request_t req;
+    powerapi_request_t req = { 0 };
     powerapi_response_t resp;
 
     TRACE1_ENTER("");
@@ -138,3 +138,130 @@ do_dump_request(void)
 
     TRACE1_EXIT("");
 }
+
+//
+// stats_percentile - Estimate a percentile of a latency histogram
+//
+// Argument(s):
+//
+//      rec     - Histogram record
+//      percent - Percentile to estimate
+//
+// Return Code(s):
+//
+//      uint64_t - Upper bound of the bucket holding the percentile, nsec
+//
+static uint64_t
+stats_percentile(const powerapi_stats_record_t *rec, double percent)
+{
+    uint64_t target = (rec->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    unsigned int i;
+
+    for (i = 0; i < POWERAPI_STATS_BUCKETS - 1; i++) {
+        seen += rec->buckets[i];
+        if (seen >= target && seen > 0) {
+            return MIN(powerapi_stats_bucket_min(i + 1) - 1, rec->max);
+        }
+    }
+
+    return rec->max;
+}
+
+//
+// do_stats_request - Process a statistics request
+//
+// Argument(s):
+//
+//      reset - clear the statistics after reporting them
+//
+// Return Code(s):
+//
+//      void
+//
+void
+do_stats_request(int reset)
+{
+    powerapi_request_t req = { 0 };
+    powerapi_response_t resp;
+    powerapi_stats_record_t *records;
+    uint32_t i;
+    int paths = 0;
+
+    TRACE1_ENTER("reset = %d", reset);
+
+    //
+    // Send the request
+    //
+    req.ReqType = PwrSTATS;
+    req.stats.reset = reset;
+
+    send_req(&req);
+
+    //
+    // Get the response, followed by the statistics records
+    //
+    get_resp(&resp);
+
+    if (resp.retval == PWR_RET_OP_NO_PERM) {
+        LOG_CRIT("No permission");
+        exit(1);
+    } else if (resp.retval != PWR_RET_SUCCESS) {
+        LOG_CRIT("Error code from server = %d", resp.retval);
+        exit(1);
+    }
+
+    records = g_new0(powerapi_stats_record_t, resp.stats.num_records);
+    if (!records && resp.stats.num_records) {
+        LOG_CRIT("Unable to allocate %u statistics records",
+                resp.stats.num_records);
+        exit(1);
+    }
+
+    get_resp_data(records, resp.stats.num_records * sizeof(*records));
+
+    printf("%-24s %10s %10s %10s %10s %10s %10s\n", "Latency (usec)",
+            "count", "mean", "p50", "p90", "p99", "max");
+    for (i = 0; i < resp.stats.num_records; i++) {
+        const powerapi_stats_record_t *rec = &records[i];
+
+        if (rec->type != PwrSTATS_HISTOGRAM) {
+            continue;
+        }
+        printf("%-24.24s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                rec->name, rec->count,
+                rec->count ? rec->sum / 1000.0 / rec->count : 0.0,
+                stats_percentile(rec, 50) / 1000.0,
+                stats_percentile(rec, 90) / 1000.0,
+                stats_percentile(rec, 99) / 1000.0,
+                rec->max / 1000.0);
+    }
+
+    printf("\n");
+    for (i = 0; i < resp.stats.num_records; i++) {
+        const powerapi_stats_record_t *rec = &records[i];
+
+        if (rec->type == PwrSTATS_COUNTER) {
+            printf("%-24.24s %10lu\n", rec->name, rec->count);
+        } else if (rec->type == PwrSTATS_GAUGE) {
+            printf("%-24.24s %10lu (max %lu)\n", rec->name, rec->count,
+                    rec->max);
+        }
+    }
+
+    for (i = 0; i < resp.stats.num_records; i++) {
+        const powerapi_stats_record_t *rec = &records[i];
+
+        if (rec->type != PwrSTATS_PATH) {
+            continue;
+        }
+        if (paths++ == 0) {
+            printf("\n%10s %10s  %s\n", "writes", "errors", "Most written paths");
+        }
+        printf("%10lu %10lu  %s\n", rec->count, rec->sum, rec->name);
+    }
+
+    g_free(records);
+
+    TRACE1_EXIT("num_records = %u", resp.stats.num_records);
+}
@@ -35,5 +35,6 @@
 
 void do_loglvl_request(int Dlevel, int Tlevel, int Sflag);
 void do_dump_request(void);
+void do_stats_request(int reset);
 
 #endif /* __CTRL_REQUEST_H */
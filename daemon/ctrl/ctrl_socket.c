@@ -41,6 +41,7 @@
 #include <sys/un.h>
 #include <getopt.h>
 #include <glib.h>
+#include <common.h>
 #include <log.h>
 
 #include "ctrl_socket.h"
@@ -104,6 +105,40 @@ get_resp(powerapi_response_t *resp)
     TRACE1_EXIT("");
 }
 
+//
+// get_resp_data - Get data following a response packet from the daemon
+//
+// Argument(s):
+//
+//      data - Buffer to be filled in
+//      len  - Number of bytes to read
+//
+// Return Code(s):
+//
+//      void
+//
+void
+get_resp_data(void *data, size_t len)
+{
+    ssize_t num_read = 0;
+    size_t total = 0;
+
+    TRACE1_ENTER("data = %p, len = %zu", data, len);
+
+    // The data may arrive in pieces
+    while (total < len) {
+        num_read = read(named_socket, (char *)data + total, len - total);
+        if (num_read <= 0) {
+            LOG_CRIT("Read %zu bytes, attempted to read %zu bytes!",
+                    total, len);
+            exit(1);
+        }
+        total += num_read;
+    }
+
+    TRACE1_EXIT("");
+}
+
 //
 // daemon_connect - Connect to daemon
 //
@@ -128,10 +163,10 @@ daemon_connect(void)
     LOG_DBG("Socket num = %d", named_socket);
 
     saddr.sun_family = AF_UNIX;
-    if (g_strlcpy(saddr.sun_path, POWERAPID_SOCKET_PATH,
+    if (g_strlcpy(saddr.sun_path, PWR_SOCKET_PATH,
             sizeof(saddr.sun_path)) >= sizeof(saddr.sun_path)) {
         LOG_CRIT("Named socket path '%s' too long for buffer!",
-                POWERAPID_SOCKET_PATH);
+                PWR_SOCKET_PATH);
         exit(1);
     }
 
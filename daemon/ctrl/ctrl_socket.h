@@ -39,6 +39,7 @@ extern void daemon_connect(void);
 extern void daemon_disconnect(void);
 extern void send_req(powerapi_request_t *req);
 extern void get_resp(powerapi_response_t *resp);
+extern void get_resp_data(void *data, size_t len);
 
 #endif /* ifndef __CTRL_SOCKET_H */
 
@@ -41,6 +41,7 @@
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -49,15 +50,27 @@
 #include <glib.h>
 
 #include <cray-powerapi/powerapid.h>
+#include <common.h>
 #include <log.h>
 
-#include <permissions.h>
 #include "powerapid.h"
 #include "pwrapi_socket.h"
 #include "pwrapi_set.h"
+#include "pwrapi_heap.h"
 #include "pwrapi_worker.h"
 #include "pwrapi_signal.h"
 #include "pwrapi_down.h"
+#include "pwrapi_telemetry.h"
+#include "pwrapi_journal.h"
+#include "pwrapi_perms.h"
+#include "pwrapi_stats.h"
+#include "pwrapi_powercap.h"
+#include "pwrapi_dvfs.h"
+#include "pwrapi_defaults.h"
+#include "pwrapi_cpufreq.h"
+#include "pwrapi_pmqos.h"
+#include "pwrapi_handover.h"
+#include "pwrapi_ring.h"
 
 #define MAX_CLIENT_SOCKETS 300
 
@@ -67,26 +80,68 @@
 //
 // def_values is a hash table of the default values for the attributes that
 // have been set.  The table is keyed by the set path.  Entries in the hash
-// table are set_info_t structs.
+// table are set_info_t structs.  A default is usually read ahead of the
+// first set for its path (see pwrapi_defaults.c).
 //
 // all_changes is a hash table of all the change requests that have been
 // received.  The table is keyed by the set path.  Entries in the hash table
-// are singly linked lists of set_info_t structs, sorted by the appropriate
-// priority for the attribute, highest priority first.
+// are heaps (set_heap_t) of set_info_t structs, ordered by the appropriate
+// priority for the attribute, highest priority at the top.
 //
-// work_queue is a thread safe queue of set requests (set_info_t).  The main
-// thread will push incoming requests onto the queue and a second "worker"
-// thread will process the requests in order.
-GHashTable   *open_sockets = NULL;
-GHashTable   *def_values   = NULL;
-GHashTable   *all_changes  = NULL;
-GAsyncQueue  *work_queue   = NULL;
+// advisory_changes is a hash table of the set requests made by the
+// daemon's own policy engines on behalf of no client.  The table is keyed
+// by the set path.  An advisory set is written in place of the default
+// value, but yields to any client's set for the path.
+//
+// changes_lock protects the structure of def_values, all_changes,
+// advisory_changes and every socket's my_changes table, all of which are
+// shared by the worker threads.
+//
+// workers is an array of num_workers worker threads.  Each worker owns a
+// shard of the attribute paths and has a thread safe queue of set requests
+// (set_info_t) for those paths.  The main thread pushes incoming requests
+// onto the queue of the owning worker, which processes them in order.
+// When a client goes away, every worker is queued a release item and
+// rolls back the client's sets for the paths it owns.
+GHashTable    *open_sockets = NULL;
+GHashTable    *def_values   = NULL;
+GHashTable    *all_changes  = NULL;
+GHashTable    *advisory_changes = NULL;
+GMutex         changes_lock;
+worker_info_t *workers      = NULL;
+int            num_workers  = DEFAULT_NUM_WORKERS;
+
+// sample_interval is the number of msec between samples of the
+// measurement files published in the telemetry segment, 0 to disable.
+static unsigned int sample_interval = DEFAULT_SAMPLE_INTERVAL;
+
+// powercap_mode selects how the node power budget is held, and sysfs_root
+// lets the power cap controller and DVFS engine run against a simulated
+// sysfs tree.
+static powercap_mode_t powercap_mode = POWERCAP_PI;
+static const char *sysfs_root = "";
+
+// dvfs_loss is the percent loss of performance the DVFS policy engine may
+// cost memory bound threads, 0 to disable it.
+static unsigned int dvfs_loss = 0;
+
+// pm_qos holds node C-state limits as a PM QoS latency request rather
+// than limiting each hyperthread.
+static gboolean pm_qos = FALSE;
 
 int daemonize = 1;
 int daemon_run = 1;
-static const char *pidfile = POWERAPID_PIDFILE_PATH;
+int daemon_handover = 0;
+static const char *pidfile = NULL;  // PWR_PIDFILE_PATH unless -p given
 static int restart = 0;
 
+// takeover_fd is the handover socket of the daemon this one takes over
+// from, and exec_path and exec_args are what to exec to hand this daemon
+// over in turn.
+static int takeover_fd = -1;
+static char *exec_path = NULL;
+static char **exec_args = NULL;
+
 static int D_flag;
 static int T_flag;
 
@@ -97,17 +152,33 @@ enum {
 	cmdline_pidfile,
 	cmdline_restart,
 	cmdline_nodaemon,
+	cmdline_workers,
+	cmdline_sample_interval,
+	cmdline_powercap,
+	cmdline_sysfs_root,
+	cmdline_rundir,
+	cmdline_dvfs_loss,
+	cmdline_pm_qos,
+	cmdline_takeover,
 	cmdline_debug,
 	cmdline_trace,
 	cmdline_MAX
 };
 
-static const char *Short_Options = "hp:rnDT";
+static const char *Short_Options = "hp:rnw:s:c:l:qDT";
 static struct option Long_Options[] = {
 	{ "help",     no_argument,       NULL, cmdline_help },
 	{ "pidfile",  required_argument, NULL, cmdline_pidfile },
 	{ "restart",  no_argument,       NULL, cmdline_restart },
 	{ "nodaemon", no_argument,       NULL, cmdline_nodaemon },
+	{ "workers",  required_argument, NULL, cmdline_workers },
+	{ "sample-interval", required_argument, NULL, cmdline_sample_interval },
+	{ "powercap", required_argument, NULL, cmdline_powercap },
+	{ "sysfs-root", required_argument, NULL, cmdline_sysfs_root },
+	{ "rundir",   required_argument, NULL, cmdline_rundir },
+	{ "dvfs-loss", required_argument, NULL, cmdline_dvfs_loss },
+	{ "pm-qos",   no_argument,       NULL, cmdline_pm_qos },
+	{ "takeover", required_argument, NULL, cmdline_takeover },
 	{ "debug",    no_argument,       NULL, cmdline_debug },
 	{ "trace",    no_argument,       NULL, cmdline_trace },
 	{ NULL }
@@ -129,7 +200,9 @@ usage(int exit_code)
 {
 	static const char *fmt =
 			"\n"
-			"Usage: %s [-hrnDT] [-p pidfile]\n"
+			"Usage: %s [-hrnqDT] [-p pidfile] [-w workers]\n"
+			"       [-s msec] [-c pi|model|none] [-l percent]\n"
+			"       [--sysfs-root dir] [--rundir dir] [--takeover fd]\n"
 			"\n"
 			"Options:\n"
 			"\n"
@@ -137,6 +210,23 @@ usage(int exit_code)
 			"   -p/--pidfile    Pathname to pidfile to use\n"
 			"   -r/--restart    Allow daemon restart\n"
 			"   -n/--nodaemon   Don't run as a daemon (for debugging)\n"
+			"   -w/--workers    Number of worker threads (default %d)\n"
+			"   -s/--sample-interval\n"
+			"                   Telemetry sample interval in msec, 0 to\n"
+			"                   disable (default %d)\n"
+			"   -c/--powercap   How the node power budget is held:\n"
+			"                   pi, model or none (default pi)\n"
+			"   -l/--dvfs-loss  Lower the frequency of memory bound\n"
+			"                   threads for at most this percent loss\n"
+			"                   of performance, 0 to disable (default 0)\n"
+			"   -q/--pm-qos     Hold node C-state limits as a PM QoS\n"
+			"                   latency request\n"
+			"      --sysfs-root Directory the power cap controller and\n"
+			"                   DVFS engine find sysfs under (for testing)\n"
+			"      --rundir     Directory for the socket and working\n"
+			"                   files in place of %s (for testing)\n"
+			"      --takeover   Take over from the daemon handing over\n"
+			"                   on this socket (used on SIGUSR2)\n"
 			"   -D/--debug      Increase debug level to stderr\n"
 			"   -T/--trace      Increase trace level to stderr\n"
 			"\n"
@@ -150,7 +240,9 @@ usage(int exit_code)
 
 	TRACE1_ENTER("exit_code = %d", exit_code);
 
-	fprintf((exit_code) ? stderr : stdout, fmt, g_get_prgname());
+	fprintf((exit_code) ? stderr : stdout, fmt, g_get_prgname(),
+			DEFAULT_NUM_WORKERS, DEFAULT_SAMPLE_INTERVAL,
+			POWERAPI_RUNDIR_PATH);
 
 	TRACE1_EXIT("exit_code = %d", exit_code);
 
@@ -208,6 +300,91 @@ parse_cmd_line(int argc, char **argv)
 			daemonize = 0;
 			LOG_DBG("-n/--nodaemon command line option specified");
 			break;
+		case cmdline_workers:
+		case 'w':
+			num_workers = atoi(optarg);
+			if (num_workers < 1 || num_workers > MAX_NUM_WORKERS) {
+				fprintf(stderr, "The -w/--workers option must be "
+						"between 1 and %d.\n", MAX_NUM_WORKERS);
+				usage(1);
+		// NOT REACHED
+				LOG_DBG("NOT REACHED");
+			}
+			LOG_DBG("-w/--workers command line option specified: %d",
+					num_workers);
+			break;
+		case cmdline_sample_interval:
+		case 's':
+			sample_interval = atoi(optarg);
+			if (sample_interval > MAX_SAMPLE_INTERVAL) {
+				fprintf(stderr, "The -s/--sample-interval option must be "
+						"between 0 and %d.\n", MAX_SAMPLE_INTERVAL);
+				usage(1);
+		// NOT REACHED
+				LOG_DBG("NOT REACHED");
+			}
+			LOG_DBG("-s/--sample-interval command line option specified: %u",
+					sample_interval);
+			break;
+		case cmdline_powercap:
+		case 'c':
+			if (strcmp(optarg, "pi") == 0) {
+				powercap_mode = POWERCAP_PI;
+			} else if (strcmp(optarg, "model") == 0) {
+				powercap_mode = POWERCAP_MODEL;
+			} else if (strcmp(optarg, "none") == 0) {
+				powercap_mode = POWERCAP_NONE;
+			} else {
+				fprintf(stderr, "The -c/--powercap option must be "
+						"pi, model or none.\n");
+				usage(1);
+		// NOT REACHED
+				LOG_DBG("NOT REACHED");
+			}
+			LOG_DBG("-c/--powercap command line option specified: %s",
+					optarg);
+			break;
+		case cmdline_dvfs_loss:
+		case 'l':
+			dvfs_loss = atoi(optarg);
+			if (dvfs_loss > MAX_DVFS_LOSS) {
+				fprintf(stderr, "The -l/--dvfs-loss option must be "
+						"between 0 and %d.\n", MAX_DVFS_LOSS);
+				usage(1);
+		// NOT REACHED
+				LOG_DBG("NOT REACHED");
+			}
+			LOG_DBG("-l/--dvfs-loss command line option specified: %u",
+					dvfs_loss);
+			break;
+		case cmdline_pm_qos:
+		case 'q':
+			pm_qos = TRUE;
+			LOG_DBG("-q/--pm-qos command line option specified");
+			break;
+		case cmdline_takeover:
+			takeover_fd = atoi(optarg);
+			if (takeover_fd < 0 || fcntl(takeover_fd, F_GETFD) < 0) {
+				fprintf(stderr, "The --takeover option must be "
+						"an open socket.\n");
+				usage(1);
+		// NOT REACHED
+				LOG_DBG("NOT REACHED");
+			}
+			LOG_DBG("--takeover command line option specified: %d",
+					takeover_fd);
+			break;
+		case cmdline_sysfs_root:
+			sysfs_root = optarg;
+			LOG_DBG("--sysfs-root command line option specified: %s",
+					sysfs_root);
+			break;
+		case cmdline_rundir:
+			// Read by pwr_rundir_path(), and kept across a handover
+			setenv(PWR_RUNDIR_ENV, optarg, 1);
+			LOG_DBG("--rundir command line option specified: %s",
+					optarg);
+			break;
 		case cmdline_debug:
 		case 'D':
 			D_flag++;
@@ -224,6 +401,10 @@ parse_cmd_line(int argc, char **argv)
 		}
 	}
 
+	if (pidfile == NULL) {
+		pidfile = PWR_PIDFILE_PATH;
+	}
+
 	TRACE1_EXIT("");
 }
 
@@ -257,27 +438,22 @@ create_pidfile(void)
 	TRACE1_EXIT("");
 }
 
-// print out a list of attribute set requests from all_changes
+// print a single set request from an all_changes heap
 static void
-list_print(gpointer key, gpointer value, gpointer user_data)
+heap_item_print(gpointer data, gpointer user_data)
 {
-	GSList     *list = NULL, *iter;
-	set_info_t *first = NULL;
-	const char *path = NULL;
+	set_print(NULL, data, NULL);
+}
 
-	if (value) {
-		list = (GSList *)value;
-		first = (set_info_t *)(list->data);
-		if (first)
-			path = first->setreq.path;
-		else
-			path = "empty key";
-	}
+// print out a heap of attribute set requests from all_changes
+static void
+heap_print(gpointer key, gpointer value, gpointer user_data)
+{
+	const set_heap_t *heap = value;
 
-	LOG_DBG("key: %s", path);
-	for (iter = list; iter; iter = iter->next) {
-		set_print(NULL, iter->data, NULL);
-	}
+	LOG_DBG("key: %s (%u requests)", (const char *)key,
+			set_heap_length(heap));
+	set_heap_foreach(heap, heap_item_print, NULL);
 }
 
 static void
@@ -287,48 +463,89 @@ debug_dump(void)
 
 	LOG_DBG("Dump open_sockets");
 	g_hash_table_foreach(open_sockets, socket_print, NULL);
+	g_mutex_lock(&changes_lock);
 	LOG_DBG("Dump def_values");
 	g_hash_table_foreach(def_values, set_print, NULL);
 	LOG_DBG("Dump all_changes");
-	g_hash_table_foreach(all_changes, list_print, NULL);
+	g_hash_table_foreach(all_changes, heap_print, NULL);
+	LOG_DBG("Dump advisory_changes");
+	g_hash_table_foreach(advisory_changes, set_print, NULL);
+	g_mutex_unlock(&changes_lock);
 	LOG_DBG("Dump done");
 
 	TRACE2_EXIT("");
 }
 
+// Send a response, followed by len bytes of data if data is not NULL.
 static void
-send_response(socket_info_t *skinfo, powerapi_response_t *resp)
+send_response_data(socket_info_t *skinfo, powerapi_response_t *resp,
+		const void *data, size_t len)
 {
+	struct iovec iov[2];
 	ssize_t bytes_written;
+	size_t expected = sizeof(*resp) + (data ? len : 0);
+	uint64_t start = stats_now();
 
-	TRACE1_ENTER("skinfo = %p, resp = %p", skinfo, resp);
+	TRACE1_ENTER("skinfo = %p, resp = %p, data = %p, len = %zu",
+			skinfo, resp, data, len);
 
 	LOG_DBG("resp->retval = %d", resp->retval);
 
+	// Requests made by the daemon itself have no one to answer.
+	if (skinfo->sockid < 0) {
+		TRACE1_EXIT("internal request");
+		return;
+	}
+
+	iov[0].iov_base = resp;
+	iov[0].iov_len = sizeof(*resp);
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = len;
+
+	// Responses may come from the main thread or any worker.
+	g_mutex_lock(socket_reply_lock(skinfo));
+
 	resp->sequence = skinfo->seqnum++;
 
-	bytes_written = write(skinfo->sockid, resp, sizeof(*resp));
-	if (bytes_written != sizeof(*resp)) {
+	bytes_written = writev(skinfo->sockid, iov, data ? 2 : 1);
+
+	g_mutex_unlock(socket_reply_lock(skinfo));
+	if (bytes_written != expected) {
 		if (bytes_written < 0) {
 			LOG_FAULT("Response write error: fd = %d: %m", skinfo->sockid);
 		} else {
 			LOG_FAULT("Response write error: fd = %d, "
 					"bytes_written = %zd, attempted = %zu",
-					skinfo->sockid, bytes_written, sizeof(*resp));
+					skinfo->sockid, bytes_written, expected);
 		}
 	}
 
+	stats_record(STATS_RESPONSE, start);
+
 	TRACE1_EXIT("");
 }
 
+static void
+send_response(socket_info_t *skinfo, powerapi_response_t *resp)
+{
+	send_response_data(skinfo, resp, NULL, 0);
+}
+
 void
-send_ret_code_response(socket_info_t *skinfo, int ret_code)
+send_ret_code_response(socket_info_t *skinfo, int ret_code, gboolean on_ring)
 {
 	powerapi_response_t resp = { .retval = ret_code };
 
-	TRACE1_ENTER("skinfo = %p, ret_code = %d", skinfo, ret_code);
+	TRACE1_ENTER("skinfo = %p, ret_code = %d, on_ring = %d",
+			skinfo, ret_code, on_ring);
 
-	send_response(skinfo, &resp);
+	// Sets taken from a request ring are answered on its response ring,
+	// and sets sent on the socket on the socket.
+	if (on_ring) {
+		ring_send_response(skinfo, &resp);
+	} else {
+		send_response(skinfo, &resp);
+	}
 
 	TRACE1_EXIT("");
 }
@@ -340,8 +557,10 @@ process_client_req(int client_socket)
 	ssize_t              bytes_read;
 	powerapi_request_t   req;
 	powerapi_response_t  resp = { .retval = PWR_RET_SUCCESS };
-	socket_info_t        *skinfo;
+	socket_info_t        *conn, *skinfo;
 	int                  send_response_now = TRUE;
+	powerapi_stats_record_t *records = NULL;
+	uint64_t             start = stats_now();
 
 	TRACE1_ENTER("client_socket = %d", client_socket);
 
@@ -359,23 +578,61 @@ process_client_req(int client_socket)
 		goto done;
 	}
 
-	skinfo = socket_lookup(client_socket);
-	if (skinfo == NULL) {
+	conn = socket_lookup(client_socket);
+	if (conn == NULL) {
 		LOG_FAULT("Socket info not found for client %d!", client_socket);
 		goto done;
 	}
 
+	stats_count(STATS_REQUESTS, 1);
+
+	// Requests on a shared connection name the session they're for.
+	if (req.channel == POWERAPI_CHANNEL_NEW) {
+		skinfo = (req.ReqType == PwrAUTH) ? conn : NULL;
+	} else {
+		skinfo = socket_channel_lookup(conn, req.channel);
+	}
+	if (skinfo == NULL) {
+		LOG_FAULT("Request on unknown channel %u from client %d!",
+				req.channel, client_socket);
+		resp.retval = PWR_RET_INVALID;
+		stats_record(STATS_PARSE, start);
+		send_response(conn, &resp);
+		retval = 0;
+		goto done;
+	}
+
 	switch (req.ReqType) {
 	case PwrAUTH:
-		LOG_DBG("Processing PwrAUTH request");
+		LOG_DBG("Processing PwrAUTH request, channel = %u",
+				req.channel);
 
-		if (skinfo->role != PWR_ROLE_NOT_SPECIFIED) {
+		if (req.channel != POWERAPI_CHANNEL_NEW &&
+				skinfo->role != PWR_ROLE_NOT_SPECIFIED) {
 			LOG_FAULT("Redundant authorization request from client %d!",
 					client_socket);
 			resp.retval = PWR_RET_INVALID;
 			break;
 		}
 
+		// root was let in regardless of the permissions file
+		if (!perms_check(skinfo->cred.uid)) {
+			resp.retval = PWR_RET_OP_NO_PERM;
+			break;
+		}
+
+		// Another context sharing the connection gets a session
+		// of its own.
+		if (req.channel == POWERAPI_CHANNEL_NEW) {
+			skinfo = socket_channel_create(conn, 0);
+			if (skinfo == NULL) {
+				skinfo = conn;
+				resp.retval = PWR_RET_FAILURE;
+				break;
+			}
+			stats_count(STATS_CHANNELS, 1);
+		}
+
 		skinfo->role         = req.auth.role;
 		skinfo->context_name = g_strdup(req.auth.context_name);
 		if (!skinfo->context_name) {
@@ -387,6 +644,32 @@ process_client_req(int client_socket)
 				"name = %s, uid = %d, gid = %d, pid = %d",
 				client_socket, skinfo->role, skinfo->context_name,
 				skinfo->cred.uid, skinfo->cred.gid, skinfo->cred.pid);
+
+		// A client reconnecting after a daemon restart asks to
+		// reclaim its session and the sets made in it.
+		if (req.auth.session != 0 &&
+				socket_reclaim(skinfo, req.auth.session)) {
+			resp.auth.reclaimed = TRUE;
+		} else {
+			skinfo->session = socket_new_session();
+			journal_session_begin(skinfo);
+		}
+		resp.auth.session = skinfo->session;
+		resp.auth.channel = skinfo->channel;
+		break;
+	case PwrCLOSE:
+		LOG_DBG("Processing PwrCLOSE request, channel = %u",
+				req.channel);
+
+		// The connection's own session ends when it closes.
+		if (skinfo == conn) {
+			resp.retval = PWR_RET_INVALID;
+			break;
+		}
+		stats_record(STATS_PARSE, start);
+		send_response(skinfo, &resp);
+		socket_channel_close(skinfo);
+		send_response_now = FALSE;
 		break;
 	case PwrSET:
 		LOG_DBG("Processing PwrSET request");
@@ -398,8 +681,14 @@ process_client_req(int client_socket)
 			break;
 		}
 
+		// A client with a request ring only sets over the socket
+		// once it has given up the ring, and is answered here.
 		set_info_t *setp = set_create_item(&req.set, skinfo);
-		g_async_queue_push(work_queue, setp);
+
+		stats_count(STATS_SETS, 1);
+
+		socket_ref(skinfo);
+		worker_queue_set(setp);
 	// The response will be sent when the set request
 	// is processed by the worker thread.
 		send_response_now = FALSE;
@@ -428,6 +717,47 @@ process_client_req(int client_socket)
 		}
 		debug_dump();
 		break;
+	case PwrPERMS:
+		LOG_DBG("Processing PwrPERMS request, op = %d, uid = %u",
+				req.perms.op, req.perms.uid);
+		if (skinfo->cred.uid != 0) {
+			resp.retval = PWR_RET_OP_NO_PERM;
+			break;
+		}
+		resp.retval = perms_update(&req.perms);
+		break;
+	case PwrSTATS:
+		LOG_DBG("Processing PwrSTATS request, reset = %d",
+				req.stats.reset);
+		if (req.stats.reset && skinfo->cred.uid != 0) {
+			resp.retval = PWR_RET_OP_NO_PERM;
+			break;
+		}
+		resp.stats.num_records = stats_report(&records);
+		if (req.stats.reset) {
+			stats_reset();
+		}
+		stats_record(STATS_PARSE, start);
+		send_response_data(skinfo, &resp, records,
+				resp.stats.num_records * sizeof(*records));
+		g_free(records);
+		send_response_now = FALSE;
+		break;
+	case PwrSHMEM:
+		LOG_DBG("Processing PwrSHMEM request");
+		if (skinfo->role == PWR_ROLE_NOT_SPECIFIED || skinfo->ring) {
+			LOG_FAULT("Request ring refused to client %d!",
+					client_socket);
+			resp.retval = PWR_RET_INVALID;
+			break;
+		}
+		if (ring_attach(skinfo) != 0) {
+			resp.retval = PWR_RET_FAILURE;
+			break;
+		}
+		stats_record(STATS_PARSE, start);
+		send_response_now = FALSE;
+		break;
 	default:
 		LOG_FAULT("Invalid request type (%d) received from client %d",
 				req.ReqType, client_socket);
@@ -436,6 +766,7 @@ process_client_req(int client_socket)
 	}
 
 	if (send_response_now) {
+		stats_record(STATS_PARSE, start);
 		send_response(skinfo, &resp);
 	}
 
@@ -455,7 +786,9 @@ abort_connect_req(int client_socket, int ret_code)
 
 	TRACE1_ENTER("client_socket = %d, ret_code = %d", client_socket, ret_code);
 
+	g_mutex_init(&skinfo.lock);
 	send_response(&skinfo, &resp);
+	g_mutex_clear(&skinfo.lock);
 
 	close(client_socket);
 
@@ -470,6 +803,7 @@ process_connect_req(int server_socket, int num_client_sockets,
 	int            retval = -1;
 	int            client_socket;
 	socklen_t      len;
+	uint64_t       start = stats_now();
 
 	TRACE1_ENTER("server_socket = %d, num_client_sockets = %d, cred = %p",
 			server_socket, num_client_sockets, cred);
@@ -503,7 +837,8 @@ process_connect_req(int server_socket, int num_client_sockets,
 
 	err_throttle = 0;
 
-	if (check_permissions_file(cred->uid) != 0) {
+	// root may always connect, if only to change the permissions
+	if (!perms_check(cred->uid) && cred->uid != 0) {
 		LOG_FAULT("authentication error: uid %u not permitted to connect",
 				cred->uid);
 		abort_connect_req(client_socket, PWR_RET_OP_NO_PERM);
@@ -513,12 +848,44 @@ process_connect_req(int server_socket, int num_client_sockets,
 	retval = client_socket;
 
 done:
+	if (client_socket >= 0) {
+		stats_count((retval < 0) ? STATS_REJECTS : STATS_CONNECTS, 1);
+		stats_record(STATS_ACCEPT, start);
+	}
+
 	TRACE1_EXIT("client_socket = %d, uid = %d, gid = %d, pid = %d",
 			client_socket, cred->uid, cred->gid, cred->pid);
 
 	return retval;
 }
 
+// Keep the command line to exec a daemon to hand over to, without this
+// daemon's own --takeover.  Must be called before changing directory.
+static void
+save_cmd_line(int argc, char **argv)
+{
+	int i, n = 0;
+
+	TRACE1_ENTER("argc = %d, argv = %p", argc, argv);
+
+	exec_path = g_find_program_in_path(argv[0]);
+	exec_args = g_new0(char *, argc);
+	if (!exec_args) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--takeover") == 0) {
+			i++;
+		} else if (!g_str_has_prefix(argv[i], "--takeover=")) {
+			exec_args[n++] = argv[i];
+		}
+	}
+
+	TRACE1_EXIT("exec_path = '%s'", exec_path);
+}
+
 static void
 set_state_dirty(void)
 {
@@ -526,9 +893,9 @@ set_state_dirty(void)
 
 	TRACE1_ENTER("");
 
-	fd = open(POWERAPID_STATE_DIRTY_PATH, O_CREAT | O_RDWR, 0666);
+	fd = open(PWR_STATE_DIRTY_PATH, O_CREAT | O_RDWR, 0666);
 	if (fd < 0) {
-		LOG_CRIT("Unable to create %s!", POWERAPID_STATE_DIRTY_PATH);
+		LOG_CRIT("Unable to create %s!", PWR_STATE_DIRTY_PATH);
 		exit(1);
 	}
 
@@ -542,7 +909,7 @@ set_state_clean(void)
 {
 	TRACE1_ENTER("");
 
-	unlink(POWERAPID_STATE_DIRTY_PATH);
+	unlink(PWR_STATE_DIRTY_PATH);
 
 	TRACE1_EXIT("");
 }
@@ -554,15 +921,28 @@ check_state_dirty(void)
 
 	TRACE1_ENTER("");
 
-	if (stat(POWERAPID_STATE_DIRTY_PATH, &statbuf) != 0) {
+	if (stat(PWR_STATE_DIRTY_PATH, &statbuf) != 0) {
 		TRACE1_EXIT("state not dirty");
 		return;
 	}
 
 	LOG_CRIT("File %s exists! Daemon state is dirty.",
-			POWERAPID_STATE_DIRTY_PATH);
+			PWR_STATE_DIRTY_PATH);
 	LOG_CRIT("Daemon appears to have exited abnormally.");
 
+	// The journal has everything needed to carry on where the
+	// previous daemon left off.  Clients have a while to reconnect
+	// and reclaim their sets; the state stays dirty until then.
+	if (journal_replay() == 0) {
+		LOG_WARN("Daemon state recovered from %s, %u sessions to reclaim",
+				PWR_JOURNAL_PATH, socket_num_orphans());
+		if (socket_num_orphans() == 0) {
+			set_state_clean();
+		}
+		TRACE1_EXIT("state recovered");
+		return;
+	}
+
 	if (stat(POWERAPID_ALLOW_RESTART_PATH, &statbuf) == 0) {
 		LOG_CRIT("File %s exists. Allowing restart...",
 				POWERAPID_ALLOW_RESTART_PATH);
@@ -584,39 +964,92 @@ check_state_dirty(void)
 	TRACE1_EXIT("");
 }
 
-static GThread *
+//
+// takeover_state - Rebuild the set tables from the journal snapshot left
+// by the daemon handing over to this one and take over its sockets, all
+// without writing anything.  Returns the named socket.
+//
+static int
+takeover_state(void)
+{
+	int named_socket = -1;
+
+	TRACE1_ENTER("takeover_fd = %d", takeover_fd);
+
+	if (journal_replay() != 0 ||
+			handover_receive(takeover_fd, &named_socket) != 0) {
+		LOG_CRIT("Unable to take over from the previous daemon!");
+		exit(1);
+	}
+
+	TRACE1_EXIT("named_socket = %d", named_socket);
+
+	return named_socket;
+}
+
+static void
 worker_start(void)
 {
-	GThread *worker;
+	int i;
 
-	TRACE1_ENTER("");
+	TRACE1_ENTER("num_workers = %d", num_workers);
 
-	worker = g_thread_new("worker", worker_process_items, NULL);
-	if (worker == NULL) {
-		LOG_CRIT("Unable to create worker thread!");
+	workers = g_new0(worker_info_t, num_workers);
+	if (!workers) {
+		LOG_CRIT(MEM_ERROR_EXIT);
 		exit(1);
 	}
 
-	TRACE1_EXIT("worker = %p", worker);
+	for (i = 0; i < num_workers; i++) {
+		worker_info_t *worker = &workers[i];
+		char name[16];
 
-	return worker;
+		worker->id = i;
+		worker->queue = g_async_queue_new();
+		if (!worker->queue) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		g_mutex_init(&worker->lock);
+		worker->written = g_hash_table_new_full(g_str_hash,
+				g_str_equal, g_free, g_free);
+		if (!worker->written) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+
+		snprintf(name, sizeof(name), "worker%d", i);
+		worker->thread = g_thread_new(name, worker_process_items, worker);
+		if (worker->thread == NULL) {
+			LOG_CRIT("Unable to create worker thread!");
+			exit(1);
+		}
+	}
+
+	TRACE1_EXIT("workers = %p", workers);
 }
 
 static void
-worker_stop(GThread *worker)
+worker_stop(void)
 {
 	set_info_t item;
+	int i;
 
-	TRACE1_ENTER("worker = %p", worker);
+	TRACE1_ENTER("workers = %p", workers);
 
 	memset(&item, 0, sizeof(item));
 
-    // Push an empty request onto the the work queue to
-    // wake up the worker thread and have it exit.
-	g_async_queue_push(work_queue, &item);
+    // Push an empty request onto each work queue to
+    // wake up the worker threads and have them exit.
+	for (i = 0; i < num_workers; i++) {
+		g_async_queue_push(workers[i].queue, &item);
+	}
 
-    // Wait for worker thread to exit.
-	g_thread_join(worker);
+    // Wait for worker threads to exit.
+	for (i = 0; i < num_workers; i++) {
+		g_thread_join(workers[i].thread);
+		workers[i].thread = NULL;
+	}
 
 	TRACE1_EXIT("");
 }
@@ -637,14 +1070,14 @@ named_socket_construct(void)
 	}
 
 	saddr.sun_family = AF_UNIX;
-	if (g_strlcpy(saddr.sun_path, POWERAPID_SOCKET_PATH,
+	if (g_strlcpy(saddr.sun_path, PWR_SOCKET_PATH,
 					sizeof(saddr.sun_path)) >= sizeof(saddr.sun_path)) {
 		LOG_CRIT("Named socket path '%s' too long for buffer!",
-				POWERAPID_SOCKET_PATH);
+				PWR_SOCKET_PATH);
 		exit(1);
 	}
 
-	unlink(POWERAPID_SOCKET_PATH);
+	unlink(PWR_SOCKET_PATH);
 
 	result = bind(new_socket, (struct sockaddr *)&saddr, sizeof(saddr));
 	if (result == -1) {
@@ -652,7 +1085,7 @@ named_socket_construct(void)
 		exit(1);
 	}
 
-	chmod(POWERAPID_SOCKET_PATH, 0666);
+	chmod(PWR_SOCKET_PATH, 0666);
 
 	result = listen(new_socket, 10);
 	if (result == -1) {
@@ -672,7 +1105,7 @@ named_socket_destruct(int named_socket)
 
 	close(named_socket);
 
-	unlink(POWERAPID_SOCKET_PATH);
+	unlink(PWR_SOCKET_PATH);
 
 	TRACE1_EXIT("");
 }
@@ -680,14 +1113,17 @@ named_socket_destruct(int named_socket)
 int
 main(int argc, char *argv[])
 {
-	int      named_socket;
+	int      named_socket = -1;
+	int      perms_socket;
 	int      max_socket = 0;
 	fd_set   incoming_sockets, select_sockets;
 	int      num_client_sockets = 0;
-	GThread *worker;
+	int      clean_pending = FALSE;  // mark state clean once rollbacks end
 	char    *prgname = NULL;
 	int      fd;
 	struct rlimit rlim;
+	GHashTableIter iter;
+	gpointer key;
 
     // Set program/application name
 	prgname = g_path_get_basename(argv[0]);
@@ -704,6 +1140,7 @@ main(int argc, char *argv[])
 	TRACE1_ENTER("argc = %d, argv = %p", argc, argv);
 
     // Parse command line args before daemonizing
+	save_cmd_line(argc, argv);
 	parse_cmd_line(argc, argv);
 
     //
@@ -711,8 +1148,8 @@ main(int argc, char *argv[])
     //
 	pmlog_stderr_set_level(D_flag, T_flag);
 
-    // Daemonize
-	if (daemonize) {
+    // Daemonize, unless already the daemon being handed over
+	if (daemonize && takeover_fd < 0) {
 		LOG_DBG("%s daemonizing", g_get_prgname());
 		pmlog_term();
 		if (daemon(0, 0) != 0) {
@@ -724,10 +1161,10 @@ main(int argc, char *argv[])
 		LOG_DBG("%s daemonized", g_get_prgname());
 	}
 
-	if (chdir(POWERAPID_WORKDIR_PATH) != 0) {
+	if (chdir(PWR_WORKDIR_PATH) != 0) {
 	/* Log error, but don't exit. */
 		LOG_FAULT("Can't change working directory to %s: %m",
-				POWERAPID_WORKDIR_PATH);
+				PWR_WORKDIR_PATH);
 	}
 
 	rlim.rlim_cur = RLIM_INFINITY;
@@ -744,51 +1181,145 @@ main(int argc, char *argv[])
     // create daemon data structures
 	open_sockets = g_hash_table_new(g_int_hash, g_int_equal);
 	def_values   = g_hash_table_new(g_str_hash, g_str_equal);
-	all_changes  = g_hash_table_new(g_str_hash, g_str_equal);
-	work_queue   = g_async_queue_new();
-	if (!open_sockets || !def_values || !all_changes || !work_queue) {
+	all_changes  = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, set_heap_free);
+	advisory_changes = g_hash_table_new(g_str_hash, g_str_equal);
+	if (!open_sockets || !def_values || !all_changes ||
+			!advisory_changes) {
 		LOG_CRIT(MEM_ERROR_EXIT);
 		exit(1);
 	}
 
 	pwrapi_handle_signals();
 
-	check_state_dirty();
+	if (takeover_fd >= 0) {
+		named_socket = takeover_state();
+	} else {
+		check_state_dirty();
+	}
 
-	if (restore_permissions_file() != 0) {
+	if (perms_init() != 0) {
 		LOG_CRIT("Unable to initialize powerapi permissions file!");
 		exit(1);
 	}
 
-	worker = worker_start();
+	cpufreq_start(sysfs_root);
+
+	if (defaults_start(sysfs_root) != 0) {
+		LOG_WARN("Defaults will be read when attributes are first set");
+	}
 
-	named_socket = named_socket_construct();
+	if (pmqos_start(sysfs_root, pm_qos) != 0) {
+		LOG_WARN("Node C-state limits will be set on each hyperthread");
+	}
+
+	worker_start();
+	ring_start();
+
+	journal_open();
+
+	if (telemetry_start(sample_interval) != 0) {
+		LOG_WARN("Telemetry unavailable, clients will read sysfs directly");
+	}
+
+	if (powercap_start(sysfs_root, powercap_mode) != 0) {
+		LOG_WARN("Power cap controller unavailable, node power "
+				"limits can't be set");
+	}
+
+	if (dvfs_start(sysfs_root, dvfs_loss) != 0) {
+		LOG_WARN("DVFS policy engine unavailable");
+	}
+
+	if (named_socket < 0) {
+		named_socket = named_socket_construct();
+	}
 	max_socket = named_socket + 1;
 
     // process incoming socket requests
 	FD_ZERO(&incoming_sockets);
 	FD_SET(named_socket, &incoming_sockets);
 
+    // and changes to the permissions file
+	perms_socket = perms_fd();
+	if (perms_socket >= 0) {
+		FD_SET(perms_socket, &incoming_sockets);
+		max_socket = MAX(max_socket, perms_socket + 1);
+	}
+
+    // and the clients taken over from the previous daemon
+	g_hash_table_iter_init(&iter, open_sockets);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		fd = *(int *)key;
+		FD_SET(fd, &incoming_sockets);
+		max_socket = MAX(max_socket, fd + 1);
+		num_client_sockets++;
+	}
+
+	if (takeover_fd >= 0) {
+		if (num_client_sockets == 0 && socket_num_orphans() == 0) {
+			clean_pending = TRUE;
+		}
+		handover_ready(takeover_fd);
+		takeover_fd = -1;
+	}
+
 	while (daemon_run) {
+		struct timeval timeout, *timeoutp = NULL;
+		gint64 deadline = socket_orphan_deadline();
 		int result;
 
 		select_sockets = incoming_sockets;
 
-		result = select(max_socket, &select_sockets, NULL, NULL, NULL);
+	// The state is clean once every client is gone and the workers
+	// have rolled back all of their sets.  Until then, check back.
+		if (clean_pending) {
+			if (worker_releases_pending() == 0) {
+				set_state_clean();
+				clean_pending = FALSE;
+			} else {
+				timeout.tv_sec = 0;
+				timeout.tv_usec = RELEASE_POLL_INTERVAL * 1000;
+				timeoutp = &timeout;
+			}
+		}
+
+	// wake up in time to roll back unclaimed orphans
+		if (deadline) {
+			gint64 wait = MAX(deadline - g_get_monotonic_time(), 0);
+
+			if (!timeoutp || wait < timeout.tv_sec * G_USEC_PER_SEC
+					+ timeout.tv_usec) {
+				timeout.tv_sec = wait / G_USEC_PER_SEC;
+				timeout.tv_usec = wait % G_USEC_PER_SEC;
+				timeoutp = &timeout;
+			}
+		}
+
+		result = select(max_socket, &select_sockets, NULL, NULL, timeoutp);
 		if (result < 0) {
 			if (errno != EINTR) {
 				LOG_FAULT("select() failed: %m");
 			}
 			continue;
 		} else if (result == 0) {
-			LOG_FAULT("select() timeout??");
+			if (deadline && g_get_monotonic_time() >= deadline) {
+				socket_expire_orphans();
+				if (num_client_sockets == 0) {
+					clean_pending = TRUE;
+				}
+			} else if (!clean_pending) {
+				LOG_FAULT("select() timeout??");
+			}
 			continue;
 		}
 	// else select succeeded
 
 		for (fd = 0; fd < max_socket; ++fd) {
 			if (FD_ISSET(fd, &select_sockets)) {
-				if (fd == named_socket) {
+				if (fd == perms_socket) {
+					perms_refresh();
+				} else if (fd == named_socket) {
 					struct ucred cred = { .uid = -1 };
 					int client_socket;
 
@@ -796,6 +1327,7 @@ main(int argc, char *argv[])
 							num_client_sockets, &cred);
 					if (client_socket >= 0) {
 						set_state_dirty();
+						clean_pending = FALSE;
 						num_client_sockets++;
 						FD_SET(client_socket, &incoming_sockets);
 						if (client_socket >= max_socket) {
@@ -809,8 +1341,9 @@ main(int argc, char *argv[])
 						close(fd);
 						FD_CLR(fd, &incoming_sockets);
 						num_client_sockets--;
-						if (num_client_sockets == 0) {
-							set_state_clean();
+						if (num_client_sockets == 0 &&
+								socket_num_orphans() == 0) {
+							clean_pending = TRUE;
 						}
 					}
 				}
@@ -818,11 +1351,35 @@ main(int argc, char *argv[])
 		}
 	}
 
-    // Stop the worker before we start resetting values.
-	worker_stop(worker);
+	telemetry_stop();
+	ring_stop();
+
+    // Drop the power cap controller's limits and the DVFS engine's
+    // frequency requests along with everyone else's.
+	powercap_stop(!daemon_handover);
+	dvfs_stop();
+
+    // Or hand over instead: finish the queued sets, leave them all in the
+    // journal and pass the sockets on, so that nothing is rolled back.
+    // Should that fail, the journal is recovered from as after a crash.
+	if (daemon_handover) {
+		LOG_MSG("Handing over to a new daemon");
+		set_state_dirty();
+		worker_stop();
+		defaults_stop();
+		if (exec_path && journal_handover() == 0) {
+			handover_send(exec_path, exec_args, named_socket);
+		}
+		LOG_CRIT("Handover failed, daemon state left in %s",
+				PWR_JOURNAL_PATH);
+		exit(1);
+	}
 
     // Don't try to clean up the named socket.
 	FD_CLR(named_socket, &incoming_sockets);
+	if (perms_socket >= 0) {
+		FD_CLR(perms_socket, &incoming_sockets);
+	}
 
     // Clean up and close all client sockets and thereby
     // reset all attributes to their persistent values.
@@ -832,6 +1389,17 @@ main(int argc, char *argv[])
 			close(fd);
 		}
 	}
+	socket_expire_orphans();
+
+    // The workers finish the queued rollbacks before they exit.
+	worker_stop();
+	pmqos_stop();
+	defaults_stop();
+	cpufreq_stop();
+
+    // Everything has been reset, so there's nothing left to recover.
+	journal_close();
+	stats_destroy();
 
 	named_socket_destruct(named_socket);
 
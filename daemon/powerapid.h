@@ -37,15 +37,21 @@
 #include <glib.h>
 
 #include "pwrapi_socket.h"
+#include "pwrapi_worker.h"
 
-extern GHashTable   *open_sockets;
-extern GHashTable   *def_values;
-extern GHashTable   *all_changes;
-extern GAsyncQueue  *work_queue;
-extern int           daemonize;
-extern int           daemon_run;
+extern GHashTable    *open_sockets;
+extern GHashTable    *def_values;
+extern GHashTable    *all_changes;
+extern GHashTable    *advisory_changes;
+extern GMutex         changes_lock;
+extern worker_info_t *workers;
+extern int            num_workers;
+extern int            daemonize;
+extern int            daemon_run;
+extern int            daemon_handover;
 
-void send_ret_code_response(socket_info_t *skinfo, int ret_code);
+void send_ret_code_response(socket_info_t *skinfo, int ret_code,
+		gboolean on_ring);
 
 #define MEM_ERROR_EXIT "Unable to allocate memory!  Exiting..."
 
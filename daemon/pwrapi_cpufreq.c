@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Map per-hyperthread cpufreq control files to those of their policy.
+ *
+ * The hyperthreads of a core, and often of a whole socket, share a
+ * cpufreq policy, and cpuN/cpufreq is a link to the policy's directory.
+ * Sets of a hyperthread's frequency limits, frequency request or governor
+ * are rewritten to the path under cpufreq/policyN before they're queued,
+ * so each policy has one default, one heap of set requests and one
+ * control file write, however many of its hyperthreads are set.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glob.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_cpufreq.h"
+
+#define CPU_PATH		"/sys/devices/system/cpu"
+#define POLICY_PATTERN		CPU_PATH "/cpufreq/policy[0-9]*"
+
+// control files of a policy, and the attributes they're set by
+static const struct {
+	PWR_AttrName  attribute;
+	const char   *name;
+} cf_files[] = {
+	{ PWR_ATTR_FREQ_REQ,       "scaling_setspeed" },
+	{ PWR_ATTR_FREQ_LIMIT_MIN, "scaling_min_freq" },
+	{ PWR_ATTR_FREQ_LIMIT_MAX, "scaling_max_freq" },
+	{ PWR_ATTR_GOV,            "scaling_governor" },
+};
+
+static char   *cf_root;         // sysfs root
+static char   *cf_parser;       // cpufreq directory of a cpu, ending in %n
+static GArray *cf_policies;     // policy of each cpu, -1 if none
+
+// record the policy of each cpu in a policy's related_cpus
+static void
+cpufreq_add_policy(const char *dir)
+{
+	const char *name = strrchr(dir, '/') + 1;
+	char *path;
+	char *related = NULL;
+	char *p, *end;
+	int policy;
+	gint none = -1;
+	guint cpu;
+
+	TRACE2_ENTER("dir = '%s'", dir);
+
+	if (sscanf(name, "policy%d", &policy) != 1) {
+		goto done;
+	}
+
+	path = g_strconcat(dir, "/related_cpus", NULL);
+	if (!g_file_get_contents(path, &related, NULL, NULL)) {
+		LOG_FAULT("Unable to read %s", path);
+		g_free(path);
+		goto done;
+	}
+	g_free(path);
+
+	for (p = related; ; p = end) {
+		cpu = strtoul(p, &end, 10);
+		if (end == p) {
+			break;
+		}
+		while (cf_policies->len <= cpu) {
+			g_array_append_val(cf_policies, none);
+		}
+		g_array_index(cf_policies, gint, cpu) = policy;
+	}
+
+done:
+	g_free(related);
+
+	TRACE2_EXIT("");
+}
+
+//
+// cpufreq_policy_path - Rewrite the path of a set of a hyperthread's
+// cpufreq attribute to that of its policy.  Other sets are left alone.
+//
+void
+cpufreq_policy_path(powerapi_setreq_t *setreq)
+{
+	const char *name;
+	guint cpu;
+	gint policy;
+	int end = -1;
+	int i;
+
+	TRACE2_ENTER("setreq = %p", setreq);
+
+	if (cf_policies == NULL || setreq->object != PWR_OBJ_HT ||
+			setreq->metadata != PWR_MD_NOT_SPECIFIED) {
+		goto done;
+	}
+
+	if (sscanf(setreq->path, cf_parser, &cpu, &end) != 1 || end < 0 ||
+			cpu >= cf_policies->len) {
+		goto done;
+	}
+	policy = g_array_index(cf_policies, gint, cpu);
+	if (policy < 0) {
+		goto done;
+	}
+
+	name = setreq->path + end;
+	for (i = 0; i < G_N_ELEMENTS(cf_files); i++) {
+		if (cf_files[i].attribute == setreq->attribute &&
+				strcmp(cf_files[i].name, name) == 0) {
+			LOG_DBG("Setting %s through cpufreq policy%d",
+					setreq->path, policy);
+			snprintf(setreq->path, sizeof(setreq->path),
+					"%s" CPU_PATH "/cpufreq/policy%d/%s",
+					cf_root, policy, cf_files[i].name);
+			break;
+		}
+	}
+
+done:
+	TRACE2_EXIT("path = '%s'", setreq->path);
+}
+
+//
+// cpufreq_start - Find the cpufreq policies under sysfs_root and the
+// cpus in each.  Without any, paths are left as they are.
+//
+void
+cpufreq_start(const char *sysfs_root)
+{
+	glob_t policies = { 0 };
+	char *pattern;
+	size_t i;
+
+	TRACE1_ENTER("sysfs_root = '%s'", sysfs_root);
+
+	cf_root = g_strdup(sysfs_root);
+	cf_parser = g_strconcat(sysfs_root, CPU_PATH "/cpu%u/cpufreq/%n",
+			NULL);
+	cf_policies = g_array_new(FALSE, FALSE, sizeof(gint));
+	if (!cf_root || !cf_parser || !cf_policies) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	pattern = g_strconcat(sysfs_root, POLICY_PATTERN, NULL);
+	glob(pattern, GLOB_ONLYDIR, NULL, &policies);
+	g_free(pattern);
+	for (i = 0; i < policies.gl_pathc; i++) {
+		cpufreq_add_policy(policies.gl_pathv[i]);
+	}
+
+	LOG_MSG("Found %zu cpufreq policies", policies.gl_pathc);
+
+	if (policies.gl_pathc == 0) {
+		g_array_free(cf_policies, TRUE);
+		cf_policies = NULL;
+	}
+	globfree(&policies);
+
+	TRACE1_EXIT("");
+}
+
+void
+cpufreq_stop(void)
+{
+	TRACE1_ENTER("");
+
+	if (cf_policies) {
+		g_array_free(cf_policies, TRUE);
+		cf_policies = NULL;
+	}
+	g_free(cf_parser);
+	cf_parser = NULL;
+	g_free(cf_root);
+	cf_root = NULL;
+
+	TRACE1_EXIT("");
+}
@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Read the default values of the attributes clients can set ahead of the
+ * first set request for them.
+ *
+ * The first set request for a path has to capture the value the path
+ * held before, so that it can be put back once every client's set is
+ * gone.  Reading it then puts a sysfs read, or for a C-state limit a scan
+ * of the cpuidle directory, in front of the write.  Instead, a background
+ * thread reads the defaults of the frequency limits, governors, C-state
+ * limits and RAPL power limits at startup, and those of the hyperthreads
+ * again whenever CPUs are hotplugged.  They are kept in a table indexed
+ * by object and attribute rather than by path.
+ *
+ * A default is taken from the table at most once.  The first set request
+ * for a path claims its entry whether or not a default had been read, so
+ * that a value the daemon has written is never read back as a default.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_worker.h"
+#include "pwrapi_file.h"
+#include "pwrapi_stats.h"
+#include "pwrapi_defaults.h"
+
+#define CPU_PATH		"/sys/devices/system/cpu"
+#define CPU_PATTERN		CPU_PATH "/cpu[0-9]*"
+#define CPU_ONLINE_PATH		CPU_PATH "/online"
+#define RAPL_PATH		"/sys/class/powercap/intel-rapl"
+#define RAPL_PKG_PATTERN	RAPL_PATH "/intel-rapl:[0-9]*"
+#define RAPL_SUB_PATTERN	RAPL_PKG_PATTERN "/intel-rapl:[0-9]*:[0-9]*"
+
+typedef enum {
+	DEFAULT_ABSENT = 0,	// not read, or the read failed
+	DEFAULT_VALID,		// read and not yet taken
+	DEFAULT_CLAIMED,	// the path has its default in def_values
+} default_state_t;
+
+typedef struct {
+	type_union_t value;
+	guint8       state;     // default_state_t
+} default_entry_t;
+
+// The attributes read ahead and their paths under the sysfs root.  HT
+// paths take the cpu number, or the cpufreq policy, which is numbered
+// after one of its cpus.  Socket paths take the RAPL package, and mem
+// paths the RAPL package twice and then its dram subdomain.
+static const struct {
+	PWR_ObjType   object;
+	PWR_AttrName  attribute;
+	const char   *format;
+} df_attrs[] = {
+	{ PWR_OBJ_HT, PWR_ATTR_FREQ_LIMIT_MIN,
+		CPU_PATH "/cpu%u/cpufreq/scaling_min_freq" },
+	{ PWR_OBJ_HT, PWR_ATTR_FREQ_LIMIT_MAX,
+		CPU_PATH "/cpu%u/cpufreq/scaling_max_freq" },
+	{ PWR_OBJ_HT, PWR_ATTR_GOV,
+		CPU_PATH "/cpu%u/cpufreq/scaling_governor" },
+	{ PWR_OBJ_HT, PWR_ATTR_CSTATE_LIMIT,
+		CPU_PATH "/cpu%u/cpuidle" },
+	{ PWR_OBJ_HT, PWR_ATTR_FREQ_LIMIT_MIN,
+		CPU_PATH "/cpufreq/policy%u/scaling_min_freq" },
+	{ PWR_OBJ_HT, PWR_ATTR_FREQ_LIMIT_MAX,
+		CPU_PATH "/cpufreq/policy%u/scaling_max_freq" },
+	{ PWR_OBJ_HT, PWR_ATTR_GOV,
+		CPU_PATH "/cpufreq/policy%u/scaling_governor" },
+	{ PWR_OBJ_SOCKET, PWR_ATTR_POWER_LIMIT_MAX,
+		RAPL_PATH "/intel-rapl:%u/constraint_0_power_limit_uw" },
+	{ PWR_OBJ_MEM, PWR_ATTR_POWER_LIMIT_MAX,
+		RAPL_PATH "/intel-rapl:%u/intel-rapl:%u:%u/constraint_0_power_limit_uw" },
+};
+
+#define DF_NUM_ATTRS	G_N_ELEMENTS(df_attrs)
+
+// The table holds df_count[i] entries for attribute i, one per object,
+// starting at df_base[i].  It's sized once at startup; CPUs that aren't
+// online then still have their cpuN directories.
+static default_entry_t *df_entries;
+static guint            df_base[DF_NUM_ATTRS];
+static guint            df_count[DF_NUM_ATTRS];
+static char            *df_formats[DF_NUM_ATTRS];   // under the sysfs root
+static char            *df_parsers[DF_NUM_ATTRS];   // the same, ending in %n
+static int             *df_dram;        // dram subdomain of each package
+static char            *df_online_path;
+static char            *df_online;      // CPUs online at the last check
+
+// df_lock protects the values and states of the entries and df_stopping.
+static GMutex    df_lock;
+static GCond     df_cond;
+static gboolean  df_stopping;
+static GThread  *df_thread;
+
+// find the table entry for the object and attribute of a set request
+static default_entry_t *
+defaults_find(const powerapi_setreq_t *setreq)
+{
+	default_entry_t *entry = NULL;
+	guint id, pkg, sub;
+	int end;
+	int i;
+
+	TRACE3_ENTER("setreq = %p", setreq);
+
+	if (setreq->metadata != PWR_MD_NOT_SPECIFIED ||
+			setreq->data_type != PWR_ATTR_DATA_UINT64) {
+		goto done;
+	}
+
+	for (i = 0; i < DF_NUM_ATTRS; i++) {
+		if (df_attrs[i].object != setreq->object ||
+				df_attrs[i].attribute != setreq->attribute) {
+			continue;
+		}
+
+		end = -1;
+		if (setreq->object == PWR_OBJ_MEM) {
+			if (sscanf(setreq->path, df_parsers[i],
+					&id, &pkg, &sub, &end) != 3 ||
+					pkg != id || id >= df_count[i] ||
+					df_dram[id] != sub) {
+				continue;
+			}
+		} else if (sscanf(setreq->path, df_parsers[i],
+				&id, &end) != 1 || id >= df_count[i]) {
+			continue;
+		}
+		if (end < 0 || setreq->path[end] != '\0') {
+			continue;
+		}
+
+		entry = &df_entries[df_base[i] + id];
+		break;
+	}
+
+done:
+	TRACE3_EXIT("entry = %p", entry);
+
+	return entry;
+}
+
+//
+// defaults_take - Take the default read ahead for the object and attribute
+// of the first set request for a path, returning FALSE if there isn't
+// one.  Either way the entry is claimed, since the path is about to be
+// written.
+//
+gboolean
+defaults_take(const powerapi_setreq_t *setreq, type_union_t *value)
+{
+	default_entry_t *entry;
+	gboolean taken = FALSE;
+
+	TRACE2_ENTER("setreq = %p, value = %p", setreq, value);
+
+	if (df_entries == NULL) {
+		goto done;
+	}
+
+	entry = defaults_find(setreq);
+	if (entry == NULL) {
+		goto done;
+	}
+
+	g_mutex_lock(&df_lock);
+	if (entry->state == DEFAULT_VALID) {
+		*value = entry->value;
+		taken = TRUE;
+	}
+	entry->state = DEFAULT_CLAIMED;
+	g_mutex_unlock(&df_lock);
+
+	if (taken) {
+		stats_count(STATS_DEFAULTS_AHEAD, 1);
+		LOG_DBG("Took default value %ld of %s read ahead",
+				value->ivalue, setreq->path);
+	}
+
+done:
+	TRACE2_EXIT("taken = %d", taken);
+
+	return taken;
+}
+
+// read the default of one object's attribute, unless a set request for
+// it got there first
+static void
+defaults_read_one(int attr, guint id)
+{
+	default_entry_t *entry = &df_entries[df_base[attr] + id];
+	set_info_t setp;
+	powerapi_setreq_t *setreq = &setp.setreq;
+	default_state_t state;
+
+	TRACE3_ENTER("attr = %d, id = %u", attr, id);
+
+	g_mutex_lock(&df_lock);
+	state = entry->state;
+	g_mutex_unlock(&df_lock);
+	if (state == DEFAULT_CLAIMED) {
+		goto done;
+	}
+
+	memset(&setp, 0, sizeof(setp));
+	setreq->object = df_attrs[attr].object;
+	setreq->attribute = df_attrs[attr].attribute;
+	setreq->data_type = PWR_ATTR_DATA_UINT64;
+	setreq->metadata = PWR_MD_NOT_SPECIFIED;
+	if (setreq->object == PWR_OBJ_MEM) {
+		snprintf(setreq->path, sizeof(setreq->path), df_formats[attr],
+				id, id, df_dram[id]);
+	} else {
+		snprintf(setreq->path, sizeof(setreq->path), df_formats[attr],
+				id);
+	}
+
+	if (setreq->object == PWR_OBJ_MEM && df_dram[id] < 0) {
+		state = DEFAULT_ABSENT;
+	} else if (set_lookup(def_values, setreq->path) != NULL) {
+		// journal replay already put the path's default in place
+		state = DEFAULT_CLAIMED;
+	} else if (access(setreq->path, F_OK) != 0) {
+		// offline CPU or missing driver, not worth a complaint
+		state = DEFAULT_ABSENT;
+	} else if (read_attr_value(&setp) != 0) {
+		state = DEFAULT_ABSENT;
+	} else {
+		state = DEFAULT_VALID;
+	}
+
+	g_mutex_lock(&df_lock);
+	if (entry->state != DEFAULT_CLAIMED) {
+		entry->state = state;
+		entry->value = setreq->value;
+	}
+	g_mutex_unlock(&df_lock);
+
+done:
+	TRACE3_EXIT("state = %d", state);
+}
+
+// read the defaults of every object's attributes, or only those of the
+// hyperthreads
+static void
+defaults_read(gboolean hts_only)
+{
+	guint id;
+	int i;
+
+	TRACE2_ENTER("hts_only = %d", hts_only);
+
+	for (i = 0; i < DF_NUM_ATTRS; i++) {
+		if (hts_only && df_attrs[i].object != PWR_OBJ_HT) {
+			continue;
+		}
+		for (id = 0; id < df_count[i]; id++) {
+			defaults_read_one(i, id);
+		}
+	}
+
+	// The workers will open these paths again when they're set.
+	file_cache_flush();
+
+	TRACE2_EXIT("");
+}
+
+static gpointer
+defaults_run(gpointer data)
+{
+	gint64 interval = DEFAULTS_PERIOD * 1000;   // usec
+	gint64 next;
+	char *online;
+
+	TRACE1_ENTER("data = %p", data);
+
+	defaults_read(FALSE);
+	LOG_DBG("Defaults read ahead");
+
+	g_mutex_lock(&df_lock);
+	while (!df_stopping) {
+		next = g_get_monotonic_time() + interval;
+		while (!df_stopping
+				&& g_cond_wait_until(&df_cond, &df_lock, next))
+			;
+		if (df_stopping) {
+			break;
+		}
+		g_mutex_unlock(&df_lock);
+
+		// Reread the hyperthreads' defaults when CPUs come or go.
+		online = NULL;
+		if (g_file_get_contents(df_online_path, &online, NULL, NULL) &&
+				g_strcmp0(g_strstrip(online), df_online) != 0) {
+			LOG_MSG("Online CPUs changed to %s, rereading defaults",
+					online);
+			g_free(df_online);
+			df_online = online;
+			online = NULL;
+			defaults_read(TRUE);
+		}
+		g_free(online);
+
+		g_mutex_lock(&df_lock);
+	}
+	g_mutex_unlock(&df_lock);
+
+	TRACE1_EXIT("");
+
+	return NULL;
+}
+
+// count the objects under sysfs_root matching pattern, whose ids follow
+// prefix in the last path component
+static guint
+defaults_count(const char *sysfs_root, const char *pattern,
+		const char *prefix)
+{
+	glob_t globs = { 0 };
+	char *path;
+	guint count = 0;
+	guint id;
+	size_t i;
+
+	path = g_strconcat(sysfs_root, pattern, NULL);
+	glob(path, GLOB_ONLYDIR, NULL, &globs);
+	g_free(path);
+
+	for (i = 0; i < globs.gl_pathc; i++) {
+		const char *name = strrchr(globs.gl_pathv[i], '/') + 1;
+
+		if (g_str_has_prefix(name, prefix) &&
+				sscanf(name + strlen(prefix), "%u", &id) == 1 &&
+				id >= count) {
+			count = id + 1;
+		}
+	}
+	globfree(&globs);
+
+	return count;
+}
+
+// find the dram subdomain of each RAPL package
+static void
+defaults_find_dram(const char *sysfs_root, guint num_pkgs)
+{
+	glob_t globs = { 0 };
+	char *path;
+	char *name;
+	guint pkg, sub;
+	size_t i;
+
+	path = g_strconcat(sysfs_root, RAPL_SUB_PATTERN, NULL);
+	glob(path, GLOB_ONLYDIR, NULL, &globs);
+	g_free(path);
+
+	for (i = 0; i < globs.gl_pathc; i++) {
+		path = g_strconcat(globs.gl_pathv[i], "/name", NULL);
+		if (g_file_get_contents(path, &name, NULL, NULL)) {
+			if (g_str_has_prefix(name, "dram") &&
+					sscanf(strrchr(globs.gl_pathv[i], '/'),
+						"/intel-rapl:%u:%u", &pkg, &sub) == 2 &&
+					pkg < num_pkgs) {
+				df_dram[pkg] = sub;
+			}
+			g_free(name);
+		}
+		g_free(path);
+	}
+	globfree(&globs);
+}
+
+//
+// defaults_start - Size the table of defaults for the objects under
+// sysfs_root and start the thread that reads them.  Must be called before
+// the workers are started.  Failure here isn't fatal: the workers read
+// each default when its path is first set.
+//
+int
+defaults_start(const char *sysfs_root)
+{
+	guint num_cpus, num_pkgs;
+	guint total = 0;
+	int retval = 1;
+	guint i;
+
+	TRACE1_ENTER("sysfs_root = '%s'", sysfs_root);
+
+	num_cpus = defaults_count(sysfs_root, CPU_PATTERN, "cpu");
+	num_pkgs = defaults_count(sysfs_root, RAPL_PKG_PATTERN, "intel-rapl:");
+
+	df_dram = g_new(int, num_pkgs + 1);
+	if (!df_dram) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	for (i = 0; i < num_pkgs; i++) {
+		df_dram[i] = -1;
+	}
+	defaults_find_dram(sysfs_root, num_pkgs);
+
+	for (i = 0; i < DF_NUM_ATTRS; i++) {
+		df_base[i] = total;
+		df_count[i] = (df_attrs[i].object == PWR_OBJ_HT) ?
+				num_cpus : num_pkgs;
+		total += df_count[i];
+
+		df_formats[i] = g_strconcat(sysfs_root, df_attrs[i].format,
+				NULL);
+		df_parsers[i] = g_strconcat(df_formats[i], "%n", NULL);
+		if (!df_formats[i] || !df_parsers[i]) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+	}
+
+	if (total == 0) {
+		LOG_MSG("No CPUs or RAPL packages under '%s', defaults won't "
+				"be read ahead", sysfs_root);
+		goto done;
+	}
+
+	df_entries = g_new0(default_entry_t, total);
+	df_online_path = g_strconcat(sysfs_root, CPU_ONLINE_PATH, NULL);
+	if (!df_entries || !df_online_path) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	if (g_file_get_contents(df_online_path, &df_online, NULL, NULL)) {
+		g_strstrip(df_online);
+	} else {
+		df_online = NULL;
+	}
+
+	g_mutex_init(&df_lock);
+	g_cond_init(&df_cond);
+	df_stopping = FALSE;
+
+	df_thread = g_thread_new("defaults", defaults_run, NULL);
+	if (df_thread == NULL) {
+		LOG_CRIT("Unable to create defaults thread!");
+		exit(1);
+	}
+
+	LOG_MSG("Reading defaults ahead for %u CPUs and %u RAPL packages",
+			num_cpus, num_pkgs);
+
+	retval = 0;
+
+done:
+	if (retval) {
+		defaults_stop();
+	}
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+//
+// defaults_stop - Stop reading defaults ahead and free the table.  Must be
+// called after the workers are stopped.
+//
+void
+defaults_stop(void)
+{
+	int i;
+
+	TRACE1_ENTER("df_thread = %p", df_thread);
+
+	if (df_thread) {
+		g_mutex_lock(&df_lock);
+		df_stopping = TRUE;
+		g_cond_signal(&df_cond);
+		g_mutex_unlock(&df_lock);
+
+		g_thread_join(df_thread);
+		df_thread = NULL;
+
+		g_cond_clear(&df_cond);
+		g_mutex_clear(&df_lock);
+	}
+
+	g_free(df_entries);
+	df_entries = NULL;
+	g_free(df_dram);
+	df_dram = NULL;
+	g_free(df_online_path);
+	df_online_path = NULL;
+	g_free(df_online);
+	df_online = NULL;
+	for (i = 0; i < DF_NUM_ATTRS; i++) {
+		g_free(df_formats[i]);
+		df_formats[i] = NULL;
+		g_free(df_parsers[i]);
+		df_parsers[i] = NULL;
+	}
+
+	TRACE1_EXIT("");
+}
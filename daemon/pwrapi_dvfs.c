@@ -0,0 +1,801 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lower the requested frequency of cpufreq policies whose busy
+ * hyperthreads are memory bound.  Every period, each hyperthread's APERF
+ * and MPERF MSRs give the fraction of the period it was busy, and the
+ * DRAM RAPL energy of its socket gives how hard memory is being driven.
+ * A memory bound thread spends a share of its time waiting on memory that
+ * doesn't stretch when the clock slows, so its policy can run slower for
+ * at most the configured loss of performance.
+ *
+ * The requests are advisory: they take the place of the default value of
+ * PWR_ATTR_FREQ_REQ, but any client's request for the same hyperthread
+ * wins, and they are only made for policies under the userspace governor.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <glob.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_socket.h"
+#include "pwrapi_worker.h"
+#include "pwrapi_dvfs.h"
+
+#define DVFS_BUSY_MIN		0.5	// C0 residency of a busy thread
+#define DVFS_MEM_BOUND		0.3	// memory intensity of a memory bound
+					// busy thread
+#define DVFS_RANGE_DECAY	0.01	// share of the observed DRAM power
+					// range forgotten every period
+#define DVFS_RANGE_MIN		1.0e6	// uW of DRAM power range needed to
+					// judge memory intensity
+
+#define MSR_IA32_MPERF		0xe7
+#define MSR_IA32_APERF		0xe8
+
+#define CPU_PATH		"/sys/devices/system/cpu"
+#define CPU_PATTERN		CPU_PATH "/cpu[0-9]*"
+#define RAPL_PKG_PATTERN	"/sys/class/powercap/intel-rapl/intel-rapl:*"
+
+// DRAM traffic of one socket, judged by DRAM power against the range of
+// DRAM power seen recently.  Power is in uW.
+typedef struct {
+	uint64_t id;            // physical package id
+	int      dram_fd;       // DRAM energy_uj, -1 if there is none
+	uint64_t range;         // energy counter wrap value
+	gboolean primed;        // prev_energy/prev_time are valid
+	uint64_t prev_energy;
+	gint64   prev_time;     // usec, monotonic
+	double   low;           // lowest recent DRAM power
+	double   high;          // highest recent DRAM power
+	double   intensity;     // 0 (idle) to 1 (busiest seen)
+} dvfs_socket_t;
+
+typedef struct {
+	uint64_t       cpu;            // OS id of the hyperthread
+	int            aperf_fd;
+	int            mperf_fd;
+	char          *freq_req_path;  // scaling_setspeed
+	dvfs_socket_t *socket;
+	gboolean       primed;         // prev_aperf/prev_mperf are valid
+	uint64_t       prev_aperf;
+	uint64_t       prev_mperf;
+	gint64         prev_time;      // usec, monotonic
+	gboolean       measured;       // busy/ratio are valid
+	double         busy;           // C0 residency over the last period
+	double         ratio;          // APERF/MPERF over the last period
+} dvfs_ht_t;
+
+// Hyperthreads whose frequency is set together.  Frequencies are in kHz.
+typedef struct {
+	uint64_t   id;          // first cpu in related_cpus
+	char      *gov_path;    // scaling_governor
+	uint64_t   max_freq;    // cpuinfo_max_freq
+	uint64_t   min_freq;    // cpuinfo_min_freq
+	uint64_t   base_freq;   // rate MPERF counts at
+	GArray    *freqs;       // available frequencies, ascending
+	GPtrArray *hts;         // dvfs_ht_t
+	uint64_t   freq;        // frequency last requested, 0 if none
+} dvfs_policy_t;
+
+static double         dv_loss = 0.0;    // allowed loss of performance
+static GPtrArray     *dv_sockets = NULL;
+static GPtrArray     *dv_policies = NULL;
+static socket_info_t *dv_skinfo = NULL; // owner of the advisory sets
+static GThread       *dv_thread = NULL;
+static GMutex         dv_lock;
+static GCond          dv_cond;
+static gboolean       dv_stopping = FALSE;
+
+static int
+dvfs_read_fd(int fd, uint64_t *value)
+{
+	char buf[32];
+	char *end = NULL;
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0) {
+		return 1;
+	}
+	buf[len] = '\0';
+
+	// MSR files hold hex with a 0x prefix, the rest decimal
+	errno = 0;
+	*value = strtoull(buf, &end, 0);
+	if (errno || end == buf) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+dvfs_read_file(const char *dir, const char *name, uint64_t *value)
+{
+	char *path = g_build_filename(dir, name, NULL);
+	int retval = 1;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		retval = dvfs_read_fd(fd, value);
+		close(fd);
+	}
+
+	g_free(path);
+
+	return retval;
+}
+
+static int
+dvfs_open_file(const char *dir, const char *name)
+{
+	char *path = g_build_filename(dir, name, NULL);
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	g_free(path);
+
+	return fd;
+}
+
+static gint
+dvfs_freq_compare(gconstpointer a, gconstpointer b)
+{
+	uint64_t fa = *(const uint64_t *)a;
+	uint64_t fb = *(const uint64_t *)b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+static void
+dvfs_socket_free(gpointer data)
+{
+	dvfs_socket_t *socket = data;
+
+	if (socket->dram_fd >= 0) {
+		close(socket->dram_fd);
+	}
+	g_free(socket);
+}
+
+static void
+dvfs_ht_free(gpointer data)
+{
+	dvfs_ht_t *ht = data;
+
+	close(ht->aperf_fd);
+	close(ht->mperf_fd);
+	g_free(ht->freq_req_path);
+	g_free(ht);
+}
+
+static void
+dvfs_policy_free(gpointer data)
+{
+	dvfs_policy_t *policy = data;
+
+	g_free(policy->gov_path);
+	g_array_free(policy->freqs, TRUE);
+	g_ptr_array_free(policy->hts, TRUE);
+	g_free(policy);
+}
+
+// find the socket for a package id, adding it if need be
+static dvfs_socket_t *
+dvfs_socket_lookup(uint64_t id)
+{
+	dvfs_socket_t *socket;
+	guint i;
+
+	for (i = 0; i < dv_sockets->len; i++) {
+		socket = g_ptr_array_index(dv_sockets, i);
+		if (socket->id == id) {
+			return socket;
+		}
+	}
+
+	socket = g_new0(dvfs_socket_t, 1);
+	if (!socket) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	socket->id = id;
+	socket->dram_fd = -1;
+	g_ptr_array_add(dv_sockets, socket);
+
+	return socket;
+}
+
+//
+// dvfs_add_dram - Attach the DRAM RAPL domain of a package domain to its
+// socket, the package id being the number in its "package-N" name.
+//
+static void
+dvfs_add_dram(const char *dir)
+{
+	char *name = NULL;
+	char *path = g_build_filename(dir, "name", NULL);
+	char *pattern = g_build_filename(dir, "intel-rapl:*:*", NULL);
+	dvfs_socket_t *socket;
+	glob_t subs = { 0 };
+	uint64_t range = 0;
+	size_t i;
+
+	TRACE2_ENTER("dir = '%s'", dir);
+
+	if (!g_file_get_contents(path, &name, NULL, NULL) ||
+			!g_str_has_prefix(g_strstrip(name), "package-")) {
+		goto done;
+	}
+	socket = dvfs_socket_lookup(strtoull(name + strlen("package-"),
+			NULL, 10));
+
+	if (glob(pattern, GLOB_ONLYDIR, NULL, &subs) != 0) {
+		goto done;
+	}
+
+	for (i = 0; i < subs.gl_pathc && socket->dram_fd < 0; i++) {
+		g_free(path);
+		g_free(name);
+		name = NULL;
+		path = g_build_filename(subs.gl_pathv[i], "name", NULL);
+		if (!g_file_get_contents(path, &name, NULL, NULL) ||
+				strcmp(g_strstrip(name), "dram") != 0) {
+			continue;
+		}
+
+		socket->dram_fd = dvfs_open_file(subs.gl_pathv[i], "energy_uj");
+
+		// The counter wraps to zero after reaching the range value
+		socket->range = 1UL << 32;
+		if (dvfs_read_file(subs.gl_pathv[i], "max_energy_range_uj",
+				&range) == 0 && range != 0) {
+			socket->range = range + 1;
+		}
+	}
+
+done:
+	globfree(&subs);
+	g_free(pattern);
+	g_free(path);
+	g_free(name);
+
+	TRACE2_EXIT("");
+}
+
+// find the policy a cpufreq directory belongs to, adding it if need be
+static dvfs_policy_t *
+dvfs_policy_lookup(uint64_t cpu, const char *freq_dir)
+{
+	dvfs_policy_t *policy;
+	char *related = NULL;
+	char *path = NULL;
+	char **freqs = NULL;
+	uint64_t id = cpu;
+	guint i;
+
+	// Every cpu in a policy lists the same related_cpus.
+	path = g_build_filename(freq_dir, "related_cpus", NULL);
+	if (g_file_get_contents(path, &related, NULL, NULL)) {
+		id = strtoull(related, NULL, 10);
+	}
+
+	for (i = 0; i < dv_policies->len; i++) {
+		policy = g_ptr_array_index(dv_policies, i);
+		if (policy->id == id) {
+			goto done;
+		}
+	}
+
+	policy = g_new0(dvfs_policy_t, 1);
+	if (!policy) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	policy->id = id;
+	policy->gov_path = g_build_filename(freq_dir, "scaling_governor", NULL);
+	policy->freqs = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	policy->hts = g_ptr_array_new_with_free_func(dvfs_ht_free);
+	if (!policy->gov_path || !policy->freqs || !policy->hts) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	dvfs_read_file(freq_dir, "cpuinfo_max_freq", &policy->max_freq);
+	dvfs_read_file(freq_dir, "cpuinfo_min_freq", &policy->min_freq);
+
+	// MPERF counts at the base (TSC) frequency; without intel_pstate's
+	// base_frequency, the highest non-turbo frequency is close enough.
+	if (dvfs_read_file(freq_dir, "base_frequency", &policy->base_freq)) {
+		policy->base_freq = policy->max_freq;
+	}
+
+	g_free(path);
+	path = g_build_filename(freq_dir, "scaling_available_frequencies",
+			NULL);
+	g_free(related);
+	related = NULL;
+	if (g_file_get_contents(path, &related, NULL, NULL)) {
+		freqs = g_strsplit(g_strstrip(related), " ", -1);
+		for (i = 0; freqs[i]; i++) {
+			uint64_t freq = strtoull(freqs[i], NULL, 10);
+
+			if (freq) {
+				g_array_append_vals(policy->freqs, &freq, 1);
+			}
+		}
+		g_array_sort(policy->freqs, dvfs_freq_compare);
+	}
+
+	g_ptr_array_add(dv_policies, policy);
+
+done:
+	g_strfreev(freqs);
+	g_free(related);
+	g_free(path);
+
+	return policy;
+}
+
+//
+// dvfs_add_ht - Add a hyperthread with a userspace frequency request file
+// and readable APERF/MPERF to its cpufreq policy.
+//
+static void
+dvfs_add_ht(const char *dir)
+{
+	char *freq_dir = g_build_filename(dir, "cpufreq", NULL);
+	char *msr = NULL;
+	dvfs_policy_t *policy;
+	dvfs_ht_t *ht;
+	uint64_t package = 0;
+	uint64_t cpu;
+
+	TRACE2_ENTER("dir = '%s'", dir);
+
+	cpu = strtoull(strrchr(dir, '/') + strlen("/cpu"), NULL, 10);
+
+	ht = g_new0(dvfs_ht_t, 1);
+	if (!ht) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	ht->cpu = cpu;
+	ht->freq_req_path = g_build_filename(freq_dir, "scaling_setspeed",
+			NULL);
+
+	msr = g_strdup_printf("msr/%xr", MSR_IA32_APERF);
+	ht->aperf_fd = dvfs_open_file(dir, msr);
+	g_free(msr);
+	msr = g_strdup_printf("msr/%xr", MSR_IA32_MPERF);
+	ht->mperf_fd = dvfs_open_file(dir, msr);
+	g_free(msr);
+
+	if (ht->aperf_fd < 0 || ht->mperf_fd < 0 ||
+			access(ht->freq_req_path, W_OK) != 0) {
+		LOG_DBG("No APERF/MPERF or frequency request for cpu%lu", cpu);
+		if (ht->aperf_fd >= 0) {
+			close(ht->aperf_fd);
+		}
+		if (ht->mperf_fd >= 0) {
+			close(ht->mperf_fd);
+		}
+		g_free(ht->freq_req_path);
+		g_free(ht);
+		goto done;
+	}
+
+	dvfs_read_file(dir, "topology/physical_package_id", &package);
+	ht->socket = dvfs_socket_lookup(package);
+
+	policy = dvfs_policy_lookup(cpu, freq_dir);
+	g_ptr_array_add(policy->hts, ht);
+
+done:
+	g_free(freq_dir);
+
+	TRACE2_EXIT("");
+}
+
+// Update a socket's memory intensity from its DRAM power.
+static void
+dvfs_measure_socket(dvfs_socket_t *socket, gint64 now)
+{
+	uint64_t energy = 0;
+	uint64_t delta;
+	double power, range;
+
+	socket->intensity = 0.0;
+
+	if (socket->dram_fd < 0 ||
+			dvfs_read_fd(socket->dram_fd, &energy) != 0) {
+		socket->primed = FALSE;
+		return;
+	}
+
+	if (!socket->primed || now <= socket->prev_time) {
+		socket->primed = TRUE;
+		socket->prev_energy = energy;
+		socket->prev_time = now;
+		return;
+	}
+
+	delta = energy - socket->prev_energy;
+	if (energy < socket->prev_energy) {
+		delta += socket->range;
+	}
+	power = (double)delta * G_USEC_PER_SEC / (now - socket->prev_time);
+	socket->prev_energy = energy;
+	socket->prev_time = now;
+
+	// The range slowly closes in, so it follows the workload rather
+	// than the extremes seen since the daemon started.
+	if (socket->high == 0.0) {
+		socket->low = socket->high = power;
+	}
+	range = socket->high - socket->low;
+	socket->low = MIN(power, socket->low + DVFS_RANGE_DECAY * range);
+	socket->high = MAX(power, socket->high - DVFS_RANGE_DECAY * range);
+
+	range = socket->high - socket->low;
+	if (range >= DVFS_RANGE_MIN) {
+		socket->intensity = (power - socket->low) / range;
+	}
+}
+
+// Find how busy a hyperthread was, and how fast it ran while busy.
+static void
+dvfs_measure_ht(dvfs_ht_t *ht, uint64_t base_freq, gint64 now)
+{
+	uint64_t aperf = 0, mperf = 0;
+	uint64_t daperf, dmperf;
+
+	ht->measured = FALSE;
+
+	if (dvfs_read_fd(ht->aperf_fd, &aperf) != 0 ||
+			dvfs_read_fd(ht->mperf_fd, &mperf) != 0) {
+		ht->primed = FALSE;
+		return;
+	}
+
+	if (ht->primed && now > ht->prev_time && base_freq) {
+		daperf = aperf - ht->prev_aperf;
+		dmperf = mperf - ht->prev_mperf;
+
+		// MPERF only counts in C0, at the base frequency (in kHz)
+		ht->busy = MIN((double)dmperf * G_USEC_PER_SEC
+				/ (base_freq * 1000.0 * (now - ht->prev_time)),
+				1.0);
+		ht->ratio = dmperf ? (double)daperf / dmperf : 0.0;
+		ht->measured = TRUE;
+	}
+
+	ht->primed = TRUE;
+	ht->prev_aperf = aperf;
+	ht->prev_mperf = mperf;
+	ht->prev_time = now;
+}
+
+// the lowest available frequency of a policy no lower than freq
+static uint64_t
+dvfs_policy_snap(const dvfs_policy_t *policy, double freq)
+{
+	guint i;
+
+	for (i = 0; i < policy->freqs->len; i++) {
+		uint64_t avail = g_array_index(policy->freqs, uint64_t, i);
+
+		if (avail >= freq && avail <= policy->max_freq) {
+			return avail;
+		}
+	}
+
+	return CLAMP((uint64_t)freq, policy->min_freq, policy->max_freq);
+}
+
+// Ask the workers to set the frequency request of every thread in a
+// policy, as advice that any client's request overrides.
+static void
+dvfs_request_freq(dvfs_policy_t *policy, uint64_t freq)
+{
+	powerapi_setreq_t setreq = {
+		.object    = PWR_OBJ_HT,
+		.attribute = PWR_ATTR_FREQ_REQ,
+		.data_type = PWR_ATTR_DATA_UINT64,
+		.metadata  = PWR_MD_NOT_SPECIFIED,
+	};
+	guint i;
+
+	TRACE2_ENTER("policy = %lu, freq = %lu", policy->id, freq);
+
+	LOG_DBG("Requesting %lu kHz for cpufreq policy %lu", freq, policy->id);
+
+	if (dv_skinfo == NULL) {
+		dv_skinfo = socket_internal_create(PWR_ROLE_MC, "dvfs",
+				TRUE);
+	}
+
+	setreq.value.ivalue = freq;
+	for (i = 0; i < policy->hts->len; i++) {
+		dvfs_ht_t *ht = g_ptr_array_index(policy->hts, i);
+
+		g_strlcpy(setreq.path, ht->freq_req_path, sizeof(setreq.path));
+
+		socket_ref(dv_skinfo);
+		worker_queue_set(set_create_item(&setreq, dv_skinfo));
+	}
+
+	policy->freq = freq;
+
+	TRACE2_EXIT("");
+}
+
+//
+// dvfs_policy_step - Pick a frequency for a policy.  A busy thread whose
+// socket's memory intensity is m is taken to spend that share of its time
+// waiting on memory, so slowing the clock from f_max to f stretches its
+// run time by (1 - m) * f_max / f + m.  Keeping that within 1 + loss
+// gives f >= f_max * (1 - m) / (1 - m + loss).  The policy runs at the
+// frequency its most demanding busy thread needs.  Policies with no busy
+// threads are left alone.
+//
+static void
+dvfs_policy_step(dvfs_policy_t *policy, gint64 now)
+{
+	char *governor = NULL;
+	double target = 0.0;
+	int busy = 0;
+	uint64_t freq;
+	guint i;
+
+	for (i = 0; i < policy->hts->len; i++) {
+		dvfs_measure_ht(g_ptr_array_index(policy->hts, i),
+				policy->base_freq, now);
+	}
+
+	if (!g_file_get_contents(policy->gov_path, &governor, NULL, NULL) ||
+			strcmp(g_strstrip(governor), "userspace") != 0) {
+		goto done;
+	}
+
+	for (i = 0; i < policy->hts->len; i++) {
+		dvfs_ht_t *ht = g_ptr_array_index(policy->hts, i);
+		double m = ht->socket->intensity;
+		double need = policy->max_freq;
+
+		if (!ht->measured || ht->busy < DVFS_BUSY_MIN) {
+			continue;
+		}
+		busy++;
+
+		if (m >= DVFS_MEM_BOUND) {
+			need = policy->max_freq * (1.0 - m) / (1.0 - m + dv_loss);
+		}
+
+		LOG_DBG("cpu%lu: busy %.2f, APERF/MPERF %.2f, memory %.2f, "
+				"%s bound", ht->cpu, ht->busy, ht->ratio, m,
+				(m >= DVFS_MEM_BOUND) ? "memory" : "compute");
+
+		target = MAX(target, need);
+	}
+
+	if (busy == 0) {
+		goto done;
+	}
+
+	freq = dvfs_policy_snap(policy, target);
+	if (freq != policy->freq) {
+		dvfs_request_freq(policy, freq);
+	}
+
+done:
+	g_free(governor);
+}
+
+static gpointer
+dvfs_run(gpointer data)
+{
+	gint64 interval = DVFS_PERIOD * 1000;   // usec
+	gint64 next = g_get_monotonic_time();
+	guint i;
+
+	TRACE1_ENTER("data = %p", data);
+
+	g_mutex_lock(&dv_lock);
+	while (!dv_stopping) {
+		gint64 now = g_get_monotonic_time();
+
+		g_mutex_unlock(&dv_lock);
+
+		for (i = 0; i < dv_sockets->len; i++) {
+			dvfs_measure_socket(g_ptr_array_index(dv_sockets, i), now);
+		}
+		for (i = 0; i < dv_policies->len; i++) {
+			dvfs_policy_step(g_ptr_array_index(dv_policies, i), now);
+		}
+
+		g_mutex_lock(&dv_lock);
+
+		// Run on a fixed schedule.  If a step fell behind, skip the
+		// missed periods rather than running back to back.
+		next += interval;
+		if (next < g_get_monotonic_time()) {
+			next = g_get_monotonic_time() + interval;
+		}
+		while (!dv_stopping
+				&& g_cond_wait_until(&dv_cond, &dv_lock, next))
+			;
+	}
+	g_mutex_unlock(&dv_lock);
+
+	TRACE1_EXIT("");
+
+	return NULL;
+}
+
+//
+// dvfs_start - Find the hyperthreads under sysfs_root and start the
+// thread that picks their frequencies, allowing at most max_loss percent
+// loss of performance.  A max_loss of 0 disables the engine.  Failure
+// here isn't fatal: frequencies are just left to clients.
+//
+int
+dvfs_start(const char *sysfs_root, unsigned int max_loss)
+{
+	glob_t cpus = { 0 };
+	glob_t pkgs = { 0 };
+	char *pattern;
+	int retval = 1;
+	size_t i;
+
+	TRACE1_ENTER("sysfs_root = '%s', max_loss = %u", sysfs_root, max_loss);
+
+	if (max_loss == 0) {
+		LOG_DBG("DVFS policy engine disabled");
+		retval = 0;
+		goto done;
+	}
+
+	dv_loss = max_loss / 100.0;
+	dv_sockets = g_ptr_array_new_with_free_func(dvfs_socket_free);
+	dv_policies = g_ptr_array_new_with_free_func(dvfs_policy_free);
+	if (!dv_sockets || !dv_policies) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	pattern = g_strconcat(sysfs_root, RAPL_PKG_PATTERN, NULL);
+	glob(pattern, GLOB_ONLYDIR, NULL, &pkgs);
+	g_free(pattern);
+	for (i = 0; i < pkgs.gl_pathc; i++) {
+		dvfs_add_dram(pkgs.gl_pathv[i]);
+	}
+
+	pattern = g_strconcat(sysfs_root, CPU_PATTERN, NULL);
+	glob(pattern, GLOB_ONLYDIR, NULL, &cpus);
+	g_free(pattern);
+	for (i = 0; i < cpus.gl_pathc; i++) {
+		dvfs_add_ht(cpus.gl_pathv[i]);
+	}
+
+	if (dv_policies->len == 0) {
+		LOG_MSG("No hyperthreads with APERF/MPERF and a frequency "
+				"request, DVFS policy engine disabled");
+		goto done;
+	}
+
+	g_mutex_init(&dv_lock);
+	g_cond_init(&dv_cond);
+	dv_stopping = FALSE;
+
+	dv_thread = g_thread_new("dvfs", dvfs_run, NULL);
+	if (dv_thread == NULL) {
+		LOG_CRIT("Unable to create DVFS thread!");
+		exit(1);
+	}
+
+	LOG_MSG("DVFS policy engine running on %u cpufreq policies, "
+			"performance loss up to %u%%", dv_policies->len, max_loss);
+
+	retval = 0;
+
+done:
+	globfree(&pkgs);
+	globfree(&cpus);
+	if (retval) {
+		if (dv_policies) {
+			g_ptr_array_free(dv_policies, TRUE);
+			dv_policies = NULL;
+		}
+		if (dv_sockets) {
+			g_ptr_array_free(dv_sockets, TRUE);
+			dv_sockets = NULL;
+		}
+	}
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+//
+// dvfs_stop - Stop the engine and withdraw its frequency requests, which
+// the workers roll back to the defaults.  Must be called before the
+// workers are stopped.
+//
+void
+dvfs_stop(void)
+{
+	TRACE1_ENTER("dv_thread = %p", dv_thread);
+
+	if (dv_thread == NULL) {
+		goto done;
+	}
+
+	g_mutex_lock(&dv_lock);
+	dv_stopping = TRUE;
+	g_cond_signal(&dv_cond);
+	g_mutex_unlock(&dv_lock);
+
+	g_thread_join(dv_thread);
+	dv_thread = NULL;
+
+	if (dv_skinfo) {
+		worker_release(dv_skinfo);
+		socket_unref(dv_skinfo);
+		dv_skinfo = NULL;
+	}
+
+	g_ptr_array_free(dv_policies, TRUE);
+	dv_policies = NULL;
+	g_ptr_array_free(dv_sockets, TRUE);
+	dv_sockets = NULL;
+
+	g_cond_clear(&dv_cond);
+	g_mutex_clear(&dv_lock);
+
+done:
+	TRACE1_EXIT("");
+}
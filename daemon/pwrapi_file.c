@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Read and write control files with single pread()/pwrite() calls on
+ * descriptors kept open between requests.  Each thread has its own least
+ * recently used cache of descriptors, keyed by path.  Paths are sharded
+ * across the workers, so a path is normally only open in one of them.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_file.h"
+#include "pwrapi_stats.h"
+
+#define FILE_BUF_LEN		256	// longest value read or formatted
+#define FILE_MAX_RETRIES	10	// tries of an I/O returning EAGAIN
+#define FILE_RETRY_DELAY	1000	// usec between those tries
+
+typedef struct {
+	char    *path;
+	int      fd;
+	int      mode;      // O_RDWR, O_RDONLY or O_WRONLY
+	gboolean regular;   // a regular file, which must be truncated
+	GList    link;      // in the cache's LRU list, most recent first
+} file_entry_t;
+
+typedef struct {
+	GHashTable *entries;    // path -> file_entry_t
+	GQueue      lru;
+} file_cache_t;
+
+static void file_cache_free(gpointer data);
+
+static GPrivate file_cache_key = G_PRIVATE_INIT(file_cache_free);
+
+static void
+file_entry_close(file_cache_t *cache, file_entry_t *entry)
+{
+	TRACE3_ENTER("path = '%s', fd = %d", entry->path, entry->fd);
+
+	g_queue_unlink(&cache->lru, &entry->link);
+	g_hash_table_remove(cache->entries, entry->path);
+
+	close(entry->fd);
+	g_free(entry->path);
+	g_free(entry);
+
+	TRACE3_EXIT("");
+}
+
+// close a thread's descriptors when it exits
+static void
+file_cache_free(gpointer data)
+{
+	file_cache_t *cache = data;
+	GList *link;
+
+	while ((link = g_queue_peek_tail_link(&cache->lru)) != NULL) {
+		file_entry_close(cache, link->data);
+	}
+	g_hash_table_destroy(cache->entries);
+	g_free(cache);
+}
+
+// close the calling thread's cached descriptors
+void
+file_cache_flush(void)
+{
+	file_cache_t *cache = g_private_get(&file_cache_key);
+	GList *link;
+
+	TRACE2_ENTER("cache = %p", cache);
+
+	if (cache) {
+		while ((link = g_queue_peek_tail_link(&cache->lru)) != NULL) {
+			file_entry_close(cache, link->data);
+		}
+	}
+
+	TRACE2_EXIT("");
+}
+
+static file_cache_t *
+file_cache_get(void)
+{
+	file_cache_t *cache = g_private_get(&file_cache_key);
+
+	if (cache == NULL) {
+		cache = g_new0(file_cache_t, 1);
+		if (!cache) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		cache->entries = g_hash_table_new(g_str_hash, g_str_equal);
+		if (!cache->entries) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		g_queue_init(&cache->lru);
+		g_private_set(&file_cache_key, cache);
+	}
+
+	return cache;
+}
+
+//
+// file_open - Find an open descriptor for a path that allows access in
+// mode, opening the path if need be.  Files are opened for both reading
+// and writing when possible, so the default value read before the first
+// write leaves behind a descriptor the write can use.
+//
+static file_entry_t *
+file_open(file_cache_t *cache, const char *filepath, int mode)
+{
+	file_entry_t *entry;
+	struct stat st;
+	int fd;
+	int fd_mode = O_RDWR;
+
+	TRACE3_ENTER("filepath = '%s', mode = %d", filepath, mode);
+
+	entry = g_hash_table_lookup(cache->entries, filepath);
+	if (entry && entry->mode != O_RDWR && entry->mode != mode) {
+		file_entry_close(cache, entry);
+		entry = NULL;
+	}
+
+	// A regular file may have been replaced under an open descriptor.
+	if (entry && entry->regular &&
+			(fstat(entry->fd, &st) != 0 || st.st_nlink == 0)) {
+		file_entry_close(cache, entry);
+		entry = NULL;
+	}
+
+	if (entry) {
+		g_queue_unlink(&cache->lru, &entry->link);
+		g_queue_push_head_link(&cache->lru, &entry->link);
+		goto done;
+	}
+
+	fd = open(filepath, O_RDWR | O_CLOEXEC);
+	if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+		fd_mode = mode;
+		fd = open(filepath, mode | O_CLOEXEC);
+	}
+	if (fd < 0) {
+		LOG_FAULT("Unable to open %s: %m", filepath);
+		goto done;
+	}
+	stats_count(STATS_FILE_OPENS, 1);
+
+	if (g_queue_get_length(&cache->lru) >= FILE_CACHE_SIZE) {
+		file_entry_close(cache,
+				g_queue_peek_tail_link(&cache->lru)->data);
+	}
+
+	entry = g_new0(file_entry_t, 1);
+	if (!entry) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	entry->path = g_strdup(filepath);
+	if (!entry->path) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	entry->fd = fd;
+	entry->mode = fd_mode;
+	entry->regular = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+	entry->link.data = entry;
+
+	g_hash_table_insert(cache->entries, entry->path, entry);
+	g_queue_push_head_link(&cache->lru, &entry->link);
+
+done:
+	TRACE3_EXIT("entry = %p", entry);
+
+	return entry;
+}
+
+// one pread() or pwrite() at offset 0, retrying interrupted calls and,
+// for a while, ones that would block
+static ssize_t
+file_pio(int fd, int mode, char *buf, size_t len)
+{
+	int tries = 0;
+	ssize_t ret;
+
+	for (;;) {
+		if (mode == O_WRONLY) {
+			ret = pwrite(fd, buf, len, 0);
+		} else {
+			ret = pread(fd, buf, len, 0);
+		}
+		if (ret >= 0 || errno == EINTR) {
+			if (ret >= 0) {
+				break;
+			}
+			continue;
+		}
+		if (errno != EAGAIN || ++tries >= FILE_MAX_RETRIES) {
+			break;
+		}
+		g_usleep(FILE_RETRY_DELAY);
+	}
+
+	return ret;
+}
+
+//
+// file_io - Read up to len bytes from, or write len bytes to, a control
+// file.  When a CPU goes offline and back online, sysfs replaces its files
+// and descriptors open on the old ones fail with ENODEV, so on such an
+// error the file is reopened and the I/O tried once more.
+//
+static ssize_t
+file_io(const char *filepath, int mode, char *buf, size_t len)
+{
+	file_cache_t *cache = file_cache_get();
+	file_entry_t *entry;
+	ssize_t ret = -1;
+	uint64_t start;
+	int err;
+	int attempt;
+
+	TRACE2_ENTER("filepath = '%s', mode = %d, len = %zu",
+			filepath, mode, len);
+
+	for (attempt = 0; attempt < 2; attempt++) {
+		entry = file_open(cache, filepath, mode);
+		if (entry == NULL) {
+			break;
+		}
+
+		start = stats_now();
+		ret = file_pio(entry->fd, mode, buf, len);
+		err = errno;
+		if (mode == O_WRONLY) {
+			stats_record(STATS_FILE_WRITE, start);
+		}
+
+		if (ret >= 0) {
+			// pwrite() doesn't truncate what was there before.
+			if (mode == O_WRONLY && entry->regular &&
+					ftruncate(entry->fd, ret) != 0) {
+				err = errno;
+				ret = -1;
+				file_entry_close(cache, entry);
+			}
+			break;
+		}
+
+		// Don't keep a descriptor that failed.
+		file_entry_close(cache, entry);
+		if (err != ENODEV && err != ESTALE && err != ENOENT) {
+			break;
+		}
+		stats_count(STATS_FILE_REOPENS, 1);
+	}
+
+	if (ret < 0) {
+		errno = err;
+	}
+
+	TRACE2_EXIT("ret = %zd", ret);
+
+	return ret;
+}
+
+// read a control file into buf as a string
+static int
+file_read(const char *filepath, char *buf, size_t size)
+{
+	ssize_t len;
+
+	len = file_io(filepath, O_RDONLY, buf, size - 1);
+	if (len < 0) {
+		LOG_FAULT("Error reading value from %s: %m", filepath);
+		return 1;
+	}
+	buf[len] = '\0';
+
+	return 0;
+}
+
+static int
+file_write(const char *filepath, char *buf, size_t len)
+{
+	ssize_t ret;
+
+	ret = file_io(filepath, O_WRONLY, buf, len);
+	if (ret < 0) {
+		LOG_FAULT("Error writing value '%s' to %s: %m", buf, filepath);
+		return 1;
+	}
+	if (ret != len) {
+		LOG_FAULT("Short write of value '%s' to %s", buf, filepath);
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+file_read_uint64(const char *filepath, uint64_t *value)
+{
+	char buf[FILE_BUF_LEN];
+	char *end = NULL;
+	uint64_t local_value = 0;
+	int retval = 1;
+
+	TRACE1_ENTER("filepath = '%s', value = %p", filepath, value);
+
+	if (file_read(filepath, buf, sizeof(buf)) != 0) {
+		goto done;
+	}
+
+	// signed, like the values written, so -1 reads back as UINT64_MAX
+	errno = 0;
+	local_value = strtoll(buf, &end, 10);
+	if (errno || end == buf) {
+		LOG_FAULT("Error reading value from %s", filepath);
+		goto done;
+	}
+
+	*value = local_value;
+	retval = 0;
+
+done:
+	TRACE1_EXIT("retval = %d, *value = %ld", retval, *value);
+
+	return retval;
+}
+
+int
+file_read_double(const char *filepath, double *value)
+{
+	char buf[FILE_BUF_LEN];
+	char *end = NULL;
+	double local_value = 0;
+	int retval = 1;
+
+	TRACE1_ENTER("filepath = '%s', value = %p", filepath, value);
+
+	if (file_read(filepath, buf, sizeof(buf)) != 0) {
+		goto done;
+	}
+
+	errno = 0;
+	local_value = strtod(buf, &end);
+	if (errno || end == buf) {
+		LOG_FAULT("Error reading value from %s", filepath);
+		goto done;
+	}
+
+	*value = local_value;
+	retval = 0;
+
+done:
+	TRACE1_EXIT("retval = %d, *value = %lf", retval, *value);
+
+	return retval;
+}
+
+// read the first line of a control file, which the caller must g_free()
+int
+file_read_string(const char *filepath, char **value)
+{
+	char buf[FILE_BUF_LEN];
+	int retval = 1;
+
+	TRACE1_ENTER("filepath = '%s', value = %p", filepath, value);
+
+	if (file_read(filepath, buf, sizeof(buf)) != 0) {
+		goto done;
+	}
+
+	*value = g_strndup(buf, strcspn(buf, "\n"));
+	if (!*value) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	retval = 0;
+
+done:
+	TRACE1_EXIT("retval = %d, *value = %p '%s'", retval, *value,
+			retval ? "" : *value);
+
+	return retval;
+}
+
+int
+file_write_uint64(const char *filepath, uint64_t value)
+{
+	char buf[FILE_BUF_LEN];
+	int retval;
+
+	TRACE1_ENTER("filepath = '%s', value = %ld", filepath, value);
+
+	retval = file_write(filepath, buf,
+			snprintf(buf, sizeof(buf), "%ld", value));
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+int
+file_write_double(const char *filepath, double value)
+{
+	char buf[FILE_BUF_LEN];
+	int retval;
+
+	TRACE1_ENTER("filepath = '%s', value = %lf", filepath, value);
+
+	retval = file_write(filepath, buf,
+			snprintf(buf, sizeof(buf), "%lf", value));
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+int
+file_write_string(const char *filepath, const char *value)
+{
+	char buf[FILE_BUF_LEN];
+	int retval = 1;
+	int len;
+
+	TRACE1_ENTER("filepath = '%s', str = %p '%s'", filepath, value, value);
+
+	len = snprintf(buf, sizeof(buf), "%s", value);
+	if (len >= sizeof(buf)) {
+		LOG_FAULT("Value '%s' too long for %s", value, filepath);
+		goto done;
+	}
+
+	retval = file_write(filepath, buf, len);
+
+done:
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
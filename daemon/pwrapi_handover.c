@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Hand a running daemon over to a newly exec'd one without rolling back
+ * any set request.  Shutting down normally closes every client socket,
+ * which rolls back all of their sets, and the clients set them all again
+ * when they reconnect.  Instead, the old daemon finishes its queued sets,
+ * snapshots the journal and execs the new daemon with --takeover, while a
+ * child passes it the named socket and each client socket over a handover
+ * socket with SCM_RIGHTS, along with what it knows of each client and
+ * the descriptors of any client's request ring.  The
+ * new daemon replays the journal, which rebuilds the set tables without
+ * writing anything, and gives each client back its session and sets.
+ * The clients never see their connections close.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_socket.h"
+#include "pwrapi_journal.h"
+#include "pwrapi_handover.h"
+#include "pwrapi_ring.h"
+
+#define HANDOVER_MAGIC		0x44484e48	// "HNHD"
+
+// a client socket and its request ring
+#define HANDOVER_MAX_FDS	(1 + POWERAPI_RING_FDS)
+
+typedef enum {
+	HANDOVER_LISTEN = 1,	// the named socket
+	HANDOVER_CLIENT,	// a client socket
+	HANDOVER_CHANNEL,	// a session sharing the last client socket
+	HANDOVER_DONE,		// no more sockets
+	HANDOVER_READY		// new daemon is running, old may exit
+} handover_type_t;
+
+typedef struct {
+	uint32_t     magic;
+	uint32_t     type;		// handover_type_t
+	struct ucred cred;
+	PWR_Role     role;		// PWR_ROLE_NOT_SPECIFIED until authorized
+	uint64_t     session;
+	uint64_t     seqnum;
+	time_t       timestamp;
+	uint32_t     channel;
+	char         context_name[PWR_MAX_STRING_LEN + 1];
+} handover_rec_t;
+
+// send a record, with nfds descriptors attached
+static int
+handover_send_rec(int handover_fd, handover_rec_t *rec, const int *fds,
+		int nfds)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(HANDOVER_MAX_FDS * sizeof(int))];
+	} cmsg;
+	struct iovec iov = { .iov_base = rec, .iov_len = sizeof(*rec) };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	ssize_t bytes;
+
+	rec->magic = HANDOVER_MAGIC;
+
+	if (nfds > 0) {
+		memset(&cmsg, 0, sizeof(cmsg));
+		msg.msg_control = cmsg.buf;
+		msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+		cmsg.hdr.cmsg_level = SOL_SOCKET;
+		cmsg.hdr.cmsg_type = SCM_RIGHTS;
+		cmsg.hdr.cmsg_len = CMSG_LEN(nfds * sizeof(int));
+		memcpy(CMSG_DATA(&cmsg.hdr), fds, nfds * sizeof(int));
+	}
+
+	do {
+		bytes = sendmsg(handover_fd, &msg, 0);
+	} while (bytes < 0 && errno == EINTR);
+	if (bytes != sizeof(*rec)) {
+		LOG_FAULT("Handover send failed: %m");
+		return 1;
+	}
+
+	return 0;
+}
+
+// receive a record and the descriptors attached to it, if any
+static int
+handover_recv_rec(int handover_fd, handover_rec_t *rec, int *fds, int *nfds)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(HANDOVER_MAX_FDS * sizeof(int))];
+	} cmsg;
+	struct iovec iov = { .iov_base = rec, .iov_len = sizeof(*rec) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg.buf,
+		.msg_controllen = sizeof(cmsg.buf),
+	};
+	struct cmsghdr *cp;
+	ssize_t bytes;
+
+	*nfds = 0;
+
+	do {
+		bytes = recvmsg(handover_fd, &msg, MSG_CMSG_CLOEXEC);
+	} while (bytes < 0 && errno == EINTR);
+	if (bytes != sizeof(*rec) || rec->magic != HANDOVER_MAGIC) {
+		LOG_FAULT("Handover receive failed: %m");
+		return 1;
+	}
+
+	for (cp = CMSG_FIRSTHDR(&msg); cp; cp = CMSG_NXTHDR(&msg, cp)) {
+		if (cp->cmsg_level == SOL_SOCKET &&
+				cp->cmsg_type == SCM_RIGHTS) {
+			*nfds = (cp->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cp), *nfds * sizeof(int));
+		}
+	}
+
+	return 0;
+}
+
+// exec the new daemon with the other end of the handover socket
+static void
+handover_exec(const char *exec_path, char **args, int handover_fd)
+{
+	GPtrArray *argv;
+	char *fdarg;
+
+	TRACE1_ENTER("exec_path = '%s', handover_fd = %d", exec_path,
+			handover_fd);
+
+	fdarg = g_strdup_printf("%d", handover_fd);
+	argv = g_ptr_array_new();
+	if (!fdarg || !argv) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	g_ptr_array_add(argv, (gpointer)exec_path);
+	for (; *args; args++) {
+		g_ptr_array_add(argv, *args);
+	}
+	g_ptr_array_add(argv, (gpointer)"--takeover");
+	g_ptr_array_add(argv, fdarg);
+	g_ptr_array_add(argv, NULL);
+
+	if (fcntl(handover_fd, F_SETFD, 0) == 0) {
+		execv(exec_path, (char **)argv->pdata);
+	}
+	LOG_FAULT("Unable to exec %s: %m", exec_path);
+
+	g_ptr_array_free(argv, TRUE);
+	g_free(fdarg);
+
+	TRACE1_EXIT("");
+}
+
+// send a client session, along with its socket, if it's the connection's
+// own session, and its request ring, if it has one
+static int
+handover_send_session(int handover_fd, socket_info_t *skinfo)
+{
+	handover_rec_t rec;
+	int fds[HANDOVER_MAX_FDS];
+	int nfds = 0;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = skinfo->conn ? HANDOVER_CHANNEL : HANDOVER_CLIENT;
+	rec.cred = skinfo->cred;
+	rec.role = skinfo->role;
+	rec.session = skinfo->session;
+	rec.seqnum = skinfo->seqnum;
+	rec.timestamp = skinfo->timestamp;
+	rec.channel = skinfo->channel;
+	if (skinfo->context_name) {
+		g_strlcpy(rec.context_name, skinfo->context_name,
+				sizeof(rec.context_name));
+	}
+	if (skinfo->conn == NULL) {
+		fds[nfds++] = skinfo->sockid;
+	}
+	if (skinfo->ring) {
+		memcpy(&fds[nfds], skinfo->ring->fds, sizeof(skinfo->ring->fds));
+		nfds += POWERAPI_RING_FDS;
+	}
+
+	return handover_send_rec(handover_fd, &rec, fds, nfds);
+}
+
+// pass the sockets to the new daemon and wait for it to be running
+static int
+handover_send_sockets(int handover_fd, int named_socket)
+{
+	handover_rec_t rec;
+	GHashTableIter iter, chan_iter;
+	gpointer key, value;
+	struct timeval timeout = { .tv_sec = HANDOVER_TIMEOUT };
+	int fds[HANDOVER_MAX_FDS];
+	int nfds;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = HANDOVER_LISTEN;
+	if (handover_send_rec(handover_fd, &rec, &named_socket, 1) != 0) {
+		return 1;
+	}
+
+	g_hash_table_iter_init(&iter, open_sockets);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		socket_info_t *skinfo = value;
+
+		if (handover_send_session(handover_fd, skinfo) != 0) {
+			return 1;
+		}
+		if (skinfo->channels == NULL) {
+			continue;
+		}
+		g_hash_table_iter_init(&chan_iter, skinfo->channels);
+		while (g_hash_table_iter_next(&chan_iter, NULL, &value)) {
+			if (handover_send_session(handover_fd, value) != 0) {
+				return 1;
+			}
+		}
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = HANDOVER_DONE;
+	if (handover_send_rec(handover_fd, &rec, NULL, 0) != 0) {
+		return 1;
+	}
+
+	if (setsockopt(handover_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+			sizeof(timeout)) != 0) {
+		LOG_FAULT("Unable to set handover timeout: %m");
+	}
+	if (handover_recv_rec(handover_fd, &rec, fds, &nfds) != 0 ||
+			rec.type != HANDOVER_READY) {
+		LOG_FAULT("New daemon didn't take over");
+		return 1;
+	}
+
+	LOG_MSG("Handed %u client sockets over to the new daemon",
+			g_hash_table_size(open_sockets));
+
+	return 0;
+}
+
+//
+// handover_send - Exec the new daemon in this process, so that it keeps
+// the daemon's pid, and pass it the named socket and client sockets from
+// a child holding them, along with anything else the old daemon holds,
+// like a PM QoS request, until the new daemon is running.  Every other
+// thread must have been stopped and the journal snapshot taken, so that
+// the new daemon replays every set.
+//
+// Returns only if the handover failed.
+//
+void
+handover_send(const char *exec_path, char **args, int named_socket)
+{
+	GHashTableIter iter;
+	gpointer key;
+	int sv[2] = { -1, -1 };
+	pid_t pid;
+
+	TRACE1_ENTER("exec_path = '%s', named_socket = %d", exec_path,
+			named_socket);
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+		LOG_FAULT("Unable to create handover socket: %m");
+		goto done;
+	}
+
+	// The new daemon only gets the sockets it's handed.
+	fcntl(named_socket, F_SETFD, FD_CLOEXEC);
+	g_hash_table_iter_init(&iter, open_sockets);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		fcntl(*(int *)key, F_SETFD, FD_CLOEXEC);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		LOG_FAULT("Unable to fork handover: %m");
+		goto done;
+	}
+	if (pid == 0) {
+		close(sv[1]);
+		_exit(handover_send_sockets(sv[0], named_socket));
+	}
+
+	close(sv[0]);
+	sv[0] = -1;
+	handover_exec(exec_path, args, sv[1]);
+
+done:
+	if (sv[0] >= 0) {
+		close(sv[0]);
+	}
+	if (sv[1] >= 0) {
+		close(sv[1]);
+	}
+
+	TRACE1_EXIT("");
+}
+
+// give a client handed over its session back, with any sets in it and
+// its request ring, if it has one
+static void
+handover_adopt(socket_info_t *skinfo, const handover_rec_t *rec,
+		const int *ring_fds)
+{
+	TRACE2_ENTER("skinfo = %p, session = %#lx", skinfo, rec->session);
+
+	skinfo->seqnum = rec->seqnum;
+	skinfo->timestamp = rec->timestamp;
+
+	if (rec->role != PWR_ROLE_NOT_SPECIFIED) {
+		skinfo->role = rec->role;
+		skinfo->context_name = g_strdup(rec->context_name);
+		if (!skinfo->context_name) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+
+		// A session without sets wasn't replayed.
+		if (!socket_reclaim(skinfo, rec->session)) {
+			skinfo->session = rec->session;
+			journal_session_begin(skinfo);
+		}
+	}
+
+	// A client whose ring is lost would wait on it forever, so hang
+	// up and let it reconnect.
+	if (ring_fds && ring_adopt(skinfo, ring_fds) != 0) {
+		shutdown(skinfo->sockid, SHUT_RDWR);
+	}
+
+	TRACE2_EXIT("");
+}
+
+//
+// handover_receive - Take over the named socket and client sockets of the
+// daemon that exec'd this one.  The journal must have been replayed
+// first.  The client sockets are added to open_sockets.
+//
+// Return Code(s):
+//
+//      0 - every socket was taken over
+//      1 - the handover failed
+//
+int
+handover_receive(int handover_fd, int *named_socket)
+{
+	handover_rec_t rec;
+	socket_info_t *conn = NULL, *skinfo;
+	guint clients = 0;
+	int fds[HANDOVER_MAX_FDS];
+	int nfds, i;
+	int retval = 1;
+
+	TRACE1_ENTER("handover_fd = %d", handover_fd);
+
+	*named_socket = -1;
+
+	while (handover_recv_rec(handover_fd, &rec, fds, &nfds) == 0) {
+		switch (rec.type) {
+		case HANDOVER_LISTEN:
+			*named_socket = (nfds == 1) ? fds[0] : -1;
+			break;
+		case HANDOVER_CLIENT:
+			if (nfds != 1 && nfds != HANDOVER_MAX_FDS) {
+				LOG_FAULT("Handover of a client without its socket");
+				goto done;
+			}
+			socket_construct(fds[0], &rec.cred);
+			conn = socket_lookup(fds[0]);
+			handover_adopt(conn, &rec, (nfds > 1) ? &fds[1] : NULL);
+			clients++;
+			break;
+		case HANDOVER_CHANNEL:
+			skinfo = NULL;
+			if (conn && (nfds == 0 || nfds == POWERAPI_RING_FDS)) {
+				skinfo = socket_channel_create(conn, rec.channel);
+			}
+			if (skinfo == NULL) {
+				LOG_FAULT("Handover of a session without its socket");
+				goto done;
+			}
+			handover_adopt(skinfo, &rec, nfds ? fds : NULL);
+			break;
+		case HANDOVER_DONE:
+			retval = (*named_socket < 0);
+			goto done;
+		default:
+			LOG_FAULT("Unknown handover record type %u", rec.type);
+			for (i = 0; i < nfds; i++) {
+				close(fds[i]);
+			}
+			goto done;
+		}
+	}
+
+done:
+	LOG_MSG("Took over %u client sockets", clients);
+
+	TRACE1_EXIT("retval = %d, named_socket = %d", retval, *named_socket);
+
+	return retval;
+}
+
+// tell the old daemon that this one is running, so that it may exit
+void
+handover_ready(int handover_fd)
+{
+	handover_rec_t rec;
+
+	TRACE1_ENTER("handover_fd = %d", handover_fd);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = HANDOVER_READY;
+	handover_send_rec(handover_fd, &rec, NULL, 0);
+	close(handover_fd);
+
+	TRACE1_EXIT("");
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Priority heap used to order competing set requests for an attribute
+ * in the powerapi daemon.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_heap.h"
+
+#define HEAP_INITIAL_SIZE   4
+
+#define HEAP_PARENT(i)      (((i) - 1) / 2)
+#define HEAP_LEFT(i)        (2 * (i) + 1)
+#define HEAP_RIGHT(i)       (2 * (i) + 2)
+
+// place a set request at a heap position, keeping its back-pointer current
+static inline void
+heap_place(set_heap_t *heap, guint index, set_info_t *setp)
+{
+    heap->items[index] = setp;
+    setp->heap_index = index;
+}
+
+// move the item at index toward the root until its parent is higher priority
+static void
+heap_sift_up(set_heap_t *heap, guint index)
+{
+    set_info_t *setp = heap->items[index];
+
+    while (index > 0) {
+        guint parent = HEAP_PARENT(index);
+
+        if (attr_value_comp(setp, heap->items[parent]) >= 0) {
+            break;
+        }
+        heap_place(heap, index, heap->items[parent]);
+        index = parent;
+    }
+
+    heap_place(heap, index, setp);
+}
+
+// move the item at index toward the leaves until both children are lower
+// priority
+static void
+heap_sift_down(set_heap_t *heap, guint index)
+{
+    set_info_t *setp = heap->items[index];
+
+    for (;;) {
+        guint left = HEAP_LEFT(index);
+        guint right = HEAP_RIGHT(index);
+        guint best = left;
+
+        if (left >= heap->len) {
+            break;
+        }
+        if (right < heap->len &&
+                attr_value_comp(heap->items[right],
+                    heap->items[left]) < 0) {
+            best = right;
+        }
+        if (attr_value_comp(heap->items[best], setp) >= 0) {
+            break;
+        }
+        heap_place(heap, index, heap->items[best]);
+        index = best;
+    }
+
+    heap_place(heap, index, setp);
+}
+
+set_heap_t *
+set_heap_new(void)
+{
+    set_heap_t *heap;
+
+    TRACE3_ENTER("");
+
+    heap = g_new0(set_heap_t, 1);
+    if (!heap) {
+        LOG_CRIT(MEM_ERROR_EXIT);
+        exit(1);
+    }
+
+    TRACE3_EXIT("heap = %p", heap);
+
+    return heap;
+}
+
+void
+set_heap_free(gpointer data)
+{
+    set_heap_t *heap = data;
+
+    TRACE3_ENTER("heap = %p", heap);
+
+    if (heap) {
+        g_free(heap->items);
+        g_free(heap);
+    }
+
+    TRACE3_EXIT("");
+}
+
+void
+set_heap_insert(set_heap_t *heap, set_info_t *setp)
+{
+    TRACE3_ENTER("heap = %p, setp = %p", heap, setp);
+
+    if (heap->len == heap->size) {
+        heap->size = heap->size ? heap->size * 2 : HEAP_INITIAL_SIZE;
+        heap->items = g_renew(set_info_t *, heap->items, heap->size);
+        if (!heap->items) {
+            LOG_CRIT(MEM_ERROR_EXIT);
+            exit(1);
+        }
+    }
+
+    heap_place(heap, heap->len++, setp);
+    heap_sift_up(heap, setp->heap_index);
+
+    TRACE3_EXIT("heap->len = %u", heap->len);
+}
+
+void
+set_heap_remove(set_heap_t *heap, set_info_t *setp)
+{
+    guint index = setp->heap_index;
+    set_info_t *last;
+
+    TRACE3_ENTER("heap = %p, setp = %p", heap, setp);
+
+    if (index >= heap->len || heap->items[index] != setp) {
+        LOG_FAULT("Set request %p is not in heap %p", setp, heap);
+        TRACE3_EXIT("");
+        return;
+    }
+
+    // fill the hole with the last item and restore the heap order,
+    // which may require moving it either up or down
+    last = heap->items[--heap->len];
+    if (index < heap->len) {
+        heap_place(heap, index, last);
+        if (index > 0 &&
+                attr_value_comp(last, heap->items[HEAP_PARENT(index)]) < 0) {
+            heap_sift_up(heap, index);
+        } else {
+            heap_sift_down(heap, index);
+        }
+    }
+
+    TRACE3_EXIT("heap->len = %u", heap->len);
+}
+
+set_info_t *
+set_heap_top(const set_heap_t *heap)
+{
+    return (heap && heap->len) ? heap->items[0] : NULL;
+}
+
+guint
+set_heap_length(const set_heap_t *heap)
+{
+    return heap ? heap->len : 0;
+}
+
+// call func for every request in the heap, top first, remainder unordered
+void
+set_heap_foreach(const set_heap_t *heap, GFunc func, gpointer user_data)
+{
+    guint i;
+
+    for (i = 0; heap && i < heap->len; i++) {
+        func(heap->items[i], user_data);
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Declare the priority heap used to order competing set requests for an
+ * attribute in the powerapi daemon.
+ */
+
+#ifndef _POWERAPI_HEAP_H
+#define _POWERAPI_HEAP_H
+
+#include <glib.h>
+
+#include "pwrapi_set.h"
+
+// A binary min-heap of set requests ordered by attr_value_comp(), so the
+// highest priority request is always at the root.  Each set_info_t records
+// its own position in the heap, which allows removal of an arbitrary
+// request without searching for it.
+typedef struct {
+    set_info_t **items;     // heap array, items[0] is the top
+    guint        len;       // number of items in the heap
+    guint        size;      // allocated size of items
+} set_heap_t;
+
+set_heap_t *set_heap_new(void);
+void set_heap_free(gpointer heap);
+void set_heap_insert(set_heap_t *heap, set_info_t *setp);
+void set_heap_remove(set_heap_t *heap, set_info_t *setp);
+set_info_t *set_heap_top(const set_heap_t *heap);
+guint set_heap_length(const set_heap_t *heap);
+void set_heap_foreach(const set_heap_t *heap, GFunc func, gpointer user_data);
+
+#endif // _POWERAPI_HEAP_H
@@ -0,0 +1,681 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Journal the daemon's default values and active set requests so that a
+ * restarted daemon can recover them instead of taking the node down.
+ *
+ * The journal is an append-only file of records written after each change
+ * to def_values or a session's my_changes.  Replaying the records in order
+ * rebuilds the tables; replaying a record more than once is harmless.
+ * When the journal grows too large it is rewritten with just the current
+ * state.  The journal is only meaningful for the boot it was written in,
+ * since the control files revert to their defaults when the node reboots,
+ * so it starts with the kernel boot id and is not fsync'ed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <common.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_socket.h"
+#include "pwrapi_journal.h"
+
+#define JOURNAL_MAGIC           0x4a525744      // "DWRJ"
+#define JOURNAL_VERSION         1
+#define JOURNAL_REC_MAGIC       0x43455252      // "RREC"
+#define JOURNAL_COMPACT_SIZE    (1024 * 1024)   // rewrite at this size
+#define JOURNAL_PATH            PWR_JOURNAL_PATH
+#define JOURNAL_NEW_PATH        pwr_rundir_path(POWERAPID_JOURNAL_PATH ".new")
+#define BOOT_ID_PATH            "/proc/sys/kernel/random/boot_id"
+#define BOOT_ID_LEN             40
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    char     boot_id[BOOT_ID_LEN];  // boot the journal was written in
+} journal_hdr_t;
+
+typedef enum {
+    JOURNAL_SESSION = 1,    // session authorized, string is context name
+    JOURNAL_END,            // session closed and its sets rolled back
+    JOURNAL_DEFAULT,        // default value, string is path
+    JOURNAL_SET,            // session set a value, string is path
+    JOURNAL_CLEAR           // session's set was removed, string is path
+} journal_type_t;
+
+typedef struct {
+    uint32_t magic;         // JOURNAL_REC_MAGIC
+    uint16_t type;          // journal_type_t
+    uint16_t strsize;       // size of string following record, with NUL
+    uint64_t session;       // session token
+    uint64_t timestamp;     // set_info_t timestamp
+    union {
+        struct {
+            uid_t    uid;
+            PWR_Role role;
+            gboolean advisory;  // its sets yield to every client's
+        } owner;            // JOURNAL_SESSION
+        struct {
+            PWR_ObjType      object;
+            PWR_AttrName     attribute;
+            PWR_AttrDataType data_type;
+            PWR_MetaName     metadata;
+            type_union_t     value;
+        } set;              // JOURNAL_DEFAULT, JOURNAL_SET, JOURNAL_CLEAR
+    };
+} journal_rec_t;
+
+// journal_lock protects the journal file and the sessions table, which
+// maps session tokens to the sockets (or orphans) that own them.  When
+// both are needed, changes_lock is taken before journal_lock.
+static GMutex      journal_lock;
+static int         journal_fd = -1;
+static size_t      journal_size = 0;
+static GHashTable *journal_sessions = NULL;
+
+static void
+journal_init_sessions(void)
+{
+    if (journal_sessions == NULL) {
+        journal_sessions = g_hash_table_new(g_int64_hash, g_int64_equal);
+        if (!journal_sessions) {
+            LOG_CRIT(MEM_ERROR_EXIT);
+            exit(1);
+        }
+    }
+}
+
+static int
+read_boot_id(char *boot_id)
+{
+    gchar *buf = NULL;
+
+    TRACE2_ENTER("boot_id = %p", boot_id);
+
+    memset(boot_id, 0, BOOT_ID_LEN);
+
+    if (!g_file_get_contents(BOOT_ID_PATH, &buf, NULL, NULL)) {
+        LOG_FAULT("Unable to read %s", BOOT_ID_PATH);
+        TRACE2_EXIT("retval = 1");
+        return 1;
+    }
+
+    g_strlcpy(boot_id, g_strstrip(buf), BOOT_ID_LEN);
+    g_free(buf);
+
+    TRACE2_EXIT("retval = 0, boot_id = '%s'", boot_id);
+
+    return 0;
+}
+
+// write a record and its string with a single write so that a record
+// is never partially written if the daemon dies
+static ssize_t
+journal_write(int fd, const journal_rec_t *rec, const char *str)
+{
+    char buf[sizeof(*rec) + PATH_MAX];
+    size_t len = sizeof(*rec) + rec->strsize;
+    ssize_t ret;
+
+    memcpy(buf, rec, sizeof(*rec));
+    memcpy(buf + sizeof(*rec), str, rec->strsize);
+    buf[len - 1] = '\0';
+
+    do {
+        ret = write(fd, buf, len);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret != len) {
+        LOG_FAULT("Journal write failed: %m");
+        return -1;
+    }
+
+    return ret;
+}
+
+static void
+journal_set_rec(journal_rec_t *rec, journal_type_t type,
+        const set_info_t *setp, uint64_t session)
+{
+    const powerapi_setreq_t *setreq = &setp->setreq;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->magic = JOURNAL_REC_MAGIC;
+    rec->type = type;
+    rec->strsize = strlen(setreq->path) + 1;
+    rec->session = session;
+    rec->timestamp = setp->timestamp;
+    rec->set.object = setreq->object;
+    rec->set.attribute = setreq->attribute;
+    rec->set.data_type = setreq->data_type;
+    rec->set.metadata = setreq->metadata;
+    rec->set.value = setreq->value;
+}
+
+static void
+journal_session_rec(journal_rec_t *rec, const socket_info_t *skinfo,
+        const char **name)
+{
+    *name = skinfo->context_name ? skinfo->context_name : "";
+
+    memset(rec, 0, sizeof(*rec));
+    rec->magic = JOURNAL_REC_MAGIC;
+    rec->type = JOURNAL_SESSION;
+    rec->strsize = MIN(strlen(*name), PWR_MAX_STRING_LEN) + 1;
+    rec->session = skinfo->session;
+    rec->owner.uid = skinfo->cred.uid;
+    rec->owner.role = skinfo->role;
+    rec->owner.advisory = skinfo->advisory;
+}
+
+typedef struct {
+    int     fd;
+    ssize_t size;   // bytes written so far, -1 after an error
+} journal_snapshot_t;
+
+static void
+journal_snapshot_rec(journal_snapshot_t *snap, const journal_rec_t *rec,
+        const char *str)
+{
+    ssize_t ret;
+
+    if (snap->size < 0) {
+        return;
+    }
+
+    ret = journal_write(snap->fd, rec, str);
+    snap->size = (ret < 0) ? -1 : snap->size + ret;
+}
+
+static void
+journal_snapshot_default(gpointer key, gpointer value, gpointer user_data)
+{
+    const set_info_t *setp = value;
+    journal_rec_t rec;
+
+    journal_set_rec(&rec, JOURNAL_DEFAULT, setp, 0);
+    journal_snapshot_rec(user_data, &rec, setp->setreq.path);
+}
+
+static void
+journal_snapshot_set(gpointer key, gpointer value, gpointer user_data)
+{
+    const set_info_t *setp = value;
+    journal_rec_t rec;
+
+    journal_set_rec(&rec, JOURNAL_SET, setp, setp->skinfo->session);
+    journal_snapshot_rec(user_data, &rec, setp->setreq.path);
+}
+
+static void
+journal_snapshot_session(gpointer key, gpointer value, gpointer user_data)
+{
+    const socket_info_t *skinfo = value;
+    journal_rec_t rec;
+    const char *name;
+
+    journal_session_rec(&rec, skinfo, &name);
+    journal_snapshot_rec(user_data, &rec, name);
+
+    g_hash_table_foreach(skinfo->my_changes, journal_snapshot_set, user_data);
+}
+
+// Replace the journal with a snapshot of the current state.  Called with
+// changes_lock and journal_lock held.  On failure the old journal, if
+// any, is kept.
+static int
+journal_rewrite(void)
+{
+    journal_snapshot_t snap = { .fd = -1, .size = 0 };
+    journal_hdr_t hdr = {
+        .magic = JOURNAL_MAGIC,
+        .version = JOURNAL_VERSION,
+    };
+    int retval = 1;
+
+    TRACE1_ENTER("journal_fd = %d, journal_size = %zu",
+            journal_fd, journal_size);
+
+    if (read_boot_id(hdr.boot_id) != 0) {
+        goto done;
+    }
+
+    snap.fd = open(JOURNAL_NEW_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND
+            | O_CLOEXEC, 0600);
+    if (snap.fd < 0) {
+        LOG_FAULT("Unable to create %s: %m", JOURNAL_NEW_PATH);
+        goto done;
+    }
+
+    if (write(snap.fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        LOG_FAULT("Unable to write %s: %m", JOURNAL_NEW_PATH);
+        goto done;
+    }
+    snap.size = sizeof(hdr);
+
+    // Defaults first, so that replay sees each path's default before
+    // any set of it.
+    g_hash_table_foreach(def_values, journal_snapshot_default, &snap);
+    g_hash_table_foreach(journal_sessions, journal_snapshot_session, &snap);
+    if (snap.size < 0) {
+        goto done;
+    }
+
+    if (rename(JOURNAL_NEW_PATH, JOURNAL_PATH) != 0) {
+        LOG_FAULT("Unable to rename %s: %m", JOURNAL_NEW_PATH);
+        goto done;
+    }
+
+    if (journal_fd >= 0) {
+        close(journal_fd);
+    }
+    journal_fd = snap.fd;
+    journal_size = snap.size;
+    snap.fd = -1;
+    retval = 0;
+
+done:
+    if (snap.fd >= 0) {
+        close(snap.fd);
+        unlink(JOURNAL_NEW_PATH);
+    }
+
+    TRACE1_EXIT("retval = %d, journal_size = %zu", retval, journal_size);
+
+    return retval;
+}
+
+// Append a record.  The caller must not hold changes_lock, since the
+// journal may need to be rewritten.
+static void
+journal_append(const journal_rec_t *rec, const char *str)
+{
+    gboolean rewrite = FALSE;
+    ssize_t ret;
+
+    TRACE2_ENTER("rec = %p, type = %d, str = '%s'", rec, rec->type, str);
+
+    g_mutex_lock(&journal_lock);
+    if (journal_fd >= 0) {
+        ret = journal_write(journal_fd, rec, str);
+        if (ret > 0) {
+            journal_size += ret;
+        }
+        rewrite = (journal_size > JOURNAL_COMPACT_SIZE);
+    }
+    g_mutex_unlock(&journal_lock);
+
+    if (rewrite) {
+        g_mutex_lock(&changes_lock);
+        g_mutex_lock(&journal_lock);
+        // another thread may have beaten us to it
+        if (journal_fd >= 0 && journal_size > JOURNAL_COMPACT_SIZE) {
+            journal_rewrite();
+        }
+        g_mutex_unlock(&journal_lock);
+        g_mutex_unlock(&changes_lock);
+    }
+
+    TRACE2_EXIT("");
+}
+
+static void
+journal_append_set(journal_type_t type, const set_info_t *setp,
+        uint64_t session)
+{
+    journal_rec_t rec;
+
+    journal_set_rec(&rec, type, setp, session);
+    journal_append(&rec, setp->setreq.path);
+}
+
+void
+journal_default(const set_info_t *defset)
+{
+    journal_append_set(JOURNAL_DEFAULT, defset, 0);
+}
+
+void
+journal_set(const set_info_t *setp)
+{
+    journal_append_set(JOURNAL_SET, setp, setp->skinfo->session);
+}
+
+void
+journal_clear(const set_info_t *setp)
+{
+    if (setp->skinfo) {
+        journal_append_set(JOURNAL_CLEAR, setp, setp->skinfo->session);
+    }
+}
+
+// record that a session has been authorized, or reclaimed by a new socket
+void
+journal_session_begin(socket_info_t *skinfo)
+{
+    journal_rec_t rec;
+    const char *name;
+
+    TRACE1_ENTER("skinfo = %p, session = %#lx", skinfo, skinfo->session);
+
+    g_mutex_lock(&journal_lock);
+    journal_init_sessions();
+    g_hash_table_replace(journal_sessions, &skinfo->session, skinfo);
+    g_mutex_unlock(&journal_lock);
+
+    journal_session_rec(&rec, skinfo, &name);
+    journal_append(&rec, name);
+
+    TRACE1_EXIT("");
+}
+
+// record that a session is over and all of its sets have been removed
+void
+journal_session_end(socket_info_t *skinfo)
+{
+    journal_rec_t rec = {
+        .magic = JOURNAL_REC_MAGIC,
+        .type = JOURNAL_END,
+        .strsize = 1,
+        .session = skinfo->session,
+    };
+    gboolean owner = FALSE;
+
+    TRACE1_ENTER("skinfo = %p, session = %#lx", skinfo, skinfo->session);
+
+    g_mutex_lock(&journal_lock);
+    if (journal_sessions && g_hash_table_lookup(journal_sessions,
+                &skinfo->session) == skinfo) {
+        g_hash_table_remove(journal_sessions, &skinfo->session);
+        owner = TRUE;
+    }
+    g_mutex_unlock(&journal_lock);
+
+    if (owner) {
+        journal_append(&rec, "");
+    }
+
+    TRACE1_EXIT("owner = %d", owner);
+}
+
+static socket_info_t *
+replay_session(uint64_t session)
+{
+    return g_hash_table_lookup(journal_sessions, &session);
+}
+
+static void
+replay_record(const journal_rec_t *rec, const char *str)
+{
+    powerapi_setreq_t setreq = { 0 };
+    socket_info_t *skinfo = NULL;
+    set_info_t *setp;
+
+    TRACE2_ENTER("rec = %p, type = %d, str = '%s'", rec, rec->type, str);
+
+    if (rec->type == JOURNAL_DEFAULT || rec->type == JOURNAL_SET
+            || rec->type == JOURNAL_CLEAR) {
+        setreq.object = rec->set.object;
+        setreq.attribute = rec->set.attribute;
+        setreq.data_type = rec->set.data_type;
+        setreq.metadata = rec->set.metadata;
+        setreq.value = rec->set.value;
+        g_strlcpy(setreq.path, str, sizeof(setreq.path));
+    }
+
+    if (rec->type != JOURNAL_DEFAULT && rec->type != JOURNAL_SESSION) {
+        skinfo = replay_session(rec->session);
+        if (skinfo == NULL) {
+            LOG_WARN("Journal record for unknown session %#lx",
+                    rec->session);
+            goto done;
+        }
+    }
+
+    switch (rec->type) {
+    case JOURNAL_SESSION:
+        if (replay_session(rec->session) == NULL) {
+            skinfo = socket_orphan_create(rec->session, rec->owner.uid,
+                    rec->owner.role, str);
+            // before its sets, which go to advisory_changes if so
+            skinfo->advisory = rec->owner.advisory;
+            g_hash_table_insert(journal_sessions, &skinfo->session, skinfo);
+        }
+        break;
+    case JOURNAL_END:
+        g_hash_table_remove(journal_sessions, &skinfo->session);
+        socket_orphan_discard(skinfo);
+        break;
+    case JOURNAL_DEFAULT:
+        setp = set_lookup(def_values, setreq.path);
+        if (setp) {
+            set_remove(setp, def_values);
+            set_destroy(setp);
+        }
+        setp = set_create_item(&setreq, NULL);
+        setp->timestamp = rec->timestamp;
+        set_insert(setp, def_values);
+        break;
+    case JOURNAL_SET:
+        // Every set needs a default to roll back to.
+        if (set_lookup(def_values, setreq.path) == NULL) {
+            LOG_WARN("Journal set of %s has no default, ignoring",
+                    setreq.path);
+            break;
+        }
+        // fall through
+    case JOURNAL_CLEAR:
+        setp = set_lookup(skinfo->my_changes, setreq.path);
+        if (setp) {
+            set_remove(setp, skinfo->my_changes);
+            set_destroy(setp);
+        }
+        if (rec->type == JOURNAL_SET) {
+            setp = set_create_item(&setreq, skinfo);
+            setp->timestamp = rec->timestamp;
+            set_insert(setp, skinfo->my_changes);
+        }
+        break;
+    default:
+        LOG_WARN("Unknown journal record type %d", rec->type);
+        break;
+    }
+
+done:
+    TRACE2_EXIT("");
+}
+
+static gboolean
+replay_idle_session(gpointer key, gpointer value, gpointer user_data)
+{
+    socket_info_t *skinfo = value;
+
+    if (g_hash_table_size(skinfo->my_changes) != 0) {
+        return FALSE;
+    }
+
+    socket_orphan_discard(skinfo);
+
+    return TRUE;
+}
+
+//
+// journal_replay - Rebuild def_values and the set requests of the
+// sessions that were open when the daemon exited.  Those sessions become
+// orphans, which their clients may reclaim by reconnecting.
+//
+// Returns 0 if the daemon state was recovered, 1 otherwise.
+//
+int
+journal_replay(void)
+{
+    gchar *buf = NULL;
+    gsize len = 0;
+    gsize off;
+    const journal_hdr_t *hdr;
+    char boot_id[BOOT_ID_LEN];
+    guint count = 0;
+    int retval = 1;
+
+    TRACE1_ENTER("");
+
+    journal_init_sessions();
+
+    if (!g_file_get_contents(JOURNAL_PATH, &buf, &len, NULL)) {
+        LOG_WARN("No journal found at %s", JOURNAL_PATH);
+        goto done;
+    }
+
+    hdr = (const journal_hdr_t *)buf;
+    if (len < sizeof(*hdr) || hdr->magic != JOURNAL_MAGIC
+            || hdr->version != JOURNAL_VERSION) {
+        LOG_WARN("Journal %s is not valid", JOURNAL_PATH);
+        goto done;
+    }
+
+    if (read_boot_id(boot_id) != 0 || strncmp(boot_id, hdr->boot_id,
+                BOOT_ID_LEN) != 0) {
+        LOG_WARN("Journal %s is from a previous boot", JOURNAL_PATH);
+        goto done;
+    }
+
+    for (off = sizeof(*hdr); off + sizeof(journal_rec_t) <= len; ) {
+        journal_rec_t rec;
+        const char *str;
+
+        memcpy(&rec, buf + off, sizeof(rec));
+        str = buf + off + sizeof(rec);
+
+        // A damaged record ends the journal.
+        if (rec.magic != JOURNAL_REC_MAGIC || rec.strsize == 0
+                || rec.strsize > PATH_MAX
+                || off + sizeof(rec) + rec.strsize > len
+                || str[rec.strsize - 1] != '\0') {
+            LOG_WARN("Journal damaged at offset %zu, ignoring the rest", off);
+            break;
+        }
+
+        replay_record(&rec, str);
+        off += sizeof(rec) + rec.strsize;
+        count++;
+    }
+
+    // Sessions without any sets have nothing to reclaim.
+    g_hash_table_foreach_remove(journal_sessions, replay_idle_session, NULL);
+
+    LOG_MSG("Replayed %u journal records, %u defaults, %u sessions",
+            count, g_hash_table_size(def_values),
+            g_hash_table_size(journal_sessions));
+
+    retval = 0;
+
+done:
+    g_free(buf);
+
+    TRACE1_EXIT("retval = %d", retval);
+
+    return retval;
+}
+
+// start journaling, beginning with a snapshot of the current state
+void
+journal_open(void)
+{
+    TRACE1_ENTER("");
+
+    g_mutex_lock(&changes_lock);
+    g_mutex_lock(&journal_lock);
+
+    journal_init_sessions();
+    if (journal_rewrite() != 0) {
+        LOG_WARN("Unable to create journal, daemon state is not recoverable");
+    }
+
+    g_mutex_unlock(&journal_lock);
+    g_mutex_unlock(&changes_lock);
+
+    TRACE1_EXIT("journal_fd = %d", journal_fd);
+}
+
+// Stop journaling, leaving a snapshot of the current state for the daemon
+// taking over to replay.  The workers must have been stopped.
+int
+journal_handover(void)
+{
+    int retval;
+
+    TRACE1_ENTER("journal_fd = %d", journal_fd);
+
+    g_mutex_lock(&changes_lock);
+    g_mutex_lock(&journal_lock);
+
+    journal_init_sessions();
+    retval = journal_rewrite();
+    if (journal_fd >= 0) {
+        close(journal_fd);
+        journal_fd = -1;
+    }
+
+    g_mutex_unlock(&journal_lock);
+    g_mutex_unlock(&changes_lock);
+
+    TRACE1_EXIT("retval = %d", retval);
+
+    return retval;
+}
+
+// stop journaling after a clean shutdown; there is nothing to recover
+void
+journal_close(void)
+{
+    TRACE1_ENTER("journal_fd = %d", journal_fd);
+
+    g_mutex_lock(&journal_lock);
+    if (journal_fd >= 0) {
+        close(journal_fd);
+        journal_fd = -1;
+    }
+    unlink(JOURNAL_PATH);
+    g_mutex_unlock(&journal_lock);
+
+    TRACE1_EXIT("");
+}
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Keep the uids permitted to connect to the powerapi daemon in memory, so
+ * that checking a connecting client doesn't mean parsing the permissions
+ * file.  The set is reloaded when the file is changed by someone else,
+ * as reported by inotify (or by its modification time if inotify isn't
+ * available), and changes requested through PwrPERMS update the set and
+ * the file together.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <permissions.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_perms.h"
+
+static GHashTable *permitted = NULL;    // set of permitted uids
+static struct stat perms_stat;          // permissions file when loaded
+static int         inotify_fd = -1;
+
+// identify the version of the permissions file, so that we only reload
+// it when it has actually changed
+static gboolean
+perms_file_changed(struct stat *st)
+{
+	if (stat(CURR_PERMISSIONS_FILE, st) != 0) {
+		memset(st, 0, sizeof(*st));
+	}
+
+	return st->st_ino != perms_stat.st_ino
+			|| st->st_size != perms_stat.st_size
+			|| st->st_mtim.tv_sec != perms_stat.st_mtim.tv_sec
+			|| st->st_mtim.tv_nsec != perms_stat.st_mtim.tv_nsec;
+}
+
+static void
+perms_remember_file(void)
+{
+	if (stat(CURR_PERMISSIONS_FILE, &perms_stat) != 0) {
+		memset(&perms_stat, 0, sizeof(perms_stat));
+	}
+}
+
+static int
+perms_load(void)
+{
+	GHashTable *uids;
+	FILE *fp;
+	unsigned int uid;
+	int retval = 1;
+
+	TRACE1_ENTER("");
+
+	uids = g_hash_table_new(g_direct_hash, g_direct_equal);
+	if (!uids) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	fp = fopen(CURR_PERMISSIONS_FILE, "r");
+	if (fp == NULL) {
+		LOG_FAULT("unable to open file %s: %m", CURR_PERMISSIONS_FILE);
+		g_hash_table_destroy(uids);
+		goto done;
+	}
+
+	// remember the file we're about to read, so that a change made
+	// while we're reading it is noticed next time
+	perms_remember_file();
+
+	while (fscanf(fp, "%u", &uid) == 1) {
+		g_hash_table_add(uids, GUINT_TO_POINTER(uid));
+	}
+	fclose(fp);
+
+	if (permitted) {
+		g_hash_table_destroy(permitted);
+	}
+	permitted = uids;
+	retval = 0;
+
+	LOG_DBG("Loaded %u permitted uids from %s",
+			g_hash_table_size(permitted), CURR_PERMISSIONS_FILE);
+
+done:
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+// rewrite the permissions file from the permitted set, atomically
+static int
+perms_save(void)
+{
+	GHashTableIter iter;
+	gpointer key;
+	FILE *fp;
+	int retval = 1;
+
+	TRACE1_ENTER("");
+
+	fp = fopen(TEMP_PERMISSIONS_FILE, "w");
+	if (fp == NULL) {
+		LOG_FAULT("unable to open file %s: %m", TEMP_PERMISSIONS_FILE);
+		goto done;
+	}
+
+	g_hash_table_iter_init(&iter, permitted);
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		fprintf(fp, "%u\n", GPOINTER_TO_UINT(key));
+	}
+
+	if (fclose(fp) != 0) {
+		LOG_FAULT("unable to write file %s: %m", TEMP_PERMISSIONS_FILE);
+		unlink(TEMP_PERMISSIONS_FILE);
+		goto done;
+	}
+
+	if (rename(TEMP_PERMISSIONS_FILE, CURR_PERMISSIONS_FILE) != 0) {
+		LOG_FAULT("unable to rename file %s to %s: %m",
+				TEMP_PERMISSIONS_FILE, CURR_PERMISSIONS_FILE);
+		unlink(TEMP_PERMISSIONS_FILE);
+		goto done;
+	}
+
+	perms_remember_file();
+	retval = 0;
+
+done:
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+// append a uid to the permissions file
+static int
+perms_append(unsigned int uid)
+{
+	FILE *fp;
+	int retval = 1;
+
+	TRACE1_ENTER("uid = %u", uid);
+
+	fp = fopen(CURR_PERMISSIONS_FILE, "a");
+	if (fp == NULL) {
+		LOG_FAULT("unable to open file %s: %m", CURR_PERMISSIONS_FILE);
+		goto done;
+	}
+
+	fprintf(fp, "%u\n", uid);
+
+	if (fclose(fp) != 0) {
+		LOG_FAULT("unable to write file %s: %m", CURR_PERMISSIONS_FILE);
+		goto done;
+	}
+
+	perms_remember_file();
+	retval = 0;
+
+done:
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+//
+// perms_init - Reset the permissions file to the boot-time uids, load
+// them, and start watching the file for changes.
+//
+// Returns 0 on success, 1 on failure.
+//
+int
+perms_init(void)
+{
+	char *dir;
+	int retval = 1;
+
+	TRACE1_ENTER("");
+
+	if (restore_permissions_file() != 0 || perms_load() != 0) {
+		goto done;
+	}
+
+	// Watch the directory rather than the file, which is replaced
+	// by rename when rewritten.
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd >= 0) {
+		dir = g_path_get_dirname(CURR_PERMISSIONS_FILE);
+		if (inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_CREATE
+				| IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) < 0) {
+			close(inotify_fd);
+			inotify_fd = -1;
+		}
+		g_free(dir);
+	}
+	if (inotify_fd < 0) {
+		LOG_WARN("Unable to watch %s, checking it on each connection: %m",
+				CURR_PERMISSIONS_FILE);
+	}
+
+	retval = 0;
+
+done:
+	TRACE1_EXIT("retval = %d, inotify_fd = %d", retval, inotify_fd);
+
+	return retval;
+}
+
+// descriptor to select on for changes to the permissions file, or -1
+int
+perms_fd(void)
+{
+	return inotify_fd;
+}
+
+// reload the permitted uids if the permissions file has changed
+void
+perms_refresh(void)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct stat st;
+
+	TRACE2_ENTER("");
+
+	// Only the fact that something in the directory changed matters.
+	if (inotify_fd >= 0) {
+		while (read(inotify_fd, buf, sizeof(buf)) > 0)
+			;
+	}
+
+	if (perms_file_changed(&st)) {
+		LOG_MSG("%s changed, reloading", CURR_PERMISSIONS_FILE);
+		perms_load();
+	}
+
+	TRACE2_EXIT("");
+}
+
+// is uid permitted to connect?
+gboolean
+perms_check(uid_t uid)
+{
+	gboolean ret;
+
+	TRACE2_ENTER("uid = %u", uid);
+
+	if (inotify_fd < 0) {
+		perms_refresh();
+	}
+
+	ret = permitted && g_hash_table_contains(permitted,
+			GUINT_TO_POINTER(uid));
+
+	TRACE2_EXIT("ret = %d", ret);
+
+	return ret;
+}
+
+//
+// perms_update - Apply a PwrPERMS request to the permitted set and the
+// permissions file.
+//
+// Returns PWR_RET_SUCCESS or PWR_RET_FAILURE.
+//
+int
+perms_update(const powerapi_permsreq_t *req)
+{
+	gpointer key = GUINT_TO_POINTER(req->uid);
+	int retval = 1;
+
+	TRACE1_ENTER("op = %d, uid = %u", req->op, req->uid);
+
+	// pick up any change made behind our back first
+	perms_refresh();
+
+	if (permitted == NULL && perms_load() != 0) {
+		goto done;
+	}
+
+	switch (req->op) {
+	case PwrPERMS_ADD:
+		retval = 0;
+		if (!g_hash_table_contains(permitted, key)) {
+			retval = perms_append(req->uid);
+			if (retval == 0) {
+				g_hash_table_add(permitted, key);
+			}
+		}
+		break;
+	case PwrPERMS_REMOVE:
+		retval = 0;
+		if (g_hash_table_remove(permitted, key)) {
+			retval = perms_save();
+		}
+		break;
+	case PwrPERMS_CLEAR:
+		g_hash_table_remove_all(permitted);
+		retval = perms_save();
+		break;
+	case PwrPERMS_RESTORE:
+		retval = restore_permissions_file();
+		if (retval == 0) {
+			retval = perms_load();
+		}
+		break;
+	default:
+		LOG_FAULT("Unknown permissions operation %d", req->op);
+		break;
+	}
+
+	// If the file couldn't be updated, go back to what's in it.
+	if (retval) {
+		perms_load();
+	}
+
+	LOG_MSG("Permissions op %d uid %u: %s", req->op, req->uid,
+			retval ? "failed" : "done");
+
+done:
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval ? PWR_RET_FAILURE : PWR_RET_SUCCESS;
+}
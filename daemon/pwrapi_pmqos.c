@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Hold a node's C-state limit as a PM QoS CPU latency request.
+ *
+ * Limiting the C-states of every hyperthread means writing the disable
+ * file of every deeper state of every hyperthread, which is hundreds of
+ * writes that take effect one cpu at a time.  A latency request written
+ * to /dev/cpu_dma_latency applies to every cpu at once: the cpuidle
+ * governors won't pick a state whose exit latency exceeds it.  The limit
+ * is turned into the latency just short of the shallowest state it
+ * excludes, using the state latencies read at startup.
+ *
+ * The request lasts as long as the device stays open, so it's dropped
+ * when the limit is, and by the kernel if the daemon dies.  Per-hyperthread
+ * C-state limits are still written to the disable files, and can only
+ * limit a hyperthread further.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <common.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_pmqos.h"
+
+#define PMQOS_DEVICE_PATH	"/dev/cpu_dma_latency"
+#define CSTATE_LATENCY_PATH	"/sys/devices/system/cpu/cpu0/cpuidle/state%d/latency"
+
+static gboolean  pq_enabled;
+static char     *pq_device;     // PM QoS device under the sysfs root
+static int       pq_fd = -1;    // open while a request is held
+static GArray   *pq_latencies;  // exit latency of each C-state, usec
+
+// read the exit latency of each of cpu0's C-states
+static void
+pmqos_read_latencies(const char *sysfs_root)
+{
+	char *path;
+	char *buf;
+	gint32 latency;
+	int i;
+
+	TRACE2_ENTER("sysfs_root = '%s'", sysfs_root);
+
+	for (i = 0; ; i++) {
+		path = g_strdup_printf("%s" CSTATE_LATENCY_PATH, sysfs_root, i);
+		if (!path) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		if (!g_file_get_contents(path, &buf, NULL, NULL)) {
+			g_free(path);
+			break;
+		}
+		latency = strtol(buf, NULL, 10);
+		g_array_append_val(pq_latencies, latency);
+		LOG_DBG("C-state %d exit latency is %d usec", i, latency);
+		g_free(buf);
+		g_free(path);
+	}
+
+	TRACE2_EXIT("num_cstates = %u", pq_latencies->len);
+}
+
+//
+// pmqos_set_cstate_limit - Hold the node to C-states no deeper than limit,
+// or drop the request for POWERAPID_NODE_CSTATE_NONE.  Called by the worker
+// that owns the node C-state limit file before writing it.
+//
+// Return Code(s):
+//
+//      0 - limit held
+//      1 - bad limit, or the request couldn't be made
+//
+int
+pmqos_set_cstate_limit(uint64_t limit)
+{
+	gint32 latency = G_MAXINT32;
+	ssize_t bytes;
+	int retval = 1;
+	guint i;
+
+	TRACE1_ENTER("limit = %ld", limit);
+
+	if (!pq_enabled) {
+		LOG_FAULT("Node C-state limits aren't held by PM QoS");
+		goto done;
+	}
+
+	if (limit != POWERAPID_NODE_CSTATE_NONE && limit >= pq_latencies->len) {
+		LOG_FAULT("Node C-state limit %ld out of range", limit);
+		goto done;
+	}
+
+	// The deepest state allowed needs no request.
+	if (limit == POWERAPID_NODE_CSTATE_NONE ||
+			limit == pq_latencies->len - 1) {
+		if (pq_fd >= 0) {
+			LOG_MSG("Dropping node C-state limit");
+			close(pq_fd);
+			pq_fd = -1;
+		}
+		retval = 0;
+		goto done;
+	}
+
+	// just short of the shallowest state excluded
+	for (i = limit + 1; i < pq_latencies->len; i++) {
+		latency = MIN(latency, g_array_index(pq_latencies, gint32, i));
+	}
+	latency = MAX(latency - 1, 0);
+
+	if (pq_fd < 0) {
+		pq_fd = open(pq_device, O_WRONLY | O_CLOEXEC);
+		if (pq_fd < 0) {
+			LOG_FAULT("Unable to open %s: %m", pq_device);
+			goto done;
+		}
+	}
+
+	// The device takes a binary s32 and applies it right away.
+	do {
+		bytes = pwrite(pq_fd, &latency, sizeof(latency), 0);
+	} while (bytes < 0 && errno == EINTR);
+	if (bytes != sizeof(latency)) {
+		LOG_FAULT("Unable to write %s: %m", pq_device);
+		goto done;
+	}
+
+	LOG_MSG("Node C-state limit %ld held as %d usec latency request",
+			limit, latency);
+	retval = 0;
+
+done:
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+//
+// pmqos_start - Read the C-state latencies under sysfs_root and put the
+// node C-state limit file in place, if enabled.  Any limit recovered from
+// the journal is held again.  Otherwise, the file is removed so clients
+// limit each hyperthread instead.
+//
+int
+pmqos_start(const char *sysfs_root, gboolean enabled)
+{
+	set_info_t *top;
+	int retval = 1;
+
+	TRACE1_ENTER("sysfs_root = '%s', enabled = %d", sysfs_root, enabled);
+
+	if (!enabled) {
+		unlink(PWR_NODE_CSTATE_PATH);
+		retval = 0;
+		goto done;
+	}
+
+	pq_latencies = g_array_new(FALSE, FALSE, sizeof(gint32));
+	pq_device = g_strconcat(sysfs_root, PMQOS_DEVICE_PATH, NULL);
+	if (!pq_latencies || !pq_device) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	pmqos_read_latencies(sysfs_root);
+	if (pq_latencies->len == 0) {
+		LOG_FAULT("No C-state latencies under '%s'", sysfs_root);
+		unlink(PWR_NODE_CSTATE_PATH);
+		goto done;
+	}
+	pq_enabled = TRUE;
+
+	top = set_top(PWR_NODE_CSTATE_PATH);
+	if (top) {
+		pmqos_set_cstate_limit(top->setreq.value.ivalue);
+	} else if (!g_file_set_contents(PWR_NODE_CSTATE_PATH, "-1", -1,
+			NULL)) {
+		LOG_FAULT("Unable to reset %s", PWR_NODE_CSTATE_PATH);
+	}
+
+	LOG_MSG("Node C-state limits held by PM QoS, %u C-states",
+			pq_latencies->len);
+	retval = 0;
+
+done:
+	if (retval) {
+		pmqos_stop();
+	}
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+//
+// pmqos_stop - Drop any request.  Must be called after the workers are
+// stopped.
+//
+void
+pmqos_stop(void)
+{
+	TRACE1_ENTER("pq_fd = %d", pq_fd);
+
+	if (pq_fd >= 0) {
+		close(pq_fd);
+		pq_fd = -1;
+	}
+	if (pq_latencies) {
+		g_array_free(pq_latencies, TRUE);
+		pq_latencies = NULL;
+	}
+	g_free(pq_device);
+	pq_device = NULL;
+	pq_enabled = FALSE;
+
+	TRACE1_EXIT("");
+}
@@ -0,0 +1,703 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Hold the node to a power budget.  Every period, node power is read from
+ * pm_counters and the power of each socket and memory RAPL domain from its
+ * energy counter.  A PI loop on the node power error (or a model of the
+ * power the RAPL domains don't see) gives the total RAPL power that meets
+ * the budget, which is divided among the domains by their recent use.
+ * The resulting limits are set through the worker queues like any client
+ * request, so that lower limits set by clients still take precedence.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <glob.h>
+#include <math.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <common.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_socket.h"
+#include "pwrapi_worker.h"
+#include "pwrapi_powercap.h"
+
+#define POWERCAP_KP		0.5	// proportional gain
+#define POWERCAP_KI		2.0	// integral gain, per second
+#define POWERCAP_MODEL_ALPHA	0.2	// smoothing of the model estimate
+#define POWERCAP_HEADROOM	0.1	// share above a domain's recent power
+#define POWERCAP_SLEW_RATE	50.0e6	// uW/s a limit may rise; it may
+					// fall at once
+#define POWERCAP_DEADBAND	1.0e6	// uW change needed to move a limit
+#define POWERCAP_MIN_FRACTION	0.25	// lowest limit, as part of the max
+
+#define RAPL_PATH		"/sys/class/powercap/intel-rapl"
+#define RAPL_PKG_PATTERN	RAPL_PATH "/intel-rapl:*"
+#define RAPL_SUB_PATTERN	RAPL_PATH "/intel-rapl:*/intel-rapl:*:*"
+#define NODE_POWER_PATH		"/sys/cray/pm_counters/power"
+
+#define POWERCAP_CONTEXT_NAME	"powercap" // internal session's context
+
+// A RAPL domain whose limit is controlled.  Power and limits are in uW.
+typedef struct {
+	PWR_ObjType object;     // PWR_OBJ_SOCKET or PWR_OBJ_MEM
+	char       *limit_path; // constraint_0_power_limit_uw
+	int         energy_fd;  // open descriptor for energy_uj
+	uint64_t    range;      // energy counter wrap value
+	double      min;        // lowest limit the controller sets
+	double      max;        // highest limit the controller sets
+	gboolean    primed;     // prev_energy/prev_time are valid
+	uint64_t    prev_energy;
+	gint64      prev_time;  // usec, monotonic
+	double      power;      // power over the last period
+	double      limit;      // limit last requested, 0 if none
+} powercap_domain_t;
+
+static powercap_mode_t    pc_mode = POWERCAP_NONE;
+static powercap_domain_t *pc_domains = NULL;
+static guint              pc_num_domains = 0;
+static int                pc_node_fd = -1;
+static GThread           *pc_thread = NULL;
+
+// pc_lock is never cleared, since workers may change the budget while
+// the controller is being stopped.  The following are guarded by it.
+static GMutex             pc_lock;
+static GCond              pc_cond;
+static gboolean           pc_running = FALSE;
+static gboolean           pc_stopping = FALSE;
+static uint64_t           pc_budget = POWERAPID_NODE_BUDGET_NONE;
+static socket_info_t     *pc_skinfo = NULL;  // owner of the limits set
+static gboolean           pc_primed = FALSE; // controller state is valid
+static gint64             pc_prev_time = 0;  // usec, monotonic
+static double             pc_target = 0.0;   // total RAPL power wanted
+static double             pc_prev_error = 0.0;
+static double             pc_estimate = 0.0; // node power not in RAPL
+
+static int
+powercap_read_fd(int fd, uint64_t *value)
+{
+	char buf[32];
+	char *end = NULL;
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0) {
+		return 1;
+	}
+	buf[len] = '\0';
+
+	errno = 0;
+	*value = strtoull(buf, &end, 10);
+	if (errno || end == buf) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static int
+powercap_read_file(const char *dir, const char *name, uint64_t *value)
+{
+	char *path = g_build_filename(dir, name, NULL);
+	int retval = 1;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		retval = powercap_read_fd(fd, value);
+		close(fd);
+	}
+
+	g_free(path);
+
+	return retval;
+}
+
+//
+// powercap_add_domain - Add a RAPL domain directory to the controlled
+// domains if it's a package or DRAM domain with a usable limit.  The
+// controller never raises a limit above the domain's default, as recorded
+// when a limit was first set, or its maximum power.  The limit in place
+// can't be used once a default was recorded, since it may be left from an
+// earlier controller or a client and would ratchet the range down across
+// restarts.  Until then nothing has set it, so it is the default, which
+// is all there is to go on for a DRAM domain without a maximum power.
+//
+static void
+powercap_add_domain(const char *dir)
+{
+	powercap_domain_t *domain = &pc_domains[pc_num_domains];
+	set_info_t *defset;
+	char *name = NULL;
+	char *name_path = g_build_filename(dir, "name", NULL);
+	char *energy_path = NULL;
+	char *limit_path = NULL;
+	uint64_t def_limit = 0;
+	uint64_t max_power = 0;
+	uint64_t range = 0;
+
+	TRACE2_ENTER("dir = '%s'", dir);
+
+	if (!g_file_get_contents(name_path, &name, NULL, NULL)) {
+		goto done;
+	}
+	g_strstrip(name);
+
+	if (g_str_has_prefix(name, "package")) {
+		domain->object = PWR_OBJ_SOCKET;
+	} else if (strcmp(name, "dram") == 0) {
+		domain->object = PWR_OBJ_MEM;
+	} else {
+		goto done;
+	}
+
+	limit_path = g_build_filename(dir, "constraint_0_power_limit_uw", NULL);
+
+	g_mutex_lock(&changes_lock);
+	defset = g_hash_table_lookup(def_values, limit_path);
+	if (defset) {
+		def_limit = defset->setreq.value.ivalue;
+	}
+	g_mutex_unlock(&changes_lock);
+
+	if (def_limit == 0) {
+		powercap_read_file(dir, "constraint_0_power_limit_uw",
+				&def_limit);
+	}
+	powercap_read_file(dir, "constraint_0_max_power_uw", &max_power);
+
+	domain->max = def_limit ? def_limit : max_power;
+	if (max_power && max_power < domain->max) {
+		domain->max = max_power;
+	}
+	if (domain->max <= 0) {
+		LOG_MSG("No default or maximum power limit for %s, "
+				"not controlled", dir);
+		goto done;
+	}
+	domain->min = domain->max * POWERCAP_MIN_FRACTION;
+
+	// The counter wraps to zero after reaching the range value
+	domain->range = 1UL << 32;
+	if (powercap_read_file(dir, "max_energy_range_uj", &range) == 0 &&
+			range != 0) {
+		domain->range = range + 1;
+	}
+
+	energy_path = g_build_filename(dir, "energy_uj", NULL);
+	domain->energy_fd = open(energy_path, O_RDONLY | O_CLOEXEC);
+	if (domain->energy_fd < 0) {
+		LOG_DBG("Unable to open %s: %m", energy_path);
+		goto done;
+	}
+
+	domain->limit_path = limit_path;
+	limit_path = NULL;
+
+	LOG_MSG("Controlling %s power limit of %s, %.0f to %.0f uW", name,
+			dir, domain->min, domain->max);
+
+	pc_num_domains++;
+
+done:
+	g_free(limit_path);
+	g_free(energy_path);
+	g_free(name_path);
+	g_free(name);
+
+	TRACE2_EXIT("pc_num_domains = %u", pc_num_domains);
+}
+
+// Measure a domain's power over the last period.  Returns 0 once the
+// power is valid.
+static int
+powercap_measure_domain(powercap_domain_t *domain, gint64 now)
+{
+	uint64_t energy = 0;
+	uint64_t delta;
+
+	if (powercap_read_fd(domain->energy_fd, &energy) != 0) {
+		domain->primed = FALSE;
+		return 1;
+	}
+
+	if (!domain->primed || now <= domain->prev_time) {
+		domain->primed = TRUE;
+		domain->prev_energy = energy;
+		domain->prev_time = now;
+		return 1;
+	}
+
+	delta = energy - domain->prev_energy;
+	if (energy < domain->prev_energy) {
+		delta += domain->range;
+	}
+
+	domain->power = (double)delta * G_USEC_PER_SEC
+			/ (now - domain->prev_time);
+	domain->prev_energy = energy;
+	domain->prev_time = now;
+
+	return 0;
+}
+
+// Ask the workers to set a domain's limit on behalf of the controller.
+static void
+powercap_request_limit(powercap_domain_t *domain, double limit)
+{
+	powerapi_setreq_t setreq = {
+		.object    = domain->object,
+		.attribute = PWR_ATTR_POWER_LIMIT_MAX,
+		.data_type = PWR_ATTR_DATA_UINT64,
+		.metadata  = PWR_MD_NOT_SPECIFIED,
+	};
+
+	TRACE2_ENTER("domain = %p, limit = %lf", domain, limit);
+
+	setreq.value.ivalue = limit;
+	g_strlcpy(setreq.path, domain->limit_path, sizeof(setreq.path));
+
+	if (pc_skinfo == NULL) {
+		pc_skinfo = socket_internal_create(PWR_ROLE_MC,
+				POWERCAP_CONTEXT_NAME, FALSE);
+	}
+
+	socket_ref(pc_skinfo);
+	worker_queue_set(set_create_item(&setreq, pc_skinfo));
+
+	domain->limit = limit;
+
+	TRACE2_EXIT("");
+}
+
+//
+// powercap_distribute - Divide the total RAPL power target among the
+// domains.  Each domain wants a little more than it has been using.  If
+// the wants don't fit, every domain gives up the same fraction of what
+// it wants above its minimum; if they do, the rest is handed out in
+// proportion to how far each domain is below its maximum.
+//
+static void
+powercap_distribute(double target, double dt)
+{
+	double sum_min = 0.0, sum_want = 0.0, sum_max = 0.0;
+	double fraction = 0.0;
+	guint i;
+
+	TRACE2_ENTER("target = %lf, dt = %lf", target, dt);
+
+	for (i = 0; i < pc_num_domains; i++) {
+		powercap_domain_t *domain = &pc_domains[i];
+		double want = domain->power * (1.0 + POWERCAP_HEADROOM);
+
+		sum_min += domain->min;
+		sum_want += CLAMP(want, domain->min, domain->max);
+		sum_max += domain->max;
+	}
+
+	if (sum_want >= target) {
+		if (sum_want > sum_min) {
+			fraction = (target - sum_min) / (sum_want - sum_min);
+		}
+	} else if (sum_max > sum_want) {
+		fraction = (target - sum_want) / (sum_max - sum_want);
+	}
+
+	for (i = 0; i < pc_num_domains; i++) {
+		powercap_domain_t *domain = &pc_domains[i];
+		double want = CLAMP(domain->power * (1.0 + POWERCAP_HEADROOM),
+				domain->min, domain->max);
+		double limit;
+
+		if (sum_want >= target) {
+			limit = domain->min + fraction * (want - domain->min);
+		} else {
+			limit = want + fraction * (domain->max - want);
+		}
+
+		// Raise limits gradually so that a burst of headroom doesn't
+		// overshoot the budget before the next period sees it.
+		if (domain->limit > 0.0 &&
+				limit > domain->limit + POWERCAP_SLEW_RATE * dt) {
+			limit = domain->limit + POWERCAP_SLEW_RATE * dt;
+		}
+
+		if (domain->limit == 0.0 ||
+				fabs(limit - domain->limit) >= POWERCAP_DEADBAND) {
+			powercap_request_limit(domain, limit);
+		}
+	}
+
+	TRACE2_EXIT("");
+}
+
+//
+// powercap_step - Run one period of the controller.  The caller must
+// hold pc_lock.
+//
+static void
+powercap_step(void)
+{
+	gint64 now = g_get_monotonic_time();
+	double rapl_power = 0.0, node_power, error, dt;
+	double sum_min = 0.0, sum_max = 0.0;
+	uint64_t ivalue = 0;
+	int measured = TRUE;
+	guint i;
+
+	TRACE2_ENTER("pc_budget = %lu", pc_budget);
+
+	for (i = 0; i < pc_num_domains; i++) {
+		if (powercap_measure_domain(&pc_domains[i], now) != 0) {
+			measured = FALSE;
+		}
+		rapl_power += pc_domains[i].power;
+		sum_min += pc_domains[i].min;
+		sum_max += pc_domains[i].max;
+	}
+	if (!measured) {
+		goto done;
+	}
+
+	// pm_counters reports watts; without it, RAPL is all there is.
+	if (pc_node_fd >= 0 && powercap_read_fd(pc_node_fd, &ivalue) == 0) {
+		node_power = ivalue * 1.0e6;
+	} else {
+		node_power = rapl_power;
+	}
+
+	error = pc_budget - node_power;
+	dt = (now - pc_prev_time) / (double)G_USEC_PER_SEC;
+
+	if (!pc_primed) {
+		pc_target = rapl_power + error;
+		pc_estimate = node_power - rapl_power;
+		pc_primed = TRUE;
+	} else if (pc_mode == POWERCAP_PI) {
+		// velocity form, so clamping the target also stops windup
+		pc_target += POWERCAP_KP * (error - pc_prev_error)
+				+ POWERCAP_KI * error * dt;
+	} else {
+		pc_estimate += POWERCAP_MODEL_ALPHA
+				* ((node_power - rapl_power) - pc_estimate);
+		pc_target = pc_budget - pc_estimate;
+	}
+	pc_target = CLAMP(pc_target, sum_min, sum_max);
+	pc_prev_error = error;
+	pc_prev_time = now;
+
+	LOG_DBG("Node power %.0f uW, RAPL power %.0f uW, budget %lu uW, "
+			"RAPL target %.0f uW", node_power, rapl_power,
+			pc_budget, pc_target);
+
+	powercap_distribute(pc_target, dt);
+
+done:
+	TRACE2_EXIT("");
+}
+
+static gpointer
+powercap_run(gpointer data)
+{
+	gint64 interval = POWERCAP_PERIOD * 1000;   // usec
+	gint64 next = g_get_monotonic_time();
+
+	TRACE1_ENTER("data = %p", data);
+
+	g_mutex_lock(&pc_lock);
+	while (!pc_stopping) {
+		if (pc_budget != POWERAPID_NODE_BUDGET_NONE) {
+			powercap_step();
+		}
+
+		// Run on a fixed schedule.  If a step fell behind, skip the
+		// missed periods rather than running back to back.
+		next += interval;
+		if (next < g_get_monotonic_time()) {
+			next = g_get_monotonic_time() + interval;
+		}
+		while (!pc_stopping
+				&& g_cond_wait_until(&pc_cond, &pc_lock, next))
+			;
+	}
+	g_mutex_unlock(&pc_lock);
+
+	TRACE1_EXIT("");
+
+	return NULL;
+}
+
+//
+// powercap_release - Drop the controller's limits, which the workers roll
+// back to whatever clients or the defaults call for.  The caller must
+// hold pc_lock.
+//
+static void
+powercap_release(void)
+{
+	guint i;
+
+	TRACE2_ENTER("pc_skinfo = %p", pc_skinfo);
+
+	if (pc_skinfo) {
+		worker_release(pc_skinfo);
+		socket_unref(pc_skinfo);
+		pc_skinfo = NULL;
+	}
+
+	for (i = 0; i < pc_num_domains; i++) {
+		pc_domains[i].limit = 0.0;
+	}
+	pc_primed = FALSE;
+
+	TRACE2_EXIT("");
+}
+
+//
+// powercap_start - Find the RAPL domains under sysfs_root and start the
+// controller thread.  The node budget is picked up from any set recovered
+// from the journal; otherwise the budget file is reset to hold none.  With
+// no controller, the file is removed so clients limit each socket and
+// memory object instead.  The
+// limits of a controller this daemon replaces are taken over, to be
+// replaced by this controller's, or dropped if it has no budget to hold.
+// Failure here isn't fatal: node power limits just can't be set.
+//
+int
+powercap_start(const char *sysfs_root, powercap_mode_t mode)
+{
+	const char *patterns[] = { RAPL_PKG_PATTERN, RAPL_SUB_PATTERN };
+	glob_t globs[G_N_ELEMENTS(patterns)];
+	set_info_t *top;
+	size_t num_paths = 0;
+	char *path;
+	int retval = 1;
+	size_t i, j;
+
+	TRACE1_ENTER("sysfs_root = '%s', mode = %d", sysfs_root, mode);
+
+	memset(globs, 0, sizeof(globs));
+
+	pc_skinfo = socket_internal_reclaim(PWR_ROLE_MC, POWERCAP_CONTEXT_NAME);
+
+	if (mode == POWERCAP_NONE) {
+		LOG_DBG("Power cap controller disabled");
+		unlink(PWR_NODE_BUDGET_PATH);
+		retval = 0;
+		goto done;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(patterns); i++) {
+		path = g_strconcat(sysfs_root, patterns[i], NULL);
+		if (glob(path, GLOB_ONLYDIR, NULL, &globs[i]) == 0) {
+			num_paths += globs[i].gl_pathc;
+		}
+		g_free(path);
+	}
+
+	pc_domains = g_new0(powercap_domain_t, MAX(num_paths, 1));
+	if (!pc_domains) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(patterns); i++) {
+		for (j = 0; j < globs[i].gl_pathc; j++) {
+			powercap_add_domain(globs[i].gl_pathv[j]);
+		}
+	}
+
+	if (pc_num_domains == 0) {
+		LOG_MSG("No RAPL power limits, power cap controller disabled");
+		unlink(PWR_NODE_BUDGET_PATH);
+		goto done;
+	}
+
+	top = set_top(PWR_NODE_BUDGET_PATH);
+	if (top) {
+		pc_budget = top->setreq.value.ivalue;
+	} else if (!g_file_set_contents(PWR_NODE_BUDGET_PATH, "-1", -1,
+			NULL)) {
+		LOG_FAULT("Unable to reset %s", PWR_NODE_BUDGET_PATH);
+	}
+
+	path = g_strconcat(sysfs_root, NODE_POWER_PATH, NULL);
+	pc_node_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (pc_node_fd < 0) {
+		LOG_WARN("Unable to open %s, capping RAPL power only: %m", path);
+	}
+	g_free(path);
+
+	pc_mode = mode;
+
+	g_mutex_lock(&pc_lock);
+	pc_running = TRUE;
+	pc_stopping = FALSE;
+	g_mutex_unlock(&pc_lock);
+
+	pc_thread = g_thread_new("powercap", powercap_run, NULL);
+	if (pc_thread == NULL) {
+		LOG_CRIT("Unable to create power cap thread!");
+		exit(1);
+	}
+
+	LOG_MSG("Power cap controller (%s) running on %u RAPL domains",
+			(mode == POWERCAP_PI) ? "PI" : "model", pc_num_domains);
+
+	retval = 0;
+
+done:
+	for (i = 0; i < G_N_ELEMENTS(patterns); i++) {
+		globfree(&globs[i]);
+	}
+	if (retval) {
+		for (i = 0; i < pc_num_domains; i++) {
+			close(pc_domains[i].energy_fd);
+			g_free(pc_domains[i].limit_path);
+		}
+		g_free(pc_domains);
+		pc_domains = NULL;
+		pc_num_domains = 0;
+	}
+
+	g_mutex_lock(&pc_lock);
+	if (pc_skinfo && (!pc_running ||
+			pc_budget == POWERAPID_NODE_BUDGET_NONE)) {
+		LOG_MSG("Dropping the power limits of the previous controller");
+		powercap_release();
+	}
+	g_mutex_unlock(&pc_lock);
+
+	TRACE1_EXIT("retval = %d, pc_num_domains = %u", retval, pc_num_domains);
+
+	return retval;
+}
+
+//
+// powercap_stop - Stop the controller and drop its limits, unless a daemon
+// taking over is to keep them until its own controller is running.  Must
+// be called before the workers are stopped.
+//
+void
+powercap_stop(gboolean release)
+{
+	guint i;
+
+	TRACE1_ENTER("pc_thread = %p, release = %d", pc_thread, release);
+
+	if (pc_thread == NULL) {
+		goto done;
+	}
+
+	g_mutex_lock(&pc_lock);
+	pc_stopping = TRUE;
+	g_cond_signal(&pc_cond);
+	g_mutex_unlock(&pc_lock);
+
+	g_thread_join(pc_thread);
+	pc_thread = NULL;
+
+	g_mutex_lock(&pc_lock);
+	if (release) {
+		powercap_release();
+	} else if (pc_skinfo) {
+		// its session is journaled, and reclaimed by the next daemon
+		socket_unref(pc_skinfo);
+		pc_skinfo = NULL;
+	}
+	pc_running = FALSE;
+	g_mutex_unlock(&pc_lock);
+
+	for (i = 0; i < pc_num_domains; i++) {
+		close(pc_domains[i].energy_fd);
+		g_free(pc_domains[i].limit_path);
+	}
+	g_free(pc_domains);
+	pc_domains = NULL;
+	pc_num_domains = 0;
+
+	if (pc_node_fd >= 0) {
+		close(pc_node_fd);
+		pc_node_fd = -1;
+	}
+	pc_mode = POWERCAP_NONE;
+
+done:
+	TRACE1_EXIT("");
+}
+
+//
+// powercap_set_budget - Change the node power budget, in uW.  Called by
+// the worker that owns the budget file before writing it.  Removing the
+// budget drops the controller's limits right away, so that they are
+// rolled back along with the client's set that held the budget.
+//
+// Return Code(s):
+//
+//      0 - budget accepted
+//      1 - no controller is running to enforce a budget
+//
+int
+powercap_set_budget(uint64_t budget)
+{
+	int retval = 0;
+
+	TRACE1_ENTER("budget = %lu", budget);
+
+	g_mutex_lock(&pc_lock);
+	if (!pc_running) {
+		if (budget != POWERAPID_NODE_BUDGET_NONE) {
+			retval = 1;
+		}
+	} else if (budget != pc_budget) {
+		LOG_MSG("Node power budget changed from %ld to %ld uW",
+				pc_budget, budget);
+		pc_budget = budget;
+		if (budget == POWERAPID_NODE_BUDGET_NONE) {
+			powercap_release();
+		}
+		g_cond_signal(&pc_cond);
+	}
+	g_mutex_unlock(&pc_lock);
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
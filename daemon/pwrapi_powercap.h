@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Declare functions to hold the node to a power budget by adjusting the
+ * socket and memory RAPL limits.
+ */
+
+#ifndef _POWERAPI_POWERCAP_H
+#define _POWERAPI_POWERCAP_H
+
+#include <stdint.h>
+
+#include <glib.h>
+
+// how the controller finds the RAPL power that meets the node budget
+typedef enum {
+	POWERCAP_NONE = 0,	// controller disabled
+	POWERCAP_PI,		// PI loop on the node power error
+	POWERCAP_MODEL,		// node power = RAPL power + estimated rest
+} powercap_mode_t;
+
+#define POWERCAP_PERIOD		100	// msec, matches pm_counters update rate
+
+int  powercap_start(const char *sysfs_root, powercap_mode_t mode);
+void powercap_stop(gboolean release);
+int  powercap_set_budget(uint64_t budget);
+
+#endif // _POWERAPI_POWERCAP_H
@@ -0,0 +1,606 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Take set requests from clients' shared memory request rings.
+ *
+ * Sending a set request over the socket costs the client a write and a
+ * blocking read, and the daemon a wakeup of the main thread, a read and
+ * a write, each a system call and most of them a context switch.  A
+ * client may instead ask for a request ring: a memfd it maps, holding a
+ * ring of set requests and a ring of responses, with an eventfd in each
+ * direction to wake a side that has gone to sleep.  The ring thread takes
+ * requests off every ring and queues them to the workers, which put
+ * their responses on the response ring.  While the daemon is busy, a
+ * burst of requests costs no system calls beyond the writes themselves.
+ *
+ * The ring is only handed out over an authorized socket, so the client's
+ * credentials are still those of the socket, which the client keeps open
+ * and whose closing still ends the session.  The memfd is sealed at its
+ * size, so the client can't shrink it out from under the daemon, and
+ * everything taken from it is copied out before it's looked at.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_socket.h"
+#include "pwrapi_worker.h"
+#include "pwrapi_stats.h"
+#include "pwrapi_ring.h"
+
+#define RING_EVENTS	32	// events taken per epoll_wait()
+
+// rg_rings holds the socket of each ring taking requests, keyed by its
+// request eventfd.  rg_lock protects it and is held while a ring's
+// requests are taken, so that none are taken once ring_detach() returns.
+static GMutex      rg_lock;
+static GHashTable *rg_rings = NULL;
+static int         rg_epoll_fd = -1;
+static int         rg_stop_fd = -1;
+static GThread    *rg_thread = NULL;
+
+// map a ring's memfd, which must hold a powerapi_ring_t
+static int
+ring_map(struct ring_info *rinfo)
+{
+	struct stat st;
+	void *addr;
+
+	if (fstat(rinfo->fds[RING_MEM_FD], &st) != 0 ||
+			st.st_size != sizeof(powerapi_ring_t)) {
+		LOG_FAULT("Request ring is the wrong size");
+		return 1;
+	}
+
+	addr = mmap(NULL, sizeof(powerapi_ring_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED, rinfo->fds[RING_MEM_FD], 0);
+	if (addr == MAP_FAILED) {
+		LOG_FAULT("Unable to map request ring: %m");
+		return 1;
+	}
+	rinfo->ring = addr;
+
+	return 0;
+}
+
+// start taking requests from a socket's ring; called with rg_lock held
+static void
+ring_register(socket_info_t *skinfo)
+{
+	struct epoll_event event = { .events = EPOLLIN };
+
+	TRACE2_ENTER("skinfo = %p", skinfo);
+
+	if (rg_rings == NULL) {
+		rg_rings = g_hash_table_new(g_int_hash, g_int_equal);
+		if (!rg_rings) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+	}
+	g_hash_table_insert(rg_rings, &skinfo->ring->fds[RING_REQ_FD], skinfo);
+
+	if (rg_epoll_fd >= 0) {
+		event.data.fd = skinfo->ring->fds[RING_REQ_FD];
+		if (epoll_ctl(rg_epoll_fd, EPOLL_CTL_ADD, event.data.fd,
+				&event) != 0) {
+			LOG_FAULT("Unable to watch request ring: %m");
+		}
+	}
+
+	TRACE2_EXIT("");
+}
+
+// stop taking requests from a socket's ring; called with rg_lock held
+static void
+ring_unregister(socket_info_t *skinfo)
+{
+	int fd = skinfo->ring->fds[RING_REQ_FD];
+
+	TRACE2_ENTER("skinfo = %p", skinfo);
+
+	if (rg_rings && g_hash_table_remove(rg_rings, &fd) &&
+			rg_epoll_fd >= 0) {
+		epoll_ctl(rg_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	}
+
+	TRACE2_EXIT("");
+}
+
+// queue a set request taken from a ring to its worker
+static void
+ring_take(socket_info_t *skinfo, const powerapi_setreq_t *slot)
+{
+	powerapi_setreq_t setreq;
+	set_info_t *setp;
+	uint64_t start = stats_now();
+
+	TRACE2_ENTER("skinfo = %p, slot = %p", skinfo, slot);
+
+	// The client may still be writing to the slot.
+	memcpy(&setreq, slot, sizeof(setreq));
+	setreq.path[sizeof(setreq.path) - 1] = '\0';
+
+	stats_count(STATS_REQUESTS, 1);
+	stats_count(STATS_SETS, 1);
+	stats_count(STATS_RING_SETS, 1);
+
+	setp = set_create_item(&setreq, skinfo);
+	setp->on_ring = TRUE;
+	socket_ref(skinfo);
+	worker_queue_set(setp);
+
+	stats_record(STATS_PARSE, start);
+
+	TRACE2_EXIT("");
+}
+
+// take every request on a socket's ring; called with rg_lock held
+static void
+ring_service(socket_info_t *skinfo)
+{
+	struct ring_info *rinfo = skinfo->ring;
+	powerapi_ring_t *ring = rinfo->ring;
+	uint64_t count;
+	uint32_t head;
+
+	TRACE2_ENTER("skinfo = %p", skinfo);
+
+	if (read(rinfo->fds[RING_REQ_FD], &count, sizeof(count)) > 0) {
+		stats_count(STATS_RING_WAKEUPS, 1);
+	}
+
+	__atomic_store_n(&ring->daemon_idle, 0, __ATOMIC_SEQ_CST);
+	for (;;) {
+		head = __atomic_load_n(&ring->req_head, __ATOMIC_ACQUIRE);
+		if (head == rinfo->req_tail) {
+			// Go idle, unless a request came in meanwhile.
+			__atomic_store_n(&ring->daemon_idle, 1, __ATOMIC_SEQ_CST);
+			head = __atomic_load_n(&ring->req_head,
+					__ATOMIC_SEQ_CST);
+			if (head == rinfo->req_tail) {
+				break;
+			}
+			__atomic_store_n(&ring->daemon_idle, 0,
+					__ATOMIC_SEQ_CST);
+		}
+
+		if (head - rinfo->req_tail > POWERAPI_RING_SLOTS) {
+			LOG_FAULT("Client %d overran its request ring, "
+					"ignoring it", skinfo->sockid);
+			ring_unregister(skinfo);
+			break;
+		}
+
+		while (rinfo->req_tail != head) {
+			ring_take(skinfo, &ring->req[rinfo->req_tail %
+					POWERAPI_RING_SLOTS]);
+			rinfo->req_tail++;
+		}
+		__atomic_store_n(&ring->req_tail, rinfo->req_tail,
+				__ATOMIC_RELEASE);
+	}
+
+	TRACE2_EXIT("req_tail = %u", rinfo->req_tail);
+}
+
+static gpointer
+ring_run(gpointer data)
+{
+	struct epoll_event events[RING_EVENTS];
+	socket_info_t *skinfo;
+	int i, n;
+
+	TRACE1_ENTER("data = %p", data);
+
+	for (;;) {
+		n = epoll_wait(rg_epoll_fd, events, RING_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			LOG_CRIT("Request ring wait failed: %m");
+			exit(1);
+		}
+
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == rg_stop_fd) {
+				goto done;
+			}
+
+			g_mutex_lock(&rg_lock);
+			skinfo = g_hash_table_lookup(rg_rings, &events[i].data.fd);
+			if (skinfo) {
+				ring_service(skinfo);
+			}
+			g_mutex_unlock(&rg_lock);
+		}
+	}
+
+done:
+	TRACE1_EXIT("");
+
+	return NULL;
+}
+
+//
+// ring_start - Start the thread taking requests from the rings.  Rings
+// taken over from the previous daemon are serviced right away.  Must be
+// called after the workers are started.
+//
+void
+ring_start(void)
+{
+	struct epoll_event event = { .events = EPOLLIN };
+	GHashTableIter iter;
+	gpointer value;
+
+	TRACE1_ENTER("");
+
+	rg_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	rg_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (rg_epoll_fd < 0 || rg_stop_fd < 0) {
+		LOG_CRIT("Unable to create request ring events: %m");
+		exit(1);
+	}
+
+	event.data.fd = rg_stop_fd;
+	epoll_ctl(rg_epoll_fd, EPOLL_CTL_ADD, rg_stop_fd, &event);
+
+	g_mutex_lock(&rg_lock);
+	if (rg_rings) {
+		g_hash_table_iter_init(&iter, rg_rings);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			socket_info_t *skinfo = value;
+
+			event.data.fd = skinfo->ring->fds[RING_REQ_FD];
+			epoll_ctl(rg_epoll_fd, EPOLL_CTL_ADD, event.data.fd,
+					&event);
+		}
+	}
+	g_mutex_unlock(&rg_lock);
+
+	rg_thread = g_thread_new("rings", ring_run, NULL);
+	if (rg_thread == NULL) {
+		LOG_CRIT("Unable to create request ring thread!");
+		exit(1);
+	}
+
+	TRACE1_EXIT("");
+}
+
+//
+// ring_stop - Stop taking requests from the rings.  The rings stay with
+// their sockets, to be handed over or closed with them.  Must be called
+// before the workers are stopped.
+//
+void
+ring_stop(void)
+{
+	uint64_t one = 1;
+
+	TRACE1_ENTER("rg_thread = %p", rg_thread);
+
+	if (rg_thread == NULL) {
+		goto done;
+	}
+
+	if (write(rg_stop_fd, &one, sizeof(one)) != sizeof(one)) {
+		LOG_FAULT("Unable to stop request ring thread: %m");
+	}
+	g_thread_join(rg_thread);
+	rg_thread = NULL;
+
+	close(rg_epoll_fd);
+	rg_epoll_fd = -1;
+	close(rg_stop_fd);
+	rg_stop_fd = -1;
+
+done:
+	TRACE1_EXIT("");
+}
+
+// send the response to a PwrSHMEM request, with the ring's descriptors
+static int
+ring_send_fds(socket_info_t *skinfo, struct ring_info *rinfo)
+{
+	powerapi_response_t resp = { .retval = PWR_RET_SUCCESS };
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(rinfo->fds))];
+	} cmsg;
+	struct iovec iov = { .iov_base = &resp, .iov_len = sizeof(resp) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg.buf,
+		.msg_controllen = sizeof(cmsg.buf),
+	};
+	ssize_t bytes;
+
+	memset(&cmsg, 0, sizeof(cmsg));
+	cmsg.hdr.cmsg_level = SOL_SOCKET;
+	cmsg.hdr.cmsg_type = SCM_RIGHTS;
+	cmsg.hdr.cmsg_len = CMSG_LEN(sizeof(rinfo->fds));
+	memcpy(CMSG_DATA(&cmsg.hdr), rinfo->fds, sizeof(rinfo->fds));
+
+	g_mutex_lock(socket_reply_lock(skinfo));
+	resp.sequence = skinfo->seqnum++;
+	bytes = sendmsg(skinfo->sockid, &msg, MSG_NOSIGNAL);
+	g_mutex_unlock(socket_reply_lock(skinfo));
+
+	if (bytes != sizeof(resp)) {
+		LOG_FAULT("Response write error: fd = %d: %m", skinfo->sockid);
+		return 1;
+	}
+
+	return 0;
+}
+
+//
+// ring_attach - Create a request ring for an authorized socket and send
+// it to the client in response to its PwrSHMEM request.
+//
+// Return Code(s):
+//
+//      0 - the response was sent, or the socket failed while sending it
+//      1 - the ring couldn't be created, nothing was sent
+//
+int
+ring_attach(socket_info_t *skinfo)
+{
+	struct ring_info *rinfo;
+	int retval = 1;
+	int i;
+
+	TRACE1_ENTER("skinfo = %p", skinfo);
+
+	rinfo = g_new0(struct ring_info, 1);
+	if (!rinfo) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	for (i = 0; i < POWERAPI_RING_FDS; i++) {
+		rinfo->fds[i] = -1;
+	}
+
+	rinfo->fds[RING_MEM_FD] = memfd_create("powerapid-ring",
+			MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (rinfo->fds[RING_MEM_FD] < 0 ||
+			ftruncate(rinfo->fds[RING_MEM_FD],
+				sizeof(powerapi_ring_t)) != 0 ||
+			fcntl(rinfo->fds[RING_MEM_FD], F_ADD_SEALS,
+				F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+		LOG_FAULT("Unable to create request ring: %m");
+		goto done;
+	}
+	if (ring_map(rinfo) != 0) {
+		goto done;
+	}
+
+	rinfo->fds[RING_REQ_FD] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	rinfo->fds[RING_RESP_FD] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (rinfo->fds[RING_REQ_FD] < 0 || rinfo->fds[RING_RESP_FD] < 0) {
+		LOG_FAULT("Unable to create request ring events: %m");
+		goto done;
+	}
+
+	rinfo->ring->magic = POWERAPI_RING_MAGIC;
+	rinfo->ring->version = POWERAPI_RING_VERSION;
+	rinfo->ring->daemon_idle = 1;
+
+	retval = 0;
+
+	if (ring_send_fds(skinfo, rinfo) != 0) {
+		goto done;
+	}
+
+	g_mutex_lock(&rg_lock);
+	skinfo->ring = rinfo;
+	ring_register(skinfo);
+	g_mutex_unlock(&rg_lock);
+	rinfo = NULL;
+
+	LOG_DBG("Client %d attached a request ring", skinfo->sockid);
+
+done:
+	if (rinfo) {
+		ring_destroy(rinfo);
+	}
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+//
+// ring_adopt - Take requests from a ring taken over from the previous
+// daemon, which kept its indexes in the ring.  The ring is serviced once
+// the ring thread starts, in case the previous daemon was in the middle
+// of taking requests and the client isn't going to wake this one.
+//
+// Return Code(s):
+//
+//      0 - the ring was adopted
+//      1 - the ring was unusable, and its descriptors closed
+//
+int
+ring_adopt(socket_info_t *skinfo, const int *fds)
+{
+	struct ring_info *rinfo;
+	int retval = 1;
+
+	TRACE1_ENTER("skinfo = %p", skinfo);
+
+	rinfo = g_new0(struct ring_info, 1);
+	if (!rinfo) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+	memcpy(rinfo->fds, fds, sizeof(rinfo->fds));
+
+	if (ring_map(rinfo) != 0) {
+		goto done;
+	}
+	if (rinfo->ring->magic != POWERAPI_RING_MAGIC ||
+			rinfo->ring->version != POWERAPI_RING_VERSION) {
+		LOG_FAULT("Request ring of client %d has an unknown version",
+				skinfo->sockid);
+		goto done;
+	}
+	rinfo->req_tail = rinfo->ring->req_tail;
+	rinfo->resp_head = rinfo->ring->resp_head;
+
+	g_mutex_lock(&rg_lock);
+	skinfo->ring = rinfo;
+	ring_register(skinfo);
+	g_mutex_unlock(&rg_lock);
+	rinfo = NULL;
+
+	if (eventfd_write(fds[RING_REQ_FD], 1) != 0) {
+		LOG_FAULT("Unable to wake request ring: %m");
+	}
+
+	retval = 0;
+
+done:
+	if (rinfo) {
+		ring_destroy(rinfo);
+	}
+
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+//
+// ring_detach - Stop taking requests from a closed socket's ring.  No
+// request is taken once this returns, but the workers may still respond
+// to those already queued, so the ring lasts as long as the socket.
+//
+void
+ring_detach(socket_info_t *skinfo)
+{
+	TRACE1_ENTER("skinfo = %p", skinfo);
+
+	if (skinfo->ring) {
+		g_mutex_lock(&rg_lock);
+		ring_unregister(skinfo);
+		g_mutex_unlock(&rg_lock);
+	}
+
+	TRACE1_EXIT("");
+}
+
+// unmap a ring and close its descriptors
+void
+ring_destroy(struct ring_info *rinfo)
+{
+	int i;
+
+	TRACE2_ENTER("rinfo = %p", rinfo);
+
+	if (rinfo->ring) {
+		munmap(rinfo->ring, sizeof(powerapi_ring_t));
+	}
+	for (i = 0; i < POWERAPI_RING_FDS; i++) {
+		if (rinfo->fds[i] >= 0) {
+			close(rinfo->fds[i]);
+		}
+	}
+	g_free(rinfo);
+
+	TRACE2_EXIT("");
+}
+
+//
+// ring_send_response - Put a response on a socket's response ring, and
+// wake the client if it's waiting for it.  Responses may come from any
+// worker, and are serialized by the connection's reply lock.
+//
+void
+ring_send_response(socket_info_t *skinfo, powerapi_response_t *resp)
+{
+	struct ring_info *rinfo = skinfo->ring;
+	powerapi_ring_t *ring = rinfo->ring;
+	uint32_t tail;
+	uint64_t start = stats_now();
+
+	TRACE1_ENTER("skinfo = %p, resp = %p", skinfo, resp);
+
+	LOG_DBG("resp->retval = %d", resp->retval);
+
+	g_mutex_lock(socket_reply_lock(skinfo));
+
+	resp->sequence = skinfo->seqnum++;
+
+	// A client keeps no more requests in flight than the ring has
+	// slots, so only one that has lost track of its ring fills it.
+	tail = __atomic_load_n(&ring->resp_tail, __ATOMIC_ACQUIRE);
+	if (rinfo->resp_head - tail >= POWERAPI_RING_SLOTS) {
+		g_mutex_unlock(socket_reply_lock(skinfo));
+		LOG_FAULT("Response ring of client %d is full", skinfo->sockid);
+		goto done;
+	}
+
+	ring->resp[rinfo->resp_head % POWERAPI_RING_SLOTS] = *resp;
+	rinfo->resp_head++;
+	__atomic_store_n(&ring->resp_head, rinfo->resp_head, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring->client_waiting, __ATOMIC_SEQ_CST) &&
+			eventfd_write(rinfo->fds[RING_RESP_FD], 1) != 0) {
+		LOG_FAULT("Unable to wake client %d: %m", skinfo->sockid);
+	}
+
+	g_mutex_unlock(socket_reply_lock(skinfo));
+
+	stats_record(STATS_RESPONSE, start);
+
+done:
+	TRACE1_EXIT("");
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Declare functions to take set requests from clients' shared memory
+ * request rings.
+ */
+
+#ifndef _POWERAPI_RING_H
+#define _POWERAPI_RING_H
+
+#include <stdint.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+
+#include "pwrapi_socket.h"
+
+// descriptors passed to the client, in order
+#define RING_MEM_FD		0	// memfd holding the ring
+#define RING_REQ_FD		1	// eventfd written by the client
+#define RING_RESP_FD		2	// eventfd written by the daemon
+
+// A client's ring.  The daemon keeps its own copy of the indexes it
+// writes, since the client can scribble on the shared ones.
+struct ring_info {
+	powerapi_ring_t *ring;
+	int              fds[POWERAPI_RING_FDS];
+	uint32_t         req_tail;	// requests taken
+	uint32_t         resp_head;	// responses sent
+};
+
+void ring_start(void);
+void ring_stop(void);
+int  ring_attach(socket_info_t *skinfo);
+int  ring_adopt(socket_info_t *skinfo, const int *fds);
+void ring_detach(socket_info_t *skinfo);
+void ring_destroy(struct ring_info *rinfo);
+void ring_send_response(socket_info_t *skinfo, powerapi_response_t *resp);
+
+#endif // _POWERAPI_RING_H
@@ -43,23 +43,39 @@
 
 #include "powerapid.h"
 #include "pwrapi_set.h"
-#include "pwrapi_worker.h"
+#include "pwrapi_heap.h"
+#include "pwrapi_journal.h"
 
 void
 set_insert(set_info_t *setp, GHashTable *hash)
 {
     char *path = setp->setreq.path;
-    GSList *slist;
+    set_heap_t *heap;
 
     TRACE2_ENTER("setp = %p (path = '%s'), hash = %p", setp, path, hash);
 
+    g_mutex_lock(&changes_lock);
+
     if (hash) {
         g_hash_table_insert(hash, path, setp);
     }
 
-    slist = g_hash_table_lookup(all_changes, path);
-    slist = g_slist_insert_sorted(slist, setp, attr_value_comp);
-    g_hash_table_insert(all_changes, path, slist);
+    // advisory sets are kept apart, so that they never outrank a client
+    if (setp->skinfo && setp->skinfo->advisory) {
+        g_hash_table_replace(advisory_changes, path, setp);
+        goto done;
+    }
+
+    heap = g_hash_table_lookup(all_changes, path);
+    if (heap == NULL) {
+        heap = set_heap_new();
+        g_hash_table_insert(all_changes, g_strdup(path), heap);
+    }
+    set_heap_insert(heap, setp);
+
+done:
+
+    g_mutex_unlock(&changes_lock);
 
     TRACE2_EXIT("");
 }
@@ -68,21 +84,76 @@ void
 set_remove(set_info_t *setp, GHashTable *hash)
 {
     char *path = setp->setreq.path;
-    GSList *slist;
+    set_heap_t *heap;
 
     TRACE2_ENTER("setp = %p (path = '%s'), hash = %p", setp, path, hash);
 
+    g_mutex_lock(&changes_lock);
+
     if (hash) {
         g_hash_table_remove(hash, path);
     }
 
-    slist = g_hash_table_lookup(all_changes, path);
-    slist = g_slist_remove(slist, setp);
-    g_hash_table_insert(all_changes, path, slist);
+    if (setp->skinfo && setp->skinfo->advisory) {
+        if (g_hash_table_lookup(advisory_changes, path) == setp) {
+            g_hash_table_remove(advisory_changes, path);
+        }
+        goto done;
+    }
+
+    heap = g_hash_table_lookup(all_changes, path);
+    if (heap) {
+        set_heap_remove(heap, setp);
+    }
+
+done:
+
+    g_mutex_unlock(&changes_lock);
 
     TRACE2_EXIT("");
 }
 
+set_info_t *
+set_lookup(GHashTable *hash, const char *path)
+{
+    set_info_t *setp;
+
+    TRACE2_ENTER("hash = %p, path = '%s'", hash, path);
+
+    g_mutex_lock(&changes_lock);
+    setp = g_hash_table_lookup(hash, path);
+    g_mutex_unlock(&changes_lock);
+
+    TRACE2_EXIT("setp = %p", setp);
+
+    return setp;
+}
+
+// Return the highest priority set request in all_changes for a path.  An
+// advisory set takes the place of the default, but not of a client's set.
+set_info_t *
+set_top(const char *path)
+{
+    set_info_t *top;
+    set_info_t *advisory;
+
+    TRACE2_ENTER("path = '%s'", path);
+
+    g_mutex_lock(&changes_lock);
+    top = set_heap_top(g_hash_table_lookup(all_changes, path));
+    if (top == NULL || top->skinfo == NULL) {
+        advisory = g_hash_table_lookup(advisory_changes, path);
+        if (advisory) {
+            top = advisory;
+        }
+    }
+    g_mutex_unlock(&changes_lock);
+
+    TRACE2_EXIT("top = %p", top);
+
+    return top;
+}
+
 void
 set_destroy(set_info_t *setp)
 {
@@ -93,48 +164,21 @@ set_destroy(set_info_t *setp)
     TRACE2_EXIT("");
 }
 
-// process set requests in the my_changes list of a socket being closed
-// - remove the set request from all_changes and if the set was the
-//   highest priority, then roll the change back to the next highest
-//   priority (write new value to file system)
-gboolean
-set_rollback(gpointer key, gpointer value, gpointer user_data)
+// Remove a set request of a departed client from its socket's my_changes
+// and from all_changes.  The caller must hold the lock of the worker which
+// owns the path, and must write the path's new top priority value.
+void
+set_rollback(set_info_t *setp)
 {
-    set_info_t *setp = (set_info_t *)value;
-    const socket_info_t *skinfo = setp->skinfo;
-    char *path;
-
-    TRACE1_ENTER("key = %p, value = %p, user_data = %p",
-            key, value, user_data);
+    TRACE1_ENTER("setp = %p", setp);
 
     set_print(NULL, setp, NULL);
 
-    path = setp->setreq.path;
-
-    // remove the set from all_changes
-    set_remove(setp, NULL);
-
-    // get the top priority value; if it's lower than the value that
-    // was just removed, then write it to the filesystem;
-    // attr_value_comp() will return a negative number if setp is
-    // higher priority than top (this means that setp was at the head
-    // of the list and that top was further down); the list is ordered
-    // such that the highest priority item is first, at the head (top)
-    GSList *slist = g_hash_table_lookup(all_changes, path);
-    set_info_t *top = slist->data;
-    if (attr_value_comp(setp, top) < 0) {
-        LOG_MSG("Rolling back client socket %d value of %s",
-                skinfo ? skinfo->sockid : -1, path);
-        write_attr_value(top);
-    }
-
+    set_remove(setp, setp->skinfo->my_changes);
+    journal_clear(setp);
     set_destroy(setp);
 
     TRACE1_EXIT("");
-
-    // by returning TRUE, we are telling g_hash_table_foreach_remove
-    // (the calling function) to remove this entry from my_changes
-    return TRUE;
 }
 
 void
@@ -241,6 +285,13 @@ value_compare(PWR_AttrDataType data_type,
     return ret;
 }
 
+gboolean
+set_value_equal(PWR_AttrDataType data_type,
+        const type_union_t *v1, const type_union_t *v2)
+{
+    return value_compare(data_type, v1, v2) == 0;
+}
+
 // compare governor values
 // a negative return value means that s1 is higher priority than s2
 static int
@@ -255,13 +306,17 @@ gov_compare(const set_info_t *s1, const set_info_t *s2)
     TRACE3_ENTER("s1 = %p, s2 = %p", s1, s2);
 
     // userspace governor has highest priority, others
-    // are based upon when they were requested
-    if (g1 == g2) {
+    // are based upon when they were requested, even when
+    // they name the same governor, so that the order holds
+    // across a heap of mixed requests
+    if (g1 == PWR_GOV_LINUX_USERSPACE && g2 == PWR_GOV_LINUX_USERSPACE) {
         ret = 0;
     } else if (g1 == PWR_GOV_LINUX_USERSPACE) {
         ret = -1;
     } else if (g2 == PWR_GOV_LINUX_USERSPACE) {
         ret = 1;
+    } else if (s1->timestamp == s2->timestamp) {
+        ret = 0;
     } else {
         // newer (larger) timestamp is higher priority
         ret = (s1->timestamp > s2->timestamp) ? -1 : 1;
@@ -287,9 +342,9 @@ attr_value_comp(gconstpointer set1, gconstpointer set2)
     TRACE2_ENTER("set1 = %p, set2 = %p", set1, set2);
 
     // a negative return means that set1 is higher priority than set2
-    // the list is ordered such that higher priority items come before
-    // (are earlier in the list) than lower priority ones so that the
-    // head (top) of the list is always the highest priority item
+    // the all_changes heap is ordered such that higher priority items
+    // are closer to the top than lower priority ones so that the top
+    // of the heap is always the highest priority item
 
     switch (sr1->attribute) {
     case PWR_ATTR_CSTATE_LIMIT:
@@ -44,14 +44,22 @@ typedef struct {
     powerapi_setreq_t  setreq;      // set request itself
     socket_info_t     *skinfo;      // requesting socket
     uint64_t           timestamp;   // time that set was requested
+    uint64_t           queued;      // stats_now() when queued for a worker
+    gboolean           release;     // queued to roll back skinfo's sets
+    guint              heap_index;  // position in all_changes heap
+    gboolean           on_ring;     // taken from skinfo's request ring
 } set_info_t;
 
 void set_insert(set_info_t *setp, GHashTable *hash);
 void set_remove(set_info_t *setp, GHashTable *hash);
+set_info_t *set_lookup(GHashTable *hash, const char *path);
+set_info_t *set_top(const char *path);
 void set_destroy(set_info_t *setp);
-gboolean set_rollback(gpointer key, gpointer value, gpointer user_data);
+void set_rollback(set_info_t *setp);
 void set_print(gpointer key, gpointer value, gpointer user_data);
 set_info_t *set_create_item(powerapi_setreq_t *setreq, socket_info_t *skinfo);
 int attr_value_comp(gconstpointer set1, gconstpointer set2);
+gboolean set_value_equal(PWR_AttrDataType data_type,
+        const type_union_t *v1, const type_union_t *v2);
 
 #endif // _POWERAPI_SET_H
@@ -55,6 +55,18 @@ stop_daemon(int signal_num)
     TRACE1_EXIT("");
 }
 
+// hand the sockets and sets over to a new daemon instead of rolling back
+static void
+handover_daemon(int signal_num)
+{
+    TRACE1_ENTER("signal_num = %d", signal_num);
+
+    daemon_handover = 1;
+    daemon_run = 0;
+
+    TRACE1_EXIT("");
+}
+
 static void
 handle_alarm(int signal_num)
 {
@@ -87,6 +99,13 @@ pwrapi_handle_signals(void)
         exit(1);
     }
 
+    sa.sa_handler = handover_daemon;
+
+    if (sigaction(SIGUSR2, &sa, NULL) == -1) {
+        LOG_CRIT("Unable to set signal handler for SIGUSR2: %m");
+        exit(1);
+    }
+
     sa.sa_handler = handle_alarm;
 
     if (sigaction(SIGALRM, &sa, NULL) == -1) {
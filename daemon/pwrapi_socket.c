@@ -36,6 +36,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -45,6 +46,16 @@
 #include "powerapid.h"
 #include "pwrapi_set.h"
 #include "pwrapi_socket.h"
+#include "pwrapi_worker.h"
+#include "pwrapi_journal.h"
+#include "pwrapi_ring.h"
+
+// orphans holds the sessions recovered from the journal that haven't
+// been reclaimed by a reconnecting client, keyed by session token.  They
+// are rolled back once orphan_deadline (monotonic usec) passes.  Only
+// the main thread uses them.
+static GHashTable *orphans = NULL;
+static gint64      orphan_deadline = 0;
 
 gboolean
 is_persistent(const socket_info_t *skinfo)
@@ -83,12 +94,30 @@ socket_construct(int client_socket, const struct ucred *cred)
         exit(1);
     }
     skinfo->timestamp = time(NULL);
+    skinfo->refcount  = 1;
+    g_mutex_init(&skinfo->lock);
 
     g_hash_table_insert(open_sockets, &skinfo->sockid, skinfo);
 
     TRACE1_EXIT("skinfo = %p", skinfo);
 }
 
+// roll back the changes of a closed socket or expired orphan and drop
+// the main thread's reference to it
+static void
+socket_release(socket_info_t *skinfo)
+{
+    TRACE1_ENTER("skinfo = %p", skinfo);
+
+    // The workers roll back the sets and end the session in the
+    // journal, so that the main thread never waits on a write.
+    worker_release(skinfo);
+
+    socket_unref(skinfo);
+
+    TRACE1_EXIT("");
+}
+
 void
 socket_destruct(int client_socket)
 {
@@ -101,15 +130,427 @@ socket_destruct(int client_socket)
     skinfo = g_hash_table_lookup(open_sockets, &client_socket);
     if (skinfo) {
         g_hash_table_remove(open_sockets, &client_socket);
+        if (skinfo->channels) {
+            GList *list, *iter;
+
+            list = g_hash_table_get_values(skinfo->channels);
+            for (iter = list; iter; iter = iter->next) {
+                socket_channel_close(iter->data);
+            }
+            g_list_free(list);
+        }
+        ring_detach(skinfo);
+        socket_release(skinfo);
+    }
+
+    TRACE1_EXIT("skinfo = %p", skinfo);
+}
+
+// Open a session on a connection for another context sharing it, on the
+// given channel, or the next one if channel is 0.  The session starts
+// out unauthorized.  Returns NULL if the connection has too many.
+socket_info_t *
+socket_channel_create(socket_info_t *conn, uint32_t channel)
+{
+    socket_info_t *skinfo = NULL;
+
+    TRACE1_ENTER("conn = %p, channel = %u", conn, channel);
+
+    if (conn->channels == NULL) {
+        conn->channels = g_hash_table_new(g_int_hash, g_int_equal);
+        if (!conn->channels) {
+            LOG_CRIT(MEM_ERROR_EXIT);
+            exit(1);
+        }
+    }
+    if (g_hash_table_size(conn->channels) >= MAX_SOCKET_CHANNELS) {
+        LOG_FAULT("Client %d has too many sessions", conn->sockid);
+        goto done;
+    }
+
+    if (channel == 0) {
+        channel = ++conn->next_channel;
+    } else if (channel > conn->next_channel) {
+        conn->next_channel = channel;
+    }
+
+    skinfo = g_new0(socket_info_t, 1);
+    if (!skinfo) {
+        LOG_CRIT(MEM_ERROR_EXIT);
+        exit(1);
+    }
+    skinfo->sockid     = conn->sockid;
+    skinfo->cred       = conn->cred;
+    skinfo->role       = PWR_ROLE_NOT_SPECIFIED;
+    skinfo->my_changes = g_hash_table_new_full(g_str_hash,
+            g_str_equal, NULL, NULL);
+    if (!skinfo->my_changes) {
+        LOG_CRIT(MEM_ERROR_EXIT);
+        exit(1);
+    }
+    skinfo->timestamp = time(NULL);
+    skinfo->refcount  = 1;
+    skinfo->channel   = channel;
+    skinfo->conn      = socket_ref(conn);
+    g_mutex_init(&skinfo->lock);
+
+    g_hash_table_insert(conn->channels, &skinfo->channel, skinfo);
+
+done:
+    TRACE1_EXIT("skinfo = %p", skinfo);
+
+    return skinfo;
+}
+
+socket_info_t *
+socket_channel_lookup(socket_info_t *conn, uint32_t channel)
+{
+    socket_info_t *skinfo = NULL;
+
+    TRACE1_ENTER("conn = %p, channel = %u", conn, channel);
+
+    if (channel == 0) {
+        skinfo = conn;
+    } else if (conn->channels) {
+        skinfo = g_hash_table_lookup(conn->channels, &channel);
+    }
+
+    TRACE1_EXIT("skinfo = %p", skinfo);
 
-        // roll back non-persistent changes
-        g_hash_table_foreach_remove(skinfo->my_changes, set_rollback, NULL);
+    return skinfo;
+}
+
+// end a session sharing a connection, rolling back its sets
+void
+socket_channel_close(socket_info_t *skinfo)
+{
+    TRACE1_ENTER("skinfo = %p, channel = %u", skinfo, skinfo->channel);
+
+    LOG_DBG("Closing channel %u of client socket %d", skinfo->channel,
+            skinfo->sockid);
+
+    g_hash_table_remove(skinfo->conn->channels, &skinfo->channel);
+    ring_detach(skinfo);
+    socket_release(skinfo);
+
+    TRACE1_EXIT("");
+}
+
+// create a random, nonzero token identifying a new session
+uint64_t
+socket_new_session(void)
+{
+    uint64_t session;
+
+    do {
+        session = ((uint64_t)g_random_int() << 32) | g_random_int();
+    } while (session == 0);
+
+    return session;
+}
+
+// create a socket_info_t for a session recovered from the journal
+socket_info_t *
+socket_orphan_create(uint64_t session, uid_t uid, PWR_Role role,
+        const char *context_name)
+{
+    socket_info_t *skinfo;
+
+    TRACE1_ENTER("session = %#lx, uid = %d, role = %d, context_name = '%s'",
+            session, uid, role, context_name);
+
+    if (orphans == NULL) {
+        orphans = g_hash_table_new(g_int64_hash, g_int64_equal);
+        if (!orphans) {
+            LOG_CRIT(MEM_ERROR_EXIT);
+            exit(1);
+        }
+        orphan_deadline = g_get_monotonic_time()
+                + ORPHAN_RECLAIM_TIMEOUT * G_USEC_PER_SEC;
+    }
+
+    skinfo = g_new0(socket_info_t, 1);
+    if (!skinfo) {
+        LOG_CRIT(MEM_ERROR_EXIT);
+        exit(1);
+    }
+    skinfo->sockid       = -1;
+    skinfo->cred.uid     = uid;
+    skinfo->cred.gid     = -1;
+    skinfo->role         = role;
+    skinfo->context_name = g_strdup(context_name);
+    skinfo->my_changes   = g_hash_table_new_full(g_str_hash,
+            g_str_equal, NULL, NULL);
+    if (!skinfo->context_name || !skinfo->my_changes) {
+        LOG_CRIT(MEM_ERROR_EXIT);
+        exit(1);
+    }
+    skinfo->timestamp = time(NULL);
+    skinfo->refcount  = 1;
+    skinfo->session   = session;
+    g_mutex_init(&skinfo->lock);
+
+    g_hash_table_insert(orphans, &skinfo->session, skinfo);
+
+    TRACE1_EXIT("skinfo = %p", skinfo);
+
+    return skinfo;
+}
+
+// allocate a socket_info_t for the daemon itself, with no session yet
+static socket_info_t *
+socket_internal_new(PWR_Role role, const char *context_name)
+{
+    socket_info_t *skinfo;
+
+    skinfo = g_new0(socket_info_t, 1);
+    if (!skinfo) {
+        LOG_CRIT(MEM_ERROR_EXIT);
+        exit(1);
+    }
+    skinfo->sockid       = -1;
+    skinfo->cred.pid     = getpid();
+    skinfo->role         = role;
+    skinfo->context_name = g_strdup(context_name);
+    skinfo->my_changes   = g_hash_table_new_full(g_str_hash,
+            g_str_equal, NULL, NULL);
+    if (!skinfo->context_name || !skinfo->my_changes) {
+        LOG_CRIT(MEM_ERROR_EXIT);
+        exit(1);
+    }
+    skinfo->timestamp = time(NULL);
+    skinfo->refcount  = 1;
+    g_mutex_init(&skinfo->lock);
+
+    return skinfo;
+}
+
+// Create a socket_info_t for sets made by the daemon itself, which are
+// journaled and rolled back like a client's.  Whether its sets are
+// advisory is journaled with the session, so it's fixed here.  Release it
+// with worker_release() and socket_unref().
+socket_info_t *
+socket_internal_create(PWR_Role role, const char *context_name,
+        gboolean advisory)
+{
+    socket_info_t *skinfo;
+
+    TRACE1_ENTER("role = %d, context_name = '%s', advisory = %d",
+            role, context_name, advisory);
+
+    skinfo = socket_internal_new(role, context_name);
+    skinfo->advisory = advisory;
+    skinfo->session = socket_new_session();
+
+    journal_session_begin(skinfo);
+
+    TRACE1_EXIT("skinfo = %p", skinfo);
+
+    return skinfo;
+}
+
+// Take over the orphaned session an earlier daemon's internal socket of
+// the same role and context name left in the journal, so that its sets
+// are replaced by new ones rather than outranking them until the orphan
+// expires.  Returns NULL if there is no such orphan; otherwise release
+// the result like one from socket_internal_create().
+socket_info_t *
+socket_internal_reclaim(PWR_Role role, const char *context_name)
+{
+    socket_info_t *skinfo = NULL;
+    socket_info_t *orphan = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    TRACE1_ENTER("role = %d, context_name = '%s'", role, context_name);
+
+    if (orphans == NULL) {
+        goto done;
+    }
+
+    g_hash_table_iter_init(&iter, orphans);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        socket_info_t *candidate = value;
+
+        if (candidate->cred.uid == 0 && candidate->role == role &&
+                g_strcmp0(candidate->context_name, context_name) == 0) {
+            orphan = candidate;
+            break;
+        }
+    }
+    if (orphan == NULL) {
+        goto done;
+    }
+
+    skinfo = socket_internal_new(role, context_name);
+    if (!socket_reclaim(skinfo, orphan->session)) {
+        socket_unref(skinfo);
+        skinfo = NULL;
+    }
+
+done:
+    TRACE1_EXIT("skinfo = %p", skinfo);
+
+    return skinfo;
+}
+
+// drop an orphan and its sets without rolling anything back; used while
+// replaying the journal, before anything has been written
+void
+socket_orphan_discard(socket_info_t *skinfo)
+{
+    GList *sets, *iter;
+
+    TRACE1_ENTER("skinfo = %p", skinfo);
+
+    g_hash_table_remove(orphans, &skinfo->session);
+
+    sets = g_hash_table_get_values(skinfo->my_changes);
+    for (iter = sets; iter; iter = iter->next) {
+        set_remove(iter->data, skinfo->my_changes);
+        set_destroy(iter->data);
+    }
+    g_list_free(sets);
+
+    socket_unref(skinfo);
+
+    TRACE1_EXIT("");
+}
+
+// Hand an orphaned session's sets over to a newly authorized socket of
+// the same user and role.  Returns TRUE if the session was reclaimed.
+gboolean
+socket_reclaim(socket_info_t *skinfo, uint64_t session)
+{
+    socket_info_t *orphan = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    TRACE1_ENTER("skinfo = %p, session = %#lx", skinfo, session);
+
+    if (orphans) {
+        orphan = g_hash_table_lookup(orphans, &session);
+    }
+    if (orphan == NULL) {
+        TRACE1_EXIT("no such session");
+        return FALSE;
+    }
+    // The sets stay in the table they're in, advisory or not.
+    if (orphan->cred.uid != skinfo->cred.uid || orphan->role != skinfo->role
+            || orphan->advisory != skinfo->advisory) {
+        LOG_FAULT("Client %d (uid %d) denied reclaim of session %#lx",
+                skinfo->sockid, skinfo->cred.uid, session);
+        TRACE1_EXIT("not owner");
+        return FALSE;
+    }
+
+    g_hash_table_remove(orphans, &orphan->session);
+
+    g_mutex_lock(&changes_lock);
+    g_hash_table_iter_init(&iter, orphan->my_changes);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        set_info_t *setp = value;
+
+        setp->skinfo = skinfo;
+        g_hash_table_insert(skinfo->my_changes, setp->setreq.path, setp);
+    }
+    g_hash_table_remove_all(orphan->my_changes);
+    g_mutex_unlock(&changes_lock);
+
+    // Journal the sets again under the new owner, in case the journal
+    // was rewritten while they were moving.
+    skinfo->session = session;
+    journal_session_begin(skinfo);
+    g_hash_table_iter_init(&iter, skinfo->my_changes);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        journal_set(value);
+    }
+
+    LOG_MSG("Client %d reclaimed session %#lx with %u sets", skinfo->sockid,
+            session, g_hash_table_size(skinfo->my_changes));
+
+    socket_unref(orphan);
+
+    TRACE1_EXIT("reclaimed");
+
+    return TRUE;
+}
+
+// roll back the orphans if their clients haven't reclaimed them in time
+void
+socket_expire_orphans(void)
+{
+    GList *list, *iter;
+
+    TRACE1_ENTER("orphans = %p", orphans);
+
+    if (orphans == NULL) {
+        goto done;
+    }
+
+    list = g_hash_table_get_values(orphans);
+    g_hash_table_remove_all(orphans);
+
+    for (iter = list; iter; iter = iter->next) {
+        socket_info_t *skinfo = iter->data;
+
+        LOG_MSG("Session %#lx (%s) was not reclaimed, rolling back",
+                skinfo->session, skinfo->context_name);
+        socket_release(skinfo);
+    }
+    g_list_free(list);
+
+done:
+    TRACE1_EXIT("");
+}
+
+// monotonic time at which unclaimed orphans expire, 0 if there are none
+gint64
+socket_orphan_deadline(void)
+{
+    return socket_num_orphans() ? orphan_deadline : 0;
+}
+
+guint
+socket_num_orphans(void)
+{
+    return orphans ? g_hash_table_size(orphans) : 0;
+}
+
+socket_info_t *
+socket_ref(socket_info_t *skinfo)
+{
+    TRACE2_ENTER("skinfo = %p", skinfo);
+
+    g_atomic_int_inc(&skinfo->refcount);
+
+    TRACE2_EXIT("refcount = %d", g_atomic_int_get(&skinfo->refcount));
+
+    return skinfo;
+}
+
+void
+socket_unref(socket_info_t *skinfo)
+{
+    TRACE2_ENTER("skinfo = %p", skinfo);
+
+    if (g_atomic_int_dec_and_test(&skinfo->refcount)) {
+        if (skinfo->ring) {
+            ring_destroy(skinfo->ring);
+        }
+        if (skinfo->channels) {
+            g_hash_table_destroy(skinfo->channels);
+        }
+        if (skinfo->conn) {
+            socket_unref(skinfo->conn);
+        }
         g_hash_table_destroy(skinfo->my_changes);
+        g_mutex_clear(&skinfo->lock);
         g_free(skinfo->context_name);
         g_free(skinfo);
     }
 
-    TRACE1_EXIT("skinfo = %p", skinfo);
+    TRACE2_EXIT("");
 }
 
 socket_info_t *
@@ -143,10 +584,14 @@ socket_print(gpointer key, gpointer value, gpointer user_data)
         }
     }
 
-    LOG_MSG("Socket %d/%d, uid/gid/pid = %d/%d/%d, role = %d, name = %s, "
-            "timestamp = %s", *((int *)key), skinfo->sockid,
-            skinfo->cred.uid, skinfo->cred.gid, skinfo->cred.pid,
-            skinfo->role, skinfo->context_name, tsbuf);
+    LOG_MSG("Socket %d/%d, channel %u, uid/gid/pid = %d/%d/%d, role = %d, "
+            "name = %s, timestamp = %s", *((int *)key), skinfo->sockid,
+            skinfo->channel, skinfo->cred.uid, skinfo->cred.gid,
+            skinfo->cred.pid, skinfo->role, skinfo->context_name, tsbuf);
+
+    if (skinfo->channels) {
+        g_hash_table_foreach(skinfo->channels, socket_print, NULL);
+    }
 
     TRACE2_EXIT("");
 }
@@ -43,7 +43,8 @@
 
 #include <cray-powerapi/powerapid.h>
 
-typedef struct {
+typedef struct socket_info socket_info_t;
+struct socket_info {
     int         sockid;            // file descriptor # for this socket
     struct ucred cred;             // credentials of requesting user
     PWR_Role    role;              // role of remote context
@@ -51,12 +52,56 @@ typedef struct {
     GHashTable *my_changes;        // all of this socket's changes
     time_t      timestamp;         // time of original connection
     uint64_t    seqnum;            // reply sequence number
-} socket_info_t;
+    GMutex      lock;              // serializes replies to this socket
+    gint        refcount;          // main thread + queued work items
+    gboolean    closed;            // socket has been closed by the client
+    gint        releasing;         // workers yet to roll back its sets
+    gboolean    advisory;          // its sets yield to every client's
+    uint64_t    session;           // session token, 0 until authorized
+    struct ring_info *ring;        // shared memory request ring, or NULL
+    uint32_t    channel;           // channel of a session sharing a
+                                   // connection, 0 for the connection's own
+    socket_info_t *conn;           // connection a shared session is on
+    GHashTable *channels;          // sessions sharing this connection
+    uint32_t    next_channel;      // last channel opened on it
+};
+
+// sessions that may share one connection, besides the connection's own
+#define MAX_SOCKET_CHANNELS     64
+
+// Replies on a connection are serialized by the lock of the connection's
+// own session, which every session sharing the connection uses.
+static inline GMutex *
+socket_reply_lock(socket_info_t *skinfo)
+{
+    return skinfo->conn ? &skinfo->conn->lock : &skinfo->lock;
+}
+
+// seconds that the sessions recovered from the journal are kept for their
+// clients to reclaim before their sets are rolled back
+#define ORPHAN_RECLAIM_TIMEOUT  60
 
 void socket_construct(int client_socket, const struct ucred *cred);
 void socket_destruct(int client_socket);
+socket_info_t *socket_ref(socket_info_t *skinfo);
+void socket_unref(socket_info_t *skinfo);
 socket_info_t *socket_lookup(int client_socket);
+socket_info_t *socket_channel_create(socket_info_t *conn, uint32_t channel);
+socket_info_t *socket_channel_lookup(socket_info_t *conn, uint32_t channel);
+void socket_channel_close(socket_info_t *skinfo);
 void socket_print(gpointer key, gpointer value, gpointer user_data);
 gboolean is_persistent(const socket_info_t *skinfo);
+uint64_t socket_new_session(void);
+socket_info_t *socket_orphan_create(uint64_t session, uid_t uid,
+        PWR_Role role, const char *context_name);
+void socket_orphan_discard(socket_info_t *skinfo);
+socket_info_t *socket_internal_create(PWR_Role role,
+        const char *context_name, gboolean advisory);
+socket_info_t *socket_internal_reclaim(PWR_Role role,
+        const char *context_name);
+gboolean socket_reclaim(socket_info_t *skinfo, uint64_t session);
+void socket_expire_orphans(void);
+gint64 socket_orphan_deadline(void);
+guint socket_num_orphans(void);
 
 #endif // _POWERAPI_SOCKET_H
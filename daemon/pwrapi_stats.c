@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Collect statistics about the daemon's own request handling, so that
+ * slow set requests can be traced to queueing, control file writes or
+ * rollbacks.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_stats.h"
+
+// most written paths reported
+#define STATS_MAX_PATHS		32
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[POWERAPI_STATS_BUCKETS];
+} stats_histogram_t;
+
+typedef struct {
+	uint64_t writes;
+	uint64_t errors;
+} stats_path_t;
+
+static const char *hist_names[STATS_NUM_HISTS] = {
+	[STATS_ACCEPT]     = "accept",
+	[STATS_PARSE]      = "request parse",
+	[STATS_QUEUE_WAIT] = "queue wait",
+	[STATS_WRITE]      = "sysfs write",
+	[STATS_RESPONSE]   = "response",
+	[STATS_FILE_WRITE] = "file pwrite",
+};
+
+static const char *counter_names[STATS_NUM_COUNTERS] = {
+	[STATS_CONNECTS]       = "connections accepted",
+	[STATS_REJECTS]        = "connections refused",
+	[STATS_REQUESTS]       = "requests",
+	[STATS_SETS]           = "set requests",
+	[STATS_COALESCED]      = "set requests coalesced",
+	[STATS_WRITES_SKIPPED] = "writes skipped",
+	[STATS_WRITE_ERRORS]   = "write errors",
+	[STATS_ROLLBACKS]      = "sets rolled back",
+	[STATS_FILE_OPENS]     = "files opened",
+	[STATS_FILE_REOPENS]   = "stale files reopened",
+	[STATS_DEFAULTS_AHEAD] = "defaults read ahead",
+	[STATS_RING_SETS]      = "ring set requests",
+	[STATS_RING_WAKEUPS]   = "ring wakeups",
+	[STATS_CHANNELS]       = "shared connection sessions",
+};
+
+// The counters and histograms are updated by the main thread and every
+// worker without locking, so they are only accessed atomically.  A
+// report may see a histogram part way through an update, which is no
+// worse than a sample arriving just after the report.
+static stats_histogram_t hists[STATS_NUM_HISTS];
+static uint64_t counters[STATS_NUM_COUNTERS];
+static int64_t queue_depth;
+static uint64_t queue_depth_max;
+
+// Writes per control file path.  Only control file writes, which take
+// far longer, update the table, so a lock is good enough here.
+static GHashTable *path_writes = NULL;
+static GMutex path_lock;
+
+static void
+atomic_max(uint64_t *max, uint64_t value)
+{
+	uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+	while (value > cur && !__atomic_compare_exchange_n(max, &cur, value,
+				TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+// add n events to a counter
+void
+stats_count(stats_counter_t counter, uint64_t n)
+{
+	__atomic_add_fetch(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+// record the time since start, from stats_now(), in a histogram
+void
+stats_record(stats_hist_t hist, uint64_t start)
+{
+	stats_histogram_t *histp = &hists[hist];
+	uint64_t now = stats_now();
+	uint64_t elapsed = (now > start) ? now - start : 0;
+
+	__atomic_add_fetch(&histp->buckets[powerapi_stats_bucket(elapsed)], 1,
+			__ATOMIC_RELAXED);
+	__atomic_add_fetch(&histp->sum, elapsed, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&histp->count, 1, __ATOMIC_RELAXED);
+	atomic_max(&histp->max, elapsed);
+}
+
+// track set requests pushed onto (delta > 0) or popped from (delta < 0)
+// the worker queues
+void
+stats_queue_depth(int delta)
+{
+	int64_t depth;
+
+	depth = __atomic_add_fetch(&queue_depth, delta, __ATOMIC_RELAXED);
+	if (depth > 0) {
+		atomic_max(&queue_depth_max, depth);
+	}
+}
+
+// count a write, or failed write, of a control file
+void
+stats_path_write(const char *path, int failed)
+{
+	stats_path_t *pathp;
+
+	TRACE3_ENTER("path = '%s', failed = %d", path, failed);
+
+	g_mutex_lock(&path_lock);
+
+	if (path_writes == NULL) {
+		path_writes = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, g_free);
+		if (!path_writes) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+	}
+
+	pathp = g_hash_table_lookup(path_writes, path);
+	if (pathp == NULL) {
+		pathp = g_new0(stats_path_t, 1);
+		if (!pathp) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		g_hash_table_insert(path_writes, g_strdup(path), pathp);
+	}
+
+	pathp->writes++;
+	if (failed) {
+		pathp->errors++;
+	}
+
+	g_mutex_unlock(&path_lock);
+
+	TRACE3_EXIT("");
+}
+
+// order path records by decreasing number of writes
+static gint
+path_record_comp(gconstpointer a, gconstpointer b)
+{
+	const powerapi_stats_record_t *ra = a;
+	const powerapi_stats_record_t *rb = b;
+
+	if (ra->count == rb->count)
+		return strcmp(ra->name, rb->name);
+
+	return (ra->count > rb->count) ? -1 : 1;
+}
+
+// Fill in an array of statistics records, to be freed with g_free().
+// Returns the number of records.
+uint32_t
+stats_report(powerapi_stats_record_t **records)
+{
+	GArray *array;
+	GArray *paths;
+	GHashTableIter iter;
+	gpointer key, value;
+	powerapi_stats_record_t rec;
+	uint32_t num_records;
+	int i, j;
+
+	TRACE2_ENTER("records = %p", records);
+
+	array = g_array_new(FALSE, FALSE, sizeof(powerapi_stats_record_t));
+	paths = g_array_new(FALSE, FALSE, sizeof(powerapi_stats_record_t));
+	if (!array || !paths) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	for (i = 0; i < STATS_NUM_HISTS; i++) {
+		stats_histogram_t *histp = &hists[i];
+
+		memset(&rec, 0, sizeof(rec));
+		rec.type = PwrSTATS_HISTOGRAM;
+		g_strlcpy(rec.name, hist_names[i], sizeof(rec.name));
+		rec.count = __atomic_load_n(&histp->count, __ATOMIC_RELAXED);
+		rec.sum = __atomic_load_n(&histp->sum, __ATOMIC_RELAXED);
+		rec.max = __atomic_load_n(&histp->max, __ATOMIC_RELAXED);
+		for (j = 0; j < POWERAPI_STATS_BUCKETS; j++) {
+			rec.buckets[j] = __atomic_load_n(&histp->buckets[j],
+					__ATOMIC_RELAXED);
+		}
+		g_array_append_val(array, rec);
+	}
+
+	for (i = 0; i < STATS_NUM_COUNTERS; i++) {
+		memset(&rec, 0, sizeof(rec));
+		rec.type = PwrSTATS_COUNTER;
+		g_strlcpy(rec.name, counter_names[i], sizeof(rec.name));
+		rec.count = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+		g_array_append_val(array, rec);
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = PwrSTATS_GAUGE;
+	g_strlcpy(rec.name, "queue depth", sizeof(rec.name));
+	rec.count = __atomic_load_n(&queue_depth, __ATOMIC_RELAXED);
+	rec.max = __atomic_load_n(&queue_depth_max, __ATOMIC_RELAXED);
+	g_array_append_val(array, rec);
+
+	g_mutex_lock(&path_lock);
+	if (path_writes) {
+		g_hash_table_iter_init(&iter, path_writes);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			const stats_path_t *pathp = value;
+
+			memset(&rec, 0, sizeof(rec));
+			rec.type = PwrSTATS_PATH;
+			g_strlcpy(rec.name, key, sizeof(rec.name));
+			rec.count = pathp->writes;
+			rec.sum = pathp->errors;
+			g_array_append_val(paths, rec);
+		}
+	}
+	g_mutex_unlock(&path_lock);
+
+	g_array_sort(paths, path_record_comp);
+	g_array_append_vals(array, paths->data, MIN(paths->len, STATS_MAX_PATHS));
+	g_array_free(paths, TRUE);
+
+	num_records = array->len;
+	*records = (powerapi_stats_record_t *)g_array_free(array, FALSE);
+
+	TRACE2_EXIT("num_records = %u", num_records);
+
+	return num_records;
+}
+
+// Clear the counters and histograms.  The queue depth is a level rather
+// than a count, so only its high water mark is cleared.
+void
+stats_reset(void)
+{
+	int i, j;
+
+	TRACE2_ENTER("");
+
+	for (i = 0; i < STATS_NUM_HISTS; i++) {
+		stats_histogram_t *histp = &hists[i];
+
+		__atomic_store_n(&histp->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&histp->sum, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&histp->max, 0, __ATOMIC_RELAXED);
+		for (j = 0; j < POWERAPI_STATS_BUCKETS; j++) {
+			__atomic_store_n(&histp->buckets[j], 0, __ATOMIC_RELAXED);
+		}
+	}
+
+	for (i = 0; i < STATS_NUM_COUNTERS; i++) {
+		__atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&queue_depth_max,
+			__atomic_load_n(&queue_depth, __ATOMIC_RELAXED),
+			__ATOMIC_RELAXED);
+
+	g_mutex_lock(&path_lock);
+	if (path_writes) {
+		g_hash_table_remove_all(path_writes);
+	}
+	g_mutex_unlock(&path_lock);
+
+	TRACE2_EXIT("");
+}
+
+void
+stats_destroy(void)
+{
+	TRACE2_ENTER("");
+
+	g_mutex_lock(&path_lock);
+	if (path_writes) {
+		g_hash_table_destroy(path_writes);
+		path_writes = NULL;
+	}
+	g_mutex_unlock(&path_lock);
+
+	TRACE2_EXIT("");
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Declare functions to collect statistics about the daemon's own
+ * request handling.
+ */
+
+#ifndef _POWERAPI_STATS_H
+#define _POWERAPI_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <cray-powerapi/types.h>
+
+// latency histograms
+typedef enum {
+	STATS_ACCEPT = 0,	// accept and check a new connection
+	STATS_PARSE,		// read and dispatch a request
+	STATS_QUEUE_WAIT,	// set request waiting in a worker queue
+	STATS_WRITE,		// write a control file
+	STATS_RESPONSE,		// write a response to a client
+	STATS_FILE_WRITE,	// one pwrite() of a control file
+	STATS_NUM_HISTS
+} stats_hist_t;
+
+// event counters
+typedef enum {
+	STATS_CONNECTS = 0,	// connections accepted
+	STATS_REJECTS,		// connections refused
+	STATS_REQUESTS,		// requests received
+	STATS_SETS,		// set requests received
+	STATS_COALESCED,	// set requests merged into another's write
+	STATS_WRITES_SKIPPED,	// writes of the value a file already held
+	STATS_WRITE_ERRORS,	// failed control file writes
+	STATS_ROLLBACKS,	// sets of departed clients rolled back
+	STATS_FILE_OPENS,	// control files opened
+	STATS_FILE_REOPENS,	// stale control file descriptors reopened
+	STATS_DEFAULTS_AHEAD,	// default values read ahead and taken
+	STATS_RING_SETS,	// set requests taken from request rings
+	STATS_RING_WAKEUPS,	// wakeups by clients with request rings
+	STATS_CHANNELS,		// sessions opened on shared connections
+	STATS_NUM_COUNTERS
+} stats_counter_t;
+
+// current time for measuring latencies, in nsec
+static inline uint64_t
+stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void     stats_count(stats_counter_t counter, uint64_t n);
+void     stats_record(stats_hist_t hist, uint64_t start);
+void     stats_queue_depth(int delta);
+void     stats_path_write(const char *path, int failed);
+uint32_t stats_report(powerapi_stats_record_t **records);
+void     stats_reset(void);
+void     stats_destroy(void);
+
+#endif // _POWERAPI_STATS_H
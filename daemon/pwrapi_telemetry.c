@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Sample read-only measurement files into the telemetry shared memory
+ * segment so that library clients can read them without touching sysfs.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_telemetry.h"
+
+#define MIN_TELEM_ENTRIES	16
+
+// Files sampled into the segment.  Counters are monotonically increasing
+// energy values for which a rate is also published.  A counter wraps back
+// to zero after reaching its range; a range of 0 means it never wraps.
+typedef struct {
+	const char *pattern;    // glob(3) pattern for the files
+	const char *range;      // file in the same directory holding the
+	                        // counter range, or NULL
+	gboolean    counter;    // publish rate of change
+} telem_source_t;
+
+static const telem_source_t telem_sources[] = {
+	{ "/sys/cray/pm_counters/power",         NULL, FALSE },
+	{ "/sys/cray/pm_counters/energy",        NULL, TRUE  },
+	{ "/sys/cray/pm_counters/cpu_power",     NULL, FALSE },
+	{ "/sys/cray/pm_counters/cpu_energy",    NULL, TRUE  },
+	{ "/sys/cray/pm_counters/memory_power",  NULL, FALSE },
+	{ "/sys/cray/pm_counters/memory_energy", NULL, TRUE  },
+	{ "/sys/class/powercap/intel-rapl/intel-rapl:*/energy_uj",
+			"max_energy_range_uj", TRUE },
+	{ "/sys/class/powercap/intel-rapl/intel-rapl:*/intel-rapl:*:*/energy_uj",
+			"max_energy_range_uj", TRUE },
+	{ "/sys/devices/system/cpu/cpu[0-9]*/cpufreq/scaling_cur_freq",
+			NULL, FALSE },
+};
+
+// Private sampling state for one entry in the segment.
+typedef struct {
+	int                     fd;         // open descriptor for the file
+	gboolean                counter;    // publish rate of change
+	uint64_t                range;      // counter wrap value, 0 if none
+	gboolean                primed;     // prev_value/prev_time are valid
+	uint64_t                prev_value;
+	uint64_t                prev_time;
+	powerapi_telem_entry_t *entry;      // entry in the segment
+} telem_file_t;
+
+static powerapi_telem_hdr_t *telem_hdr = NULL;
+static size_t                telem_size = 0;
+static telem_file_t         *telem_files = NULL;
+static guint                 telem_num_files = 0;
+static GThread              *telem_thread = NULL;
+static GMutex                telem_lock;
+static GCond                 telem_cond;
+static gboolean              telem_stopping = FALSE;
+
+static uint64_t
+telem_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int
+telem_read_file(int fd, uint64_t *value)
+{
+	char buf[32];
+	char *end = NULL;
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0) {
+		return 1;
+	}
+	buf[len] = '\0';
+
+	errno = 0;
+	*value = strtoull(buf, &end, 10);
+	if (errno || end == buf) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static uint64_t
+telem_read_range(const char *path, const char *name)
+{
+	char *dir = g_path_get_dirname(path);
+	char *range_path = g_build_filename(dir, name, NULL);
+	uint64_t range = 1UL << 32;     // RAPL energy counters are 32 bits
+	int fd;
+
+	fd = open(range_path, O_RDONLY);
+	if (fd >= 0) {
+		uint64_t value = 0;
+
+		// The counter wraps to zero after reaching the range value
+		if (telem_read_file(fd, &value) == 0 && value != 0) {
+			range = value + 1;
+		}
+		close(fd);
+	}
+
+	g_free(range_path);
+	g_free(dir);
+
+	return range;
+}
+
+//
+// telem_add_file - Claim a segment entry for path and open it for
+// sampling.  The entry table is open addressed with linear probing on
+// powerapi_telem_hash(path), and is never changed once the segment has
+// been published, so readers can look up entries without locking.
+//
+static void
+telem_add_file(const char *path, const telem_source_t *source)
+{
+	telem_file_t *file = &telem_files[telem_num_files];
+	uint32_t mask = telem_hdr->num_entries - 1;
+	uint32_t i;
+	int fd;
+
+	TRACE3_ENTER("path = '%s', source = %p", path, source);
+
+	if (strlen(path) >= POWERAPI_TELEM_PATH_LEN) {
+		LOG_DBG("telemetry path too long, skipping: %s", path);
+		goto done;
+	}
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOG_DBG("Unable to open %s for sampling: %m", path);
+		goto done;
+	}
+
+	for (i = powerapi_telem_hash(path) & mask;
+			telem_hdr->entries[i].path[0] != '\0';
+			i = (i + 1) & mask) {
+		if (strcmp(telem_hdr->entries[i].path, path) == 0) {
+			close(fd);
+			goto done;
+		}
+	}
+
+	strcpy(telem_hdr->entries[i].path, path);
+	telem_hdr->entries[i].status = PWR_RET_FAILURE;
+
+	file->fd = fd;
+	file->counter = source->counter;
+	file->range = source->range ? telem_read_range(path, source->range) : 0;
+	file->entry = &telem_hdr->entries[i];
+
+	telem_num_files++;
+	telem_hdr->num_used = telem_num_files;
+
+done:
+	TRACE3_EXIT("telem_num_files = %u", telem_num_files);
+}
+
+//
+// telem_sample_file - Read one file and publish the result.  The entry's
+// sequence count is odd while the entry is being updated, so a reader
+// that sees an odd count, or a count that changed while it was copying
+// the entry, knows to retry.
+//
+static void
+telem_sample_file(telem_file_t *file)
+{
+	powerapi_telem_entry_t *entry = file->entry;
+	uint64_t value = 0;
+	uint64_t now;
+	uint32_t seq;
+	int status;
+
+	status = telem_read_file(file->fd, &value) ? PWR_RET_FAILURE
+			: PWR_RET_SUCCESS;
+	now = telem_now();
+
+	seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	entry->status = status;
+	entry->ivalue = value;
+	entry->timestamp = now;
+	entry->rate_window = 0;
+
+	if (status == PWR_RET_SUCCESS && file->counter) {
+		if (file->primed && now > file->prev_time
+				&& (value >= file->prev_value || file->range)) {
+			uint64_t delta = value - file->prev_value;
+
+			if (value < file->prev_value) {
+				delta += file->range;
+			}
+
+			entry->rate_window = now - file->prev_time;
+			entry->rate = (double)delta * NSEC_PER_SEC
+					/ entry->rate_window;
+		}
+		file->primed = TRUE;
+		file->prev_value = value;
+		file->prev_time = now;
+	} else {
+		file->primed = FALSE;
+	}
+
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static gpointer
+telem_sample_files(gpointer data)
+{
+	gint64 interval = telem_hdr->interval / 1000;   // usec
+	gint64 next = g_get_monotonic_time();
+	guint i;
+
+	TRACE1_ENTER("data = %p", data);
+
+	g_mutex_lock(&telem_lock);
+	while (!telem_stopping) {
+		g_mutex_unlock(&telem_lock);
+
+		for (i = 0; i < telem_num_files; i++) {
+			telem_sample_file(&telem_files[i]);
+		}
+
+		g_mutex_lock(&telem_lock);
+
+		// Sample on a fixed schedule.  If sampling fell behind,
+		// skip the missed intervals rather than running back to back.
+		next += interval;
+		if (next < g_get_monotonic_time()) {
+			next = g_get_monotonic_time() + interval;
+		}
+		while (!telem_stopping
+				&& g_cond_wait_until(&telem_cond, &telem_lock, next))
+			;
+	}
+	g_mutex_unlock(&telem_lock);
+
+	TRACE1_EXIT("");
+
+	return NULL;
+}
+
+//
+// telemetry_start - Create the telemetry segment and start the thread
+// that samples into it every interval msec.  An interval of 0 disables
+// sampling.  Failure here isn't fatal: clients fall back to reading the
+// files directly when the segment is missing.
+//
+// Returns 0 on success, 1 on failure.
+//
+int
+telemetry_start(unsigned int interval)
+{
+	glob_t globs[G_N_ELEMENTS(telem_sources)];
+	size_t num_paths = 0;
+	uint32_t num_entries = MIN_TELEM_ENTRIES;
+	int retval = 1;
+	int fd = -1;
+	size_t i, j;
+
+	TRACE1_ENTER("interval = %u", interval);
+
+	memset(globs, 0, sizeof(globs));
+
+	if (interval == 0) {
+		LOG_DBG("Telemetry sampling disabled");
+		retval = 0;
+		goto done;
+	}
+
+	// Remove any segment left behind by a previous instance.
+	shm_unlink(POWERAPI_TELEM_SHM_NAME);
+
+	for (i = 0; i < G_N_ELEMENTS(telem_sources); i++) {
+		if (glob(telem_sources[i].pattern, 0, NULL, &globs[i]) == 0) {
+			num_paths += globs[i].gl_pathc;
+		}
+	}
+
+	if (num_paths == 0) {
+		LOG_MSG("No files to sample, telemetry disabled");
+		retval = 0;
+		goto done;
+	}
+
+	// Keep the table at most half full so lookups stay short.
+	while (num_entries < 2 * num_paths) {
+		num_entries <<= 1;
+	}
+
+	telem_size = sizeof(powerapi_telem_hdr_t)
+			+ num_entries * sizeof(powerapi_telem_entry_t);
+
+	fd = shm_open(POWERAPI_TELEM_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		LOG_FAULT("shm_open(%s) failed: %m", POWERAPI_TELEM_SHM_NAME);
+		goto done;
+	}
+
+	// Make the segment world readable regardless of umask.
+	if (fchmod(fd, 0644) != 0 || ftruncate(fd, telem_size) != 0) {
+		LOG_FAULT("Unable to size %s: %m", POWERAPI_TELEM_SHM_NAME);
+		goto done;
+	}
+
+	telem_hdr = mmap(NULL, telem_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	if (telem_hdr == MAP_FAILED) {
+		LOG_FAULT("mmap(%s) failed: %m", POWERAPI_TELEM_SHM_NAME);
+		telem_hdr = NULL;
+		goto done;
+	}
+
+	telem_hdr->version = POWERAPI_TELEM_VERSION;
+	telem_hdr->num_entries = num_entries;
+	telem_hdr->interval = (uint64_t)interval * 1000000UL;
+
+	telem_files = g_new0(telem_file_t, num_paths);
+	if (!telem_files) {
+		LOG_CRIT(MEM_ERROR_EXIT);
+		exit(1);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(telem_sources); i++) {
+		for (j = 0; j < globs[i].gl_pathc; j++) {
+			telem_add_file(globs[i].gl_pathv[j], &telem_sources[i]);
+		}
+	}
+
+	// Take a first sample before publishing the segment.
+	for (i = 0; i < telem_num_files; i++) {
+		telem_sample_file(&telem_files[i]);
+	}
+
+	// Readers don't use the segment until they see the magic number,
+	// so set it last.
+	__atomic_store_n(&telem_hdr->magic, POWERAPI_TELEM_MAGIC,
+			__ATOMIC_RELEASE);
+
+	g_mutex_init(&telem_lock);
+	g_cond_init(&telem_cond);
+	telem_stopping = FALSE;
+
+	telem_thread = g_thread_new("telemetry", telem_sample_files, NULL);
+	if (telem_thread == NULL) {
+		LOG_CRIT("Unable to create telemetry thread!");
+		exit(1);
+	}
+
+	LOG_MSG("Sampling %u files every %u msec into %s", telem_num_files,
+			interval, POWERAPI_TELEM_SHM_NAME);
+
+	retval = 0;
+
+done:
+	for (i = 0; i < G_N_ELEMENTS(telem_sources); i++) {
+		globfree(&globs[i]);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (retval) {
+		for (i = 0; i < telem_num_files; i++) {
+			close(telem_files[i].fd);
+		}
+		g_free(telem_files);
+		telem_files = NULL;
+		telem_num_files = 0;
+		if (telem_hdr) {
+			munmap(telem_hdr, telem_size);
+			telem_hdr = NULL;
+		}
+		shm_unlink(POWERAPI_TELEM_SHM_NAME);
+	}
+
+	TRACE1_EXIT("retval = %d, telem_num_files = %u", retval, telem_num_files);
+
+	return retval;
+}
+
+//
+// telemetry_stop - Stop sampling and remove the telemetry segment, so
+// clients go back to reading the files directly.
+//
+void
+telemetry_stop(void)
+{
+	guint i;
+
+	TRACE1_ENTER("telem_thread = %p", telem_thread);
+
+	if (telem_thread == NULL) {
+		goto done;
+	}
+
+	g_mutex_lock(&telem_lock);
+	telem_stopping = TRUE;
+	g_cond_signal(&telem_cond);
+	g_mutex_unlock(&telem_lock);
+
+	g_thread_join(telem_thread);
+	telem_thread = NULL;
+
+	shm_unlink(POWERAPI_TELEM_SHM_NAME);
+	munmap(telem_hdr, telem_size);
+	telem_hdr = NULL;
+
+	for (i = 0; i < telem_num_files; i++) {
+		close(telem_files[i].fd);
+	}
+	g_free(telem_files);
+	telem_files = NULL;
+	telem_num_files = 0;
+
+	g_cond_clear(&telem_cond);
+	g_mutex_clear(&telem_lock);
+
+done:
+	TRACE1_EXIT("");
+}
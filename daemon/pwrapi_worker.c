@@ -49,213 +49,13 @@
 #include "powerapid.h"
 #include "pwrapi_set.h"
 #include "pwrapi_worker.h"
-
-static int
-file_read_uint64(const char *filepath, uint64_t *value)
-{
-	FILE *fp = NULL;
-	uint64_t local_value = 0;
-	int retval = 1;
-
-	TRACE1_ENTER("filepath = '%s', value = %p", filepath, value);
-
-	fp = fopen(filepath, "r");
-	if (fp == NULL) {
-		LOG_FAULT("Unable to open %s: %m", filepath);
-		goto done;
-	}
-
-	if (fscanf(fp, "%ld", &local_value) != 1) {
-		LOG_FAULT("Error reading value from %s", filepath);
-		goto done;
-	}
-
-	*value = local_value;
-	retval = 0;
-
-done:
-	if (fp)
-		fclose(fp);
-
-	TRACE1_EXIT("retval = %d, *value = %ld", retval, *value);
-
-	return retval;
-}
-
-static int
-file_read_double(const char *filepath, double *value)
-{
-	FILE *fp = NULL;
-	double local_value = 0;
-	int retval = 1;
-
-	TRACE1_ENTER("filepath = '%s', value = %p", filepath, value);
-
-	fp = fopen(filepath, "r");
-	if (fp == NULL) {
-		LOG_FAULT("Unable to open %s: %m", filepath);
-		goto done;
-	}
-
-	if (fscanf(fp, "%lf", &local_value) != 1) {
-		LOG_FAULT("Error reading value from %s", filepath);
-		goto done;
-	}
-
-	*value = local_value;
-	retval = 0;
-
-done:
-	if (fp)
-		fclose(fp);
-	TRACE1_EXIT("retval = %d, *value = %lf", retval, *value);
-
-	return retval;
-}
-
-static int
-file_read_string(const char *filepath, char **value)
-{
-	FILE *fp = NULL;
-	char *str = NULL;
-	size_t size = 0;
-	ssize_t ret;
-	int retval = 1;
-
-	TRACE1_ENTER("filepath = '%s', value = %p", filepath, value);
-
-	fp = fopen(filepath, "r");
-	if (fp == NULL) {
-		LOG_FAULT("Unable to open %s: %m", filepath);
-		goto done;
-	}
-
-	ret = getline(&str, &size, fp);
-	if (ret < 0) {
-		LOG_FAULT("Error reading value from %s", filepath);
-		goto done;
-	}
-
-	if (ret > 0 && str[ret - 1] == '\n') {
-		str[ret - 1] = '\0';
-	}
-
-	*value = str;
-	retval = 0;
-
-done:
-	if (fp)
-		fclose(fp);
-
-	TRACE1_EXIT("retval = %d, *value = %p '%s'", retval, *value, *value);
-
-	return retval;
-}
-
-static int
-file_write_uint64(const char *filepath, uint64_t value)
-{
-	FILE *fp = NULL;
-	int retval = 1;
-
-	TRACE1_ENTER("filepath = '%s', value = %ld", filepath, value);
-
-	fp = fopen(filepath, "w");
-	if (fp == NULL) {
-		LOG_FAULT("Unable to open %s: %m", filepath);
-		goto done;
-	}
-
-	if (fprintf(fp, "%ld", value) < 0) {
-		LOG_FAULT("Error writing value (%ld) to %s", value, filepath);
-		goto done;
-	}
-
-	if (fflush(fp) != 0) {
-		LOG_FAULT("Error flushing value (%ld) to %s: %m", value, filepath);
-		goto done;
-	}
-
-	retval = 0;
-
-done:
-	if (fp)
-		fclose(fp);
-
-	TRACE1_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-static int
-file_write_double(const char *filepath, double value)
-{
-	FILE *fp = NULL;
-	int retval = 1;
-
-	TRACE1_ENTER("filepath = '%s', value = %lf", filepath, value);
-
-	fp = fopen(filepath, "w");
-	if (fp == NULL) {
-		LOG_FAULT("Unable to open %s: %m", filepath);
-		goto done;
-	}
-
-	if (fprintf(fp, "%lf", value) < 0) {
-		LOG_FAULT("Error writing value (%lf) to %s", value, filepath);
-		goto done;
-	}
-
-	if (fflush(fp) != 0) {
-		LOG_FAULT("Error flushing value (%lf) to %s: %m", value, filepath);
-		goto done;
-	}
-
-	retval = 0;
-
-done:
-	if (fp)
-		fclose(fp);
-
-	TRACE1_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-static int
-file_write_string(const char *filepath, const char *value)
-{
-	FILE *fp = NULL;
-	int retval = 1;
-
-	TRACE1_ENTER("filepath = '%s', str = %p '%s'", filepath, value, value);
-
-	fp = fopen(filepath, "w");
-	if (fp == NULL) {
-		LOG_FAULT("Unable to open %s: %m", filepath);
-		goto done;
-	}
-
-	if (fprintf(fp, "%s", value) < 0) {
-		LOG_FAULT("Error writing value '%s' to %s", value, filepath);
-		goto done;
-	}
-
-	if (fflush(fp) != 0) {
-		LOG_FAULT("Error flushing value '%s' to %s: %m", value, filepath);
-		goto done;
-	}
-
-	retval = 0;
-
-done:
-	if (fp)
-		fclose(fp);
-
-	TRACE1_EXIT("retval = %d", retval);
-
-	return retval;
-}
+#include "pwrapi_journal.h"
+#include "pwrapi_stats.h"
+#include "pwrapi_powercap.h"
+#include "pwrapi_file.h"
+#include "pwrapi_defaults.h"
+#include "pwrapi_cpufreq.h"
+#include "pwrapi_pmqos.h"
 
 static int
 get_cstates_count(const char *path)
@@ -388,7 +188,8 @@ read_value_by_type(const char *path, PWR_AttrDataType data_type,
 	return retval;
 }
 
-static int
+// Read an attribute's current value from its control file into setp.
+int
 read_attr_value(set_info_t *setp)
 {
 	powerapi_setreq_t *setreq;
@@ -404,7 +205,12 @@ read_attr_value(set_info_t *setp)
 
 	switch (setreq->attribute) {
 	case PWR_ATTR_CSTATE_LIMIT:
-		retval = read_cstate_limit(path, &value->ivalue);
+		if (setreq->object == PWR_OBJ_NODE) {
+			retval = read_value_by_type(path, setreq->data_type,
+					value);
+		} else {
+			retval = read_cstate_limit(path, &value->ivalue);
+		}
 		break;
 	case PWR_ATTR_GOV:
 		retval = read_governor(path, &value->ivalue);
@@ -477,6 +283,50 @@ write_governor(const char *path, uint64_t ivalue)
 	return retval;
 }
 
+// The node power cap is a budget enforced by the power cap controller,
+// which is told of it before the file clients read is updated.
+static int
+write_node_budget(const char *path, uint64_t budget)
+{
+	int retval = 1;
+
+	TRACE2_ENTER("path = '%s', budget = %ld", path, budget);
+
+	if (powercap_set_budget(budget) != 0) {
+		LOG_FAULT("No power cap controller to hold node budget %ld uW",
+				budget);
+		goto done;
+	}
+
+	retval = file_write_uint64(path, budget);
+
+done:
+	TRACE2_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+// The node C-state limit is held as a PM QoS latency request, which is
+// made before the file clients read is updated.
+static int
+write_node_cstate_limit(const char *path, uint64_t limit)
+{
+	int retval = 1;
+
+	TRACE2_ENTER("path = '%s', limit = %ld", path, limit);
+
+	if (pmqos_set_cstate_limit(limit) != 0) {
+		goto done;
+	}
+
+	retval = file_write_uint64(path, limit);
+
+done:
+	TRACE2_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
 static int
 write_value_by_type(const char *path, PWR_AttrDataType data_type,
 		const type_union_t *value)
@@ -505,12 +355,48 @@ write_value_by_type(const char *path, PWR_AttrDataType data_type,
 	return retval;
 }
 
+// Remember the value a path is known to hold, or forget it if the
+// value is unknown.  Called with the owning worker's lock held.
+static void
+record_written_value(const set_info_t *setp, gboolean known)
+{
+	const char *path = setp->setreq.path;
+	worker_info_t *worker = worker_lookup(path);
+	type_union_t *written;
+
+	TRACE2_ENTER("setp = %p, known = %d", setp, known);
+
+	if (!known) {
+		g_hash_table_remove(worker->written, path);
+		TRACE2_EXIT("");
+		return;
+	}
+
+	written = g_hash_table_lookup(worker->written, path);
+	if (written == NULL) {
+		written = g_new0(type_union_t, 1);
+		if (!written) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		g_hash_table_insert(worker->written, g_strdup(path), written);
+	}
+	*written = setp->setreq.value;
+
+	TRACE2_EXIT("");
+}
+
+// Write an attribute value to its control file.  Writes of the value
+// the file is already known to hold are skipped.  The caller must hold
+// the lock of the worker which owns the path.
 int
 write_attr_value(const set_info_t *setp)
 {
 	const powerapi_setreq_t *setreq;
 	const char *path;
 	const type_union_t *value;
+	const type_union_t *written;
+	uint64_t start;
 	int retval = 1;
 
 	TRACE1_ENTER("setp = %p", setp);
@@ -519,9 +405,31 @@ write_attr_value(const set_info_t *setp)
 	path = setreq->path;
 	value = &setreq->value;
 
+	written = g_hash_table_lookup(worker_lookup(path)->written, path);
+	if (written && set_value_equal(setreq->data_type, written, value)) {
+		LOG_DBG("Skipping write of %s, value unchanged", path);
+		stats_count(STATS_WRITES_SKIPPED, 1);
+		retval = 0;
+		goto done;
+	}
+
+	start = stats_now();
+
 	switch (setreq->attribute) {
 	case PWR_ATTR_CSTATE_LIMIT:
-		retval = write_cstate_limit(path, value->ivalue);
+		if (setreq->object == PWR_OBJ_NODE) {
+			retval = write_node_cstate_limit(path, value->ivalue);
+		} else {
+			retval = write_cstate_limit(path, value->ivalue);
+		}
+		break;
+	case PWR_ATTR_POWER_LIMIT_MAX:
+		if (setreq->object == PWR_OBJ_NODE) {
+			retval = write_node_budget(path, value->ivalue);
+		} else {
+			retval = write_value_by_type(path, setreq->data_type,
+					value);
+		}
 		break;
 	case PWR_ATTR_GOV:
 		retval = write_governor(path, value->ivalue);
@@ -531,15 +439,97 @@ write_attr_value(const set_info_t *setp)
 		break;
 	}
 
+	stats_record(STATS_WRITE, start);
+	stats_path_write(path, retval != 0);
+	if (retval) {
+		stats_count(STATS_WRITE_ERRORS, 1);
+	}
+
+	// A failed write may have been partially applied (e.g. c-state
+	// limits span several files), so the file contents are unknown.
+	record_written_value(setp, retval == 0);
+
+done:
 	TRACE1_EXIT("retval = %d", retval);
 
 	return retval;
 }
 
-static void
-worker_process_item(set_info_t *newset)
+// find the worker that owns an attribute path
+worker_info_t *
+worker_lookup(const char *path)
+{
+	worker_info_t *worker;
+
+	TRACE3_ENTER("path = '%s'", path);
+
+	worker = &workers[g_str_hash(path) % num_workers];
+
+	TRACE3_EXIT("worker = %d", worker->id);
+
+	return worker;
+}
+
+// Queue a set request for the worker that owns its path.  The caller
+// holds a reference to the requesting socket for the worker to drop.
+void
+worker_queue_set(set_info_t *setp)
+{
+	TRACE2_ENTER("setp = %p", setp);
+
+	// Hyperthreads sharing a cpufreq policy share its control files.
+	cpufreq_policy_path(&setp->setreq);
+
+	stats_queue_depth(1);
+	setp->queued = stats_now();
+
+	g_async_queue_push(worker_lookup(setp->setreq.path)->queue, setp);
+
+	TRACE2_EXIT("");
+}
+
+// number of closed sockets whose sets are still being rolled back
+static gint releases_pending = 0;
+
+// Queue the roll back of a closed socket's sets.  Every worker is sent a
+// release item, behind any set requests from the socket already queued,
+// and rolls back the sets for the paths it owns.  The last worker to
+// finish ends the socket's session in the journal.
+void
+worker_release(socket_info_t *skinfo)
+{
+	int i;
+
+	TRACE1_ENTER("skinfo = %p", skinfo);
+
+	// Set requests from a closed socket that are still queued are
+	// discarded, so no more sets will be added to my_changes.
+	g_atomic_int_set(&skinfo->closed, TRUE);
+	g_atomic_int_set(&skinfo->releasing, num_workers);
+	g_atomic_int_inc(&releases_pending);
+
+	for (i = 0; i < num_workers; i++) {
+		set_info_t *item = g_new0(set_info_t, 1);
+
+		if (!item) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		item->skinfo = socket_ref(skinfo);
+		item->release = TRUE;
+		g_async_queue_push(workers[i].queue, item);
+	}
+
+	TRACE1_EXIT("");
+}
+
+// Update the default, my_changes and all_changes tables for a new set
+// request.  Returns 0 if the request was accepted, in which case the
+// caller owes the client a response.  Otherwise the request has been
+// disposed of, and answered if the client is still there.
+static int
+worker_accept_item(set_info_t *newset)
 {
-	int retval = PWR_RET_SUCCESS;
 	char *path;
 	socket_info_t *skinfo;
 	set_info_t *defset;
@@ -551,15 +541,31 @@ worker_process_item(set_info_t *newset)
 	path = newset->setreq.path;
 	skinfo = newset->skinfo;
 
-	defset = g_hash_table_lookup(def_values, path);
+	// The client went away while this request was queued.  Its other
+	// changes have already been rolled back, so just drop it.
+	if (g_atomic_int_get(&skinfo->closed)) {
+		LOG_DBG("Dropping request for %s from closed socket %d",
+				path, skinfo->sockid);
+		set_destroy(newset);
+		TRACE1_EXIT("dropped");
+		return 1;
+	}
+
+	defset = set_lookup(def_values, path);
 	persist = is_persistent(skinfo);
 
 	if (defset == NULL || persist) {
 		powerapi_setreq_t *setreq;
 		type_union_t *value;
+		gboolean ahead = FALSE;
 
 		if (defset == NULL) {
 			defset = set_create_item(&newset->setreq, NULL);
+
+			// Claim any default read ahead even if it isn't
+			// needed, since it goes stale once the path is written.
+			ahead = defaults_take(&defset->setreq,
+					&defset->setreq.value);
 		} else {
 			set_remove(defset, def_values);
 		}
@@ -570,14 +576,18 @@ worker_process_item(set_info_t *newset)
 		if (persist) {
 			*value = newset->setreq.value;
 		} else {
-			if (read_attr_value(defset) != 0) {
+			if (!ahead && read_attr_value(defset) != 0) {
 				LOG_FAULT("Unable to read default value for %s!", path);
-				send_ret_code_response(skinfo, PWR_RET_FAILURE);
+				send_ret_code_response(skinfo, PWR_RET_FAILURE,
+						newset->on_ring);
 				set_destroy(defset);
 				set_destroy(newset);
-				TRACE1_EXIT("");
-				return;
+				TRACE1_EXIT("failed");
+				return 1;
 			}
+
+			// the file holds the default
+			record_written_value(defset, TRUE);
 		}
 
 		switch (setreq->attribute) {
@@ -604,11 +614,12 @@ worker_process_item(set_info_t *newset)
 		defset->timestamp = g_get_real_time();
 
 		set_insert(defset, def_values);
+		journal_default(defset);
 	}
 
 	// Check if this attribute has already been set from this socket
 	// (my_changes). If it has, remove it so we can update it.
-	oldset = g_hash_table_lookup(skinfo->my_changes, path);
+	oldset = set_lookup(skinfo->my_changes, path);
 	if (oldset != NULL) {
 		// set request is present in my_changes, remove it from
 		// my_changes and all_changes
@@ -619,44 +630,279 @@ worker_process_item(set_info_t *newset)
 	newset->timestamp = g_get_real_time();
 
 	set_insert(newset, skinfo->my_changes);
+	journal_set(newset);
+
+	TRACE1_EXIT("accepted");
+
+	return 0;
+}
+
+// a client waiting for the outcome of a coalesced write
+typedef struct {
+	socket_info_t    *skinfo;      // requesting socket (referenced)
+	PWR_AttrDataType  data_type;   // data type of the requested value
+	type_union_t      value;       // requested value
+	gboolean          on_ring;     // answered on the request ring
+} worker_reply_t;
+
+// the queued work for a single path
+typedef struct {
+	char   *path;        // attribute path
+	GSList *sets;        // new set requests, in arrival order
+	GSList *rollbacks;   // sets of closed sockets to roll back
+} worker_group_t;
+
+// Process all queued work for a single path.  The sets of closed sockets
+// are rolled back, then every new request updates the tables in arrival
+// order, then the resulting top priority value is written once.  A client
+// is told of a write failure only if the value it asked for is the one
+// that failed to be written.
+static void
+worker_process_path(worker_info_t *worker, worker_group_t *group)
+{
+	GSList *iter;
+	GSList *replies = NULL;
+	guint num_items = 0;
+	type_union_t top_value = { 0 };
+	int write_failed = FALSE;
+
+	TRACE1_ENTER("worker = %d, path = '%s'", worker->id, group->path);
+
+	g_mutex_lock(&worker->lock);
+
+	for (iter = group->rollbacks; iter; iter = iter->next) {
+		set_rollback(iter->data);
+		stats_count(STATS_ROLLBACKS, 1);
+		num_items++;
+	}
 
-	// Find the top priority value for this attribute in all_changes
-	GSList *slist = g_hash_table_lookup(all_changes, path);
-	set_info_t *top = slist->data;
-	if (attr_value_comp(newset, top) == 0) {
-		// new set request is the highest priority value, make the change
-		if (write_attr_value(newset) != 0) {
+	for (iter = group->sets; iter; iter = iter->next) {
+		set_info_t *newset = iter->data;
+		socket_info_t *skinfo = newset->skinfo;
+		worker_reply_t *reply;
+
+		if (worker_accept_item(newset) != 0) {
+			socket_unref(skinfo);
+			continue;
+		}
+
+		reply = g_new0(worker_reply_t, 1);
+		if (!reply) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		reply->skinfo = skinfo;
+		reply->data_type = newset->setreq.data_type;
+		reply->value = newset->setreq.value;
+		reply->on_ring = newset->on_ring;
+		replies = g_slist_prepend(replies, reply);
+		num_items++;
+	}
+
+	if (num_items > 0) {
+		if (group->rollbacks) {
+			LOG_MSG("Rolling back %u client values of %s",
+					g_slist_length(group->rollbacks), group->path);
+		}
+		if (num_items > 1) {
+			LOG_DBG("Coalesced %u requests for %s",
+					num_items, group->path);
+			stats_count(STATS_COALESCED, num_items - 1);
+		}
+
+		// Find the top priority value for this attribute in
+		// all_changes and make it so.
+		set_info_t *top = set_top(group->path);
+
+		top_value = top->setreq.value;
+		if (write_attr_value(top) != 0) {
+			write_failed = TRUE;
+		}
+	}
+
+	g_mutex_unlock(&worker->lock);
+
+	replies = g_slist_reverse(replies);
+	for (iter = replies; iter; iter = iter->next) {
+		worker_reply_t *reply = iter->data;
+		int retval = PWR_RET_SUCCESS;
+
+		if (write_failed && set_value_equal(reply->data_type,
+					&reply->value, &top_value)) {
 			retval = PWR_RET_FAILURE;
 		}
+
+		send_ret_code_response(reply->skinfo, retval, reply->on_ring);
+		socket_unref(reply->skinfo);
+	}
+
+	g_slist_free_full(replies, g_free);
+
+	TRACE1_EXIT("");
+}
+
+// find or add the group for a path
+static worker_group_t *
+worker_group_lookup(GHashTable *groups, GSList **order, const char *path)
+{
+	worker_group_t *group;
+
+	group = g_hash_table_lookup(groups, path);
+	if (group == NULL) {
+		group = g_new0(worker_group_t, 1);
+		if (!group) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		group->path = g_strdup(path);
+		if (!group->path) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
+		g_hash_table_insert(groups, group->path, group);
+		*order = g_slist_prepend(*order, group);
 	}
 
-	send_ret_code_response(skinfo, retval);
+	return group;
+}
 
-	TRACE1_EXIT("retval = %d", retval);
+// number of closed sockets with sets yet to be rolled back
+int
+worker_releases_pending(void)
+{
+	return g_atomic_int_get(&releases_pending);
+}
+
+// Add the sets of a closed socket for paths this worker owns to their
+// groups.  Sets from the socket queued ahead of the release item are
+// discarded when processed, and those processed before it are already
+// in my_changes, so no set is missed.
+static void
+worker_expand_release(worker_info_t *worker, socket_info_t *skinfo,
+		GHashTable *groups, GSList **order)
+{
+	GList *sets, *iter;
+
+	TRACE2_ENTER("worker = %d, skinfo = %p", worker->id, skinfo);
+
+	// other workers remove their paths' sets concurrently
+	g_mutex_lock(&changes_lock);
+	sets = g_hash_table_get_values(skinfo->my_changes);
+	g_mutex_unlock(&changes_lock);
+
+	for (iter = sets; iter; iter = iter->next) {
+		set_info_t *setp = iter->data;
+		worker_group_t *group;
+
+		if (worker_lookup(setp->setreq.path) != worker) {
+			continue;
+		}
+
+		group = worker_group_lookup(groups, order, setp->setreq.path);
+		group->rollbacks = g_slist_prepend(group->rollbacks, setp);
+	}
+	g_list_free(sets);
+
+	TRACE2_EXIT("");
+}
+
+// finish the release of a closed socket once this worker's share of its
+// sets has been rolled back
+static void
+worker_release_done(set_info_t *item)
+{
+	socket_info_t *skinfo = item->skinfo;
+
+	TRACE2_ENTER("skinfo = %p", skinfo);
+
+	if (g_atomic_int_dec_and_test(&skinfo->releasing)) {
+		journal_session_end(skinfo);
+		g_atomic_int_add(&releases_pending, -1);
+	}
+
+	socket_unref(skinfo);
+	set_destroy(item);
+
+	TRACE2_EXIT("");
 }
 
 gpointer
 worker_process_items(gpointer data)
 {
+	worker_info_t *worker = data;
+	int exiting = FALSE;
+
 	TRACE1_ENTER("data = %p", data);
 
-	g_async_queue_ref(work_queue);
+	g_async_queue_ref(worker->queue);
 
-	while (daemon_run) {
+	// Keep going until the request to exit, so that every rollback
+	// queued during shutdown is done.
+	while (!exiting) {
 		set_info_t *setp = NULL;
+		GHashTable *groups = NULL;
+		GSList *order = NULL;
+		GSList *releases = NULL;
+		GSList *iter;
+
+		// Wait for work, then drain everything else already queued
+		// and group it by path, keeping the order of first arrival.
+		groups = g_hash_table_new(g_str_hash, g_str_equal);
+		if (!groups) {
+			LOG_CRIT(MEM_ERROR_EXIT);
+			exit(1);
+		}
 
-		setp = g_async_queue_pop(work_queue);
-		if (setp->skinfo == NULL) {
-			// Must be a request to exit.
-			continue;
+		for (setp = g_async_queue_pop(worker->queue); setp;
+				setp = g_async_queue_try_pop(worker->queue)) {
+			char *path = setp->setreq.path;
+			worker_group_t *group;
+
+			if (setp->skinfo == NULL) {
+				// Must be a request to exit.
+				exiting = TRUE;
+				continue;
+			}
+
+			if (setp->release) {
+				LOG_DBG("worker %d: release of socket %d arrived",
+						worker->id, setp->skinfo->sockid);
+				worker_expand_release(worker, setp->skinfo, groups,
+						&order);
+				releases = g_slist_prepend(releases, setp);
+				continue;
+			}
+
+			stats_queue_depth(-1);
+			stats_record(STATS_QUEUE_WAIT, setp->queued);
+
+			LOG_DBG("worker %d: work item arrived: %s",
+					worker->id, path);
+
+			group = worker_group_lookup(groups, &order, path);
+			group->sets = g_slist_prepend(group->sets, setp);
 		}
 
-		LOG_DBG("work item arrived: %s", setp->setreq.path);
+		g_hash_table_destroy(groups);
+
+		order = g_slist_reverse(order);
+		for (iter = order; iter; iter = iter->next) {
+			worker_group_t *group = iter->data;
+
+			group->sets = g_slist_reverse(group->sets);
+			worker_process_path(worker, group);
+
+			g_slist_free(group->sets);
+			g_slist_free(group->rollbacks);
+			g_free(group->path);
+			g_free(group);
+		}
+		g_slist_free(order);
 
-		worker_process_item(setp);
+		g_slist_free_full(releases, (GDestroyNotify)worker_release_done);
 	}
 
-	g_async_queue_unref(work_queue);
+	g_async_queue_unref(worker->queue);
 
 	TRACE1_EXIT("");
 
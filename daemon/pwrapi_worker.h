@@ -39,7 +39,30 @@
 #include <cray-powerapi/powerapid.h>
 #include "pwrapi_set.h"
 
-int      write_attr_value(const set_info_t *setp);
-gpointer worker_process_items(gpointer data);
+// Attribute paths are sharded across the worker threads by a hash of the
+// path, so that all requests for a given path are processed in order by
+// the same worker while unrelated paths are written in parallel.
+typedef struct {
+	int          id;        // index of this worker
+	GAsyncQueue *queue;     // set requests for paths owned by this worker
+	GMutex       lock;      // held while processing an owned path
+	GThread     *thread;    // worker thread
+	GHashTable  *written;   // last value written to each owned path
+} worker_info_t;
+
+#define DEFAULT_NUM_WORKERS	4
+#define MAX_NUM_WORKERS		64
+
+// msec between checks for the end of queued rollbacks while waiting to
+// mark the daemon state clean
+#define RELEASE_POLL_INTERVAL	100
+
+int            read_attr_value(set_info_t *setp);
+int            write_attr_value(const set_info_t *setp);
+worker_info_t *worker_lookup(const char *path);
+void           worker_queue_set(set_info_t *setp);
+void           worker_release(socket_info_t *skinfo);
+int            worker_releases_pending(void);
+gpointer       worker_process_items(gpointer data);
 
 #endif // _POWERAPI_WORKER_H
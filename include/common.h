@@ -36,9 +36,24 @@
 #define __COMMON_H__
 
 #include <cray-powerapi/types.h>
+#include <cray-powerapi/powerapid.h>
 
 PWR_AttrGov pwr_string_to_gov(const char *str);
 const char *pwr_gov_to_string(PWR_AttrGov gov);
 
+// names a directory to use in place of POWERAPI_RUNDIR_PATH
+#define PWR_RUNDIR_ENV "PWR_RUNDIR"
+
+const char *pwr_rundir_path(const char *path);
+
+// powerapid's paths, as mapped by pwr_rundir_path()
+#define PWR_PIDFILE_PATH      pwr_rundir_path(POWERAPID_PIDFILE_PATH)
+#define PWR_SOCKET_PATH       pwr_rundir_path(POWERAPID_SOCKET_PATH)
+#define PWR_WORKDIR_PATH      pwr_rundir_path(POWERAPID_WORKDIR_PATH)
+#define PWR_STATE_DIRTY_PATH  pwr_rundir_path(POWERAPID_STATE_DIRTY_PATH)
+#define PWR_JOURNAL_PATH      pwr_rundir_path(POWERAPID_JOURNAL_PATH)
+#define PWR_NODE_BUDGET_PATH  pwr_rundir_path(POWERAPID_NODE_BUDGET_PATH)
+#define PWR_NODE_CSTATE_PATH  pwr_rundir_path(POWERAPID_NODE_CSTATE_PATH)
+
 #endif /* __COMMON_H__ */
 
@@ -212,6 +212,22 @@ int CRAYPWR_AttrGetList(PWR_ObjType obj, size_t len, const char **str_list,
                         int *val_list);
 int CRAYPWR_AttrGetName(PWR_AttrName attr, char *buf, size_t max);
 PWR_AttrName CRAYPWR_AttrGetEnum(const char *attrname);
+int CRAYPWR_CntxtSnapshot(PWR_Cntxt context, int count,
+                          CRAYPWR_Snapshot snap[]);
+int CRAYPWR_GrpPrepareRead(PWR_Grp group, PWR_AttrName attr);
+int CRAYPWR_ObjAttrGetValueAsync(PWR_Obj object, PWR_AttrName attr,
+                                 void *value, PWR_Time *ts,
+                                 CRAYPWR_RequestCallback callback, void *data,
+                                 CRAYPWR_Request *request);
+int CRAYPWR_GrpAttrGetValueAsync(PWR_Grp group, PWR_AttrName attr,
+                                 void *values, PWR_Time ts[],
+                                 PWR_Status status,
+                                 CRAYPWR_RequestCallback callback, void *data,
+                                 CRAYPWR_Request *request);
+int CRAYPWR_RequestTest(CRAYPWR_Request request, int *done, int *retval);
+int CRAYPWR_RequestWait(CRAYPWR_Request request, int *retval);
+int CRAYPWR_RequestDestroy(CRAYPWR_Request request);
+int CRAYPWR_CntxtGetRequestFd(PWR_Cntxt context, int *fd);
 
 #ifdef __cplusplus
 }
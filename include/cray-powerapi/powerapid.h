@@ -36,6 +36,7 @@
 #define _POWERAPID_H
 
 #include <limits.h>
+#include <stdint.h>
 #include <cray-powerapi/types.h>
 
 /*
@@ -53,7 +54,11 @@ typedef enum {
     PwrAUTH = 0,    // authentication request
     PwrSET,         // obj/attr set value request
     PwrLOGLVL,      // set debug/trace level
-    PwrDUMP         // dump state request
+    PwrDUMP,        // dump state request
+    PwrPERMS,       // modify permitted uids request
+    PwrSTATS,       // daemon statistics request
+    PwrSHMEM,       // shared memory request ring request
+    PwrCLOSE        // end a session opened on a shared connection
 } powerapi_reqtype_t;
 
 /*
@@ -69,14 +74,120 @@ typedef struct {
     int  trclvl;         // trace level (-1 to 3)
 } powerapi_loglvlresp_t;
 
+/*
+ * Permissions request
+ */
+typedef enum {
+    PwrPERMS_ADD = 0,   // permit uid
+    PwrPERMS_REMOVE,    // stop permitting uid
+    PwrPERMS_CLEAR,     // permit no uids
+    PwrPERMS_RESTORE    // permit the boot-time uids
+} powerapi_permsop_t;
+
+typedef struct {
+    powerapi_permsop_t op;
+    unsigned int       uid;    // uid to add or remove
+} powerapi_permsreq_t;
+
+/*
+ * Statistics request/response
+ *
+ * The response to a PwrSTATS request is followed on the socket by
+ * num_records powerapi_stats_record_t structures.  Latency histograms
+ * are log-linear: values below POWERAPI_STATS_SUB_BUCKETS have a bucket
+ * each, and every power of two above that is split into
+ * POWERAPI_STATS_SUB_BUCKETS equal buckets.  The last bucket also holds
+ * everything too large for the others.
+ */
+#define POWERAPI_STATS_SUB_BITS     2
+#define POWERAPI_STATS_SUB_BUCKETS  (1 << POWERAPI_STATS_SUB_BITS)
+#define POWERAPI_STATS_BUCKETS      128     // up to ~8.6 sec in nsec
+#define POWERAPI_STATS_NAME_LEN     128
+
+typedef enum {
+    PwrSTATS_COUNTER = 0,   // count is the number of events
+    PwrSTATS_GAUGE,         // count is the current level, max the highest
+    PwrSTATS_HISTOGRAM,     // latencies in nsec
+    PwrSTATS_PATH           // count is the number of writes to name,
+                            // sum the number of failed writes
+} powerapi_statstype_t;
+
+typedef struct {
+    int  reset;          // clear the statistics after reporting them
+} powerapi_statsreq_t;
+
+typedef struct {
+    uint32_t num_records;   // records following the response
+} powerapi_statsresp_t;
+
+typedef struct {
+    powerapi_statstype_t type;
+    char     name[POWERAPI_STATS_NAME_LEN];
+    uint64_t count;                 // events, level or samples
+    uint64_t sum;                   // sum of samples
+    uint64_t max;                   // largest sample or level
+    uint64_t buckets[POWERAPI_STATS_BUCKETS];   // samples per bucket
+} powerapi_stats_record_t;
+
+// histogram bucket that holds a value
+static inline unsigned int
+powerapi_stats_bucket(uint64_t value)
+{
+    unsigned int bit, bucket;
+
+    if (value < POWERAPI_STATS_SUB_BUCKETS)
+        return value;
+
+    bit = 63 - __builtin_clzll(value);
+    bucket = (bit - POWERAPI_STATS_SUB_BITS + 1) * POWERAPI_STATS_SUB_BUCKETS +
+        ((value >> (bit - POWERAPI_STATS_SUB_BITS)) &
+         (POWERAPI_STATS_SUB_BUCKETS - 1));
+
+    return (bucket < POWERAPI_STATS_BUCKETS) ?
+        bucket : POWERAPI_STATS_BUCKETS - 1;
+}
+
+// smallest value held by a histogram bucket
+static inline uint64_t
+powerapi_stats_bucket_min(unsigned int bucket)
+{
+    unsigned int bit, sub;
+
+    if (bucket < POWERAPI_STATS_SUB_BUCKETS)
+        return bucket;
+
+    bit = bucket / POWERAPI_STATS_SUB_BUCKETS + POWERAPI_STATS_SUB_BITS - 1;
+    sub = bucket % POWERAPI_STATS_SUB_BUCKETS;
+
+    return (uint64_t)(POWERAPI_STATS_SUB_BUCKETS + sub) <<
+        (bit - POWERAPI_STATS_SUB_BITS);
+}
+
 /*
  * Auth request/response
+ *
+ * A connection is authorized once, by a PwrAUTH request on channel 0,
+ * which starts the connection's own session.  Contexts in a process may
+ * instead share a connection, each opening a session of its own with a
+ * PwrAUTH request on channel POWERAPI_CHANNEL_NEW.  The response gives
+ * the new session's channel, which the context's later requests carry.
+ * Each session's sets are rolled back when it's ended by a PwrCLOSE
+ * request on its channel, or when the connection closes.
  */
+#define POWERAPI_CHANNEL_NEW    UINT32_MAX
+
 typedef struct {
     PWR_Role role;
     char     context_name[PWR_MAX_STRING_LEN + 1];
+    uint64_t session;    // session to reclaim after reconnecting, or 0
 } powerapi_authreq_t;
 
+typedef struct {
+    uint64_t session;    // session token for reconnecting
+    int      reclaimed;  // requested session and its sets were reclaimed
+    uint32_t channel;    // channel of the session on the connection
+} powerapi_authresp_t;
+
 /*
  * Set request/response
  */
@@ -94,10 +205,13 @@ typedef struct {
  */
 typedef struct {
     powerapi_reqtype_t       ReqType;
+    uint32_t                 channel;   // session on the connection
     union {
         powerapi_authreq_t   auth;
         powerapi_setreq_t    set;
         powerapi_loglvlreq_t loglvl;
+        powerapi_permsreq_t  perms;
+        powerapi_statsreq_t  stats;
     };
 } powerapi_request_t;
 
@@ -108,10 +222,106 @@ typedef struct {
     int                retval;		// return value to client
     uint64_t           sequence;	// sequence number
     union {
+        powerapi_authresp_t   auth;	// auth response message
         powerapi_loglvlresp_t loglvl;	// loglvl response message
+        powerapi_statsresp_t  stats;	// stats response message
     };
 } powerapi_response_t;
 
+/*
+ * Shared memory request ring
+ *
+ * An authorized client may ask, with a PwrSHMEM request, to send its set
+ * requests through a ring in shared memory instead of the socket.  The
+ * response to the PwrSHMEM request carries POWERAPI_RING_FDS descriptors
+ * with SCM_RIGHTS: a sealed memfd holding a powerapi_ring_t, an eventfd
+ * the client writes to wake the daemon and an eventfd the daemon writes
+ * to wake the client.  The socket stays open for the other requests, and
+ * its closing still ends the session.
+ *
+ * Each ring has a single producer and a single consumer, and the heads
+ * and tails count slots ever used, so a ring holds head - tail entries.
+ * Entries are published by storing head with release ordering and taken
+ * by loading it with acquire ordering.  Each side only writes to the
+ * eventfd when the other has said it's about to sleep, by setting
+ * daemon_idle or client_waiting.  The flag and the head it guards are
+ * stored and loaded sequentially consistent, so that either the sleeper
+ * sees the new entry or the producer sees the flag.
+ */
+#define POWERAPI_RING_MAGIC         0x50575252      // "PWRR"
+#define POWERAPI_RING_VERSION       1
+#define POWERAPI_RING_SLOTS         16              // a power of two
+#define POWERAPI_RING_FDS           3               // memfd, req, resp
+
+typedef struct {
+    uint32_t magic;                 // POWERAPI_RING_MAGIC
+    uint32_t version;               // POWERAPI_RING_VERSION
+
+    // written by the client
+    uint32_t req_head __attribute__((aligned(64)));
+    uint32_t resp_tail;
+    uint32_t client_waiting;        // client is waiting for a response
+
+    // written by the daemon
+    uint32_t req_tail __attribute__((aligned(64)));
+    uint32_t resp_head;
+    uint32_t daemon_idle;           // daemon is waiting for a request
+
+    powerapi_setreq_t   req[POWERAPI_RING_SLOTS] __attribute__((aligned(64)));
+    powerapi_response_t resp[POWERAPI_RING_SLOTS];
+} powerapi_ring_t;
+
+/*
+ * Telemetry shared memory segment
+ *
+ * powerapid periodically samples read-only measurement files (pm_counters,
+ * RAPL energy counters, HT current frequency) into a shared memory segment.
+ * The segment is a header followed by an open addressed hash table of
+ * entries keyed by the sampled file's pathname, so a reader can find the
+ * entry for a file without searching.  Each entry is protected by its own
+ * sequence lock: the writer makes seq odd before updating the entry and
+ * even again afterward, and a reader retries if seq was odd or changed
+ * while it copied the entry.
+ */
+#define POWERAPI_TELEM_SHM_NAME     "/powerapid-telemetry"
+#define POWERAPI_TELEM_MAGIC        0x50575254      // "PWRT"
+#define POWERAPI_TELEM_VERSION      1
+#define POWERAPI_TELEM_PATH_LEN     128
+
+typedef struct {
+    uint32_t seq;                   // sequence lock, odd while updating
+    int32_t  status;                // PWR_RET_SUCCESS if sample is valid
+    char     path[POWERAPI_TELEM_PATH_LEN]; // sampled file, "" if unused
+    uint64_t ivalue;                // value read from the file
+    uint64_t timestamp;             // time of sample, nsec since Epoch
+    double   rate;                  // change in ivalue per second
+    uint64_t rate_window;           // nsec over which rate was computed,
+                                    // 0 if rate is not valid
+} powerapi_telem_entry_t;
+
+typedef struct {
+    uint32_t magic;                 // POWERAPI_TELEM_MAGIC once ready
+    uint32_t version;               // POWERAPI_TELEM_VERSION
+    uint32_t num_entries;           // size of entries, a power of two
+    uint32_t num_used;              // entries with a path
+    uint64_t interval;              // nsec between samples
+    powerapi_telem_entry_t entries[];
+} powerapi_telem_hdr_t;
+
+// FNV-1a hash of an entry pathname, used to index the entry table
+static inline uint32_t
+powerapi_telem_hash(const char *path)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*path) {
+        hash ^= (unsigned char)*path++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
 // state directory for powerapi
 #define POWERAPI_STATEDIR_PATH "/var/opt/cray/powerapi"
 
@@ -136,6 +346,23 @@ typedef struct {
 // if this file exists, the daemon state is dirty
 #define POWERAPID_STATE_DIRTY_PATH POWERAPID_WORKDIR_PATH "/dirty"
 
+// journal of daemon state, replayed to recover from an abnormal exit
+#define POWERAPID_JOURNAL_PATH POWERAPID_WORKDIR_PATH "/journal"
+
+// node power budget, in uW, held by the daemon's power cap controller;
+// a node's PWR_ATTR_POWER_LIMIT_MAX is set by having the daemon write it
+#define POWERAPID_NODE_BUDGET_PATH POWERAPID_WORKDIR_PATH "/node_power_budget"
+
+// node power budget value meaning there is no budget
+#define POWERAPID_NODE_BUDGET_NONE UINT64_MAX
+
+// node C-state limit, held by the daemon as a PM QoS latency request;
+// only present when the daemon holds node C-state limits this way
+#define POWERAPID_NODE_CSTATE_PATH POWERAPID_WORKDIR_PATH "/node_cstate_limit"
+
+// node C-state limit value meaning there is no limit
+#define POWERAPID_NODE_CSTATE_NONE UINT64_MAX
+
 // if this file exists, a daemon restart is allowed
 // it is in /tmp so that it is ephemeral and goes away each boot
 #define POWERAPID_ALLOW_RESTART_PATH "/tmp/powerapid-allow-restart"
@@ -63,6 +63,7 @@ typedef void* PWR_Grp;
 typedef void* PWR_Obj;
 typedef void* PWR_Status;
 typedef void* PWR_Stat;
+typedef void* CRAYPWR_Request;
 
 /*
  * Context types.
@@ -381,4 +382,29 @@ typedef enum {
 	PWR_PERF_NOT_SPECIFIED = -2,
 } PWR_PerfState;
 
+/*
+ * One column of a snapshot taken with CRAYPWR_CntxtSnapshot(): an attribute
+ * of every object of a type at or below the context's entry point, indexed
+ * by object in hierarchy order.  The caller allocates the arrays.
+ */
+typedef struct {
+	PWR_ObjType type;	// The object type to sample
+	PWR_AttrName attr;	// The attribute to sample
+	int len;		// The number of objects the arrays can hold
+	int count;		// Returned number of objects of the type
+	void *values;		// 8 byte value per object
+	PWR_Time *ts;		// Timestamp per object, or NULL
+	int *status;		// Return code per object, or NULL
+	PWR_Obj *objs;		// Object per index, or NULL
+} CRAYPWR_Snapshot;
+
+/*
+ * Called on a library thread when an asynchronous request completes, with
+ * the return code of the read and the data passed when it was made.  A
+ * request made without asking for its handle is destroyed once this
+ * returns.  The context can't be destroyed from the callback.
+ */
+typedef void (*CRAYPWR_RequestCallback)(CRAYPWR_Request request, int retval,
+		void *data);
+
 #endif /* _PWR_TYPES_H */
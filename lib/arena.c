@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains the arena allocator that holds the objects of a
+ * hierarchy.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <log.h>
+
+#include "arena.h"
+
+// Size of a chunk, and the alignment of every allocation in it
+#define ARENA_CHUNK_SIZE	(16 * 1024)
+#define ARENA_ALIGN		16
+
+typedef struct arena_chunk_s arena_chunk_t;
+struct arena_chunk_s {
+	arena_chunk_t	*next;		// previously filled chunk
+	size_t		 size;		// bytes available in data
+	size_t		 used;		// bytes handed out from data
+	char		 data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+struct arena_s {
+	arena_chunk_t	*chunks;	// chunk being filled, first
+};
+
+static arena_chunk_t *
+arena_chunk_new(arena_t *arena, size_t size)
+{
+	arena_chunk_t *chunk;
+
+	chunk = g_malloc(sizeof(arena_chunk_t) + size);
+	if (!chunk) {
+		return NULL;
+	}
+	chunk->size = size;
+	chunk->used = 0;
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	return chunk;
+}
+
+arena_t *
+arena_new(void)
+{
+	arena_t *arena;
+
+	TRACE3_ENTER("");
+
+	arena = g_new0(arena_t, 1);
+
+	TRACE3_EXIT("arena = %p", arena);
+
+	return arena;
+}
+
+void
+arena_free(arena_t *arena)
+{
+	arena_chunk_t *chunk;
+
+	TRACE3_ENTER("arena = %p", arena);
+
+	if (arena) {
+		while ((chunk = arena->chunks) != NULL) {
+			arena->chunks = chunk->next;
+			g_free(chunk);
+		}
+		g_free(arena);
+	}
+
+	TRACE3_EXIT("");
+}
+
+void *
+arena_alloc0(arena_t *arena, size_t size)
+{
+	arena_chunk_t *chunk = arena->chunks;
+	void *ptr = NULL;
+
+	TRACE3_ENTER("arena = %p, size = %zu", arena, size);
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		// Anything too big for a chunk gets a chunk of its own
+		chunk = arena_chunk_new(arena, MAX(size, ARENA_CHUNK_SIZE));
+		if (!chunk) {
+			LOG_FAULT("Failed to alloc arena chunk");
+			goto done;
+		}
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	memset(ptr, 0, size);
+
+done:
+	TRACE3_EXIT("ptr = %p", ptr);
+
+	return ptr;
+}
+
+char *
+arena_strdup_vprintf(arena_t *arena, const char *fmt, va_list args)
+{
+	va_list copy;
+	char *str = NULL;
+	int len;
+
+	TRACE3_ENTER("arena = %p, fmt = '%s'", arena, fmt);
+
+	va_copy(copy, args);
+	len = vsnprintf(NULL, 0, fmt, copy);
+	va_end(copy);
+	if (len < 0) {
+		goto done;
+	}
+
+	str = arena_alloc0(arena, len + 1);
+	if (str) {
+		vsnprintf(str, len + 1, fmt, args);
+	}
+
+done:
+	TRACE3_EXIT("str = %p", str);
+
+	return str;
+}
@@ -43,6 +43,7 @@
 #include "attributes.h"
 #include "hierarchy.h"
 #include "context.h"
+#include "plan.h"
 #include "timer.h"
 #include "utility.h"
 
@@ -283,37 +284,7 @@ PWR_ObjAttrGetValue(PWR_Obj object, PWR_AttrName attr, void *value,
 		goto error_handling;
 	}
 
-	// All cases set retval to final value
-	switch (obj->type) {
-	case PWR_OBJ_NODE:
-		retval = node_attr_get_value(to_node(obj), attr, value,
-				&tspec);
-		break;
-	case PWR_OBJ_SOCKET:
-		retval = socket_attr_get_value(to_socket(obj), attr, value,
-				&tspec);
-		break;
-	case PWR_OBJ_CORE:
-		retval = core_attr_get_value(to_core(obj), attr, value,
-				&tspec);
-		break;
-	case PWR_OBJ_POWER_PLANE:
-		retval = pplane_attr_get_value(to_pplane(obj), attr, value,
-				&tspec);
-		break;
-	case PWR_OBJ_MEM:
-		retval = mem_attr_get_value(to_mem(obj), attr, value,
-				&tspec);
-		break;
-	case PWR_OBJ_HT:
-		retval = ht_attr_get_value(to_ht(obj), attr, value,
-				&tspec);
-		break;
-	default:
-		LOG_FAULT("Invalid PWR_Obj type %u", obj->type);
-		retval = PWR_RET_FAILURE;
-		break;
-	}
+	retval = obj_attr_get_value(obj, attr, value, &tspec);
 
 	// Return if not successful.
 	if (retval != PWR_RET_SUCCESS) {
@@ -378,37 +349,12 @@ PWR_ObjAttrSetValue(PWR_Obj object, PWR_AttrName attr, const void *value)
 		goto error_handling;
 	}
 
-	// All cases set retval to final value
-	switch (obj->type) {
-	case PWR_OBJ_NODE:
-		retval = node_attr_set_value(to_node(obj), context->ipc,
-				attr, value);
-		break;
-	case PWR_OBJ_SOCKET:
-		retval = socket_attr_set_value(to_socket(obj), context->ipc,
-				attr, value);
-		break;
-	case PWR_OBJ_CORE:
-		retval = core_attr_set_value(to_core(obj), context->ipc,
-				attr, value);
-		break;
-	case PWR_OBJ_POWER_PLANE:
-		retval = pplane_attr_set_value(to_pplane(obj), context->ipc,
-				attr, value);
-		break;
-	case PWR_OBJ_MEM:
-		retval = mem_attr_set_value(to_mem(obj), context->ipc,
-				attr, value);
-		break;
-	case PWR_OBJ_HT:
-		retval = ht_attr_set_value(to_ht(obj), context->ipc,
-				attr, value);
-		break;
-	default:
-		LOG_FAULT("Invalid PWR_Obj type %u", obj->type);
-		retval = PWR_RET_FAILURE;
-		break;
-	}
+	// Hyperthreads below the object may share cpufreq policies
+	ipc_batch_begin(context->ipc);
+
+	retval = obj_attr_set_value(obj, context->ipc, attr, value);
+
+	ipc_batch_end(context->ipc);
 
 error_handling:
 	TRACE1_EXIT("retval = %d", retval);
@@ -576,6 +522,66 @@ error_handling:
 	return retval;
 }
 
+// the read set kept for reading attrs from every object in a group
+static read_set_t *
+group_read_set(PWR_Grp group, int count, const PWR_AttrName attrs[])
+{
+	context_t *context = NULL;
+	read_set_t *set = NULL;
+	GString *key = NULL;
+	int i;
+
+	context = opaque_map_lookup_context(opaque_map,
+			OPAQUE_GET_CONTEXT_KEY(group));
+	if (!context) {
+		return NULL;
+	}
+
+	key = g_string_new(NULL);
+	g_string_append_printf(key, "group %p", OPAQUE_GET_DATA_KEY(group));
+	for (i = 0; i < count; i++) {
+		g_string_append_printf(key, " %d", attrs[i]);
+	}
+
+	set = context_read_set(context, key->str);
+
+	g_string_free(key, TRUE);
+
+	return set;
+}
+
+// Read a group attribute through a plan prepared by CRAYPWR_GrpPrepareRead()
+static int
+group_plan_get_value(plan_t *plan, void *values, PWR_Time ts[],
+		status_t *stat)
+{
+	int *errcodes = NULL;
+	int retval;
+	int i;
+
+	// Errors are only looked at when there is a status to report them to
+	if (stat) {
+		errcodes = g_new(int, plan->nsteps);
+		if (!errcodes) {
+			LOG_FAULT("unable to allocate error codes!");
+			return PWR_RET_FAILURE;
+		}
+	}
+
+	retval = plan_run(plan, values, ts, errcodes);
+
+	for (i = 0; stat && i < plan->nsteps; i++) {
+		if (errcodes[i] != PWR_RET_SUCCESS) {
+			push_status_error(stat, plan->steps[i].handle,
+					plan->attr, i, errcodes[i]);
+		}
+	}
+
+	g_free(errcodes);
+
+	return retval;
+}
+
 /**
  * Per specification, this gets a specific attribute for all objects in a
  * specified group, and returns the attribute value through an array, and the
@@ -613,6 +619,8 @@ PWR_GrpAttrGetValue(PWR_Grp group, PWR_AttrName attr, void *values,
 		    PWR_Time ts[], PWR_Status status)
 {
 	status_t *stat = NULL;
+	group_t *grp = NULL;
+	plan_t *plan = NULL;
 	int num_objs;
 	int i;
 	int retval = PWR_RET_FAILURE;
@@ -634,6 +642,17 @@ PWR_GrpAttrGetValue(PWR_Grp group, PWR_AttrName attr, void *values,
 	}
 	clear_status(stat);
 
+	// A prepared read has already found the objects and their getters
+	grp = opaque_map_lookup_group(opaque_map, OPAQUE_GET_DATA_KEY(group));
+	if (grp) {
+		plan = group_read_plan(grp, attr);
+	}
+	if (plan) {
+		retval = group_plan_get_value(plan, values, ts, stat);
+		plan_unref(plan);
+		goto error_handling;
+	}
+
 	// We will iterate over elements in the group
 	// An empty group is valid
 	num_objs = PWR_GrpGetNumObjs(group);
@@ -643,6 +662,9 @@ PWR_GrpAttrGetValue(PWR_Grp group, PWR_AttrName attr, void *values,
 		goto error_handling;
 	}
 
+	// Read the group's files together, as the last read learned them
+	read_cache_begin(group_read_set(group, 1, &attr));
+
 	// Any failure results in call failure
 	retval = PWR_RET_SUCCESS;
 	for (i = 0; i < num_objs; i++) {
@@ -667,12 +689,26 @@ PWR_GrpAttrGetValue(PWR_Grp group, PWR_AttrName attr, void *values,
 		}
 	}
 
+	read_cache_end();
+
 error_handling:
 	TRACE1_EXIT("retval = %d", retval);
 
 	return retval;
 }
 
+// the IPC of the context a group belongs to
+static ipc_t *
+group_ipc(PWR_Grp group)
+{
+	context_t *context = NULL;
+
+	context = opaque_map_lookup_context(opaque_map,
+			OPAQUE_GET_CONTEXT_KEY(group));
+
+	return context ? context->ipc : NULL;
+}
+
 /**
  * Per specification, this sets a specific attribute for all objects in a
  * specified group. The attribute is set to the same value for all objects.
@@ -704,6 +740,7 @@ PWR_GrpAttrSetValue(PWR_Grp group, PWR_AttrName attr, const void *value,
 	status_t *stat = NULL;
 	int num_objs;
 	int i;
+	ipc_t *ipc = NULL;
 	int retval = PWR_RET_FAILURE;
 
 	TRACE1_ENTER("group = %p, attr = %d, value = %p, status = %p",
@@ -732,6 +769,12 @@ PWR_GrpAttrSetValue(PWR_Grp group, PWR_AttrName attr, const void *value,
 		goto error_handling;
 	}
 
+	// Objects of the group may share cpufreq policies
+	ipc = group_ipc(group);
+	if (ipc) {
+		ipc_batch_begin(ipc);
+	}
+
 	// Any failure results in call failure
 	retval = PWR_RET_SUCCESS;
 	for (i = 0; i < num_objs; i++) {
@@ -755,6 +798,10 @@ PWR_GrpAttrSetValue(PWR_Grp group, PWR_AttrName attr, const void *value,
 		}
 	}
 
+	if (ipc) {
+		ipc_batch_end(ipc);
+	}
+
 error_handling:
 	TRACE1_EXIT("retval = %d", retval);
 
@@ -839,6 +886,9 @@ PWR_GrpAttrGetValues(PWR_Grp group, int count, const PWR_AttrName attrs[],
 		goto error_handling;
 	}
 
+	// Read the group's files together, as the last read learned them
+	read_cache_begin(group_read_set(group, count, attrs));
+
 	// Any failure results in call failure
 	retval = PWR_RET_SUCCESS;
 	offset = 0;				// incremented in the inner loop
@@ -871,6 +921,8 @@ PWR_GrpAttrGetValues(PWR_Grp group, int count, const PWR_AttrName attrs[],
 		}
 	}
 
+	read_cache_end();
+
 error_handling:
 	TRACE1_EXIT("retval = %d", retval);
 
@@ -909,6 +961,7 @@ PWR_GrpAttrSetValues(PWR_Grp group, int count, const PWR_AttrName attrs[],
 	status_t *stat = NULL;
 	int num_objs;
 	int i, j;
+	ipc_t *ipc = NULL;
 	int retval = PWR_RET_FAILURE;
 
 	TRACE1_ENTER("group = %p, count = %d, attrs = %p, values = %p, "
@@ -946,6 +999,12 @@ PWR_GrpAttrSetValues(PWR_Grp group, int count, const PWR_AttrName attrs[],
 		goto error_handling;
 	}
 
+	// Objects of the group may share cpufreq policies
+	ipc = group_ipc(group);
+	if (ipc) {
+		ipc_batch_begin(ipc);
+	}
+
 	// Any failure results in call failure
 	retval = PWR_RET_SUCCESS;
 	for (i = 0; i < num_objs; i++) {	// outer loop over objects in group
@@ -976,12 +1035,168 @@ PWR_GrpAttrSetValues(PWR_Grp group, int count, const PWR_AttrName attrs[],
 		}
 	}
 
+	if (ipc) {
+		ipc_batch_end(ipc);
+	}
+
 error_handling:
 	TRACE1_EXIT("retval = %d", retval);
 
 	return retval;
 }
 
+// State of the hierarchy walk taking a CRAYPWR_CntxtSnapshot()
+typedef struct {
+	context_t		*ctx;
+	int			count;
+	CRAYPWR_Snapshot	*snap;
+	int			retval;
+} snapshot_walk_t;
+
+// Sample every column of the snapshot that covers a hierarchy object
+static gboolean
+snapshot_obj(GNode *gnode, gpointer data)
+{
+	snapshot_walk_t *walk = data;
+	obj_t *obj = to_obj(gnode->data);
+	struct timespec tspec;
+	int errcode;
+	int idx;
+	int i;
+
+	for (i = 0; i < walk->count; i++) {
+		CRAYPWR_Snapshot *snap = &walk->snap[i];
+
+		if (snap->type != obj->type) {
+			continue;
+		}
+
+		idx = snap->count++;
+		if (idx >= snap->len) {
+			if (walk->retval == PWR_RET_SUCCESS) {
+				walk->retval = PWR_RET_WARN_TRUNC;
+			}
+			continue;
+		}
+
+		if (snap->objs) {
+			snap->objs[idx] = OPAQUE_GENERATE(walk->ctx->opaque.key,
+					obj->opaque.key);
+		}
+
+		errcode = obj_attr_get_value(obj, snap->attr,
+				snap->values+8*idx, &tspec);
+		if (snap->status) {
+			snap->status[idx] = errcode;
+		}
+		if (snap->ts) {
+			snap->ts[idx] = (errcode == PWR_RET_SUCCESS) ?
+				pwr_tspec_to_nsec(&tspec) : PWR_TIME_UNKNOWN;
+		}
+		if (errcode != PWR_RET_SUCCESS) {
+			walk->retval = PWR_RET_FAILURE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Cray extension that samples a set of attributes for every object at or
+ * below the entry point of a context in a single walk of the hierarchy.
+ *
+ * Each CRAYPWR_Snapshot names an object type and attribute, and returns the
+ * attribute of each object of that type in caller-allocated arrays, indexed
+ * by the object's position in the hierarchy, which is the same in every
+ * snapshot of the context. Objects are sampled one after another, and each
+ * file is read only once per call, so attributes and objects with the same
+ * source (a socket's power and energy, hyperthreads in one cpufreq policy)
+ * share a read and its timestamp. Files read by the last snapshot of the
+ * same attributes are read ahead together.
+ *
+ * 'values' must point to memory of at least (len*8) bytes. 'ts', 'status'
+ * and 'objs' are optional, and hold len entries when supplied. On return,
+ * 'count' is the number of objects of the type, which may exceed len.
+ *
+ * @param context - context to sample
+ * @param count - number of snapshot columns (>= 0)
+ * @param snap - array of count snapshot columns
+ *
+ * @return int - return code
+ *   PWR_RET_SUCCESS = all attributes returned successfully
+ *   PWR_RET_WARN_TRUNC = a column had more objects than it could hold
+ *   PWR_RET_FAILURE = one or more attributes failed, see 'status'
+ *   PWR_RET_INVALID = bad context or arguments, nothing was sampled
+ */
+int
+CRAYPWR_CntxtSnapshot(PWR_Cntxt context, int count, CRAYPWR_Snapshot snap[])
+{
+	snapshot_walk_t walk = { 0 };
+	GString *key = NULL;
+	opaque_key_t context_key = OPAQUE_GET_CONTEXT_KEY(context);
+	opaque_key_t data_key = OPAQUE_GET_DATA_KEY(context);
+	int i;
+
+	TRACE1_ENTER("context = %p, count = %d, snap = %p",
+			context, count, snap);
+
+	walk.retval = PWR_RET_INVALID;
+
+	// Verify this is a context by ensuring the context key
+	// matches the data key.
+	if (context_key != data_key) {
+		LOG_FAULT("Opaque reference is not valid for a context");
+		goto error_handling;
+	}
+
+	walk.ctx = opaque_map_lookup_context(opaque_map, data_key);
+	if (!walk.ctx) {
+		LOG_FAULT("Failed to find context key = %p", data_key);
+		goto error_handling;
+	}
+
+	if (!walk.ctx->entry_point) {
+		LOG_FAULT("Context '%s' entry point not set", walk.ctx->name);
+		goto error_handling;
+	}
+
+	// Sanity checks
+	if (count < 0 || (count > 0 && snap == NULL)) {
+		LOG_FAULT("Invalid snapshot count %d, snap %p", count, snap);
+		goto error_handling;
+	}
+	for (i = 0; i < count; i++) {
+		if (snap[i].len < 0 || (snap[i].len > 0 &&
+				snap[i].values == NULL)) {
+			LOG_FAULT("Invalid snapshot column %d", i);
+			goto error_handling;
+		}
+		snap[i].count = 0;
+	}
+
+	walk.count = count;
+	walk.snap = snap;
+	walk.retval = PWR_RET_SUCCESS;
+
+	key = g_string_new("snapshot");
+	for (i = 0; i < count; i++) {
+		g_string_append_printf(key, " %d:%d", snap[i].type,
+				snap[i].attr);
+	}
+
+	read_cache_begin(context_read_set(walk.ctx, key->str));
+	g_node_traverse(walk.ctx->entry_point, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
+			snapshot_obj, &walk);
+	read_cache_end();
+
+	g_string_free(key, TRUE);
+
+error_handling:
+	TRACE1_EXIT("retval = %d", walk.retval);
+
+	return walk.retval;
+}
+
 /**
  * Create a status object. This object is contextless, and can be reused in any
  * context.
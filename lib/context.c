@@ -35,6 +35,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include <cray-powerapi/api.h>
@@ -45,8 +47,12 @@
 #include "hierarchy.h"
 #include "context.h"
 
+// Most repeated reads a context keeps read sets for
+#define CONTEXT_READ_SETS_MAX	64
+
 // Maps the name of a context to the address of the context structure.
 static GHashTable *context_name_map = NULL;
+static GMutex context_name_lock;
 
 // Create a new group under management of the context.
 group_t *
@@ -62,9 +68,11 @@ context_new_group(context_t *context)
 		goto error_handling;
 	}
 
+	g_rec_mutex_lock(&context->lock);
 	context->group_list = g_list_prepend(context->group_list,
 							group);
 	group->link = context->group_list;
+	g_rec_mutex_unlock(&context->lock);
 	group->context_key = context->opaque.key;
 
 error_handling:
@@ -79,10 +87,12 @@ context_del_group(context_t *context, group_t *group)
 {
 	TRACE2_ENTER("context = %p, group = %p", context, group);
 
+	g_rec_mutex_lock(&context->lock);
 	if (group->link)
 		context->group_list =
 			g_list_delete_link(context->group_list,
 					   group->link);
+	g_rec_mutex_unlock(&context->lock);
 	del_group(group);
 
 	TRACE2_EXIT("");
@@ -101,8 +111,10 @@ context_new_status(context_t *context)
 	}
 
 	// Link status to the context
+	g_rec_mutex_lock(&context->lock);
 	context->status_list = g_list_prepend(context->status_list, stat);
 	stat->link = context->status_list;
+	g_rec_mutex_unlock(&context->lock);
 	stat->context_key = context->opaque.key;
 
 error_handling:
@@ -115,10 +127,12 @@ context_del_status(context_t *context, status_t *stat)
 {
 	TRACE2_ENTER("context = %p, stat = %p", context, stat);
 
+	g_rec_mutex_lock(&context->lock);
 	if (stat->link)
 		context->status_list =
 			g_list_delete_link(context->status_list,
 					   stat->link);
+	g_rec_mutex_unlock(&context->lock);
 	del_status(stat);
 
 	TRACE2_EXIT("");
@@ -137,8 +151,10 @@ context_new_statistic(context_t *context)
 	}
 
 	// Link statistic to the context
+	g_rec_mutex_lock(&context->lock);
 	context->stat_list = g_list_prepend(context->stat_list, stat);
 	stat->ctx_link = context->stat_list;
+	g_rec_mutex_unlock(&context->lock);
 	stat->context_key = context->opaque.key;
 
 error_handling:
@@ -151,15 +167,185 @@ context_del_statistic(context_t *context, stat_t *stat)
 {
 	TRACE2_ENTER("context = %p, stat = %p", context, stat);
 
+	g_rec_mutex_lock(&context->lock);
 	if (stat->ctx_link)
 		context->stat_list =
 			g_list_delete_link(context->stat_list,
 					   stat->ctx_link);
+	g_rec_mutex_unlock(&context->lock);
 	del_stat(stat);
 
 	TRACE2_EXIT("");
 }
 
+// A read set no thread is using can be dropped
+static gboolean
+read_set_idle(gpointer key, gpointer value, gpointer user_data)
+{
+	read_set_t *set = value;
+
+	if (!read_set_trylock(set))
+		return FALSE;
+	read_set_unlock(set);
+
+	return TRUE;
+}
+
+// Find the read set kept for a repeated read, identified by key, and claim
+// it for the calling thread.  Returns NULL if another thread has it.
+read_set_t *
+context_read_set(context_t *context, const char *key)
+{
+	read_set_t *set = NULL;
+
+	TRACE2_ENTER("context = %p, key = '%s'", context, key);
+
+	// Sets are only claimed and dropped under the context lock, so an
+	// idle set can't be claimed while it is being freed.
+	g_rec_mutex_lock(&context->lock);
+
+	set = g_hash_table_lookup(context->read_sets, key);
+	if (set) {
+		if (!read_set_trylock(set))
+			set = NULL;
+	} else {
+		// Drop the idle sets rather than track which are still useful
+		if (g_hash_table_size(context->read_sets)
+				>= CONTEXT_READ_SETS_MAX) {
+			g_hash_table_foreach_remove(context->read_sets,
+					read_set_idle, NULL);
+		}
+
+		set = read_set_new();
+		if (set) {
+			read_set_trylock(set);
+			g_hash_table_insert(context->read_sets,
+					g_strdup(key), set);
+		}
+	}
+
+	g_rec_mutex_unlock(&context->lock);
+
+	TRACE2_EXIT("set = %p", set);
+
+	return set;
+}
+
+request_t *
+context_new_request(context_t *context)
+{
+	request_t *request = NULL;
+
+	TRACE2_ENTER("context = %p", context);
+
+	request = new_request();
+	if (!request) {
+		goto error_handling;
+	}
+
+	// Link request to the context
+	g_rec_mutex_lock(&context->lock);
+	context->request_list = g_list_prepend(context->request_list, request);
+	request->link = context->request_list;
+	g_rec_mutex_unlock(&context->lock);
+	request->context_key = context->opaque.key;
+
+error_handling:
+	TRACE2_EXIT("request = %p", request);
+	return request;
+}
+
+void
+context_del_request(context_t *context, request_t *request)
+{
+	TRACE2_ENTER("context = %p, request = %p", context, request);
+
+	g_rec_mutex_lock(&context->lock);
+	if (request->link)
+		context->request_list =
+			g_list_delete_link(context->request_list,
+					   request->link);
+	g_rec_mutex_unlock(&context->lock);
+	del_request(request);
+
+	TRACE2_EXIT("");
+}
+
+// Hand a request to the context's worker threads, starting them the
+// first time.
+int
+context_queue_request(context_t *context, request_t *request)
+{
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("context = %p, request = %p", context, request);
+
+	g_rec_mutex_lock(&context->lock);
+
+	if (!context->workers) {
+		context->workers = g_thread_pool_new(request_run, context,
+				REQUEST_WORKERS, FALSE, NULL);
+		if (!context->workers) {
+			LOG_FAULT("unable to start request worker threads!");
+			goto unlock;
+		}
+	}
+
+	if (!g_thread_pool_push(context->workers, request, NULL)) {
+		LOG_FAULT("unable to queue request!");
+		goto unlock;
+	}
+
+	status = PWR_RET_SUCCESS;
+
+unlock:
+	g_rec_mutex_unlock(&context->lock);
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+// The eventfd counting the context's completed requests, made the first
+// time it is asked for.  Returns -1 if it can't be made.
+int
+context_request_fd(context_t *context)
+{
+	int fd;
+
+	TRACE2_ENTER("context = %p", context);
+
+	g_rec_mutex_lock(&context->lock);
+	if (context->request_fd < 0) {
+		context->request_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (context->request_fd < 0) {
+			LOG_FAULT("unable to create request eventfd: %m");
+		}
+	}
+	fd = context->request_fd;
+	g_rec_mutex_unlock(&context->lock);
+
+	TRACE2_EXIT("fd = %d", fd);
+
+	return fd;
+}
+
+// Count a completed request on the context's eventfd, if anyone asked
+// for it.
+void
+context_notify_request(context_t *context)
+{
+	TRACE2_ENTER("context = %p", context);
+
+	g_rec_mutex_lock(&context->lock);
+	if (context->request_fd >= 0) {
+		eventfd_write(context->request_fd, 1);
+	}
+	g_rec_mutex_unlock(&context->lock);
+
+	TRACE2_EXIT("");
+}
+
 static void
 del_context(context_t *context)
 {
@@ -169,10 +355,18 @@ del_context(context_t *context)
 		// Nesting termination of the AppHint logging application
 		app_hint_term();
 
+		// Let queued requests finish while what they read still
+		// exists.  Contexts can't be destroyed from a callback.
+		if (context->workers)
+			g_thread_pool_free(context->workers, FALSE, TRUE);
+
 		if (context->opaque.key != 0)
 			opaque_map_remove(opaque_map, context->opaque.key);
-		if (context->name)
+		if (context->name) {
+			g_mutex_lock(&context_name_lock);
 			g_hash_table_remove(context_name_map, context->name);
+			g_mutex_unlock(&context_name_lock);
+		}
 		del_ipc(context->ipc);
 		/*
 		 * NOTE: deleting the hierarchy will delete all of the objects,
@@ -190,9 +384,20 @@ del_context(context_t *context)
 			g_list_free_full(context->stat_list,
 					 stat_destroy_callback);
 		}
+		if (context->request_list) {
+			g_list_free_full(context->request_list,
+					 request_destroy_callback);
+		}
+		if (context->request_fd >= 0) {
+			close(context->request_fd);
+		}
 		if (context->hintnames) {
 			g_sequence_free(context->hintnames);
 		}
+		if (context->read_sets) {
+			g_hash_table_destroy(context->read_sets);
+		}
+		g_rec_mutex_clear(&context->lock);
 		g_free(context->name);
 		g_free(context);
 	}
@@ -216,6 +421,8 @@ new_context(PWR_CntxtType type, PWR_Role role, const char *name)
 		goto error_handling;
 	}
 
+	g_rec_mutex_init(&context->lock);
+	context->request_fd = -1;
 	context->type = type;
 	context->role = role;
 	context->name = g_strdup(name);
@@ -228,12 +435,19 @@ new_context(PWR_CntxtType type, PWR_Role role, const char *name)
 	context->group_list  = NULL;
 	context->status_list = NULL;
 	context->stat_list   = NULL;
+	context->request_list = NULL;
 	context->hintnames   = g_sequence_new(NULL);
 	if (!context->hintnames) {
 		error = 1;
 		goto error_handling;
 	}
 	context->hintunique  = 0;
+	context->read_sets   = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify)read_set_free);
+	if (!context->read_sets) {
+		error = 1;
+		goto error_handling;
+	}
 
 	// Create the hierarchy of power objects
 	context->hierarchy = new_hierarchy();
@@ -244,14 +458,16 @@ new_context(PWR_CntxtType type, PWR_Role role, const char *name)
 	context->entry_point = context->hierarchy->tree;
 
 	// Setup the mechanism for IPC to powerapid
-	context->ipc = new_ipc(IPC_SOCKET, context->name, context->role);
+	context->ipc = new_ipc(IPC_SHMEM, context->name, context->role);
 	if (!context->ipc) {
 		error = 1;
 		goto error_handling;
 	}
 
 	// Add context to the context name map
+	g_mutex_lock(&context_name_lock);
 	g_hash_table_insert(context_name_map, context->name, context);
+	g_mutex_unlock(&context_name_lock);
 
 	// Add context to the opaque map
 	if (opaque_map_insert(opaque_map, OPAQUE_CONTEXT,
@@ -311,13 +527,15 @@ PWR_CntxtInit(PWR_CntxtType type, PWR_Role role, const char *name,
 
 	// If the file scope context name map hasn't been initialized,
 	// do it now.
+	g_mutex_lock(&context_name_lock);
 	if (!context_name_map) {
 		context_name_map = g_hash_table_new(g_str_hash, g_str_equal);
-		if (!context_name_map) {
-			LOG_FAULT("Failed to create context name map");
-			status = PWR_RET_FAILURE;
-			goto failure_return;
-		}
+	}
+	g_mutex_unlock(&context_name_lock);
+	if (!context_name_map) {
+		LOG_FAULT("Failed to create context name map");
+		status = PWR_RET_FAILURE;
+		goto failure_return;
 	}
 
 	// Only PWR_CNTXT_DEFAULT implemented at this time
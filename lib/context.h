@@ -46,6 +46,8 @@
 #include "ipc.h"
 #include "opaque.h"
 #include "statistics.h"
+#include "request.h"
+#include "plugins/common/file.h"
 
 // Internal definition of the PWR_Cntxt opaque object.
 // see typedefs.h for:
@@ -63,6 +65,12 @@ struct context_s {
 	GList		*group_list;	// List of allocated groups
 	GList		*status_list;	// List of allocated status objects
 	GList		*stat_list;	// List of allocated statistics objects
+	GList		*request_list;	// List of asynchronous requests
+	GThreadPool	*workers;	// Threads running requests, or NULL
+	int		request_fd;	// Eventfd for completions, or -1
+	GHashTable	*read_sets;	// Repeated read -> read_set_t
+	GRecMutex	lock;		// Guards the lists, hintnames, read_sets,
+					// workers, request_fd
 };
 
 group_t  *context_new_group(context_t *context);
@@ -71,6 +79,12 @@ status_t *context_new_status(context_t *context);
 void	  context_del_status(context_t *context, status_t *stat);
 stat_t   *context_new_statistic(context_t *context);
 void	  context_del_statistic(context_t *context, stat_t *stat);
+read_set_t *context_read_set(context_t *context, const char *key);
+request_t *context_new_request(context_t *context);
+void	  context_del_request(context_t *context, request_t *request);
+int	  context_queue_request(context_t *context, request_t *request);
+int	  context_request_fd(context_t *context);
+void	  context_notify_request(context_t *context);
 
 #endif /* _PWR_CONTEXT_H */
 
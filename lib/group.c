@@ -38,6 +38,7 @@
 
 #include "group.h"
 #include "context.h"
+#include "plan.h"
 #include "utility.h"
 
 // This is a function used by glib, so it uses glib basic types.
@@ -118,6 +119,25 @@ void group_invalidate_statistics(group_t *group)
 	}
 }
 
+// Replace the group's prepared read, NULL to drop it
+static void
+group_set_plan(group_t *group, plan_t *plan)
+{
+	context_t *ctx = NULL;
+	plan_t *old = NULL;
+
+	ctx = opaque_map_lookup_context(opaque_map, group->context_key);
+	if (ctx)
+		g_rec_mutex_lock(&ctx->lock);
+	old = group->plan;
+	group->plan = plan;
+	if (ctx)
+		g_rec_mutex_unlock(&ctx->lock);
+
+	// Readers running the old plan hold their own reference
+	plan_unref(old);
+}
+
 void
 del_group(group_t *group)
 {
@@ -132,6 +152,7 @@ del_group(group_t *group)
 	// because the statistics' monitoring threads use the group's opaque
 	// key.
 	group_invalidate_statistics(group);
+	group_set_plan(group, NULL);
 
 	// If the group has an opaque key, remove it from the opaque_map.
 	if (group->opaque.key != 0)
@@ -210,6 +231,7 @@ group_insert_obj(group_t *group, obj_t *obj)
 	// We need to invalidate the statistics associated with this group
 	// because the size of the group is increasing.
 	group_invalidate_statistics(group);
+	group_set_plan(group, NULL);
 
 	iter = g_sequence_insert_sorted(group->list, obj, group_compare_obj,
 			NULL);
@@ -262,6 +284,7 @@ group_remove_obj(group_t *group, obj_t *obj)
 	// We need to invalidate the statistics associated with this group
 	// because the size of the group is decreasing.
 	group_invalidate_statistics(group);
+	group_set_plan(group, NULL);
 
 	g_sequence_remove(iter);
 
@@ -312,8 +335,10 @@ group_new_statistic(group_t *group)
 	}
 
 	// Link statistic to the group
+	g_rec_mutex_lock(&ctx->lock);
 	group->stat_list = g_list_prepend(group->stat_list, stat);
 	stat->link = group->stat_list;
+	g_rec_mutex_unlock(&ctx->lock);
 
 error_handling:
 	TRACE2_EXIT("stat = %p", stat);
@@ -327,10 +352,6 @@ group_del_statistic(group_t *group, stat_t *stat)
 
 	TRACE2_ENTER("group = %p, stat = %p", group, stat);
 
-	if (stat->link)
-		group->stat_list =
-				g_list_delete_link(group->stat_list, stat->link);
-
 	// Find the context
 	ctx = opaque_map_lookup_context(opaque_map, group->context_key);
 	if (!ctx) {
@@ -338,11 +359,78 @@ group_del_statistic(group_t *group, stat_t *stat)
 		return;
 	}
 
+	g_rec_mutex_lock(&ctx->lock);
+	if (stat->link)
+		group->stat_list =
+				g_list_delete_link(group->stat_list, stat->link);
+	g_rec_mutex_unlock(&ctx->lock);
+
 	context_del_statistic(ctx, stat);
 
 	TRACE2_EXIT("");
 }
 
+/*
+ * group_new_plan - Make a plan to read attr from the objects in a group,
+ *		    in group index order.  The plan is not updated if the
+ *		    group changes.
+ */
+plan_t *
+group_new_plan(group_t *group, PWR_AttrName attr, bool as_double)
+{
+	plan_t *plan = NULL;
+	GSequenceIter *iter = NULL;
+	obj_t *obj = NULL;
+
+	TRACE2_ENTER("group = %p, attr = %d, as_double = %d",
+			group, attr, as_double);
+
+	plan = plan_new(attr, g_sequence_get_length(group->list), as_double);
+	if (!plan)
+		goto done;
+
+	iter = g_sequence_get_begin_iter(group->list);
+	while (!g_sequence_iter_is_end(iter)) {
+		obj = g_sequence_get(iter);
+		plan_add_obj(plan, obj,
+				OPAQUE_GENERATE(group->context_key,
+						obj->opaque.key));
+		iter = g_sequence_iter_next(iter);
+	}
+
+done:
+	TRACE2_EXIT("plan = %p", plan);
+
+	return plan;
+}
+
+/*
+ * group_read_plan - Get a reference to the group's prepared read, if it
+ *		     reads attr.  Drop it with plan_unref().
+ */
+plan_t *
+group_read_plan(group_t *group, PWR_AttrName attr)
+{
+	context_t *ctx = NULL;
+	plan_t *plan = NULL;
+
+	TRACE2_ENTER("group = %p, attr = %d", group, attr);
+
+	ctx = opaque_map_lookup_context(opaque_map, group->context_key);
+	if (!ctx)
+		goto done;
+
+	g_rec_mutex_lock(&ctx->lock);
+	if (group->plan && group->plan->attr == attr)
+		plan = plan_ref(group->plan);
+	g_rec_mutex_unlock(&ctx->lock);
+
+done:
+	TRACE2_EXIT("plan = %p", plan);
+
+	return plan;
+}
+
 static int
 group_union(group_t *group1, group_t *group2, group_t *union_grp)
 {
@@ -932,6 +1020,49 @@ error_handling:
 	return status;
 }
 
+//
+// Prepare the group for repeated PWR_GrpAttrGetValue() calls reading attr,
+// replacing any read prepared before. The preparation is dropped when an
+// object is added to or removed from the group.
+//
+int
+CRAYPWR_GrpPrepareRead(PWR_Grp group, PWR_AttrName attr)
+{
+	int status = PWR_RET_FAILURE;
+	group_t *grp = NULL;
+	plan_t *plan = NULL;
+
+	TRACE1_ENTER("group = %p, attr = %d", group, attr);
+
+	if ((unsigned int)attr >= PWR_NUM_ATTR_NAMES) {
+		LOG_FAULT("invalid attribute (%d)!", attr);
+		status = PWR_RET_NOT_IMPLEMENTED;
+		goto error_handling;
+	}
+
+	// Find the group
+	grp = find_group_by_opaque(group);
+	if (!grp) {
+		LOG_FAULT("Group not found!");
+		goto error_handling;
+	}
+
+	plan = group_new_plan(grp, attr, false);
+	if (!plan) {
+		LOG_FAULT("unable to prepare group read!");
+		goto error_handling;
+	}
+
+	group_set_plan(grp, plan);
+
+	status = PWR_RET_SUCCESS;
+
+error_handling:
+	TRACE1_EXIT("status = %d", status);
+
+	return status;
+}
+
 int
 PWR_GrpUnion(PWR_Grp group1, PWR_Grp group2, PWR_Grp *group3)
 {
@@ -55,6 +55,7 @@ struct group_s {
 	GList		*link;		// Link into the context's group list
 	GSequence	*list;		// Collection of objects in group
 	GList		*stat_list;	// List of statistics for this group
+	plan_t		*plan;		// Prepared read, NULL if none
 };
 
 group_t	*new_group(void);
@@ -69,5 +70,8 @@ void	 group_destroy_callback(gpointer data);
 stat_t	*group_new_statistic(group_t *group);
 void	 group_del_statistic(group_t *group, stat_t *stat);
 
+plan_t	*group_new_plan(group_t *group, PWR_AttrName attr, bool as_double);
+plan_t	*group_read_plan(group_t *group, PWR_AttrName attr);
+
 #endif /* _PWR_GROUP_H */
 
@@ -73,13 +73,15 @@ hierarchy_insert(hierarchy_t *hierarchy, GNode *parent, obj_t *obj)
 
 	LOG_DBG("Inserting object %s into hierarchy", obj->name);
 
-	// Allocate the gnode for the object being inserted
-	obj->gnode = g_node_new(obj);
+	// Allocate the gnode for the object being inserted next to
+	// the object, since the tree is only freed with the arena.
+	obj->gnode = arena_alloc0(hierarchy->arena, sizeof(GNode));
 	if (!obj->gnode) {
 		LOG_FAULT("Failed to alloc hierarchy gnode for %s", obj->name);
 		retval = PWR_RET_FAILURE;
 		goto error_return;
 	}
+	obj->gnode->data = obj;
 
 	// If parent available, make child one of its children.
 	// Else make child the root of the hierarchy tree.
@@ -107,6 +109,15 @@ new_hierarchy(void)
 
 	TRACE2_ENTER("");
 
+	// The objects, their plugin data, names and tree nodes are all
+	// allocated from the arena as the plugin builds the hierarchy,
+	// so they are laid out in the order the tree is walked.
+	hierarchy->arena = arena_new();
+	if (!hierarchy->arena) {
+		g_free(hierarchy);
+		return NULL;
+	}
+
 	// The name map will be used to deallocate the resources for
 	// the power objects. The tree is only used to maintain the
 	// hierarchical relationship among the power objects.
@@ -143,10 +154,8 @@ del_hierarchy(hierarchy_t *hierarchy)
 
 	plugin->destruct_hierarchy(hierarchy);
 
-	if (hierarchy->tree) {
-		g_node_destroy(hierarchy->tree);
-		hierarchy->tree = NULL;
-	}
+	// The tree nodes belong to the arena
+	hierarchy->tree = NULL;
 
 	// Delete the name map, since name map hash table was
 	// created using g_hash_table_new_full() all the
@@ -157,6 +166,9 @@ del_hierarchy(hierarchy_t *hierarchy)
 		hierarchy->map = NULL;
 	}
 
+	// Release the memory of all of the objects at once
+	arena_free(hierarchy->arena);
+
 	g_free(hierarchy);
 
 	TRACE2_EXIT("");
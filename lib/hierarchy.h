@@ -40,6 +40,7 @@
 #include <glib.h>
 
 #include "typedefs.h"
+#include "arena.h"
 #include "plugin.h"
 
 
@@ -48,6 +49,7 @@
 struct hierarchy_s {
 	GNode		*tree;		// root of N-ary tree
 	GHashTable	*map;		// name to object map
+	arena_t		*arena;		// objects, names and tree nodes
 };
 
 hierarchy_t *new_hierarchy(void);
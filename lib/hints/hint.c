@@ -44,6 +44,7 @@
 // Implementation simply logs to a file
 static void *logctx = NULL;
 static int _initcount = 0;
+static GMutex _initlock;		// Contexts come and go on any thread
 
 // The implementation -- yep, that's it
 #define	LOG(fmt, arg...)	if (logctx) pmlog_message_ctx(logctx, LOG_TYPE_MESSAGE, fmt "\n", ## arg)
@@ -59,19 +60,24 @@ static int _initcount = 0;
 void
 app_hint_term(void)
 {
+	g_mutex_lock(&_initlock);
+
 	// Always sync logging, if enabled
 	if (logctx)
 		pmlog_sync_ctx(logctx);
 
 	// Do nothing until the last termination
 	if (_initcount == 0 || --_initcount > 0)
-		return;
+		goto done;
 
 	// Terminate the logging on the last termination
 	if (logctx) {
 		pmlog_term_ctx(logctx);
 		logctx = NULL;
 	}
+
+done:
+	g_mutex_unlock(&_initlock);
 }
 
 /**
@@ -90,6 +96,8 @@ app_hint_init(void)
 
 	TRACE3_ENTER("");
 
+	g_mutex_lock(&_initlock);
+
 	// Keep track of nested initializations
 	_initcount++;
 
@@ -111,6 +119,8 @@ app_hint_init(void)
 	logctx = pmlog_init_new(path, max_size, max_files, num_rings, ring_size);
 
 done:
+	g_mutex_unlock(&_initlock);
+
 	TRACE3_EXIT("");
 }
 
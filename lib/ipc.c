@@ -37,6 +37,7 @@
 
 #include "ipc.h"
 #include "plugins/ipc_socket/ipc_socket.h"
+#include "plugins/ipc_shmem/ipc_shmem.h"
 
 //----------------------------------------------------------------------//
 // 			IPC INTERFACES					//
@@ -56,6 +57,7 @@ new_ipc(ipc_type_t type, const char *context_name, PWR_Role context_role)
 		status = PWR_RET_FAILURE;
 		goto failure_return;
 	}
+	g_rec_mutex_init(&ipc->lock);
 	ipc->type = type;
 	ipc->context_name = g_strdup(context_name);
 	ipc->context_role = context_role;
@@ -64,6 +66,9 @@ new_ipc(ipc_type_t type, const char *context_name, PWR_Role context_role)
 	case IPC_SOCKET:
 		status = ipc_socket_construct(ipc);
 		break;
+	case IPC_SHMEM:
+		status = ipc_shmem_construct(ipc);
+		break;
 	default:
 		status = PWR_RET_FAILURE;
 		break;
@@ -90,9 +95,94 @@ del_ipc(ipc_t *ipc)
 			ipc->ops->destruct(ipc);
 		}
 
+		if (ipc->batch) {
+			g_hash_table_destroy(ipc->batch);
+		}
+		g_rec_mutex_clear(&ipc->lock);
 		g_free(ipc->context_name);
 		g_free(ipc);
 	}
 
 	TRACE2_EXIT("");
 }
+
+//
+// Sets of objects with many hyperthreads, and of groups, are bracketed by
+// ipc_batch_begin() and ipc_batch_end(), which may nest.  In between, a
+// path already sent with the same value is skipped.  Every set goes
+// through a batch, which holds the ipc for the calling thread.
+//
+void
+ipc_batch_begin(ipc_t *ipc)
+{
+	g_rec_mutex_lock(&ipc->lock);
+
+	TRACE3_ENTER("ipc = %p, batch_depth = %d", ipc, ipc->batch_depth);
+
+	ipc->batch_depth++;
+
+	TRACE3_EXIT("");
+}
+
+void
+ipc_batch_end(ipc_t *ipc)
+{
+	TRACE3_ENTER("ipc = %p, batch_depth = %d", ipc, ipc->batch_depth);
+
+	if (--ipc->batch_depth == 0 && ipc->batch) {
+		g_hash_table_destroy(ipc->batch);
+		ipc->batch = NULL;
+	}
+
+	TRACE3_EXIT("");
+
+	g_rec_mutex_unlock(&ipc->lock);
+}
+
+int
+ipc_batch_sent(ipc_t *ipc, const char *path, uint64_t value)
+{
+	uint64_t *sent = NULL;
+	int retval = 0;
+
+	TRACE3_ENTER("ipc = %p, path = '%s', value = %#lx", ipc, path, value);
+
+	if (ipc->batch) {
+		sent = g_hash_table_lookup(ipc->batch, path);
+		retval = (sent && *sent == value);
+	}
+
+	TRACE3_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+void
+ipc_batch_add(ipc_t *ipc, const char *path, uint64_t value)
+{
+	uint64_t *sent = NULL;
+
+	TRACE3_ENTER("ipc = %p, path = '%s', value = %#lx", ipc, path, value);
+
+	if (ipc->batch_depth == 0) {
+		goto done;
+	}
+
+	if (!ipc->batch) {
+		ipc->batch = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, g_free);
+		if (!ipc->batch) {
+			goto done;
+		}
+	}
+
+	sent = g_new(uint64_t, 1);
+	if (!sent) {
+		goto done;
+	}
+	*sent = value;
+	g_hash_table_replace(ipc->batch, g_strdup(path), sent);
+
+done:
+	TRACE3_EXIT("");
+}
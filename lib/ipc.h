@@ -37,6 +37,8 @@
 
 #include <stdint.h>
 
+#include <glib.h>
+
 #include <cray-powerapi/types.h>
 
 #include "typedefs.h"
@@ -59,7 +61,7 @@ struct ipc_ops {
 typedef enum {
 	IPC_INVALID = -1,
 	IPC_SOCKET = 0,
-	IPC_SHMEM,		// Not implemented
+	IPC_SHMEM,		// request ring, falling back to the socket
 	IPC_MAX
 } ipc_type_t;
 
@@ -73,6 +75,17 @@ struct ipc_s {
 
 	void		 *plugin_data;
 
+	// Paths set, and their values, by the set of a node, core, socket
+	// or group in progress.  Hyperthreads which share a cpufreq policy
+	// set the same control file, which only needs to be sent once.
+	int		 batch_depth;
+	GHashTable	 *batch;
+
+	// Held from ipc_batch_begin() to ipc_batch_end(), so that sets by
+	// several threads through one context take turns on its connection
+	// and batch.
+	GRecMutex	 lock;
+
 	const struct ipc_ops *ops;
 };
 
@@ -80,4 +93,9 @@ struct ipc_s {
 ipc_t *new_ipc(ipc_type_t type, const char *context_name, PWR_Role context_role);
 void del_ipc(ipc_t *ipc);
 
+void ipc_batch_begin(ipc_t *ipc);
+void ipc_batch_end(ipc_t *ipc);
+int  ipc_batch_sent(ipc_t *ipc, const char *path, uint64_t value);
+void ipc_batch_add(ipc_t *ipc, const char *path, uint64_t value);
+
 #endif // _PWR_IPC_H
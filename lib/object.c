@@ -148,57 +148,6 @@ const char *attr_desc[PWR_NUM_ATTR_NAMES] = {
 	" the operating system interface for the %s object."
 };
 
-// Macro to test a bit in a bitmask and assign a powerapi return value
-// for the result. PWR_RET_SUCCESS if bit is set, PWR_RET_NO_ATTRIB if
-// bit is not set.
-#define TEST_OBJ_ATTR(bitmask, attr) \
-	(BITMASK_TEST((bitmask), (attr)) ? PWR_RET_SUCCESS : PWR_RET_NO_ATTRIB)
-
-// Node attribute support bitmask
-const DECLARE_BITMASK_AUTO(node_attr_bitmask, PWR_NUM_ATTR_NAMES,
-		BITBLOCK_MASK(PWR_ATTR_POWER)|
-		BITBLOCK_MASK(PWR_ATTR_POWER_LIMIT_MAX)|
-		BITBLOCK_MASK(PWR_ATTR_ENERGY)|
-		BITBLOCK_MASK(PWR_ATTR_OS_ID));
-
-// Socket attribute support bitmask
-const DECLARE_BITMASK_AUTO(socket_attr_bitmask, PWR_NUM_ATTR_NAMES,
-		BITBLOCK_MASK(PWR_ATTR_POWER)|
-		BITBLOCK_MASK(PWR_ATTR_POWER_LIMIT_MAX)|
-		BITBLOCK_MASK(PWR_ATTR_ENERGY)|
-		BITBLOCK_MASK(PWR_ATTR_TEMP)|
-		BITBLOCK_MASK(PWR_ATTR_OS_ID)|
-		BITBLOCK_MASK(PWR_ATTR_THROTTLED_TIME));
-
-// Memory attribute support bitmask
-const DECLARE_BITMASK_AUTO(mem_attr_bitmask, PWR_NUM_ATTR_NAMES,
-		BITBLOCK_MASK(PWR_ATTR_POWER)|
-		BITBLOCK_MASK(PWR_ATTR_POWER_LIMIT_MAX)|
-		BITBLOCK_MASK(PWR_ATTR_ENERGY)|
-		BITBLOCK_MASK(PWR_ATTR_OS_ID)|
-		BITBLOCK_MASK(PWR_ATTR_THROTTLED_TIME));
-
-// Power Plane attribute support bitmask
-const DECLARE_BITMASK_AUTO(pplane_attr_bitmask, PWR_NUM_ATTR_NAMES,
-		BITBLOCK_MASK(PWR_ATTR_POWER)|
-		BITBLOCK_MASK(PWR_ATTR_ENERGY)|
-		BITBLOCK_MASK(PWR_ATTR_OS_ID));
-
-// Core attribute support bitmask
-const DECLARE_BITMASK_AUTO(core_attr_bitmask, PWR_NUM_ATTR_NAMES,
-		BITBLOCK_MASK(PWR_ATTR_TEMP)|
-		BITBLOCK_MASK(PWR_ATTR_OS_ID));
-
-// Hardware Thread attribute support bitmask
-const DECLARE_BITMASK_AUTO(ht_attr_bitmask, PWR_NUM_ATTR_NAMES,
-		BITBLOCK_MASK(PWR_ATTR_CSTATE_LIMIT)|
-		BITBLOCK_MASK(PWR_ATTR_FREQ)|
-		BITBLOCK_MASK(PWR_ATTR_FREQ_REQ)|
-		BITBLOCK_MASK(PWR_ATTR_FREQ_LIMIT_MIN)|
-		BITBLOCK_MASK(PWR_ATTR_FREQ_LIMIT_MAX)|
-		BITBLOCK_MASK(PWR_ATTR_OS_ID)|
-		BITBLOCK_MASK(PWR_ATTR_GOV));
-
 // Bitmask of all supported attributes
 const DECLARE_BITMASK_AUTO(supported_attr_bitmask, PWR_NUM_ATTR_NAMES,
 		BITBLOCK_MASK(PWR_ATTR_POWER)|
@@ -220,35 +169,61 @@ const DECLARE_BITMASK_AUTO(supported_attr_bitmask, PWR_NUM_ATTR_NAMES,
 //----------------------------------------------------------------------//
 
 
+// Start an object out supporting every attribute of its type. The
+// plugin construct function clears any that the hardware lacks.
+static void
+obj_init_attrs(obj_t *obj)
+{
+	const attr_entry_t *table = obj_attr_tables[obj->type];
+	int attr;
+
+	obj->attrs.used = PWR_NUM_ATTR_NAMES;
+	for (attr = 0; attr < PWR_NUM_ATTR_NAMES; attr++) {
+		if (table[attr].flags & ATTR_READ)
+			BITMASK_SET(&obj->attrs, attr);
+	}
+}
+
 // Macro defines a function to construct a specified hierarchy
 // object type; used as a generic function template.
 #define NEW_OBJ(TYPE, PWR_TYPE)						\
-	TYPE##_t *new_##TYPE(uint64_t id,				\
+	TYPE##_t *new_##TYPE(hierarchy_t *hierarchy, uint64_t id,	\
 			const char *name_fmt, ...)			\
 	{								\
 		va_list args;						\
 		TYPE##_t *ptr;						\
 									\
-		TRACE3_ENTER("id = %#lx, name_fmt = '%s'", id, name_fmt); \
+		TRACE3_ENTER("hierarchy = %p, id = %#lx, name_fmt = '%s'", \
+				hierarchy, id, name_fmt);		\
 									\
-		ptr = g_new0(TYPE##_t, 1);				\
+		if (!plugin) {						\
+			LOG_FAULT("Plugin not configured!");		\
+			return NULL;					\
+		}							\
+		ptr = arena_alloc0(hierarchy->arena, sizeof(TYPE##_t));	\
 		if (!ptr) {						\
 			LOG_FAULT("Alloc for " #TYPE " object failed"); \
 			goto error_return;				\
 		}							\
 		ptr->obj.os_id = id;					\
 		ptr->obj.type = PWR_TYPE;				\
+		obj_init_attrs(&ptr->obj);				\
+		if (plugin->TYPE##_data_size) {				\
+			ptr->plugin_data = arena_alloc0(hierarchy->arena, \
+					plugin->TYPE##_data_size);	\
+			if (!ptr->plugin_data) {			\
+				LOG_FAULT("Failed to alloc plugin data"); \
+				goto error_return;			\
+			}						\
+		}							\
 		va_start(args, name_fmt);				\
-		ptr->obj.name = g_strdup_vprintf(name_fmt, args);	\
+		ptr->obj.name = arena_strdup_vprintf(hierarchy->arena,	\
+				name_fmt, args);			\
 		va_end(args);						\
 		if (!ptr->obj.name) {					\
 			LOG_FAULT("Failed to alloc object name");	\
 			goto error_return;				\
 		}							\
-		if (!plugin) {						\
-			LOG_FAULT("Plugin not configured!");		\
-			goto error_return;				\
-		}							\
 		if (plugin->construct_##TYPE(ptr) != 0) {		\
 			LOG_FAULT("plugin construct_" #TYPE " fail");	\
 			goto error_return;				\
@@ -273,7 +248,8 @@ error_return:								\
 	}
 
 // Macro defines a function to destruct a specified hierarchy
-// object type; used as a generic function template
+// object type; used as a generic function template. The memory
+// of the object belongs to its hierarchy's arena.
 #define DEL_OBJ(TYPE)							\
 	void del_##TYPE(TYPE##_t *ptr)					\
 	{								\
@@ -289,8 +265,6 @@ error_return:								\
 		if (plugin) {						\
 			plugin->destruct_##TYPE(ptr);			\
 		}							\
-		g_free(ptr->obj.name);					\
-		g_free(ptr);						\
 									\
 		TRACE3_EXIT("");					\
 	}
@@ -421,6 +395,9 @@ obj_attr_set_meta_plugin(obj_t *obj, ipc_t *ipc, PWR_AttrName attr,
 	TRACE2_ENTER("obj = %p, ipc = %p, attr = %d, meta = %d, value = %p",
 			obj, ipc, attr, meta, value);
 
+	// Holds the context's connection while the plugin sets
+	ipc_batch_begin(ipc);
+
 	// Call the plugin set_meta() function for the specific object type.
 	switch (obj->type) {
 	case PWR_OBJ_NODE:
@@ -453,6 +430,8 @@ obj_attr_set_meta_plugin(obj_t *obj, ipc_t *ipc, PWR_AttrName attr,
 		break;
 	}
 
+	ipc_batch_end(ipc);
+
 	TRACE2_EXIT("retval = %d", retval);
 
 	return retval;
@@ -608,11 +587,11 @@ obj_attr_get_meta(obj_t *obj, PWR_AttrName attr, PWR_MetaName meta,
 }
 
 static int
-get_os_id(uint64_t id, uint64_t *value, struct timespec *ts)
+get_os_id(obj_t *obj, void *value, struct timespec *ts)
 {
 	int retval = PWR_RET_FAILURE;
 
-	TRACE2_ENTER("id = %#lx, value = %p, ts = %p", id, value, ts);
+	TRACE2_ENTER("obj = %p, value = %p, ts = %p", obj, value, ts);
 
 	/*
 	 * Must grab timestamp as close to the data sample as possible.
@@ -621,7 +600,7 @@ get_os_id(uint64_t id, uint64_t *value, struct timespec *ts)
 	if (clock_gettime(CLOCK_REALTIME, ts))
 		goto done;
 
-	*value = id;
+	*(uint64_t *)value = obj->os_id;
 	retval = PWR_RET_SUCCESS;
 
 done:
@@ -630,6 +609,209 @@ done:
 	return retval;
 }
 
+// Generate the dispatch table function that calls an object type's
+// plugin get operation, e.g. ATTR_GET_OP(ht, get_freq) generates
+// ht_attr_get_freq().
+#define ATTR_GET_OP(otype, op)						\
+static int								\
+otype##_attr_##op(obj_t *obj, void *value, struct timespec *ts)		\
+{									\
+	return to_##otype(obj)->ops->op(to_##otype(obj), value, ts);	\
+}
+
+// Generate the dispatch table function that calls an object type's
+// plugin set operation.
+#define ATTR_SET_OP(otype, op)						\
+static int								\
+otype##_attr_##op(obj_t *obj, ipc_t *ipc, const void *value)		\
+{									\
+	return to_##otype(obj)->ops->op(to_##otype(obj), ipc, value);	\
+}
+
+// Dispatch table entry initializers
+#define ATTR_RO(dtype, getter) \
+	{ .data_type = (dtype), .flags = ATTR_READ, .get = (getter) }
+#define ATTR_RW(dtype, getter, setter) \
+	{ .data_type = (dtype), .flags = ATTR_READ | ATTR_WRITE, \
+	  .get = (getter), .set = (setter) }
+
+ATTR_GET_OP(node, get_power)
+ATTR_GET_OP(node, get_power_limit_max)
+ATTR_SET_OP(node, set_power_limit_max)
+ATTR_GET_OP(node, get_energy)
+
+// The node-wide cstate limit is optional for the plugin. Without it
+// the limit is set on each ht instead.
+static int
+node_attr_set_cstate_limit(obj_t *obj, ipc_t *ipc, const void *value)
+{
+	node_t *node = to_node(obj);
+
+	if (!node->ops->set_cstate_limit)
+		return PWR_RET_NOT_IMPLEMENTED;
+
+	return node->ops->set_cstate_limit(node, ipc, value);
+}
+
+static const attr_entry_t node_attr_table[PWR_NUM_ATTR_NAMES] = {
+	[PWR_ATTR_POWER] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, node_attr_get_power),
+	[PWR_ATTR_POWER_LIMIT_MAX] = {
+		.data_type = PWR_ATTR_DATA_DOUBLE,
+		.flags = ATTR_READ | ATTR_WRITE | ATTR_FORWARD,
+		.get = node_attr_get_power_limit_max,
+		.set = node_attr_set_power_limit_max
+	},
+	[PWR_ATTR_ENERGY] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, node_attr_get_energy),
+	[PWR_ATTR_OS_ID] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64, get_os_id),
+	[PWR_ATTR_CSTATE_LIMIT] = {
+		.data_type = PWR_ATTR_DATA_UINT64,
+		.flags = ATTR_WRITE | ATTR_FORWARD,
+		.set = node_attr_set_cstate_limit
+	},
+};
+
+ATTR_GET_OP(socket, get_power)
+ATTR_GET_OP(socket, get_power_limit_max)
+ATTR_SET_OP(socket, set_power_limit_max)
+ATTR_GET_OP(socket, get_energy)
+ATTR_GET_OP(socket, get_throttled_time)
+ATTR_GET_OP(socket, get_temp)
+
+static const attr_entry_t socket_attr_table[PWR_NUM_ATTR_NAMES] = {
+	[PWR_ATTR_POWER] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, socket_attr_get_power),
+	[PWR_ATTR_POWER_LIMIT_MAX] =
+		ATTR_RW(PWR_ATTR_DATA_DOUBLE, socket_attr_get_power_limit_max,
+			socket_attr_set_power_limit_max),
+	[PWR_ATTR_ENERGY] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, socket_attr_get_energy),
+	[PWR_ATTR_TEMP] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, socket_attr_get_temp),
+	[PWR_ATTR_OS_ID] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64, get_os_id),
+	[PWR_ATTR_THROTTLED_TIME] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64,
+			socket_attr_get_throttled_time),
+};
+
+ATTR_GET_OP(mem, get_power)
+ATTR_GET_OP(mem, get_power_limit_max)
+ATTR_SET_OP(mem, set_power_limit_max)
+ATTR_GET_OP(mem, get_energy)
+ATTR_GET_OP(mem, get_throttled_time)
+
+static const attr_entry_t mem_attr_table[PWR_NUM_ATTR_NAMES] = {
+	[PWR_ATTR_POWER] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, mem_attr_get_power),
+	[PWR_ATTR_POWER_LIMIT_MAX] =
+		ATTR_RW(PWR_ATTR_DATA_DOUBLE, mem_attr_get_power_limit_max,
+			mem_attr_set_power_limit_max),
+	[PWR_ATTR_ENERGY] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, mem_attr_get_energy),
+	[PWR_ATTR_OS_ID] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64, get_os_id),
+	[PWR_ATTR_THROTTLED_TIME] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64, mem_attr_get_throttled_time),
+};
+
+ATTR_GET_OP(pplane, get_power)
+ATTR_GET_OP(pplane, get_energy)
+
+static const attr_entry_t pplane_attr_table[PWR_NUM_ATTR_NAMES] = {
+	[PWR_ATTR_POWER] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, pplane_attr_get_power),
+	[PWR_ATTR_ENERGY] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, pplane_attr_get_energy),
+	[PWR_ATTR_OS_ID] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64, get_os_id),
+};
+
+ATTR_GET_OP(core, get_temp)
+
+static const attr_entry_t core_attr_table[PWR_NUM_ATTR_NAMES] = {
+	[PWR_ATTR_TEMP] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, core_attr_get_temp),
+	[PWR_ATTR_OS_ID] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64, get_os_id),
+};
+
+ATTR_GET_OP(ht, get_cstate_limit)
+ATTR_SET_OP(ht, set_cstate_limit)
+ATTR_GET_OP(ht, get_freq)
+ATTR_GET_OP(ht, get_freq_req)
+ATTR_SET_OP(ht, set_freq_req)
+ATTR_GET_OP(ht, get_freq_limit_min)
+ATTR_SET_OP(ht, set_freq_limit_min)
+ATTR_GET_OP(ht, get_freq_limit_max)
+ATTR_SET_OP(ht, set_freq_limit_max)
+ATTR_GET_OP(ht, get_governor)
+ATTR_SET_OP(ht, set_governor)
+
+static const attr_entry_t ht_attr_table[PWR_NUM_ATTR_NAMES] = {
+	[PWR_ATTR_CSTATE_LIMIT] =
+		ATTR_RW(PWR_ATTR_DATA_UINT64, ht_attr_get_cstate_limit,
+			ht_attr_set_cstate_limit),
+	[PWR_ATTR_FREQ] =
+		ATTR_RO(PWR_ATTR_DATA_DOUBLE, ht_attr_get_freq),
+	[PWR_ATTR_FREQ_REQ] =
+		ATTR_RW(PWR_ATTR_DATA_DOUBLE, ht_attr_get_freq_req,
+			ht_attr_set_freq_req),
+	[PWR_ATTR_FREQ_LIMIT_MIN] =
+		ATTR_RW(PWR_ATTR_DATA_DOUBLE, ht_attr_get_freq_limit_min,
+			ht_attr_set_freq_limit_min),
+	[PWR_ATTR_FREQ_LIMIT_MAX] =
+		ATTR_RW(PWR_ATTR_DATA_DOUBLE, ht_attr_get_freq_limit_max,
+			ht_attr_set_freq_limit_max),
+	[PWR_ATTR_OS_ID] =
+		ATTR_RO(PWR_ATTR_DATA_UINT64, get_os_id),
+	[PWR_ATTR_GOV] =
+		ATTR_RW(PWR_ATTR_DATA_UINT64, ht_attr_get_governor,
+			ht_attr_set_governor),
+};
+
+// PWR_ObjType values mapped to attribute dispatch tables. Object types
+// with no table have no attributes in this implementation.
+const attr_entry_t *const obj_attr_tables[PWR_NUM_OBJ_TYPES] = {
+	[ PWR_OBJ_NODE		] = node_attr_table,
+	[ PWR_OBJ_SOCKET	] = socket_attr_table,
+	[ PWR_OBJ_CORE		] = core_attr_table,
+	[ PWR_OBJ_POWER_PLANE	] = pplane_attr_table,
+	[ PWR_OBJ_MEM		] = mem_attr_table,
+	[ PWR_OBJ_HT		] = ht_attr_table,
+};
+
+// Look up the dispatch table entry for an object's attribute, NULL if
+// the attribute is out of range or the object type has no table.
+static inline const attr_entry_t *
+obj_attr_entry(const obj_t *obj, PWR_AttrName attr)
+{
+	if ((unsigned int)attr >= PWR_NUM_ATTR_NAMES ||
+			(unsigned int)obj->type >= PWR_NUM_OBJ_TYPES ||
+			!obj_attr_tables[obj->type])
+		return NULL;
+
+	return &obj_attr_tables[obj->type][attr];
+}
+
+/*
+ * obj_attr_readable - Look up the dispatch table entry used to read an
+ *		       attribute of an object, NULL if the object can't
+ *		       supply it.
+ */
+const attr_entry_t *
+obj_attr_readable(const obj_t *obj, PWR_AttrName attr)
+{
+	const attr_entry_t *entry = obj_attr_entry(obj, attr);
+
+	if (!entry || !entry->get || !BITMASK_TEST(&obj->attrs, attr))
+		return NULL;
+
+	return entry;
+}
+
 static int
 forward_attr_set_value(obj_t *obj, ipc_t *ipc, PWR_AttrName attr,
 		const void *value)
@@ -644,38 +826,8 @@ forward_attr_set_value(obj_t *obj, ipc_t *ipc, PWR_AttrName attr,
 	for (gnode = g_node_first_child(obj->gnode);
 			gnode != NULL;
 			gnode = g_node_next_sibling(gnode)) {
-		int status = PWR_RET_SUCCESS;
-		obj_t *child_obj = to_obj(gnode->data);
-
-		switch (child_obj->type) {
-		case PWR_OBJ_NODE:
-			status = node_attr_set_value(to_node(child_obj),
-					ipc, attr, value);
-			break;
-		case PWR_OBJ_SOCKET:
-			status = socket_attr_set_value(to_socket(child_obj),
-					ipc, attr, value);
-			break;
-		case PWR_OBJ_CORE:
-			status = core_attr_set_value(to_core(child_obj),
-					ipc, attr, value);
-			break;
-		case PWR_OBJ_POWER_PLANE:
-			status = pplane_attr_set_value(to_pplane(child_obj),
-					ipc, attr, value);
-			break;
-		case PWR_OBJ_MEM:
-			status = mem_attr_set_value(to_mem(child_obj),
-					ipc, attr, value);
-			break;
-		case PWR_OBJ_HT:
-			status = ht_attr_set_value(to_ht(child_obj),
-					ipc, attr, value);
-			break;
-		default:
-			status = PWR_RET_NOT_IMPLEMENTED;
-			break;
-		}
+		int status = obj_attr_set_value(to_obj(gnode->data), ipc,
+				attr, value);
 
 		if (status == PWR_RET_NOT_IMPLEMENTED) {
 			continue;
@@ -718,212 +870,22 @@ forward_attr_set_value(obj_t *obj, ipc_t *ipc, PWR_AttrName attr,
 	return retval;
 }
 
+/*
+ * obj_attr_get_value - Get the value of an attribute of a hierarchy object
+ *			through its object type's dispatch table.
+ */
 int
-node_attr_get_value(node_t *node, PWR_AttrName attr, void *value,
-		struct timespec *ts)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("node = %p, attr = %d, value = %p, ts = %p",
-			node, attr, value, ts);
-
-	switch (attr) {
-	case PWR_ATTR_OS_ID:
-		retval = get_os_id(node->obj.os_id, value, ts);
-		break;
-	case PWR_ATTR_POWER:
-		retval = node->ops->get_power(node, value, ts);
-		break;
-	case PWR_ATTR_POWER_LIMIT_MAX:
-		retval = node->ops->get_power_limit_max(node, value, ts);
-		break;
-	case PWR_ATTR_ENERGY:
-		retval = node->ops->get_energy(node, value, ts);
-		break;
-	default:
-		retval = PWR_RET_NOT_IMPLEMENTED;
-		break;
-	}
-
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-node_attr_set_value(node_t *node, ipc_t *ipc, PWR_AttrName attr,
-		const void *value)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("node = %p, ipc = %p, attr = %d, value = %p",
-			node, ipc, attr, value);
-
-	switch (attr) {
-		/* attributes handled at this level go here */
-	case PWR_ATTR_OS_ID:
-	case PWR_ATTR_POWER:
-	case PWR_ATTR_ENERGY:
-		retval = PWR_RET_READ_ONLY;
-		break;
-	default:
-		/* attributes not handled here get forwarded */
-		retval = forward_attr_set_value(to_obj(node), ipc,
-				attr, value);
-		break;
-	}
-
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-socket_attr_get_value(socket_t *socket, PWR_AttrName attr, void *value,
-		struct timespec *ts)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("socket = %p, attr = %d, value = %p, ts = %p",
-			socket, attr, value, ts);
-
-	switch (attr) {
-	case PWR_ATTR_OS_ID:
-		retval = get_os_id(socket->obj.os_id, value, ts);
-		break;
-	case PWR_ATTR_POWER:
-		retval = socket->ops->get_power(socket, value, ts);
-		break;
-	case PWR_ATTR_POWER_LIMIT_MAX:
-		retval = socket->ops->get_power_limit_max(socket, value, ts);
-		break;
-	case PWR_ATTR_ENERGY:
-		retval = socket->ops->get_energy(socket, value, ts);
-		break;
-	case PWR_ATTR_THROTTLED_TIME:
-		retval = socket->ops->get_throttled_time(socket, value, ts);
-		break;
-	case PWR_ATTR_TEMP:
-		retval = socket->ops->get_temp(socket, value, ts);
-		break;
-	default:
-		retval = PWR_RET_NOT_IMPLEMENTED;
-		break;
-	}
-
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-socket_attr_set_value(socket_t *socket, ipc_t *ipc, PWR_AttrName attr,
-		const void *value)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("socket = %p, ipc = %p, attr = %d, value = %p",
-			socket, ipc, attr, value);
-
-	switch (attr) {
-		/* attributes handled at this level go here */
-	case PWR_ATTR_OS_ID:
-	case PWR_ATTR_POWER:
-	case PWR_ATTR_ENERGY:
-	case PWR_ATTR_THROTTLED_TIME:
-	case PWR_ATTR_TEMP:
-		retval = PWR_RET_READ_ONLY;
-		break;
-	case PWR_ATTR_POWER_LIMIT_MAX:
-		retval = socket->ops->set_power_limit_max(socket, ipc, value);
-		break;
-	default:
-		/* attributes not handled here get forwarded */
-		retval = forward_attr_set_value(to_obj(socket), ipc,
-				attr, value);
-		break;
-	}
-
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-core_attr_get_value(core_t *core, PWR_AttrName attr, void *value,
-		struct timespec *ts)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("core = %p, attr = %d, value = %p, ts = %p",
-			core, attr, value, ts);
-
-	switch (attr) {
-	case PWR_ATTR_OS_ID:
-		retval = get_os_id(core->obj.os_id, value, ts);
-		break;
-	case PWR_ATTR_TEMP:
-		retval = core->ops->get_temp(core, value, ts);
-		break;
-	default:
-		retval = PWR_RET_NOT_IMPLEMENTED;
-		break;
-	}
-
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-core_attr_set_value(core_t *core, ipc_t *ipc, PWR_AttrName attr,
-		const void *value)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("core = %p, ipc = %p, attr = %d, value = %p",
-			core, ipc, attr, value);
-
-	switch (attr) {
-		/* attributes handled at this level go here */
-	case PWR_ATTR_OS_ID:
-	case PWR_ATTR_TEMP:
-		retval = PWR_RET_READ_ONLY;
-		break;
-	default:
-		/* attributes not handled here get forwarded */
-		retval = forward_attr_set_value(to_obj(core), ipc,
-				attr, value);
-		break;
-	}
-
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-pplane_attr_get_value(pplane_t *pplane, PWR_AttrName attr, void *value,
+obj_attr_get_value(obj_t *obj, PWR_AttrName attr, void *value,
 		struct timespec *ts)
 {
-	int retval = PWR_RET_SUCCESS;
+	const attr_entry_t *entry = obj_attr_readable(obj, attr);
+	int retval = PWR_RET_NOT_IMPLEMENTED;
 
-	TRACE2_ENTER("pplane = %p, attr = %d, value = %p, ts = %p",
-			pplane, attr, value, ts);
+	TRACE2_ENTER("obj = %p, attr = %d, value = %p, ts = %p",
+			obj, attr, value, ts);
 
-	switch (attr) {
-	case PWR_ATTR_OS_ID:
-		retval = get_os_id(pplane->obj.os_id, value, ts);
-		break;
-	case PWR_ATTR_POWER:
-		retval = pplane->ops->get_power(pplane, value, ts);
-		break;
-	case PWR_ATTR_ENERGY:
-		retval = pplane->ops->get_energy(pplane, value, ts);
-		break;
-	default:
-		retval = PWR_RET_NOT_IMPLEMENTED;
-		break;
+	if (entry) {
+		retval = entry->get(obj, value, ts);
 	}
 
 	TRACE2_EXIT("retval = %d", retval);
@@ -931,198 +893,75 @@ pplane_attr_get_value(pplane_t *pplane, PWR_AttrName attr, void *value,
 	return retval;
 }
 
+/*
+ * obj_attr_set_value - Set the value of an attribute of a hierarchy object
+ *			through its object type's dispatch table.  Attributes
+ *			the object has no setter for are forwarded to its
+ *			children.
+ */
 int
-pplane_attr_set_value(pplane_t *pplane, ipc_t *ipc, PWR_AttrName attr,
+obj_attr_set_value(obj_t *obj, ipc_t *ipc, PWR_AttrName attr,
 		const void *value)
 {
-	int retval = PWR_RET_SUCCESS;
+	const attr_entry_t *entry = obj_attr_entry(obj, attr);
+	int retval = PWR_RET_NOT_IMPLEMENTED;
 
-	TRACE2_ENTER("pplane = %p, ipc = %p, attr = %d, value = %p",
-			pplane, ipc, attr, value);
+	TRACE2_ENTER("obj = %p, ipc = %p, attr = %d, value = %p",
+			obj, ipc, attr, value);
 
-	switch (attr) {
-		/* attributes handled at this level go here */
-	case PWR_ATTR_OS_ID:
-	case PWR_ATTR_POWER:
-	case PWR_ATTR_ENERGY:
-		retval = PWR_RET_READ_ONLY;
-		break;
-	default:
-		/* attributes not handled here get forwarded */
-		retval = forward_attr_set_value(to_obj(pplane), ipc,
-				attr, value);
-		break;
+	if (!entry) {
+		goto done;
 	}
 
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-mem_attr_get_value(mem_t *mem, PWR_AttrName attr, void *value,
-		struct timespec *ts)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("mem = %p, attr = %d, value = %p, ts = %p",
-			mem, attr, value, ts);
-
-	switch (attr) {
-	case PWR_ATTR_OS_ID:
-		retval = get_os_id(mem->obj.os_id, value, ts);
-		break;
-	case PWR_ATTR_POWER:
-		retval = mem->ops->get_power(mem, value, ts);
-		break;
-	case PWR_ATTR_POWER_LIMIT_MAX:
-		retval = mem->ops->get_power_limit_max(mem, value, ts);
-		break;
-	case PWR_ATTR_ENERGY:
-		retval = mem->ops->get_energy(mem, value, ts);
-		break;
-	case PWR_ATTR_THROTTLED_TIME:
-		retval = mem->ops->get_throttled_time(mem, value, ts);
-		break;
-	default:
-		retval = PWR_RET_NOT_IMPLEMENTED;
-		break;
+	// Not present on this particular object
+	if ((entry->flags & ATTR_READ) && !BITMASK_TEST(&obj->attrs, attr)) {
+		goto done;
 	}
 
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-mem_attr_set_value(mem_t *mem, ipc_t *ipc, PWR_AttrName attr,
-		const void *value)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("mem = %p, ipc = %p, attr = %d, value = %p",
-			mem, ipc, attr, value);
-
-	switch (attr) {
-		/* attributes handled at this level go here */
-	case PWR_ATTR_OS_ID:
-	case PWR_ATTR_POWER:
-	case PWR_ATTR_ENERGY:
-	case PWR_ATTR_THROTTLED_TIME:
+	if (entry->set) {
+		retval = entry->set(obj, ipc, value);
+		if (retval != PWR_RET_NOT_IMPLEMENTED ||
+				!(entry->flags & ATTR_FORWARD)) {
+			goto done;
+		}
+	} else if (entry->flags & ATTR_READ) {
 		retval = PWR_RET_READ_ONLY;
-		break;
-	case PWR_ATTR_POWER_LIMIT_MAX:
-		retval = mem->ops->set_power_limit_max(mem, ipc, value);
-		break;
-	default:
-		/* attributes not handled here get forwarded */
-		retval = forward_attr_set_value(to_obj(mem), ipc,
-				attr, value);
-		break;
+		goto done;
 	}
 
-	TRACE2_EXIT("retval = %d", retval);
-
-	return retval;
-}
-
-int
-ht_attr_get_value(ht_t *ht, PWR_AttrName attr, void *value,
-		struct timespec *ts)
-{
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("ht = %p, attr = %d, value = %p, ts = %p",
-			ht, attr, value, ts);
-
-	switch (attr) {
-	case PWR_ATTR_OS_ID:
-		retval = get_os_id(ht->obj.os_id, value, ts);
-		break;
-	case PWR_ATTR_CSTATE_LIMIT:
-		retval = ht->ops->get_cstate_limit(ht, value, ts);
-		break;
-	case PWR_ATTR_FREQ:
-		retval = ht->ops->get_freq(ht, value, ts);
-		break;
-	case PWR_ATTR_FREQ_REQ:
-		retval = ht->ops->get_freq_req(ht, value, ts);
-		break;
-	case PWR_ATTR_FREQ_LIMIT_MIN:
-		retval = ht->ops->get_freq_limit_min(ht, value, ts);
-		break;
-	case PWR_ATTR_FREQ_LIMIT_MAX:
-		retval = ht->ops->get_freq_limit_max(ht, value, ts);
-		break;
-	case PWR_ATTR_GOV:
-		retval = ht->ops->get_governor(ht, value, ts);
-		break;
-	default:
-		retval = PWR_RET_NOT_IMPLEMENTED;
-		break;
-	}
+	/* attributes not handled here get forwarded */
+	retval = forward_attr_set_value(obj, ipc, attr, value);
 
+done:
 	TRACE2_EXIT("retval = %d", retval);
 
 	return retval;
 }
 
-int
-ht_attr_set_value(ht_t *ht, ipc_t *ipc, PWR_AttrName attr,
-		const void *value)
+// Determine if an attribute is listed for an object type's dispatch
+// table, or for any object type if the table is NULL.
+static inline bool
+attr_listed(const attr_entry_t *table, int attr)
 {
-	int retval = PWR_RET_SUCCESS;
-
-	TRACE2_ENTER("ht = %p, ipc = %p, attr = %d, value = %p",
-			ht, ipc, attr, value);
-
-	switch (attr) {
-		/* attributes handled at this level go here */
-	case PWR_ATTR_OS_ID:
-	case PWR_ATTR_FREQ:
-		retval = PWR_RET_READ_ONLY;
-		break;
-	case PWR_ATTR_CSTATE_LIMIT:
-		retval = ht->ops->set_cstate_limit(ht, ipc, value);
-		break;
-	case PWR_ATTR_FREQ_REQ:
-		retval = ht->ops->set_freq_req(ht, ipc, value);
-		break;
-	case PWR_ATTR_FREQ_LIMIT_MIN:
-		retval = ht->ops->set_freq_limit_min(ht, ipc, value);
-		break;
-	case PWR_ATTR_FREQ_LIMIT_MAX:
-		retval = ht->ops->set_freq_limit_max(ht, ipc, value);
-		break;
-	case PWR_ATTR_GOV:
-		retval = ht->ops->set_governor(ht, ipc, value);
-		break;
-	default:
-		/* attributes not handled here get forwarded */
-		retval = forward_attr_set_value(to_obj(ht), ipc,
-				attr, value);
-		break;
-	}
-
-	TRACE2_EXIT("retval = %d", retval);
+	if (!table)
+		return BITMASK_TEST(&supported_attr_bitmask, attr);
 
-	return retval;
+	return (table[attr].flags & ATTR_READ) != 0;
 }
 
 static int
-get_attr_list(const bitmask_t *bitmask, size_t len,
+get_attr_list(const attr_entry_t *table, size_t len,
 		const char **str_list, int *val_list)
 {
 	int retval = PWR_RET_SUCCESS;
 	int bit = 0;
 	int set = 0;
 
-	TRACE3_ENTER("bitmask = %p, len = %zu, str_list = %p, val_list = %p",
-			bitmask, len, str_list, val_list);
+	TRACE3_ENTER("table = %p, len = %zu, str_list = %p, val_list = %p",
+			table, len, str_list, val_list);
 
-	for (bit = 0; bit < BITMASK_NUM_BITS_USED(bitmask) && set < len;
-			bit++) {
-		if (BITMASK_TEST(bitmask, bit)) {
+	for (bit = 0; bit < PWR_NUM_ATTR_NAMES && set < len; bit++) {
+		if (attr_listed(table, bit)) {
 			if (val_list)
 				val_list[set] = bit;
 			if (str_list)
@@ -1131,7 +970,7 @@ get_attr_list(const bitmask_t *bitmask, size_t len,
 		}
 	}
 
-	if (bit < BITMASK_NUM_BITS_USED(bitmask)) {
+	if (bit < PWR_NUM_ATTR_NAMES) {
 		retval = PWR_RET_WARN_TRUNC;
 	}
 
@@ -1155,29 +994,10 @@ validate_attr(obj_t *obj, PWR_AttrName attr)
 		goto quick_return;
 	}
 
-	// Determine if the attribute is supported by the object type.
-	switch (obj->type) {
-	case PWR_OBJ_NODE:
-		status = TEST_OBJ_ATTR(&node_attr_bitmask, attr);
-		break;
-	case PWR_OBJ_SOCKET:
-		status = TEST_OBJ_ATTR(&socket_attr_bitmask, attr);
-		break;
-	case PWR_OBJ_CORE:
-		status = TEST_OBJ_ATTR(&core_attr_bitmask, attr);
-		break;
-	case PWR_OBJ_POWER_PLANE:
-		status = TEST_OBJ_ATTR(&pplane_attr_bitmask, attr);
-		break;
-	case PWR_OBJ_MEM:
-		status = TEST_OBJ_ATTR(&mem_attr_bitmask, attr);
-		break;
-	case PWR_OBJ_HT:
-		status = TEST_OBJ_ATTR(&ht_attr_bitmask, attr);
-		break;
-	default:
-		status = PWR_RET_INVALID;
-		break;
+	// Determine if the attribute is supported by the object, as
+	// found by the plugin when the object was constructed.
+	if (!BITMASK_TEST(&obj->attrs, attr)) {
+		status = PWR_RET_NO_ATTRIB;
 	}
 
 	if (status) {
@@ -1804,30 +1624,17 @@ CRAYPWR_AttrGetCount(PWR_ObjType obj, size_t *value)
 	}
 
 	// Want count of attributes for a specific object type
-	else {
-		switch (obj) {
-		case PWR_OBJ_NODE:
-			*value = BITMASK_NUM_BITS_SET(&node_attr_bitmask);
-			break;
-		case PWR_OBJ_SOCKET:
-			*value = BITMASK_NUM_BITS_SET(&socket_attr_bitmask);
-			break;
-		case PWR_OBJ_CORE:
-			*value = BITMASK_NUM_BITS_SET(&core_attr_bitmask);
-			break;
-		case PWR_OBJ_POWER_PLANE:
-			*value = BITMASK_NUM_BITS_SET(&pplane_attr_bitmask);
-			break;
-		case PWR_OBJ_MEM:
-			*value = BITMASK_NUM_BITS_SET(&mem_attr_bitmask);
-			break;
-		case PWR_OBJ_HT:
-			*value = BITMASK_NUM_BITS_SET(&ht_attr_bitmask);
-			break;
-		default:
-			retval = PWR_RET_NO_ATTRIB;
-			break;
+	else if (!obj_attr_tables[obj]) {
+		retval = PWR_RET_NO_ATTRIB;
+	} else {
+		size_t count = 0;
+		int attr;
+
+		for (attr = 0; attr < PWR_NUM_ATTR_NAMES; attr++) {
+			if (attr_listed(obj_attr_tables[obj], attr))
+				count++;
 		}
+		*value = count;
 	}
 
 	return retval;
@@ -1844,40 +1651,14 @@ CRAYPWR_AttrGetList(PWR_ObjType obj, size_t len, const char **str_list,
 		retval = PWR_RET_OUT_OF_RANGE;
 	} else if (obj < 0) {
 		// Request to get list of all supported attributes.
-		retval = get_attr_list(&supported_attr_bitmask, len,
-				str_list, val_list);
-	} else {
+		retval = get_attr_list(NULL, len, str_list, val_list);
+	} else if (obj_attr_tables[obj]) {
 		// Request to get list of supported attributes for a
 		// specified object type.
-		switch (obj) {
-		case PWR_OBJ_NODE:
-			retval = get_attr_list(&node_attr_bitmask, len,
-					str_list, val_list);
-			break;
-		case PWR_OBJ_SOCKET:
-			retval = get_attr_list(&socket_attr_bitmask, len,
-					str_list, val_list);
-			break;
-		case PWR_OBJ_CORE:
-			retval = get_attr_list(&core_attr_bitmask, len,
-					str_list, val_list);
-			break;
-		case PWR_OBJ_POWER_PLANE:
-			retval = get_attr_list(&pplane_attr_bitmask, len,
-					str_list, val_list);
-			break;
-		case PWR_OBJ_MEM:
-			retval = get_attr_list(&mem_attr_bitmask, len,
-					str_list, val_list);
-			break;
-		case PWR_OBJ_HT:
-			retval = get_attr_list(&ht_attr_bitmask, len,
-					str_list, val_list);
-			break;
-		default:
-			retval = PWR_RET_NO_ATTRIB;
-			break;
-		}
+		retval = get_attr_list(obj_attr_tables[obj], len,
+				str_list, val_list);
+	} else {
+		retval = PWR_RET_NO_ATTRIB;
 	}
 
 	return retval;
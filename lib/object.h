@@ -63,14 +63,23 @@ extern const char *attr_names[PWR_NUM_ATTR_NAMES];
 extern const char *attr_descriptions[PWR_NUM_ATTR_NAMES];
 
 
-// Bitmasks to identify what attributes are supported by
-// each of the hierarchy object types in the implementation.
-extern const DEFINE_BITMASK(node_attr_bitmask);
-extern const DEFINE_BITMASK(socket_attr_bitmask);
-extern const DEFINE_BITMASK(mem_attr_bitmask);
-extern const DEFINE_BITMASK(pplane_attr_bitmask);
-extern const DEFINE_BITMASK(core_attr_bitmask);
-extern const DEFINE_BITMASK(ht_attr_bitmask);
+// Attribute dispatch table entry flags
+#define ATTR_READ	0x1	// value can be read
+#define ATTR_WRITE	0x2	// value can be written
+#define ATTR_FORWARD	0x4	// set on the children if the setter can't
+
+// Attribute dispatch table entry. Each hierarchy object type has a
+// table, indexed by PWR_AttrName, of the attributes it supports in the
+// implementation. An entry with no flags is an unsupported attribute.
+typedef struct {
+	PWR_AttrDataType data_type;
+	unsigned int	 flags;
+	int (*get)(obj_t *obj, void *value, struct timespec *ts);
+	int (*set)(obj_t *obj, ipc_t *ipc, const void *value);
+} attr_entry_t;
+
+// PWR_ObjType values mapped to attribute dispatch tables
+extern const attr_entry_t *const obj_attr_tables[PWR_NUM_OBJ_TYPES];
 
 
 struct node_ops {
@@ -78,7 +87,11 @@ struct node_ops {
     int (*get_power) (node_t *self, double *value, struct timespec *ts);
     int (*get_power_limit_max) (node_t *self, double *value,
 					struct timespec *ts);
+    int (*set_power_limit_max) (node_t *self, ipc_t *ipc,
+					const double *value);
     int (*get_energy) (node_t *self, double *value, struct timespec *ts);
+    int (*set_cstate_limit) (node_t *self, ipc_t *ipc,
+					const uint64_t *value);
 
     // Metadata functions
     int (*get_meta) (node_t *self, PWR_AttrName attr,
@@ -204,6 +217,7 @@ struct obj_s {
 	char		*name;
 	GSequence	*hints;
 	GNode		*gnode;
+	DEFINE_BITMASK(attrs);		// attributes this object supports
 };
 
 #define to_obj(x)	((obj_t *) x)
@@ -224,7 +238,8 @@ struct node_s {
     const struct node_ops *ops;
 };
 
-node_t  *new_node(uint64_t id, const char *name_fmt, ...);
+node_t  *new_node(hierarchy_t *hierarchy, uint64_t id,
+			const char *name_fmt, ...);
 void    del_node(node_t *);
 #define to_node(x)	((node_t *) x)
 
@@ -245,7 +260,8 @@ struct socket_s {
     const struct socket_ops *ops;
 };
 
-socket_t *new_socket(uint64_t id, const char *name_fmt, ...);
+socket_t *new_socket(hierarchy_t *hierarchy, uint64_t id,
+			const char *name_fmt, ...);
 void     del_socket(socket_t *);
 #define  to_socket(x)	((socket_t *) x)
 
@@ -266,7 +282,8 @@ struct mem_s {
     const struct mem_ops *ops;
 };
 
-mem_t   *new_mem(uint64_t id, const char *name_fmt, ...);
+mem_t   *new_mem(hierarchy_t *hierarchy, uint64_t id,
+			const char *name_fmt, ...);
 void    del_mem(mem_t *);
 #define to_mem(x)	((mem_t *) x)
 
@@ -287,7 +304,8 @@ struct pplane_s {
     const struct pplane_ops *ops;
 };
 
-pplane_t *new_pplane(uint64_t id, const char *name_fmt, ...);
+pplane_t *new_pplane(hierarchy_t *hierarchy, uint64_t id,
+			const char *name_fmt, ...);
 void     del_pplane(pplane_t *);
 #define  to_pplane(x)	((pplane_t *) x)
 
@@ -308,7 +326,8 @@ struct core_s {
     const struct core_ops *ops;
 };
 
-core_t  *new_core(uint64_t id, const char *name_fmt, ...);
+core_t  *new_core(hierarchy_t *hierarchy, uint64_t id,
+			const char *name_fmt, ...);
 void    del_core(core_t *);
 #define to_core(x)	((core_t *) x)
 
@@ -328,7 +347,8 @@ struct ht_s {
     const struct ht_ops *ops;
 };
 
-ht_t    *new_ht(uint64_t id, const char *name_fmt, ...);
+ht_t    *new_ht(hierarchy_t *hierarchy, uint64_t id,
+			const char *name_fmt, ...);
 void    del_ht(ht_t *);
 #define to_ht(x)	((ht_t *) x)
 
@@ -337,34 +357,10 @@ void    del_ht(ht_t *);
 // Object attribute get/set function prototypes. //
 // --------------------------------------------- //
 
-int	node_attr_get_value(node_t *node, PWR_AttrName attr,
-		void *value, struct timespec *tspec);
-int	node_attr_set_value(node_t *node, ipc_t *ipc, PWR_AttrName attr,
-		const void *value);
-
-int	socket_attr_get_value(socket_t *socket, PWR_AttrName attr,
-		void *value, struct timespec *tspec);
-int	socket_attr_set_value(socket_t *socket, ipc_t *ipc, PWR_AttrName attr,
-		const void *value);
-
-int	mem_attr_get_value(mem_t *mem, PWR_AttrName attr,
-		void *value, struct timespec *tspec);
-int	mem_attr_set_value(mem_t *mem, ipc_t *ipc, PWR_AttrName attr,
-		const void *value);
-
-int	pplane_attr_get_value(pplane_t *pplane, PWR_AttrName attr,
-		void *value, struct timespec *tspec);
-int	pplane_attr_set_value(pplane_t *pplane, ipc_t *ipc, PWR_AttrName attr,
-		const void *value);
-
-int	core_attr_get_value(core_t *core, PWR_AttrName attr,
-		void *value, struct timespec *tspec);
-int	core_attr_set_value(core_t *core, ipc_t *ipc, PWR_AttrName attr,
-		const void *value);
-
-int	ht_attr_get_value(ht_t *ht, PWR_AttrName attr,
+const attr_entry_t *obj_attr_readable(const obj_t *obj, PWR_AttrName attr);
+int	obj_attr_get_value(obj_t *obj, PWR_AttrName attr,
 		void *value, struct timespec *tspec);
-int	ht_attr_set_value(ht_t *ht, ipc_t *ipc, PWR_AttrName attr,
+int	obj_attr_set_value(obj_t *obj, ipc_t *ipc, PWR_AttrName attr,
 		const void *value);
 
 #endif /* _PWR_OBJECT_H */
@@ -69,6 +69,9 @@ opaque_map_debug_entry(opaque_type_t type, opaque_ref_t *opaque)
 }
 #endif
 
+// Initial number of slots in a map's table
+#define OPAQUE_TABLE_MIN	64
+
 static void
 opaque_map_clean_entry(void *data)
 {
@@ -84,14 +87,107 @@ opaque_map_clean_entry(void *data)
 	TRACE3_EXIT("");
 }
 
+static opaque_table_t *
+opaque_table_new(guint size)
+{
+	opaque_table_t *table;
+
+	table = g_malloc0(sizeof(opaque_table_t)
+			+ size * sizeof(opaque_slot_t));
+	if (table) {
+		table->size = size;
+	}
+
+	return table;
+}
+
+// Find the slot holding key, or the empty slot ending its probe sequence
+static opaque_slot_t *
+opaque_table_probe(opaque_table_t *table, opaque_key_t key)
+{
+	guint mask = table->size - 1;
+	guint i = GPOINTER_TO_UINT(key) & mask;
+	opaque_key_t slot_key;
+
+	for (;;) {
+		slot_key = g_atomic_pointer_get(&table->slots[i].key);
+		if (slot_key == NULL || slot_key == key) {
+			return &table->slots[i];
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+//
+// opaque_table_grow - Replace a map's table with a copy of its live keys
+// that has room for at least as many again.  Called with the lock held.
+//
+static opaque_table_t *
+opaque_table_grow(opaque_map_t *map)
+{
+	opaque_table_t *old = map->table;
+	opaque_table_t *table = NULL;
+	opaque_slot_t *slot;
+	guint live = 0;
+	guint size = OPAQUE_TABLE_MIN;
+	guint i;
+
+	TRACE3_ENTER("map = %p, size = %u", map, old->size);
+
+	for (i = 0; i < old->size; i++) {
+		if (old->slots[i].ref) {
+			live++;
+		}
+	}
+	while (size < 4 * (live + 1)) {
+		size *= 2;
+	}
+
+	table = opaque_table_new(size);
+	if (!table) {
+		goto done;
+	}
+
+	for (i = 0; i < old->size; i++) {
+		if (!old->slots[i].ref) {
+			continue;
+		}
+		slot = opaque_table_probe(table, old->slots[i].key);
+		*slot = old->slots[i];
+		table->used++;
+	}
+
+	// Publish the filled in table to lookups
+	table->older = old;
+	g_atomic_pointer_set(&map->table, table);
+
+done:
+	TRACE3_EXIT("table = %p, size = %u", table, size);
+
+	return table;
+}
+
 void
 opaque_map_free(opaque_map_t *map)
 {
+	opaque_table_t *table;
+	guint i;
+
 	TRACE3_ENTER("map = %p", map);
 
 	if (map) {
-		g_hash_table_destroy(map->table);
-		g_rand_free(map->rand);
+		table = map->table;
+		for (i = 0; table && i < table->size; i++) {
+			opaque_map_clean_entry(table->slots[i].ref);
+		}
+		while ((table = map->table) != NULL) {
+			map->table = table->older;
+			g_free(table);
+		}
+		if (map->rand) {
+			g_rand_free(map->rand);
+		}
+		g_mutex_clear(&map->lock);
 		g_free(map);
 	}
 
@@ -111,6 +207,7 @@ opaque_map_new(void)
 		error = 1;
 		goto error_return;
 	}
+	g_mutex_init(&map->lock);
 
 	map->rand = g_rand_new();
 	if (!map->rand) {
@@ -118,8 +215,7 @@ opaque_map_new(void)
 		goto error_return;
 	}
 
-	map->table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
-			opaque_map_clean_entry);
+	map->table = opaque_table_new(OPAQUE_TABLE_MIN);
 	if (!map->table) {
 		error = 1;
 		goto error_return;
@@ -140,11 +236,14 @@ opaque_ref_t *
 opaque_map_lookup(opaque_map_t *map, opaque_key_t key)
 {
 	opaque_ref_t *opaque = NULL;
+	opaque_slot_t *slot;
 
 	TRACE2_ENTER("map = %p, key = %p", map, key);
 
-	if (map) {
-		opaque = g_hash_table_lookup(map->table, key);
+	if (map && key) {
+		slot = opaque_table_probe(g_atomic_pointer_get(&map->table),
+				key);
+		opaque = g_atomic_pointer_get(&slot->ref);
 	}
 
 	TRACE2_EXIT("opaque = %p", opaque);
@@ -174,6 +273,8 @@ opaque_map_lookup_type(opaque_map_t *map, opaque_key_t key, opaque_type_t type)
 opaque_key_t
 opaque_map_insert(opaque_map_t *map, opaque_type_t type, opaque_ref_t *opaque)
 {
+	opaque_table_t *table;
+	opaque_slot_t *slot;
 	gpointer key = NULL;
 
 	TRACE3_ENTER("map = %p, type = %d, opaque = %p", map, type, opaque);
@@ -181,17 +282,42 @@ opaque_map_insert(opaque_map_t *map, opaque_type_t type, opaque_ref_t *opaque)
 	if (!map)
 		goto done;
 
+	g_mutex_lock(&map->lock);
+
+	// Keep the table at most half full, so probes stay short
+	table = map->table;
+	if (2 * (table->used + 1) > table->size) {
+		table = opaque_table_grow(map);
+		if (!table) {
+			g_mutex_unlock(&map->lock);
+			goto done;
+		}
+	}
+
 	while (key == NULL) {
 		key = GUINT_TO_POINTER(g_rand_int(map->rand));
-		if (g_hash_table_lookup(map->table, key)) {
+		if (key == NULL) {
+			continue;
+		}
+
+		// A removed key may be handed out again
+		slot = opaque_table_probe(table, key);
+		if (slot->ref) {
 			key = NULL;
-		} else {
-			opaque->type = type;
-			opaque->key = key;
-			g_hash_table_insert(map->table, key, opaque);
+			continue;
+		}
+
+		opaque->type = type;
+		opaque->key = key;
+		g_atomic_pointer_set(&slot->ref, opaque);
+		if (slot->key == NULL) {
+			g_atomic_pointer_set(&slot->key, key);
+			table->used++;
 		}
 	}
 
+	g_mutex_unlock(&map->lock);
+
 done:
 	TRACE3_EXIT("key = %p", key);
 
@@ -201,12 +327,22 @@ done:
 bool
 opaque_map_remove(opaque_map_t *map, gpointer key)
 {
+	opaque_slot_t *slot;
 	bool retval = false;
 
 	TRACE3_ENTER("map = %p, key = %p", map, key);
 
-	if (map) {
-		retval = g_hash_table_remove(map->table, key);
+	if (map && key) {
+		g_mutex_lock(&map->lock);
+
+		slot = opaque_table_probe(map->table, key);
+		if (slot->ref) {
+			opaque_map_clean_entry(slot->ref);
+			g_atomic_pointer_set(&slot->ref, NULL);
+			retval = true;
+		}
+
+		g_mutex_unlock(&map->lock);
 	}
 
 	TRACE3_EXIT("retval = %d", retval);
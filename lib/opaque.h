@@ -51,6 +51,7 @@ typedef enum {
 	OPAQUE_STATUS,
 	OPAQUE_STAT,
 	OPAQUE_HINT,
+	OPAQUE_REQUEST,
 	OPAQUE_MAX
 } opaque_type_t;
 
@@ -62,8 +63,26 @@ typedef struct {
 } opaque_ref_t;
 
 typedef struct {
+	opaque_key_t	key;	// NULL if the slot was never used
+	opaque_ref_t	*ref;	// NULL once the key is removed
+} opaque_slot_t;
+
+typedef struct opaque_table_s {
+	guint			size;	// Number of slots, a power of two
+	guint			used;	// Slots with a key, removed or not
+	struct opaque_table_s	*older;	// Table this replaced
+	opaque_slot_t		slots[];
+} opaque_table_t;
+
+// Lookups are lock free: they probe the current table, whose slots are
+// only ever filled in, never moved.  Inserts and removals are serialized
+// by the lock, and a table that fills up is replaced by a larger copy.
+// Replaced tables are kept until the map is freed, since a lookup may
+// still be probing one.
+typedef struct {
+	GMutex		lock;
 	GRand		*rand;
-	GHashTable	*table;
+	opaque_table_t	*table;
 } opaque_map_t;
 
 // Global map to associate reference keys to an address of the
@@ -104,5 +123,7 @@ opaque_ref_t	*opaque_map_lookup_type(opaque_map_t *map, opaque_key_t key,
 	((stat_t *)opaque_map_lookup_type(m, k, OPAQUE_STAT))
 #define opaque_map_lookup_hint(m, k)	\
 	((hint_t *)opaque_map_lookup_type(m, k, OPAQUE_HINT))
+#define opaque_map_lookup_request(m, k)	\
+	((request_t *)opaque_map_lookup_type(m, k, OPAQUE_REQUEST))
 
 #endif // _PWR_OPAQUE_H
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains the functions for read plans.
+ */
+
+#include <stdint.h>
+
+#include <cray-powerapi/types.h>
+#include <log.h>
+
+#include "plan.h"
+#include "timer.h"
+
+/*
+ * plan_new - Make an empty plan to read attr from up to nobjs objects,
+ *	      added with plan_add_obj().  If as_double is set, integer
+ *	      values are returned converted to double.
+ */
+plan_t *
+plan_new(PWR_AttrName attr, int nobjs, bool as_double)
+{
+	plan_t *plan = NULL;
+
+	TRACE2_ENTER("attr = %d, nobjs = %d, as_double = %d",
+			attr, nobjs, as_double);
+
+	plan = g_malloc0(sizeof(plan_t) + nobjs * sizeof(plan_step_t));
+	if (!plan) {
+		LOG_FAULT("Failed to alloc read plan");
+		goto done;
+	}
+
+	plan->refcount = 1;
+	plan->attr = attr;
+	plan->as_double = as_double;
+
+	// Without a read set, the plan still runs, reading files one by one
+	plan->set = read_set_new();
+
+done:
+	TRACE2_EXIT("plan = %p", plan);
+
+	return plan;
+}
+
+/*
+ * plan_add_obj - Add the next object to a plan, with the opaque handle
+ *		  errors reading it are reported under.  The plan must
+ *		  have room for it.
+ */
+void
+plan_add_obj(plan_t *plan, obj_t *obj, PWR_Obj handle)
+{
+	plan_step_t *step = &plan->steps[plan->nsteps++];
+	const attr_entry_t *entry = NULL;
+
+	TRACE2_ENTER("plan = %p, obj = %p, handle = %p", plan, obj, handle);
+
+	step->obj = obj;
+	step->handle = handle;
+
+	entry = obj_attr_readable(obj, plan->attr);
+	if (entry) {
+		step->get = entry->get;
+		step->data_type = entry->data_type;
+	} else {
+		step->errcode = PWR_RET_NOT_IMPLEMENTED;
+	}
+
+	TRACE2_EXIT("errcode = %d", step->errcode);
+}
+
+plan_t *
+plan_ref(plan_t *plan)
+{
+	if (plan)
+		g_atomic_int_inc(&plan->refcount);
+
+	return plan;
+}
+
+void
+plan_unref(plan_t *plan)
+{
+	TRACE2_ENTER("plan = %p", plan);
+
+	if (plan && g_atomic_int_dec_and_test(&plan->refcount)) {
+		read_set_free(plan->set);
+		g_free(plan);
+	}
+
+	TRACE2_EXIT("");
+}
+
+/*
+ * plan_run - Read a plan's attribute from each of its objects.  The value
+ *	      read from the object of step i is stored at (values + 8*i),
+ *	      and its timestamp at ts[i] if ts is not NULL.  If errcodes is
+ *	      not NULL, errcodes[i] is set to the result of step i.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Every object was read
+ *	PWR_RET_FAILURE - One or more objects could not be read
+ */
+int
+plan_run(plan_t *plan, void *values, PWR_Time ts[], int errcodes[])
+{
+	plan_step_t *step = NULL;
+	struct timespec tspec;
+	void *value = NULL;
+	int retval = PWR_RET_SUCCESS;
+	int errcode;
+	int i;
+
+	TRACE2_ENTER("plan = %p, values = %p, ts = %p, errcodes = %p",
+			plan, values, ts, errcodes);
+
+	// Another thread running the same plan has its read set, in which
+	// case this run reads without one
+	if (plan->set && read_set_trylock(plan->set))
+		read_cache_begin(plan->set);
+	else
+		read_cache_begin(NULL);
+
+	for (i = 0; i < plan->nsteps; i++) {
+		step = &plan->steps[i];
+		value = (char *)values + 8*i;
+
+		errcode = step->errcode;
+		if (errcode == PWR_RET_SUCCESS)
+			errcode = step->get(step->obj, value, &tspec);
+
+		if (errcode == PWR_RET_SUCCESS) {
+			if (plan->as_double &&
+					step->data_type == PWR_ATTR_DATA_UINT64)
+				*(double *)value = *(uint64_t *)value;
+			if (ts)
+				ts[i] = pwr_tspec_to_nsec(&tspec);
+		} else {
+			retval = PWR_RET_FAILURE;
+		}
+
+		if (errcodes)
+			errcodes[i] = errcode;
+	}
+
+	read_cache_end();
+
+	TRACE2_EXIT("retval = %d", retval);
+
+	return retval;
+}
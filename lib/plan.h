@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains the structure definitions and prototypes for read
+ * plans, repeated reads of an attribute from a fixed list of objects.
+ */
+
+#ifndef _PWR_PLAN_H
+#define _PWR_PLAN_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/types.h>
+
+#include "typedefs.h"
+#include "object.h"
+#include "plugins/common/file.h"
+
+//
+// A plan does once what every read of the attribute would otherwise
+// repeat: it checks each object supports the attribute and resolves the
+// object type's getter, so running it just calls the getters in order.
+// The plan keeps its own read set, which holds the files the getters
+// open, so they are read together and stay open between runs.
+//
+typedef struct {
+	int		(*get)(obj_t *obj, void *value, struct timespec *ts);
+	obj_t		*obj;
+	PWR_Obj		 handle;	// Opaque handle, for reporting errors
+	PWR_AttrDataType data_type;
+	int		 errcode;	// Error found while planning, if any
+} plan_step_t;
+
+// See typedefs.h for:
+// typedef struct plan_s plan_t;
+struct plan_s {
+	gint		 refcount;
+	PWR_AttrName	 attr;
+	bool		 as_double;	// Convert integer values to double
+	read_set_t	*set;		// Files the steps read
+	int		 nsteps;
+	plan_step_t	 steps[];
+};
+
+plan_t	*plan_new(PWR_AttrName attr, int nobjs, bool as_double);
+void	 plan_add_obj(plan_t *plan, obj_t *obj, PWR_Obj handle);
+plan_t	*plan_ref(plan_t *plan);
+void	 plan_unref(plan_t *plan);
+int	 plan_run(plan_t *plan, void *values, PWR_Time ts[], int errcodes[]);
+
+#endif /* _PWR_PLAN_H */
@@ -57,6 +57,15 @@ struct plugin_s {
 	// System file names
 	sysentry_t *sysfile_catalog;
 
+	// Size of the plugin data the library allocates with each
+	// object of a type, for the construct function to fill in
+	size_t node_data_size;
+	size_t socket_data_size;
+	size_t mem_data_size;
+	size_t pplane_data_size;
+	size_t core_data_size;
+	size_t ht_data_size;
+
 	// Function pointers
 	int (*destruct) (plugin_t *plugin);
 
@@ -31,6 +31,10 @@
  * This file contains common functions for plugin functions.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -38,11 +42,485 @@
 #include <log.h>
 
 #include "file.h"
+#include "telemetry.h"
+#include "uring.h"
+
+#define READ_BUF_LEN	256	// longest value read ahead by a read set
+#define READ_SET_MAX	4096	// most files a read set remembers
+#define READ_RING_DEPTH	64	// reads in flight in a batch
+
+// A value read while a thread's read cache is active
+typedef struct {
+	int		retval;
+	gboolean	telem;		// ivalue came from the telemetry segment
+	uint64_t	ivalue;
+	gchar		*buf;		// file contents, if read from the file
+	struct timespec	tspec;
+} read_entry_t;
+
+// A file a read set has learned to read ahead
+typedef struct {
+	char		*path;
+	int		fd;		// -1 if not yet or not openable
+	gboolean	telem;		// last value came from the telemetry segment
+} read_file_t;
+
+struct read_set {
+	GHashTable	*index;		// path -> read_file_t
+	GPtrArray	*files;		// read_file_t, in the order learned
+	char		*bufs;		// READ_BUF_LEN per file
+	int		*fds;		// file table registered with the ring
+	int		*lens;		// result of each file's read
+	guint		nbufs;		// files the arrays have room for
+	uring_t		*ring;
+	gboolean	registered;	// ring's file table matches files
+	gboolean	no_ring;	// io_uring isn't available
+	GMutex		lock;		// held by the thread using the set
+};
+
+typedef struct {
+	unsigned int	depth;		// nesting of read_cache_begin() calls
+	GHashTable	*entries;	// path -> read_entry_t
+	read_set_t	*set;		// read set of the outermost call
+} read_cache_t;
+
+static void read_cache_free(gpointer data);
+
+static GPrivate read_cache_key = G_PRIVATE_INIT(read_cache_free);
+
+static void
+read_entry_free(gpointer data)
+{
+	read_entry_t *entry = data;
+
+	g_free(entry->buf);
+	g_free(entry);
+}
+
+static void
+read_cache_free(gpointer data)
+{
+	read_cache_t *cache = data;
+
+	if (cache->entries)
+		g_hash_table_destroy(cache->entries);
+	g_free(cache);
+}
+
+static void
+read_file_free(gpointer data)
+{
+	read_file_t *file = data;
+
+	if (file->fd >= 0)
+		close(file->fd);
+	g_free(file->path);
+	g_free(file);
+}
+
+/*
+ * read_set_new - Create a read set.  A read set remembers the files read
+ *		  while it is passed to read_cache_begin(), and reads all of
+ *		  them at once, as an io_uring batch where the kernel allows
+ *		  it, at the start of the next such call.  Callers keep one
+ *		  for each operation they repeat.
+ */
+read_set_t *
+read_set_new(void)
+{
+	read_set_t *set = NULL;
+
+	set = g_new0(read_set_t, 1);
+	if (!set) {
+		LOG_FAULT("Failed to alloc read set");
+		return NULL;
+	}
+	g_mutex_init(&set->lock);
+
+	set->index = g_hash_table_new(g_str_hash, g_str_equal);
+	set->files = g_ptr_array_new_with_free_func(read_file_free);
+	if (!set->index || !set->files) {
+		LOG_FAULT("Failed to alloc read set tables");
+		read_set_free(set);
+		return NULL;
+	}
+
+	return set;
+}
+
+void
+read_set_free(read_set_t *set)
+{
+	if (!set)
+		return;
+
+	uring_free(set->ring);
+	if (set->index)
+		g_hash_table_destroy(set->index);
+	if (set->files)
+		g_ptr_array_free(set->files, TRUE);
+	g_free(set->bufs);
+	g_free(set->fds);
+	g_free(set->lens);
+	g_mutex_clear(&set->lock);
+	g_free(set);
+}
+
+/*
+ * read_set_trylock - Claim a read set for the calling thread, failing if
+ *		      another thread has it.  A set is only used by one
+ *		      thread at a time; one that loses the race reads
+ *		      without it.
+ */
+gboolean
+read_set_trylock(read_set_t *set)
+{
+	return g_mutex_trylock(&set->lock);
+}
+
+void
+read_set_unlock(read_set_t *set)
+{
+	g_mutex_unlock(&set->lock);
+}
+
+// Remember a file read without the read set's help
+static void
+read_set_learn(read_set_t *set, const char *path, gboolean telem)
+{
+	read_file_t *file = NULL;
+
+	TRACE3_ENTER("set = %p, path = '%s', telem = %d", set, path, telem);
+
+	file = g_hash_table_lookup(set->index, path);
+	if (file == NULL) {
+		if (set->files->len >= READ_SET_MAX)
+			goto done;
+
+		file = g_new0(read_file_t, 1);
+		if (!file) {
+			LOG_FAULT("Failed to alloc read set file");
+			goto done;
+		}
+		file->path = g_strdup(path);
+		file->fd = -1;
+		g_ptr_array_add(set->files, file);
+		g_hash_table_insert(set->index, file->path, file);
+	}
+
+	// Values sampled by powerapid are cheaper to take from telemetry
+	file->telem = telem;
+	if (!telem && file->fd < 0) {
+		file->fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (file->fd >= 0)
+			set->registered = FALSE;
+	}
+
+done:
+	TRACE3_EXIT("");
+}
+
+/*
+ * read_set_fetch_ring - Read the files of a read set as io_uring batches
+ *			 against the registered file table.  Reads that don't
+ *			 complete are left for the caller to retry.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - io_uring can't be used
+ */
+static int
+read_set_fetch_ring(read_set_t *set)
+{
+	int retval = PWR_RET_FAILURE;
+	read_file_t *file = NULL;
+	guint n = set->files->len;
+	uint64_t tag;
+	guint i;
+	int res;
+
+	TRACE3_ENTER("set = %p, n = %u", set, n);
+
+	if (!set->ring) {
+		set->ring = uring_new(READ_RING_DEPTH);
+		if (!set->ring) {
+			set->no_ring = TRUE;
+			goto done;
+		}
+	}
+
+	if (!set->registered) {
+		if (uring_register_files(set->ring, set->fds, n)
+				!= PWR_RET_SUCCESS)
+			goto failed;
+		set->registered = TRUE;
+	}
+
+	for (i = 0; i < n; ) {
+		for (; i < n; i++) {
+			file = g_ptr_array_index(set->files, i);
+			if (file->telem || file->fd < 0)
+				continue;
+			if (uring_prep_read(set->ring, i,
+					set->bufs + i * READ_BUF_LEN,
+					READ_BUF_LEN - 1, i) != PWR_RET_SUCCESS)
+				break;
+		}
+
+		if (uring_submit_wait(set->ring) != PWR_RET_SUCCESS)
+			goto failed;
+
+		while (uring_complete(set->ring, &tag, &res)) {
+			if (tag < n)
+				set->lens[tag] = res;
+		}
+	}
+
+	retval = PWR_RET_SUCCESS;
+	goto done;
+
+failed:
+	// Don't try again with a ring in an unknown state
+	uring_free(set->ring);
+	set->ring = NULL;
+	set->no_ring = TRUE;
+
+done:
+	TRACE3_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+// Read every file a read set has learned into the read cache
+static void
+read_set_fetch(read_set_t *set, read_cache_t *cache, gboolean use_ring)
+{
+	read_file_t *file = NULL;
+	read_entry_t *entry = NULL;
+	struct timespec tspec;
+	guint n = set->files->len;
+	char *buf;
+	guint i;
+
+	TRACE3_ENTER("set = %p, cache = %p, n = %u", set, cache, n);
+
+	if (n == 0)
+		goto done;
+
+	if (set->nbufs < n) {
+		set->bufs = g_renew(char, set->bufs, n * READ_BUF_LEN);
+		set->fds = g_renew(int, set->fds, n);
+		set->lens = g_renew(int, set->lens, n);
+		if (!set->bufs || !set->fds || !set->lens) {
+			LOG_FAULT("Failed to alloc read set buffers");
+			set->nbufs = 0;
+			goto done;
+		}
+		set->nbufs = n;
+	}
+
+	for (i = 0; i < n; i++) {
+		file = g_ptr_array_index(set->files, i);
+		set->fds[i] = file->fd;
+		set->lens[i] = -1;
+	}
+
+	if (use_ring && !set->no_ring)
+		read_set_fetch_ring(set);
+
+	// Read whatever the ring didn't, one file after another
+	for (i = 0; i < n; i++) {
+		file = g_ptr_array_index(set->files, i);
+		if (set->lens[i] >= 0 || file->telem || file->fd < 0)
+			continue;
+		set->lens[i] = pread(file->fd, set->bufs + i * READ_BUF_LEN,
+				READ_BUF_LEN - 1, 0);
+	}
+
+	if (clock_gettime(CLOCK_REALTIME, &tspec)) {
+		LOG_FAULT("clock_gettime() failed: %m");
+		goto done;
+	}
+
+	// A value that filled the buffer may be cut short; leave it to be
+	// read whole when it is asked for.
+	for (i = 0; i < n; i++) {
+		if (set->lens[i] < 0 || set->lens[i] >= READ_BUF_LEN - 1)
+			continue;
+
+		file = g_ptr_array_index(set->files, i);
+		buf = set->bufs + i * READ_BUF_LEN;
+
+		entry = g_new0(read_entry_t, 1);
+		if (!entry) {
+			LOG_FAULT("Failed to alloc read cache entry");
+			goto done;
+		}
+		entry->buf = g_strndup(buf, set->lens[i]);
+		entry->tspec = tspec;
+		entry->retval = PWR_RET_SUCCESS;
+
+		g_hash_table_insert(cache->entries, g_strdup(file->path),
+				entry);
+	}
+
+done:
+	TRACE3_EXIT("");
+}
+
+/*
+ * read_cache_begin - Start sharing reads within the calling thread.  Until
+ *		      the matching read_cache_end(), each file read through
+ *		      read_val_from_file() is read once, and later reads of
+ *		      it return the same value and timestamp.  Calls nest.
+ *		      The outermost call reads ahead the files of set, if
+ *		      given, and teaches it any others that are read.  The
+ *		      caller must hold set with read_set_trylock(); it is
+ *		      released by the matching read_cache_end().
+ *
+ *		      PWR_READ_BATCH=off in the environment disables read
+ *		      sets, and PWR_READ_BATCH=pread disables io_uring.
+ */
+void
+read_cache_begin(read_set_t *set)
+{
+	read_cache_t *cache = g_private_get(&read_cache_key);
+	const char *mode = getenv("PWR_READ_BATCH");
+
+	TRACE2_ENTER("cache = %p, set = %p", cache, set);
+
+	if (cache == NULL) {
+		cache = g_new0(read_cache_t, 1);
+		if (!cache) {
+			LOG_FAULT("Failed to alloc read cache");
+			goto done;
+		}
+		cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, read_entry_free);
+		if (!cache->entries) {
+			LOG_FAULT("Failed to alloc read cache table");
+			g_free(cache);
+			goto done;
+		}
+		g_private_set(&read_cache_key, cache);
+	}
+
+	if (cache->depth++ == 0 && set
+			&& !(mode && strcmp(mode, "off") == 0)) {
+		cache->set = set;
+		read_set_fetch(set, cache,
+				!(mode && strcmp(mode, "pread") == 0));
+		set = NULL;
+	}
+
+done:
+	// Release a set that won't be used
+	if (set)
+		read_set_unlock(set);
+
+	TRACE2_EXIT("");
+}
+
+/*
+ * read_cache_end - Stop sharing reads started by read_cache_begin(),
+ *		    forgetting the values read once the outermost call ends.
+ */
+void
+read_cache_end(void)
+{
+	read_cache_t *cache = g_private_get(&read_cache_key);
+
+	TRACE2_ENTER("cache = %p", cache);
+
+	if (cache && cache->depth > 0 && --cache->depth == 0) {
+		g_hash_table_remove_all(cache->entries);
+		if (cache->set)
+			read_set_unlock(cache->set);
+		cache->set = NULL;
+	}
+
+	TRACE2_EXIT("");
+}
+
+/*
+ * read_val_cached - Converts the value of a file held in the read cache,
+ *		     reading the file into the cache if it isn't there.
+ */
+static int
+read_val_cached(read_cache_t *cache, const char *path, void *val,
+		val_type_t type, struct timespec *tspec)
+{
+	int retval = PWR_RET_FAILURE;
+	read_entry_t *entry = NULL;
+
+	TRACE3_ENTER("path = '%s', val = %p, type = %d, tspec = %p",
+			path, val, type, tspec);
+
+	entry = g_hash_table_lookup(cache->entries, path);
+	if (entry == NULL) {
+		entry = g_new0(read_entry_t, 1);
+		if (!entry) {
+			LOG_FAULT("Failed to alloc read cache entry");
+			goto done;
+		}
+
+		if (type == TYPE_UINT64 && telemetry_read_uint64(path,
+				&entry->ivalue, &entry->tspec)
+				== PWR_RET_SUCCESS) {
+			entry->telem = TRUE;
+			entry->retval = PWR_RET_SUCCESS;
+		} else if (!g_file_get_contents(path, &entry->buf,
+				NULL, NULL)) {
+			LOG_FAULT("File '%s' read failed", path);
+			entry->retval = PWR_RET_FAILURE;
+		} else if (clock_gettime(CLOCK_REALTIME, &entry->tspec)) {
+			LOG_FAULT("clock_gettime() failed: %m");
+			entry->retval = PWR_RET_FAILURE;
+		} else {
+			entry->retval = PWR_RET_SUCCESS;
+		}
+
+		g_hash_table_insert(cache->entries, g_strdup(path), entry);
+
+		if (cache->set && entry->retval == PWR_RET_SUCCESS)
+			read_set_learn(cache->set, path, entry->telem);
+	}
+
+	retval = entry->retval;
+	if (retval != PWR_RET_SUCCESS)
+		goto done;
+
+	if (entry->telem) {
+		// Only the integer value of a sampled file is at hand
+		if (type != TYPE_UINT64) {
+			retval = read_val_from_file_direct(path, val, type,
+					tspec);
+			goto done;
+		}
+		*(uint64_t *)val = entry->ivalue;
+	} else {
+		retval = read_val_from_buf(entry->buf, val, type, NULL);
+		if (retval != PWR_RET_SUCCESS)
+			goto done;
+	}
+
+	if (tspec != NULL)
+		*tspec = entry->tspec;
+
+done:
+	TRACE3_EXIT("retval = %d", retval);
+
+	return retval;
+}
 
 /*
  * read_val_from_file - Reads the contents of the specified file and converts
  *		        it to the specified type.  Assumes file contains a
- *		        single value but can be of any type.
+ *		        single value but can be of any type.  Integer values
+ *		        sampled by powerapid are taken from the telemetry
+ *		        segment when it has a fresh sample.  Reads are shared
+ *		        while the read cache is active.
  *
  * Argument(s):
  *
@@ -60,6 +538,40 @@
 int
 read_val_from_file(const char *path, void *val, val_type_t type,
 		struct timespec *tspec)
+{
+	read_cache_t *cache = g_private_get(&read_cache_key);
+
+	if (cache && cache->depth > 0)
+		return read_val_cached(cache, path, val, type, tspec);
+
+	if (type == TYPE_UINT64
+			&& telemetry_read_uint64(path, val, tspec) == PWR_RET_SUCCESS)
+		return PWR_RET_SUCCESS;
+
+	return read_val_from_file_direct(path, val, type, tspec);
+}
+
+/*
+ * read_val_from_file_direct - Reads the contents of the specified file and
+ *			       converts it to the specified type, bypassing
+ *			       the telemetry segment.
+ *
+ * Argument(s):
+ *
+ *	path - Path to file to read
+ *	val - Target memory to hold value
+ *	type - Target type to convert to
+ *	tspec - Target memory to hold timestamp of when data sample is taken.
+ *		If NULL, no timestamp is taken.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+int
+read_val_from_file_direct(const char *path, void *val, val_type_t type,
+		struct timespec *tspec)
 {
 	int retval = PWR_RET_FAILURE;
 	gchar *buf = NULL;
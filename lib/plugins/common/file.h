@@ -37,9 +37,22 @@
 
 #include "common.h"
 
+typedef struct read_set read_set_t;
+
+read_set_t *read_set_new(void);
+void read_set_free(read_set_t *set);
+gboolean read_set_trylock(read_set_t *set);
+void read_set_unlock(read_set_t *set);
+
+void read_cache_begin(read_set_t *set);
+void read_cache_end(void);
+
 int read_val_from_file(const char *path, void *val, val_type_t type,
 		struct timespec *tspec);
 
+int read_val_from_file_direct(const char *path, void *val, val_type_t type,
+		struct timespec *tspec);
+
 int read_line_from_file(const char *path, unsigned int num, char **line,
 		struct timespec *tspec);
 
@@ -49,6 +62,13 @@ read_uint64_from_file(const char *path, uint64_t *val, struct timespec *tspec)
 	return read_val_from_file(path, val, TYPE_UINT64, tspec);
 }
 
+static inline int
+read_uint64_from_file_direct(const char *path, uint64_t *val,
+		struct timespec *tspec)
+{
+	return read_val_from_file_direct(path, val, TYPE_UINT64, tspec);
+}
+
 static inline int
 read_double_from_file(const char *path, double *val, struct timespec *tspec)
 {
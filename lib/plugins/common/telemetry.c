@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains functions to read samples published by powerapid in
+ * the telemetry shared memory segment.  Reads are lock free; whenever the
+ * segment is missing, stale, or doesn't have the requested file, callers
+ * fall back to reading the file directly.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cray-powerapi/types.h>
+#include <cray-powerapi/powerapid.h>
+#include <compiler.h>
+#include <log.h>
+
+#include "telemetry.h"
+
+// How often to try attaching to the segment when it isn't available
+#define TELEM_ATTACH_INTERVAL	NSEC_PER_SEC
+
+// A sample older than this many sample intervals is considered stale
+#define TELEM_MAX_AGE		2
+
+// How many times to retry reading an entry being updated by powerapid
+#define TELEM_READ_RETRIES	100
+
+/*
+ * Readers on any thread load telem_hdr once and use that mapping for the
+ * whole read.  A segment is published with a compare-and-swap, and one
+ * found stale is only unpublished, never unmapped, since another thread
+ * may still be reading it.  That leaks one mapping per powerapid restart.
+ */
+static const powerapi_telem_hdr_t *telem_hdr = NULL;
+static uint64_t telem_next_attach = 0;
+static int telem_disabled = -1;
+
+static uint64_t
+telem_clock(clockid_t clock, struct timespec *tspec)
+{
+	struct timespec ts;
+
+	if (tspec == NULL)
+		tspec = &ts;
+
+	clock_gettime(clock, tspec);
+
+	return tspec->tv_sec * NSEC_PER_SEC + tspec->tv_nsec;
+}
+
+static void
+telem_detach(const powerapi_telem_hdr_t *hdr)
+{
+	__atomic_compare_exchange_n(&telem_hdr, &hdr, NULL, false,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/*
+ * telem_attach - Map the telemetry segment read only if it isn't already
+ *		  mapped.  Attempts are rate limited so that clients on
+ *		  nodes without powerapid don't pay for a failing shm_open
+ *		  on every read.
+ *
+ * Return Code(s):
+ *
+ *	The mapped segment header, or NULL if it isn't available
+ */
+static const powerapi_telem_hdr_t *
+telem_attach(void)
+{
+	const powerapi_telem_hdr_t *hdr = NULL;
+	const powerapi_telem_hdr_t *cur = NULL;
+	struct stat st;
+	uint64_t now, next;
+	int disabled;
+	int fd = -1;
+
+	hdr = __atomic_load_n(&telem_hdr, __ATOMIC_ACQUIRE);
+	if (likely(hdr != NULL))
+		return hdr;
+
+	disabled = __atomic_load_n(&telem_disabled, __ATOMIC_RELAXED);
+	if (unlikely(disabled < 0)) {
+		disabled = (getenv("PWR_TELEMETRY_DISABLE") != NULL);
+		__atomic_store_n(&telem_disabled, disabled, __ATOMIC_RELAXED);
+	}
+	if (disabled)
+		return NULL;
+
+	// Only one of several racing threads gets to try
+	now = telem_clock(CLOCK_MONOTONIC, NULL);
+	next = __atomic_load_n(&telem_next_attach, __ATOMIC_RELAXED);
+	if (now < next || !__atomic_compare_exchange_n(&telem_next_attach,
+				&next, now + TELEM_ATTACH_INTERVAL, false,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return NULL;
+
+	fd = shm_open(POWERAPI_TELEM_SHM_NAME, O_RDONLY, 0);
+	if (fd < 0)
+		goto failure_return;
+
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(powerapi_telem_hdr_t))
+		goto failure_return;
+
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		hdr = NULL;
+		goto failure_return;
+	}
+
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE)
+				!= POWERAPI_TELEM_MAGIC
+			|| hdr->version != POWERAPI_TELEM_VERSION
+			|| hdr->interval == 0
+			|| sizeof(powerapi_telem_hdr_t) + hdr->num_entries
+				* sizeof(powerapi_telem_entry_t) > st.st_size) {
+		LOG_DBG("Ignoring telemetry segment with unexpected layout");
+		goto failure_return;
+	}
+
+	LOG_DBG("Attached telemetry segment, %u entries", hdr->num_used);
+
+	close(fd);
+	if (!__atomic_compare_exchange_n(&telem_hdr, &cur, hdr, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		munmap((void *)hdr, st.st_size);
+		hdr = cur;
+	}
+
+	return hdr;
+
+failure_return:
+	if (hdr)
+		munmap((void *)hdr, st.st_size);
+	if (fd >= 0)
+		close(fd);
+
+	return NULL;
+}
+
+/*
+ * telem_read_entry - Find the entry for a file and copy a consistent,
+ *		      fresh sample from it.
+ *
+ * Argument(s):
+ *
+ *	path - Path of the sampled file
+ *	copy - Target memory to hold the sample
+ *	tspec - Target memory to hold timestamp of the sample.
+ *		If NULL, no timestamp is returned.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+static int
+telem_read_entry(const char *path, powerapi_telem_entry_t *copy,
+		struct timespec *tspec)
+{
+	const powerapi_telem_hdr_t *hdr = NULL;
+	const powerapi_telem_entry_t *entry = NULL;
+	uint32_t mask, i, n, seq;
+	int tries;
+
+	hdr = telem_attach();
+	if (hdr == NULL)
+		return PWR_RET_FAILURE;
+
+	// The entry table is fixed once published, so it can be
+	// searched without synchronizing with powerapid.
+	mask = hdr->num_entries - 1;
+	for (i = powerapi_telem_hash(path) & mask, n = 0;
+			n < hdr->num_entries; i = (i + 1) & mask, n++) {
+		if (hdr->entries[i].path[0] == '\0')
+			return PWR_RET_FAILURE;
+		if (strcmp(hdr->entries[i].path, path) == 0) {
+			entry = &hdr->entries[i];
+			break;
+		}
+	}
+	if (entry == NULL)
+		return PWR_RET_FAILURE;
+
+	// Copy the sample, retrying if powerapid updated it meanwhile.
+	for (tries = 0; tries < TELEM_READ_RETRIES; tries++) {
+		seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		copy->status = entry->status;
+		copy->ivalue = entry->ivalue;
+		copy->timestamp = entry->timestamp;
+		copy->rate = entry->rate;
+		copy->rate_window = entry->rate_window;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+	if (tries == TELEM_READ_RETRIES || copy->status != PWR_RET_SUCCESS)
+		return PWR_RET_FAILURE;
+
+	// If powerapid stopped updating the segment, drop it so that a
+	// segment created by a restarted powerapid is picked up later.
+	if (telem_clock(CLOCK_REALTIME, tspec)
+			> copy->timestamp + TELEM_MAX_AGE * hdr->interval) {
+		LOG_DBG("Telemetry for '%s' is stale, detaching", path);
+		telem_detach(hdr);
+		return PWR_RET_FAILURE;
+	}
+
+	if (tspec != NULL) {
+		tspec->tv_sec = copy->timestamp / NSEC_PER_SEC;
+		tspec->tv_nsec = copy->timestamp % NSEC_PER_SEC;
+	}
+
+	return PWR_RET_SUCCESS;
+}
+
+/*
+ * telemetry_read_uint64 - Returns the latest value sampled by powerapid
+ *			   from a file.
+ *
+ * Argument(s):
+ *
+ *	path - Path of the sampled file
+ *	val - Target memory to hold value
+ *	tspec - Target memory to hold timestamp of when data sample is taken.
+ *		If NULL, no timestamp is returned.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Value not available, read the file instead
+ */
+int
+telemetry_read_uint64(const char *path, uint64_t *val, struct timespec *tspec)
+{
+	powerapi_telem_entry_t copy;
+	int retval;
+
+	TRACE3_ENTER("path = '%s', val = %p, tspec = %p", path, val, tspec);
+
+	retval = telem_read_entry(path, &copy, tspec);
+	if (retval == PWR_RET_SUCCESS)
+		*val = copy.ivalue;
+
+	TRACE3_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+/*
+ * telemetry_read_rate - Returns the latest rate of change per second of a
+ *			 counter file sampled by powerapid, if it was measured
+ *			 over close to the requested window.
+ *
+ * Argument(s):
+ *
+ *	path - Path of the sampled counter file
+ *	window - Requested measurement window in nanoseconds
+ *	rate - Target memory to hold rate
+ *	tspec - Target memory to hold timestamp of the end of the window.
+ *		If NULL, no timestamp is returned.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Rate not available, measure it instead
+ */
+int
+telemetry_read_rate(const char *path, PWR_Time window, double *rate,
+		struct timespec *tspec)
+{
+	powerapi_telem_entry_t copy;
+	int retval;
+
+	TRACE3_ENTER("path = '%s', window = %lu, rate = %p, tspec = %p",
+			path, window, rate, tspec);
+
+	retval = telem_read_entry(path, &copy, tspec);
+	if (retval != PWR_RET_SUCCESS)
+		goto done;
+
+	// Accept a rate measured within 25% of the requested window, which
+	// allows for jitter in powerapid's sampling schedule.
+	if (copy.rate_window == 0 || copy.rate_window < window - window / 4
+			|| copy.rate_window > window + window / 4) {
+		retval = PWR_RET_FAILURE;
+		goto done;
+	}
+
+	*rate = copy.rate;
+
+done:
+	TRACE3_EXIT("retval = %d", retval);
+
+	return retval;
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains a minimal io_uring wrapper, driven through the raw
+ * system calls so that no library is needed.  It only supports what the
+ * file layer needs: reads at offset zero of registered files, submitted
+ * together and waited for together.  Where io_uring isn't available,
+ * uring_new() fails and callers read the files themselves.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <glib.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#include <cray-powerapi/types.h>
+#include <log.h>
+
+#include "uring.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+struct uring {
+	int			fd;
+	unsigned int		entries;
+	unsigned int		pending;	// prepared, not yet completed
+	gboolean		files;		// a file table is registered
+
+	// Submission queue
+	void			*sq_ptr;
+	size_t			sq_len;
+	unsigned int		*sq_head;
+	unsigned int		*sq_tail;
+	unsigned int		*sq_mask;
+	unsigned int		*sq_array;
+	struct io_uring_sqe	*sqes;
+	size_t			sqes_len;
+
+	// Completion queue
+	void			*cq_ptr;
+	size_t			cq_len;
+	unsigned int		*cq_head;
+	unsigned int		*cq_tail;
+	unsigned int		*cq_mask;
+	struct io_uring_cqe	*cqes;
+};
+
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned int opcode, const void *arg,
+		unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * uring_new - Set up a ring with room for entries reads in flight.
+ *
+ * Return Code(s):
+ *
+ *	uring_t * - Upon SUCCESS
+ *	NULL	  - If io_uring is unavailable or setup failed
+ */
+uring_t *
+uring_new(unsigned int entries)
+{
+	struct io_uring_params p;
+	uring_t *ring = NULL;
+
+	TRACE2_ENTER("entries = %u", entries);
+
+	ring = g_new0(uring_t, 1);
+	if (!ring) {
+		LOG_FAULT("Failed to alloc ring");
+		goto failure_return;
+	}
+	ring->sq_ptr = ring->cq_ptr = ring->sqes = MAP_FAILED;
+
+	memset(&p, 0, sizeof(p));
+	ring->fd = sys_io_uring_setup(entries, &p);
+	if (ring->fd < 0) {
+		LOG_DBG("io_uring unavailable: %m");
+		goto failure_return;
+	}
+	ring->entries = p.sq_entries;
+
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		LOG_FAULT("Failed to map submission ring: %m");
+		goto failure_return;
+	}
+	ring->sq_head = ring->sq_ptr + p.sq_off.head;
+	ring->sq_tail = ring->sq_ptr + p.sq_off.tail;
+	ring->sq_mask = ring->sq_ptr + p.sq_off.ring_mask;
+	ring->sq_array = ring->sq_ptr + p.sq_off.array;
+
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		LOG_FAULT("Failed to map submission entries: %m");
+		goto failure_return;
+	}
+
+	ring->cq_len = p.cq_off.cqes
+			+ p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	if (ring->cq_ptr == MAP_FAILED) {
+		LOG_FAULT("Failed to map completion ring: %m");
+		goto failure_return;
+	}
+	ring->cq_head = ring->cq_ptr + p.cq_off.head;
+	ring->cq_tail = ring->cq_ptr + p.cq_off.tail;
+	ring->cq_mask = ring->cq_ptr + p.cq_off.ring_mask;
+	ring->cqes = ring->cq_ptr + p.cq_off.cqes;
+
+	TRACE2_EXIT("ring = %p", ring);
+
+	return ring;
+
+failure_return:
+	if (ring && ring->fd >= 0) {
+		uring_free(ring);
+	} else {
+		g_free(ring);
+	}
+
+	TRACE2_EXIT("ring = NULL");
+
+	return NULL;
+}
+
+void
+uring_free(uring_t *ring)
+{
+	if (!ring) {
+		return;
+	}
+
+	if (ring->cq_ptr != MAP_FAILED)
+		munmap(ring->cq_ptr, ring->cq_len);
+	if (ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->sq_ptr != MAP_FAILED)
+		munmap(ring->sq_ptr, ring->sq_len);
+	close(ring->fd);
+	g_free(ring);
+}
+
+// the most reads that can be in flight at once
+unsigned int
+uring_depth(uring_t *ring)
+{
+	return ring->entries;
+}
+
+/*
+ * uring_register_files - Replace the ring's registered file table.  Reads
+ *			  name files by their index in fds, where -1 leaves
+ *			  a slot empty.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+int
+uring_register_files(uring_t *ring, const int *fds, unsigned int nfds)
+{
+	int retval = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ring = %p, fds = %p, nfds = %u", ring, fds, nfds);
+
+	if (ring->files) {
+		sys_io_uring_register(ring->fd, IORING_UNREGISTER_FILES,
+				NULL, 0);
+		ring->files = FALSE;
+	}
+
+	if (nfds > 0 && sys_io_uring_register(ring->fd,
+			IORING_REGISTER_FILES, fds, nfds) < 0) {
+		LOG_FAULT("Failed to register %u files: %m", nfds);
+		goto done;
+	}
+	ring->files = (nfds > 0);
+
+	retval = PWR_RET_SUCCESS;
+
+done:
+	TRACE2_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+/*
+ * uring_prep_read - Queue a read of up to len bytes from the start of a
+ *		     registered file.  The completion carries tag.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - The submission queue is full
+ */
+int
+uring_prep_read(uring_t *ring, unsigned int file, void *buf,
+		unsigned int len, uint64_t tag)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail = *ring->sq_tail;
+	unsigned int idx;
+
+	if (ring->pending >= ring->entries
+			|| tail - __atomic_load_n(ring->sq_head,
+				__ATOMIC_ACQUIRE) >= ring->entries)
+		return PWR_RET_FAILURE;
+
+	idx = tail & *ring->sq_mask;
+	sqe = &ring->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = file;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = 0;
+	sqe->user_data = tag;
+
+	ring->sq_array[idx] = idx;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->pending++;
+
+	return PWR_RET_SUCCESS;
+}
+
+/*
+ * uring_submit_wait - Submit the queued reads and wait for all of them to
+ *		       complete.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+int
+uring_submit_wait(uring_t *ring)
+{
+	unsigned int queued;
+	unsigned int done;
+	int ret;
+
+	TRACE2_ENTER("ring = %p, pending = %u", ring, ring->pending);
+
+	queued = *ring->sq_tail - __atomic_load_n(ring->sq_head,
+			__ATOMIC_ACQUIRE);
+	for (;;) {
+		done = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)
+				- *ring->cq_head;
+		if (queued == 0 && done >= ring->pending)
+			break;
+
+		ret = sys_io_uring_enter(ring->fd, queued,
+				ring->pending - done, IORING_ENTER_GETEVENTS);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			LOG_FAULT("io_uring_enter failed: %m");
+			TRACE2_EXIT("retval = %d", PWR_RET_FAILURE);
+			return PWR_RET_FAILURE;
+		}
+		queued -= ret;
+	}
+
+	TRACE2_EXIT("retval = %d", PWR_RET_SUCCESS);
+
+	return PWR_RET_SUCCESS;
+}
+
+/*
+ * uring_complete - Take the next completion, if any.
+ *
+ * Return Code(s):
+ *
+ *	1 - A completion was returned in tag and res
+ *	0 - No completion is waiting
+ */
+int
+uring_complete(uring_t *ring, uint64_t *tag, int *res)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+
+	cqe = &ring->cqes[head & *ring->cq_mask];
+	*tag = cqe->user_data;
+	*res = cqe->res;
+
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	if (ring->pending > 0)
+		ring->pending--;
+
+	return 1;
+}
+
+#else /* no io_uring */
+
+uring_t *
+uring_new(unsigned int entries)
+{
+	return NULL;
+}
+
+void
+uring_free(uring_t *ring)
+{
+}
+
+unsigned int
+uring_depth(uring_t *ring)
+{
+	return 0;
+}
+
+int
+uring_register_files(uring_t *ring, const int *fds, unsigned int nfds)
+{
+	return PWR_RET_FAILURE;
+}
+
+int
+uring_prep_read(uring_t *ring, unsigned int file, void *buf,
+		unsigned int len, uint64_t tag)
+{
+	return PWR_RET_FAILURE;
+}
+
+int
+uring_submit_wait(uring_t *ring)
+{
+	return PWR_RET_FAILURE;
+}
+
+int
+uring_complete(uring_t *ring, uint64_t *tag, int *res)
+{
+	return 0;
+}
+
+#endif /* io_uring */
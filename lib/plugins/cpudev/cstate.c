@@ -141,8 +141,14 @@ map_cs_to_ss(int cstate)
 	return ret;
 }
 
+/*
+ * latencies is published atomically once complete, after num_cstates
+ * and ss_to_cs are set, so that callers on other threads either see the
+ * whole table or take init_lock and build it themselves.
+ */
 static int64_t	*latencies = NULL;
 static int	num_cstates = 0;
+static GMutex	init_lock;
 
 /*
  * init_cstate_limits - C-state attribute initialization.
@@ -163,13 +169,22 @@ init_cstate_limits(PWR_Obj obj, int *num_vals, int64_t **lats)
 {
 	int retval = PWR_RET_FAILURE;
 	uint64_t val = 0;
+	int64_t *table = NULL;
+	int count = 0;
 	int i = 0;
 
 	TRACE2_ENTER("num_vals = %p, lats = %p", num_vals, lats);
 
-	if (latencies != NULL)
+	table = g_atomic_pointer_get(&latencies);
+	if (table != NULL)
 		goto success;
 
+	g_mutex_lock(&init_lock);
+
+	table = g_atomic_pointer_get(&latencies);
+	if (table != NULL)
+		goto unlock;
+
 	/*
 	 * First find out how many C-States there are.
 	 */
@@ -177,29 +192,29 @@ init_cstate_limits(PWR_Obj obj, int *num_vals, int64_t **lats)
 	if (retval != PWR_RET_SUCCESS) {
 		LOG_FAULT("Unable to determine the number of processor"
 				" c-states, retval = %d.", retval);
-		goto done;
+		goto unlock;
 	}
-	num_cstates = val;
-	if (num_cstates <= 0) {
-		LOG_FAULT("Invalid number of c-states(%d).", num_cstates);
-		goto done;
+	count = val;
+	if (count <= 0) {
+		LOG_FAULT("Invalid number of c-states(%d).", count);
+		retval = PWR_RET_FAILURE;
+		goto unlock;
 	}
 
-	init_ss_to_cs(num_cstates);
-
 	/*
 	 * Allocate enough memory for all of the cstates' latencies.
 	 */
-	latencies = g_malloc0(sizeof(*latencies) * num_cstates);
-	if (latencies == NULL) {
+	table = g_malloc0(sizeof(*table) * count);
+	if (table == NULL) {
 		LOG_FAULT("Unable to allocate memory for c-state latencies.");
-		goto done;
+		retval = PWR_RET_FAILURE;
+		goto unlock;
 	}
 
 	/*
 	 * Iterate through each C-State, recording its latency.
 	 */
-	for (i = 0; i < num_cstates; ++i) {
+	for (i = 0; i < count; ++i) {
 		char path[80];
 
 		snprintf(path, sizeof(path), CSTATE_LATENCY_PATH, i);
@@ -207,26 +222,32 @@ init_cstate_limits(PWR_Obj obj, int *num_vals, int64_t **lats)
 		if (retval != PWR_RET_SUCCESS) {
 			LOG_FAULT("Unable to read c-state latency from %s.",
 					path);
-			goto done;
+			g_free(table);
+			table = NULL;
+			goto unlock;
 		}
-		latencies[i] = val;
+		table[i] = val;
 	}
 
+	init_ss_to_cs(count);
+	num_cstates = count;
+	g_atomic_pointer_set(&latencies, table);
+
+unlock:
+	g_mutex_unlock(&init_lock);
+
+	if (table == NULL)
+		goto done;
+
 success:
 	/*
 	 * Point return pointers to correct data.
 	 */
-	*lats = latencies;
+	*lats = table;
 	*num_vals = num_cstates;
 	retval = PWR_RET_SUCCESS;
 
 done:
-	if (retval != PWR_RET_SUCCESS) {
-		g_free(latencies);
-		latencies = NULL;
-		num_cstates = 0;
-	}
-
 	TRACE2_EXIT("retval = %d, *num_vals = %d, *lats = %p",
 			retval, *num_vals, *lats);
 
@@ -139,8 +139,14 @@ map_freq_to_ps(int freq_idx)
 	return ret;
 }
 
+/*
+ * freqs is published atomically once complete, after num_freqs and
+ * ps_to_freq are set, so that callers on other threads either see the
+ * whole table or take init_lock and build it themselves.
+ */
 static double *freqs = NULL;
 static int num_freqs = 0;
+static GMutex init_lock;
 
 /*
  * init_freqs - Frequency attribute initialization.
@@ -159,6 +165,8 @@ init_freqs(PWR_Obj obj, int *num_vals, double **vals)
 {
 	int retval = PWR_RET_FAILURE;
 	uint64_t val = 0;
+	double *table = NULL;
+	int count = 0;
 	int i = 0;
 
 	TRACE2_ENTER("num_vals = %p, vals = %p", num_vals, vals);
@@ -167,9 +175,16 @@ init_freqs(PWR_Obj obj, int *num_vals, double **vals)
 	 * PWR_ATTR_FREQ and PWR_ATTR_FREQ_LIMIT_{MIN|MAX} all point to
 	 * the same data.
 	 */
-	if (freqs != NULL)
+	table = g_atomic_pointer_get(&freqs);
+	if (table != NULL)
 		goto success;
 
+	g_mutex_lock(&init_lock);
+
+	table = g_atomic_pointer_get(&freqs);
+	if (table != NULL)
+		goto unlock;
+
 	/*
 	 * First find out how many frequencies there are.
 	 */
@@ -177,58 +192,64 @@ init_freqs(PWR_Obj obj, int *num_vals, double **vals)
 	if (retval != PWR_RET_SUCCESS) {
 		LOG_FAULT("Unable to determine the number of processor"
 				" frequencies, retval = %d.", retval);
-		goto done;
+		goto unlock;
 	}
-	num_freqs = val;
-	if (num_freqs <= 0) {
+	count = val;
+	if (count <= 0) {
 		LOG_FAULT("Invalid number of processor frequencies(%d).",
-				num_freqs);
-		goto done;
+				count);
+		retval = PWR_RET_FAILURE;
+		goto unlock;
 	}
 
-	init_ps_to_freq(num_freqs);
-
 	/*
 	 * Allocate enough memory for all of the frequencies.
 	 */
-	freqs = g_malloc0(sizeof(*freqs) * num_freqs);
-	if (freqs == NULL) {
+	table = g_malloc0(sizeof(*table) * count);
+	if (table == NULL) {
 		LOG_FAULT("Unable to allocate memory for processor frequencies.");
-		goto done;
+		retval = PWR_RET_FAILURE;
+		goto unlock;
 	}
 
 	/*
 	 * Iterate, recording each frequency.  Store them in reverse order so
 	 * largest frequencies are first.
 	 */
-	for (i = 0; i < num_freqs; ++i) {
+	for (i = 0; i < count; ++i) {
 		double dval = 0.0;
 
 		retval = PWR_MetaValueAtIndex(obj, PWR_ATTR_FREQ_REQ,
-				num_freqs - i - 1, &dval, NULL);
+				count - i - 1, &dval, NULL);
 		if (retval != PWR_RET_SUCCESS) {
 			LOG_FAULT("Unable to read frequency at index %d,"
 				       " retval = %d.", i, retval);
-			goto done;
+			g_free(table);
+			table = NULL;
+			goto unlock;
 		}
-		freqs[i] = dval;
+		table[i] = dval;
 	}
 
+	init_ps_to_freq(count);
+	num_freqs = count;
+	g_atomic_pointer_set(&freqs, table);
+
+unlock:
+	g_mutex_unlock(&init_lock);
+
+	if (table == NULL)
+		goto done;
+
 success:
 	/*
 	 * Point return pointers to correct data.
 	 */
-	*vals = freqs;
+	*vals = table;
 	*num_vals = num_freqs;
 	retval = PWR_RET_SUCCESS;
 
 done:
-	if (retval != PWR_RET_SUCCESS) {
-		g_free(freqs);
-		freqs = NULL;
-		num_freqs = 0;
-	}
-
 	TRACE2_EXIT("retval = %d, *num_vals = %d, *vals = %p",
 			retval, *num_vals, *vals);
 
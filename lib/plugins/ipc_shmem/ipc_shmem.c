@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains the functions for the shared memory transport to
+ * powerapid.
+ *
+ * Set requests go through a request ring in shared memory, which the
+ * daemon hands out over the socket to an authorized client, rather than
+ * a write and a blocking read of the socket.  The client spins briefly on
+ * the response ring before going to sleep on its eventfd, since most sets
+ * are answered within the spin.  The socket stays open, carrying the
+ * session, and its hanging up, or another context reconnecting it, tells
+ * a waiting client the daemon is gone.
+ * Then the set falls back to the socket transport, which reconnects and
+ * resends it, and the next set asks the new daemon for a new ring.  A
+ * daemon that hands out no rings is only ever talked to over the socket.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/types.h>
+#include <cray-powerapi/powerapid.h>
+#include <log.h>
+
+#include "timer.h"
+#include "plugins/ipc_socket/ipc_socket.h"
+#include "ipc_shmem.h"
+
+// How long to spin waiting for a response before sleeping, and how
+// often to check, while sleeping, that the connection is still the same
+#define RING_SPIN_NSEC		(20 * NSEC_PER_USEC)	// 20 usec
+#define RING_POLL_MSEC		1000
+
+// Descriptors handed out with the ring, in order
+#define RING_MEM_FD		0
+#define RING_REQ_FD		1
+#define RING_RESP_FD		2
+
+static PWR_Time
+ipc_shmem_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return pwr_tspec_to_nsec(&ts);
+}
+
+//
+// Unmap the ring and close its descriptors, after losing the connection
+// it was handed out over.
+//
+static void
+ipc_shmem_detach(ipc_shmem_t *ipc_shm)
+{
+	int i;
+
+	TRACE2_ENTER("ipc_shm = %p", ipc_shm);
+
+	if (ipc_shm->ring) {
+		munmap(ipc_shm->ring, sizeof(powerapi_ring_t));
+		ipc_shm->ring = NULL;
+	}
+	for (i = 0; i < POWERAPI_RING_FDS; i++) {
+		if (ipc_shm->fds[i] >= 0) {
+			close(ipc_shm->fds[i]);
+			ipc_shm->fds[i] = -1;
+		}
+	}
+	ipc_shm->sock_fd = -1;
+	ipc_shm->generation = 0;
+
+	TRACE2_EXIT("");
+}
+
+//
+// Ask powerapid for a request ring over the context's session, and map
+// it.
+//
+static int
+ipc_shmem_request(ipc_shmem_t *ipc_shm)
+{
+	ipc_socket_t *ipc_sock = ipc_shm->sock->plugin_data;
+	int status = PWR_RET_FAILURE;
+	powerapi_request_t req = { .ReqType = PwrSHMEM };
+	powerapi_response_t resp = { 0 };
+	struct stat st;
+	void *addr;
+
+	TRACE2_ENTER("ipc_shm = %p", ipc_shm);
+
+	status = ipc_socket_xfer_fds(ipc_shm->sock, &req, &resp, ipc_shm->fds,
+			POWERAPI_RING_FDS);
+	if (status != PWR_RET_SUCCESS) {
+		goto failure_return;
+	}
+	status = PWR_RET_FAILURE;
+
+	//
+	// An older powerapid refuses the request, and will refuse it again
+	//
+	if (resp.retval != PWR_RET_SUCCESS ||
+			ipc_shm->fds[RING_MEM_FD] < 0) {
+		LOG_DBG("powerapid has no request rings, using the socket");
+		ipc_shm->unsupported = TRUE;
+		goto failure_return;
+	}
+
+	if (fstat(ipc_shm->fds[RING_MEM_FD], &st) != 0 ||
+			st.st_size != sizeof(powerapi_ring_t)) {
+		LOG_FAULT("Request ring is the wrong size");
+		ipc_shm->unsupported = TRUE;
+		goto failure_return;
+	}
+
+	addr = mmap(NULL, sizeof(powerapi_ring_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED, ipc_shm->fds[RING_MEM_FD], 0);
+	if (addr == MAP_FAILED) {
+		LOG_FAULT("Failed to map request ring: %m");
+		goto failure_return;
+	}
+	ipc_shm->ring = addr;
+
+	if (ipc_shm->ring->magic != POWERAPI_RING_MAGIC ||
+			ipc_shm->ring->version != POWERAPI_RING_VERSION) {
+		LOG_FAULT("Request ring has an unknown version");
+		ipc_shm->unsupported = TRUE;
+		goto failure_return;
+	}
+
+	ipc_shm->req_head = ipc_shm->ring->req_head;
+	ipc_shm->resp_tail = ipc_shm->ring->resp_tail;
+	ipc_shm->sock_fd = ipc_sock->fd;
+	ipc_shm->generation = ipc_sock->generation;
+
+	status = PWR_RET_SUCCESS;
+
+failure_return:
+	if (status != PWR_RET_SUCCESS) {
+		ipc_shmem_detach(ipc_shm);
+	}
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+//
+// Connect to powerapid and get a request ring, unless the ring handed out
+// over the current connection is still in use.
+//
+static int
+ipc_shmem_attach(ipc_t *ipc)
+{
+	ipc_shmem_t *ipc_shm = ipc->plugin_data;
+	ipc_socket_t *ipc_sock = ipc_shm->sock->plugin_data;
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ipc = %p", ipc);
+
+	if (ipc_shm->unsupported) {
+		goto failure_return;
+	}
+
+	status = ipc_socket_connect(ipc_shm->sock);
+	if (status != PWR_RET_SUCCESS) {
+		goto failure_return;
+	}
+
+	//
+	// A reconnect opens a new session, and the old ring went with the
+	// old one
+	//
+	if (ipc_shm->ring && ipc_shm->generation == ipc_sock->generation) {
+		goto failure_return;
+	}
+	ipc_shmem_detach(ipc_shm);
+
+	status = ipc_shmem_request(ipc_shm);
+
+failure_return:
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+//
+// Wait for a response.  Returns PWR_RET_FAILURE if the connection to
+// powerapid was lost first, which this or another context sharing it
+// notices.
+//
+static int
+ipc_shmem_wait(ipc_shmem_t *ipc_shm)
+{
+	powerapi_ring_t *ring = ipc_shm->ring;
+	struct pollfd pfds[2] = {
+		{ .fd = ipc_shm->fds[RING_RESP_FD], .events = POLLIN },
+		// only its hanging up, since other contexts share it
+		{ .fd = ipc_shm->sock_fd, .events = 0 },
+	};
+	PWR_Time deadline = ipc_shmem_now() + RING_SPIN_NSEC;
+	int status = PWR_RET_FAILURE;
+	eventfd_t count;
+
+	TRACE3_ENTER("ipc_shm = %p", ipc_shm);
+
+	while (__atomic_load_n(&ring->resp_head, __ATOMIC_ACQUIRE) ==
+			ipc_shm->resp_tail) {
+		if (ipc_shmem_now() < deadline) {
+			continue;
+		}
+
+		//
+		// Sleep, unless the response came in meanwhile
+		//
+		__atomic_store_n(&ring->client_waiting, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->resp_head, __ATOMIC_SEQ_CST) ==
+				ipc_shm->resp_tail) {
+			if (poll(pfds, 2, RING_POLL_MSEC) < 0 &&
+					errno != EINTR) {
+				LOG_FAULT("Failed poll of request ring: %m");
+				goto failure_return;
+			}
+			// Another context may have noticed first.
+			if (ipc_socket_generation() != ipc_shm->generation) {
+				LOG_FAULT("Lost connection to powerapid");
+				goto failure_return;
+			}
+			// Responses to other contexts' requests may be waiting
+			// on the shared socket, for them to read.
+			if (pfds[1].revents & (POLLHUP | POLLERR)) {
+				LOG_FAULT("Lost connection to powerapid");
+				goto failure_return;
+			}
+			if (pfds[0].revents) {
+				eventfd_read(pfds[0].fd, &count);
+			}
+		}
+		__atomic_store_n(&ring->client_waiting, 0, __ATOMIC_SEQ_CST);
+	}
+
+	status = PWR_RET_SUCCESS;
+
+failure_return:
+	__atomic_store_n(&ring->client_waiting, 0, __ATOMIC_SEQ_CST);
+
+	TRACE3_EXIT("status = %d", status);
+
+	return status;
+}
+
+//
+// Send a set request through the ring and receive its response.  Returns
+// PWR_RET_SUCCESS if the exchange completed, whatever the response, or
+// PWR_RET_FAILURE if the connection to powerapid was lost.
+//
+static int
+ipc_shmem_xfer(ipc_shmem_t *ipc_shm, const powerapi_setreq_t *setreq,
+		powerapi_response_t *resp)
+{
+	powerapi_ring_t *ring = ipc_shm->ring;
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ipc_shm = %p, setreq = %p, resp = %p",
+			ipc_shm, setreq, resp);
+
+	//
+	// Publish the request, waking powerapid if it has gone idle
+	//
+	ring->req[ipc_shm->req_head % POWERAPI_RING_SLOTS] = *setreq;
+	ipc_shm->req_head++;
+	__atomic_store_n(&ring->req_head, ipc_shm->req_head, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring->daemon_idle, __ATOMIC_SEQ_CST) &&
+			eventfd_write(ipc_shm->fds[RING_REQ_FD], 1) != 0) {
+		LOG_FAULT("Failed to wake powerapid: %m");
+		goto failure_return;
+	}
+
+	//
+	// Receive the response
+	//
+	status = ipc_shmem_wait(ipc_shm);
+	if (status != PWR_RET_SUCCESS) {
+		goto failure_return;
+	}
+
+	*resp = ring->resp[ipc_shm->resp_tail % POWERAPI_RING_SLOTS];
+	ipc_shm->resp_tail++;
+	__atomic_store_n(&ring->resp_tail, ipc_shm->resp_tail,
+			__ATOMIC_RELEASE);
+
+failure_return:
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+static int
+ipc_shmem_set(ipc_t *ipc, PWR_ObjType obj_type, PWR_AttrName attr_name,
+		PWR_MetaName meta_name, PWR_AttrDataType attr_type,
+		const void *value, const char *path)
+{
+	ipc_shmem_t *ipc_shm = ipc->plugin_data;
+	int status = PWR_RET_FAILURE;
+	powerapi_setreq_t setreq = { 0 };
+	powerapi_response_t resp = { 0 };
+
+	TRACE2_ENTER("ipc = %p, obj_type = %d, attr_name = %d, attr_type = %d, "
+			"value = %p, path = '%s'",
+			ipc, obj_type, attr_name, attr_type, value, path);
+
+	//
+	// Setup set request
+	//
+	setreq.object = obj_type;
+	setreq.attribute = attr_name;
+	setreq.metadata = meta_name;
+	setreq.data_type = attr_type;
+
+	switch (attr_type) {
+	case PWR_ATTR_DATA_DOUBLE:
+		setreq.value.fvalue = *((double *)value);
+		break;
+	case PWR_ATTR_DATA_UINT64:
+		setreq.value.ivalue = *((uint64_t *)value);
+		break;
+	default:
+		status = PWR_RET_INVALID;
+		goto failure_return;
+	}
+
+	if (g_strlcpy(setreq.path, path,
+			sizeof(setreq.path)) >= sizeof(setreq.path)) {
+		LOG_FAULT("Path '%s' too long for buffer!", path);
+		status = PWR_RET_FAILURE;
+		goto failure_return;
+	}
+
+	//
+	// Skip a path this node or group set has already sent
+	//
+	if (ipc_batch_sent(ipc, setreq.path, setreq.value.ivalue)) {
+		status = PWR_RET_SUCCESS;
+		goto failure_return;
+	}
+
+	//
+	// Send the request through the ring.  Should the connection have
+	// been lost, the socket transport reconnects and resends it.
+	// Resending is safe: a set replaces the session's earlier set of
+	// the same attribute.
+	//
+	if (ipc_shmem_attach(ipc) == PWR_RET_SUCCESS) {
+		status = ipc_shmem_xfer(ipc_shm, &setreq, &resp);
+		if (status == PWR_RET_SUCCESS) {
+			status = resp.retval;
+			goto sent;
+		}
+		ipc_shmem_detach(ipc_shm);
+	}
+
+	if (attr_type == PWR_ATTR_DATA_DOUBLE) {
+		status = ipc_shm->sock->ops->set_double(ipc_shm->sock,
+				obj_type, attr_name, meta_name, value, path);
+	} else {
+		status = ipc_shm->sock->ops->set_uint64(ipc_shm->sock,
+				obj_type, attr_name, meta_name, value, path);
+	}
+
+sent:
+	if (status == PWR_RET_SUCCESS) {
+		ipc_batch_add(ipc, setreq.path, setreq.value.ivalue);
+	}
+
+failure_return:
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+static int
+ipc_shmem_set_uint64(ipc_t *ipc, PWR_ObjType obj_type, PWR_AttrName attr_name,
+		PWR_MetaName meta_name, const uint64_t *value, const char *path)
+{
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ipc = %p, obj_type = %d, attr_name = %d, "
+			"value = %p, path = '%s'",
+			ipc, obj_type, attr_name, value, path);
+
+	status = ipc_shmem_set(ipc, obj_type, attr_name, meta_name,
+			PWR_ATTR_DATA_UINT64, value, path);
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+static int
+ipc_shmem_set_double(ipc_t *ipc, PWR_ObjType obj_type, PWR_AttrName attr_name,
+		PWR_MetaName meta_name, const double *value, const char *path)
+{
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ipc = %p, obj_type = %d, attr_name = %d, "
+			"value = %p, path = '%s'",
+			ipc, obj_type, attr_name, value, path);
+
+	status = ipc_shmem_set(ipc, obj_type, attr_name, meta_name,
+			PWR_ATTR_DATA_DOUBLE, value, path);
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+static int
+ipc_shmem_destruct(ipc_t *ipc)
+{
+	int status = PWR_RET_FAILURE;
+	ipc_shmem_t *ipc_shm = NULL;
+
+	TRACE2_ENTER("ipc = %p", ipc);
+
+	if (!ipc || !ipc->plugin_data) {
+		goto failure_return;
+	}
+
+	ipc_shm = (ipc_shmem_t *)ipc->plugin_data;
+	ipc->plugin_data = NULL;
+
+	ipc->ops = NULL;
+
+	// Unmap the ring before closing the socket, which ends the session.
+	ipc_shmem_detach(ipc_shm);
+	del_ipc(ipc_shm->sock);
+
+	g_free(ipc_shm);
+
+	status = PWR_RET_SUCCESS;
+
+failure_return:
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+
+const struct ipc_ops ipc_shmem_ops = {
+	.destruct = ipc_shmem_destruct,
+	.set_uint64 = ipc_shmem_set_uint64,
+	.set_double = ipc_shmem_set_double
+};
+
+
+int
+ipc_shmem_construct(ipc_t *ipc)
+{
+	int status = PWR_RET_FAILURE;
+	ipc_shmem_t *ipc_shm = NULL;
+	int i;
+
+	TRACE2_ENTER("ipc = %p", ipc);
+
+	if (!ipc) {
+		goto failure_return;
+	}
+
+	//
+	// Allocate the plugin data, and the socket the ring is requested
+	// over and sets fall back to
+	//
+	ipc_shm = g_new0(ipc_shmem_t, 1);
+	if (!ipc_shm) {
+		LOG_FAULT("Failed to allocate ipc_shmem_t");
+		goto failure_return;
+	}
+
+	ipc_shm->sock = new_ipc(IPC_SOCKET, ipc->context_name,
+			ipc->context_role);
+	if (!ipc_shm->sock) {
+		goto failure_return;
+	}
+
+	ipc->plugin_data = (void *)ipc_shm;
+
+	ipc->ops = &ipc_shmem_ops;
+
+	// The ring is requested lazily, along with the socket connection.
+	ipc_shm->sock_fd = -1;
+	for (i = 0; i < POWERAPI_RING_FDS; i++) {
+		ipc_shm->fds[i] = -1;
+	}
+
+	status = PWR_RET_SUCCESS;
+
+failure_return:
+	if (status != PWR_RET_SUCCESS && ipc_shm) {
+		del_ipc(ipc_shm->sock);
+		g_free(ipc_shm);
+		ipc_shm = NULL;
+	}
+
+	TRACE2_EXIT("status = %d, ipc_shm = %p", status, ipc_shm);
+
+	return status;
+}
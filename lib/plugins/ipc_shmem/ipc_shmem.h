@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains the declarations for the shared memory transport to
+ * powerapid.
+ */
+
+#ifndef _PWR_IPC_SHMEM_H
+#define _PWR_IPC_SHMEM_H
+
+#include <cray-powerapi/powerapid.h>
+
+#include "ipc.h"
+
+typedef struct ipc_shmem_s ipc_shmem_t;
+struct ipc_shmem_s {
+	ipc_t		*sock;		// socket the ring is requested over
+	int		sock_fd;	// its fd when the ring was handed out
+	guint		generation;	// and its connection count
+	powerapi_ring_t	*ring;		// NULL until a ring is handed out
+	int		fds[POWERAPI_RING_FDS];	// memfd, req and resp eventfds
+	uint32_t	req_head;	// requests sent
+	uint32_t	resp_tail;	// responses received
+	int		unsupported;	// powerapid hands out no rings
+};
+
+int ipc_shmem_construct(ipc_t *ipc);
+
+#endif // _PWR_IPC_SHMEM_H
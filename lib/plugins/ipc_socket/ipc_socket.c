@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -42,39 +43,102 @@
 
 #include <cray-powerapi/types.h>
 #include <cray-powerapi/powerapid.h>
+#include <common.h>
 #include <log.h>
 
+#include "timer.h"
 #include "ipc_socket.h"
 
+// How long to keep trying to reconnect to a restarting powerapid
+#define RECONNECT_TRIES		50
+#define RECONNECT_DELAY		(100000 * NSEC_PER_USEC)	// 100 msec
+
+//
+// Every context in the process shares one connection to powerapid, and
+// authorizes a session of its own on it, on a channel of its own, so its
+// sets are still rolled back when it's destroyed.  conn_lock serializes
+// the use of the connection: a request and its response are exchanged
+// with it held, so that a response always goes to the context that made
+// the request.  The connection is closed along with the last context
+// using it.  conn_gen counts the connections made, so that each context
+// knows to authorize its session again after a reconnect.
+//
+static GMutex conn_lock;
+static int    conn_fd = -1;
+static int    conn_refcount = 0;
+static guint  conn_gen = 0;
+
+// close the lost connection to powerapid; called with conn_lock held
+static void
+ipc_socket_disconnect(void)
+{
+	close(conn_fd);
+	conn_fd = -1;
+}
 
+//
+// Send a request on the context's channel and receive its response, and
+// nfds descriptors passed with it if fds isn't NULL.  Returns
+// PWR_RET_SUCCESS if the exchange completed, whatever the response, or
+// PWR_RET_FAILURE if the connection to powerapid was lost, in which case
+// it's closed.  Called with conn_lock held.
+//
 static int
-ipc_socket_req(ipc_t *ipc, powerapi_request_t *req, powerapi_response_t *resp)
+ipc_socket_xfer(ipc_socket_t *ipc_sock, powerapi_request_t *req,
+		powerapi_response_t *resp, int *fds, int nfds)
 {
-	ipc_socket_t *ipc_sock = ipc->plugin_data;
 	int status = PWR_RET_FAILURE;
 	ssize_t bytes = 0;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(POWERAPI_RING_FDS * sizeof(int))];
+	} cmsg;
+	struct iovec iov = { .iov_base = resp, .iov_len = sizeof(*resp) };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	struct cmsghdr *cp;
 
-	TRACE2_ENTER("ipc = %p, req = %p, resp = %p", ipc, req, resp);
+	TRACE2_ENTER("ipc_sock = %p, req = %p, resp = %p", ipc_sock, req, resp);
+
+	if (conn_fd < 0 || nfds > POWERAPI_RING_FDS) {
+		goto failure_return;
+	}
+	if (req->channel != POWERAPI_CHANNEL_NEW) {
+		req->channel = ipc_sock->channel;
+	}
 
 	//
-	// Send request
+	// Send request; don't raise SIGPIPE if powerapid has gone away
 	//
-	bytes = write(ipc_sock->fd, req, sizeof(*req));
+	bytes = send(conn_fd, req, sizeof(*req), MSG_NOSIGNAL);
 	if (bytes != sizeof(*req)) {
 		LOG_FAULT("Failed write to socket: %m");
+		ipc_socket_disconnect();
 		goto failure_return;
 	}
 
 	//
 	// Receive response
 	//
-	bytes = read(ipc_sock->fd, resp, sizeof(*resp));
+	if (fds) {
+		msg.msg_control = cmsg.buf;
+		msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+	}
+	bytes = recvmsg(conn_fd, &msg, MSG_CMSG_CLOEXEC);
 	if (bytes != sizeof(*resp)) {
 		LOG_FAULT("Failed read from socket: %m");
+		ipc_socket_disconnect();
 		goto failure_return;
 	}
 
-	status = resp->retval;
+	for (cp = CMSG_FIRSTHDR(&msg); cp; cp = CMSG_NXTHDR(&msg, cp)) {
+		if (cp->cmsg_level == SOL_SOCKET &&
+				cp->cmsg_type == SCM_RIGHTS &&
+				cp->cmsg_len == CMSG_LEN(nfds * sizeof(int))) {
+			memcpy(fds, CMSG_DATA(cp), nfds * sizeof(int));
+		}
+	}
+
+	status = PWR_RET_SUCCESS;
 
 failure_return:
 	TRACE2_EXIT("status = %d", status);
@@ -82,9 +146,15 @@ failure_return:
 	return status;
 }
 
+//
+// Open a session on the connection for the context.  A reconnecting
+// context asks to reclaim its session, so the values it set through the
+// old connection stay in effect.  Called with conn_lock held.
+//
 static int
 ipc_socket_auth(ipc_t *ipc)
 {
+	ipc_socket_t *ipc_sock = ipc->plugin_data;
 	powerapi_request_t req = { 0 };
 	powerapi_response_t resp = { 0 };
 	int status = PWR_RET_FAILURE;
@@ -95,6 +165,7 @@ ipc_socket_auth(ipc_t *ipc)
 	// Setup authorization request
 	//
 	req.ReqType = PwrAUTH;
+	req.channel = POWERAPI_CHANNEL_NEW;
 	req.auth.role = ipc->context_role;
 	if (g_strlcpy(req.auth.context_name, ipc->context_name,
 			sizeof(req.auth.context_name)) >=
@@ -104,10 +175,30 @@ ipc_socket_auth(ipc_t *ipc)
 		goto failure_return;
 	}
 
+	//
+	// Ask to reclaim our session if this is a reconnect
+	//
+	req.auth.session = ipc_sock->session;
+
 	//
 	// Send the request to powerapid
 	//
-	status = ipc_socket_req(ipc, &req, &resp);
+	status = ipc_socket_xfer(ipc_sock, &req, &resp, NULL, 0);
+	if (status != PWR_RET_SUCCESS)
+		goto failure_return;
+
+	status = resp.retval;
+	if (status != PWR_RET_SUCCESS)
+		goto failure_return;
+
+	if (ipc_sock->session && !resp.auth.reclaimed) {
+		LOG_WARN("Reconnected to powerapid, but values set by context "
+				"'%s' were reset", ipc->context_name);
+	}
+	ipc_sock->session = resp.auth.session;
+	ipc_sock->channel = resp.auth.channel;
+	ipc_sock->fd = conn_fd;
+	ipc_sock->generation = conn_gen;
 
 failure_return:
 	TRACE2_EXIT("status = %d", status);
@@ -115,8 +206,13 @@ failure_return:
 	return status;
 }
 
+//
+// Connect to powerapid, unless another context already has, and open a
+// session for the context on the connection, unless it already has one.
+// Called with conn_lock held.
+//
 static int
-ipc_socket_connect(ipc_t *ipc)
+ipc_socket_connect_locked(ipc_t *ipc)
 {
 	ipc_socket_t *ipc_sock = ipc->plugin_data;
 	int status = PWR_RET_FAILURE;
@@ -127,9 +223,8 @@ ipc_socket_connect(ipc_t *ipc)
 
 	// If file descriptor for the socket has been set to a
 	// valid value, assume it has already been connected.
-	if (ipc_sock->fd >= 0) {
-		status = PWR_RET_SUCCESS;
-		goto failure_return;
+	if (conn_fd >= 0) {
+		goto authorize;
 	}
 
 	//
@@ -142,38 +237,167 @@ ipc_socket_connect(ipc_t *ipc)
 	}
 
 	saddr.sun_family = AF_UNIX;
-	if (g_strlcpy(saddr.sun_path, POWERAPID_SOCKET_PATH,
+	if (g_strlcpy(saddr.sun_path, PWR_SOCKET_PATH,
 			sizeof(saddr.sun_path)) >= sizeof(saddr.sun_path)) {
 		LOG_FAULT("Named socket path '%s' too long for buffer!",
-				POWERAPID_SOCKET_PATH);
+				PWR_SOCKET_PATH);
+		close(fd);
 		goto failure_return;
 	}
 
 	if (connect(fd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0) {
 		LOG_FAULT("Failed socket connect: %m");
+		close(fd);
 		goto failure_return;
 	}
 
-	ipc_sock->fd = fd;
+	conn_fd = fd;
+	conn_gen++;
 
+authorize:
 	//
-	// Send authentication request
+	// Send authentication request, if the session isn't open on this
+	// connection yet
 	//
-	status = ipc_socket_auth(ipc);
+	status = PWR_RET_SUCCESS;
+	if (ipc_sock->generation != conn_gen) {
+		status = ipc_socket_auth(ipc);
+	}
 
 failure_return:
+	TRACE2_EXIT("status = %d, conn_fd = %d", status, conn_fd);
+
+	return status;
+}
+
+//
+// Reconnect after losing the connection to powerapid, which is most
+// likely restarting, and reopen the context's session.  Called with
+// conn_lock held, which is dropped between tries so that the other
+// contexts aren't held up meanwhile.  One of them may reconnect first,
+// in which case only the session is reopened.
+//
+static int
+ipc_socket_reconnect(ipc_t *ipc)
+{
+	int status = PWR_RET_FAILURE;
+	int tries;
+
+	TRACE2_ENTER("ipc = %p", ipc);
+
+	for (tries = 0; tries < RECONNECT_TRIES; tries++) {
+		status = ipc_socket_connect_locked(ipc);
+		if (status == PWR_RET_SUCCESS)
+			break;
+		g_mutex_unlock(&conn_lock);
+		pwr_nanosleep(RECONNECT_DELAY);
+		g_mutex_lock(&conn_lock);
+	}
+
+	TRACE2_EXIT("status = %d, tries = %d", status, tries);
+
+	return status;
+}
+
+static int
+ipc_socket_req(ipc_t *ipc, powerapi_request_t *req, powerapi_response_t *resp)
+{
+	ipc_socket_t *ipc_sock = ipc->plugin_data;
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ipc = %p, req = %p, resp = %p", ipc, req, resp);
+
+	g_mutex_lock(&conn_lock);
+
+	status = ipc_socket_connect_locked(ipc);
+	if (status == PWR_RET_SUCCESS) {
+		status = ipc_socket_xfer(ipc_sock, req, resp, NULL, 0);
+	} else if (ipc_sock->generation == 0) {
+		// Never connected; powerapid isn't restarting.
+		goto failure_return;
+	}
 	if (status != PWR_RET_SUCCESS) {
-		if (fd >= 0) {
-			close(fd);
-			fd = -1;
-		}
+		// Resending is safe: a set replaces the session's
+		// earlier set of the same attribute.
+		status = ipc_socket_reconnect(ipc);
+		if (status != PWR_RET_SUCCESS)
+			goto failure_return;
+
+		status = ipc_socket_xfer(ipc_sock, req, resp, NULL, 0);
+		if (status != PWR_RET_SUCCESS)
+			goto failure_return;
+	}
+
+	status = resp->retval;
+
+failure_return:
+	g_mutex_unlock(&conn_lock);
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+//
+// Connect to powerapid and open the context's session, unless already
+// done.  Used by the shared memory transport before it asks for a ring.
+//
+int
+ipc_socket_connect(ipc_t *ipc)
+{
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ipc = %p", ipc);
+
+	g_mutex_lock(&conn_lock);
+	status = ipc_socket_connect_locked(ipc);
+	g_mutex_unlock(&conn_lock);
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+//
+// Send a request on the context's session and receive its response,
+// along with nfds descriptors passed with it.  Unlike a set, the request
+// isn't retried if the connection was lost.
+//
+int
+ipc_socket_xfer_fds(ipc_t *ipc, powerapi_request_t *req,
+		powerapi_response_t *resp, int *fds, int nfds)
+{
+	ipc_socket_t *ipc_sock = ipc->plugin_data;
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ipc = %p, req = %p, resp = %p, fds = %p, nfds = %d",
+			ipc, req, resp, fds, nfds);
+
+	g_mutex_lock(&conn_lock);
+	status = ipc_socket_connect_locked(ipc);
+	if (status == PWR_RET_SUCCESS) {
+		status = ipc_socket_xfer(ipc_sock, req, resp, fds, nfds);
 	}
+	g_mutex_unlock(&conn_lock);
 
-	TRACE2_EXIT("status = %d, fd = %d", status, fd);
+	TRACE2_EXIT("status = %d", status);
 
 	return status;
 }
 
+// number of connections made to powerapid, bumped by each reconnect
+guint
+ipc_socket_generation(void)
+{
+	guint generation;
+
+	g_mutex_lock(&conn_lock);
+	generation = conn_gen;
+	g_mutex_unlock(&conn_lock);
+
+	return generation;
+}
+
 static int
 ipc_socket_set(ipc_t *ipc, PWR_ObjType obj_type, PWR_AttrName attr_name,
 		PWR_MetaName meta_name, PWR_AttrDataType attr_type,
@@ -187,11 +411,6 @@ ipc_socket_set(ipc_t *ipc, PWR_ObjType obj_type, PWR_AttrName attr_name,
 			"value = %p, path = '%s'",
 			ipc, obj_type, attr_name, attr_type, value, path);
 
-	status = ipc_socket_connect(ipc);
-	if (status != PWR_RET_SUCCESS) {
-		goto failure_return;
-	}
-
 	//
 	// Setup set request
 	//
@@ -227,9 +446,20 @@ ipc_socket_set(ipc_t *ipc, PWR_ObjType obj_type, PWR_AttrName attr_name,
 	}
 
 	//
-	// Send the request to powerapid
+	// Skip a path this node or group set has already sent
+	//
+	if (ipc_batch_sent(ipc, req.set.path, req.set.value.ivalue)) {
+		status = PWR_RET_SUCCESS;
+		goto failure_return;
+	}
+
+	//
+	// Send the request to powerapid, connecting first if need be
 	//
 	status = ipc_socket_req(ipc, &req, &resp);
+	if (status == PWR_RET_SUCCESS) {
+		ipc_batch_add(ipc, req.set.path, req.set.value.ivalue);
+	}
 
 failure_return:
 	TRACE2_EXIT("status = %d", status);
@@ -290,10 +520,22 @@ ipc_socket_destruct(ipc_t *ipc)
 
 	ipc->ops = NULL;
 
-	// If the socket was connected, disconnect it and
-	// deallocate the memory.
-	if (ipc_sock->fd >= 0)
-		close(ipc_sock->fd);
+	g_mutex_lock(&conn_lock);
+
+	// End the context's session, which rolls back its sets, and
+	// disconnect if no other context is using the connection.
+	if (conn_fd >= 0 && ipc_sock->generation == conn_gen) {
+		powerapi_request_t req = { .ReqType = PwrCLOSE };
+		powerapi_response_t resp = { 0 };
+
+		ipc_socket_xfer(ipc_sock, &req, &resp, NULL, 0);
+	}
+	if (--conn_refcount == 0 && conn_fd >= 0) {
+		close(conn_fd);
+		conn_fd = -1;
+	}
+
+	g_mutex_unlock(&conn_lock);
 
 	g_free(ipc_sock);
 
@@ -338,10 +580,13 @@ ipc_socket_construct(ipc_t *ipc)
 
 	ipc->ops = &ipc_socket_ops;
 
-	// Initialize file desc. to illegal value, to indicate the
-	// lazy socket connection must be done.
+	// The connection and the session are opened lazily.
 	ipc_sock->fd = -1;
 
+	g_mutex_lock(&conn_lock);
+	conn_refcount++;
+	g_mutex_unlock(&conn_lock);
+
 	status = PWR_RET_SUCCESS;
 
 failure_return:
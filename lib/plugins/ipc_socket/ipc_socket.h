@@ -34,13 +34,23 @@
 #ifndef _PWR_IPC_SOCKET_H
 #define _PWR_IPC_SOCKET_H
 
+#include <cray-powerapi/powerapid.h>
+
 #include "ipc.h"
 
 typedef struct ipc_socket_s ipc_socket_t;
 struct ipc_socket_s {
-	int fd;
+	int fd;			// connection the session is open on
+	uint64_t session;	// powerapid session token, 0 if none yet
+	uint32_t channel;	// session's channel on the connection
+	guint generation;	// connections made when the session was
+				// opened, 0 if it hasn't been yet
 };
 
-int ipc_socket_construct(ipc_t *ipc);
+int   ipc_socket_construct(ipc_t *ipc);
+int   ipc_socket_connect(ipc_t *ipc);
+int   ipc_socket_xfer_fds(ipc_t *ipc, powerapi_request_t *req,
+		powerapi_response_t *resp, int *fds, int nfds);
+guint ipc_socket_generation(void);
 
 #endif // _PWR_IPC_SOCKET_H
@@ -383,7 +383,7 @@ x86_find_socket(hierarchy_t *hierarchy, uint64_t socket_id, uint64_t ht_id)
 		x86_socket_t *x86_socket = NULL;
 		x86_mem_t *x86_mem = NULL;
 
-		socket = new_socket(socket_id, socket_name);
+		socket = new_socket(hierarchy, socket_id, socket_name);
 		if (!socket) {
 			LOG_FAULT("Failed to alloc socket object %lu",
 					socket_id);
@@ -391,7 +391,7 @@ x86_find_socket(hierarchy_t *hierarchy, uint64_t socket_id, uint64_t ht_id)
 			goto error_return;
 		}
 
-		mem = new_mem(socket_id, "mem.%lu", socket_id);
+		mem = new_mem(hierarchy, socket_id, "mem.%lu", socket_id);
 		if (!mem) {
 			LOG_FAULT("Failed to alloc mem object %lu", socket_id);
 			error = PWR_RET_FAILURE;
@@ -453,7 +453,7 @@ x86_find_socket(hierarchy_t *hierarchy, uint64_t socket_id, uint64_t ht_id)
 
 		// Only read the metadata for socket 0. On a cray node
 		// all sockets will have the same metadata.
-		if (socket_id == 0)
+		if (socket_id == 0 && !x86_metadata.loaded)
 			x86_read_socket_metadata(socket_id, hierarchy);
 	}
 
@@ -505,7 +505,7 @@ x86_find_core(hierarchy_t *hierarchy, uint64_t core_id, uint64_t socket_id,
 			goto error_return;
 		}
 
-		core = new_core(core_id, core_name);
+		core = new_core(hierarchy, core_id, core_name);
 		if (!core) {
 			LOG_FAULT("Failed to alloc core.%lu", core_id);
 			error = PWR_RET_FAILURE;
@@ -578,7 +578,7 @@ x86_find_ht(hierarchy_t *hierarchy, uint64_t ht_id)
 		goto error_return;
 	}
 
-	ht = new_ht(ht_id, "ht.%lu", ht_id);
+	ht = new_ht(hierarchy, ht_id, "ht.%lu", ht_id);
 	if (!ht) {
 		LOG_FAULT("Failed to alloc ht %lu", ht_id);
 		error = PWR_RET_FAILURE;
@@ -863,7 +863,9 @@ x86_read_topology(info_t *info, hierarchy_t *hierarchy)
 	// the topology as creation of objects may need metadata
 	// values.
 	cpu = sched_getcpu();
-	if (cpu < 0) {
+	if (x86_metadata.loaded) {
+		// Another hierarchy already read it
+	} else if (cpu < 0) {
 		LOG_FAULT("Failed to determine current CPU number: %m");
 		status = PWR_RET_FAILURE;
 	} else {
@@ -48,6 +48,7 @@
 #include <log.h>
 
 #include "../common/file.h"
+#include "../common/telemetry.h"
 #include "../common/command.h"
 #include "typedefs.h"
 #include "hierarchy.h"
@@ -110,7 +111,16 @@ x86_get_power(const char *path, PWR_Time window, double *value,
 	TRACE2_ENTER("path = '%s', window = %lu, value = %p, ts = %p",
 			path, window, value, ts);
 
-	retval = read_uint64_from_file(path, &energy1, &ts1);
+	// Use the rate powerapid measured over the last sample interval
+	// if it matches the window, rather than sleeping for the window.
+	retval = telemetry_read_rate(path, window, &energy, ts);
+	if (retval == PWR_RET_SUCCESS) {
+		// Convert from uJ/s to Watts.
+		*value = energy * 1.0e-6;
+		goto failure_return;
+	}
+
+	retval = read_uint64_from_file_direct(path, &energy1, &ts1);
 	if (retval != PWR_RET_SUCCESS) {
 		goto failure_return;
 	}
@@ -120,7 +130,7 @@ x86_get_power(const char *path, PWR_Time window, double *value,
 		goto failure_return;
 	}
 
-	retval = read_uint64_from_file(path, &energy2, &ts2);
+	retval = read_uint64_from_file_direct(path, &energy2, &ts2);
 	if (retval != PWR_RET_SUCCESS) {
 		goto failure_return;
 	}
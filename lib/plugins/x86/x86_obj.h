@@ -88,6 +88,10 @@ typedef struct x86_metadata_s {
 	// Socket vendor data
 	// Used for sockets, mems, cores, and hardware threads.
 	char		*socket_vendor_info;
+
+	// Set once the first hierarchy has read the metadata above, which
+	// later hierarchies share rather than read again while any exists.
+	gboolean	loaded;
 } x86_metadata_t;
 
 extern x86_metadata_t x86_metadata;
@@ -125,7 +129,11 @@ void x86_del_node(node_t *node);
 int x86_node_get_power(node_t *node, double *value, struct timespec *ts);
 int x86_node_get_power_limit_max(node_t *node, double *value,
 		struct timespec *ts);
+int x86_node_set_power_limit_max(node_t *node, ipc_t *ipc,
+		const double *value);
 int x86_node_get_energy(node_t *node, double *value, struct timespec *ts);
+int x86_node_set_cstate_limit(node_t *node, ipc_t *ipc,
+		const uint64_t *value);
 
 // Metadata Functions
 int x86_node_get_meta(node_t *node, PWR_AttrName attr, PWR_MetaName meta,
@@ -144,7 +152,7 @@ typedef struct {
 	uint64_t temp_id;
 	char *temp_input;
 	char *temp_max;
-	PWR_Time power_time_window_meta;
+	PWR_Time power_time_window_meta;	// atomic, set while others read
 } x86_socket_t;
 
 int x86_new_socket(socket_t *socket);
@@ -176,7 +184,7 @@ int x86_socket_get_meta_at_index(socket_t *socket, PWR_AttrName attr,
 typedef struct {
 	uint64_t rapl_pkg_id;
 	uint64_t rapl_mem_id;
-	PWR_Time power_time_window_meta;
+	PWR_Time power_time_window_meta;	// atomic, set while others read
 } x86_mem_t;
 
 int x86_new_mem(mem_t *mem);
@@ -202,12 +210,16 @@ int x86_mem_get_meta_at_index(mem_t *mem, PWR_AttrName attr, unsigned int index,
 //	Plugin Power Plane Object Types and Prototypes			//
 //----------------------------------------------------------------------//
 
+// The pm_counters files for the sub-object type, NULL on older node
+// types that don't have them.
 typedef struct {
-	uint8_t dummy;
+	const char *power_path;
+	const char *energy_path;
 } x86_pplane_t;
 
 int x86_new_pplane(pplane_t *pplane);
 void x86_del_pplane(pplane_t *pplane);
+void x86_pplane_set_sub_type(pplane_t *pplane, PWR_ObjType sub_type);
 
 // Attribute Functions
 int x86_pplane_get_power(pplane_t *pplane, double *value, struct timespec *ts);
@@ -249,8 +261,11 @@ int x86_core_get_meta_at_index(core_t *core, PWR_AttrName attr,
 //	Plugin Hardware Thread Object Types and Prototypes		//
 //----------------------------------------------------------------------//
 
+// Sibling hyperthreads often share a cpufreq policy.  Their frequency
+// and governor sets go to the policy's control files, so that a set of a
+// whole core or node is sent once per policy.
 typedef struct {
-	uint8_t dummy;
+	int64_t policy_id;	// cpufreq policy, -1 if not known
 } x86_ht_t;
 
 int x86_new_ht(ht_t *ht);
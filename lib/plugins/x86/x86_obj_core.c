@@ -74,7 +74,6 @@ x86_del_core(core_t *core)
 	if (x86_core) {
 		g_free(x86_core->temp_input);
 		g_free(x86_core->temp_max);
-		g_free(x86_core);
 	}
 
 	core->plugin_data = NULL;
@@ -86,15 +85,13 @@ x86_new_core(core_t *core)
 	int status = PWR_RET_SUCCESS;
 	x86_core_t *x86_core = NULL;
 
-	x86_core = g_new0(x86_core_t, 1);
+	x86_core = core->plugin_data;
 	if (!x86_core) {
-		LOG_FAULT("Failed to alloc x86_core for %s", core->obj.name);
+		LOG_FAULT("No x86_core allocated for %s", core->obj.name);
 		status = PWR_RET_FAILURE;
 		goto status_return;
 	}
 
-	core->plugin_data = x86_core;
-
 status_return:
 	return status;
 }
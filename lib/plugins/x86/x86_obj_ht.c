@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 
 #include <dirent.h>
 
@@ -65,13 +66,122 @@
 void
 x86_del_ht(ht_t *ht)
 {
-	return;
+	if (!ht) {
+		return;
+	}
+
+	// The x86_ht is freed with the hierarchy
+	ht->plugin_data = NULL;
+}
+
+//
+// x86_ht_policy_id - Find the cpufreq policy of a hyperthread from the
+// policyN directory its cpufreq directory links to.  Older kernels and
+// simulated trees give each hyperthread a cpufreq directory of its own.
+//
+static int64_t
+x86_ht_policy_id(ht_t *ht)
+{
+	int64_t policy_id = -1;
+	char *path = NULL;
+	char target[PATH_MAX];
+	const char *name;
+	ssize_t len;
+	uint64_t id;
+
+	TRACE3_ENTER("ht = %p", ht);
+
+	path = g_strdup_printf(HT_FREQ_POLICY_PATH, ht->obj.os_id);
+	if (!path) {
+		goto done;
+	}
+
+	len = readlink(path, target, sizeof(target) - 1);
+	if (len < 0) {
+		goto done;
+	}
+	target[len] = '\0';
+
+	name = strrchr(target, '/');
+	name = name ? name + 1 : target;
+	if (sscanf(name, "policy%lu", &id) == 1) {
+		policy_id = id;
+	}
+
+done:
+	g_free(path);
+
+	TRACE3_EXIT("policy_id = %ld", policy_id);
+
+	return policy_id;
+}
+
+// Does the per-hyperthread sysfs directory from the format exist?
+static bool
+x86_ht_has_dir(ht_t *ht, const char *fmt)
+{
+	char *path = NULL;
+	bool found = false;
+
+	path = g_strdup_printf(fmt, ht->obj.os_id);
+	if (path) {
+		found = g_file_test(path, G_FILE_TEST_IS_DIR);
+		g_free(path);
+	}
+
+	return found;
 }
 
 int
 x86_new_ht(ht_t *ht)
 {
-	return 0;
+	int status = PWR_RET_SUCCESS;
+	x86_ht_t *x86_ht = NULL;
+
+	x86_ht = ht->plugin_data;
+	if (!x86_ht) {
+		LOG_FAULT("No x86_ht allocated for %s", ht->obj.name);
+		status = PWR_RET_FAILURE;
+		goto status_return;
+	}
+
+	x86_ht->policy_id = x86_ht_policy_id(ht);
+	if (x86_ht->policy_id >= 0) {
+		LOG_DBG("%s is in cpufreq policy%ld", ht->obj.name,
+				x86_ht->policy_id);
+	}
+
+	// Hyperthreads without cpufreq or cpuidle support have no
+	// frequency or C-state controls to read or set.
+	if (!x86_ht_has_dir(ht, HT_FREQ_POLICY_PATH)) {
+		LOG_DBG("%s has no cpufreq support", ht->obj.name);
+		BITMASK_CLEAR(&ht->obj.attrs, PWR_ATTR_FREQ);
+		BITMASK_CLEAR(&ht->obj.attrs, PWR_ATTR_FREQ_REQ);
+		BITMASK_CLEAR(&ht->obj.attrs, PWR_ATTR_FREQ_LIMIT_MIN);
+		BITMASK_CLEAR(&ht->obj.attrs, PWR_ATTR_FREQ_LIMIT_MAX);
+		BITMASK_CLEAR(&ht->obj.attrs, PWR_ATTR_GOV);
+	}
+	if (!x86_ht_has_dir(ht, HT_CSTATE_PATH)) {
+		LOG_DBG("%s has no cpuidle support", ht->obj.name);
+		BITMASK_CLEAR(&ht->obj.attrs, PWR_ATTR_CSTATE_LIMIT);
+	}
+
+status_return:
+	return status;
+}
+
+// path of a frequency or governor control file, the policy's if known, so
+// that hyperthreads sharing a policy share reads of it
+static char *
+x86_ht_freq_path(ht_t *ht, const char *ht_fmt, const char *policy_fmt)
+{
+	x86_ht_t *x86_ht = ht->plugin_data;
+
+	if (x86_ht->policy_id >= 0) {
+		return g_strdup_printf(policy_fmt, x86_ht->policy_id);
+	}
+
+	return g_strdup_printf(ht_fmt, ht->obj.os_id);
 }
 
 // Attribute Functions -----------------------------------------------//
@@ -113,7 +223,8 @@ x86_ht_get_freq_req(ht_t *ht, double *value, struct timespec *ts)
 
 	TRACE2_ENTER("ht = %p, value = %p, ts = %p", ht, value, ts);
 
-	path = g_strdup_printf(HT_FREQ_REQ_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_FREQ_REQ_PATH,
+			POLICY_FREQ_REQ_PATH);
 	if (!path) {
 		goto failure_return;
 	}
@@ -142,7 +253,8 @@ x86_ht_set_freq_req(ht_t *ht, ipc_t *ipc, const double *value)
 
 	TRACE2_ENTER("ht = %p, ipc = %p, value = %p", ht, ipc, value);
 
-	path = g_strdup_printf(HT_FREQ_REQ_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_FREQ_REQ_PATH,
+			POLICY_FREQ_REQ_PATH);
 	if (!path) {
 		goto failure_return;
 	}
@@ -172,7 +284,8 @@ x86_ht_get_freq_limit_min(ht_t *ht, double *value, struct timespec *ts)
 
 	TRACE2_ENTER("ht = %p, value = %p, ts = %p", ht, value, ts);
 
-	path = g_strdup_printf(HT_FREQ_LIMIT_MIN_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_FREQ_LIMIT_MIN_PATH,
+			POLICY_FREQ_LIMIT_MIN_PATH);
 	if (!path) {
 		goto failure_return;
 	}
@@ -201,7 +314,8 @@ x86_ht_set_freq_limit_min(ht_t *ht, ipc_t *ipc, const double *value)
 
 	TRACE2_ENTER("ht = %p, ipc = %p, value = %p", ht, ipc, value);
 
-	path = g_strdup_printf(HT_FREQ_LIMIT_MIN_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_FREQ_LIMIT_MIN_PATH,
+			POLICY_FREQ_LIMIT_MIN_PATH);
 	if (!path) {
 		goto failure_return;
 	}
@@ -231,7 +345,8 @@ x86_ht_get_freq_limit_max(ht_t *ht, double *value, struct timespec *ts)
 
 	TRACE2_ENTER("ht = %p, value = %p, ts = %p", ht, value, ts);
 
-	path = g_strdup_printf(HT_FREQ_LIMIT_MAX_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_FREQ_LIMIT_MAX_PATH,
+			POLICY_FREQ_LIMIT_MAX_PATH);
 	if (!path) {
 		goto failure_return;
 	}
@@ -260,7 +375,8 @@ x86_ht_set_freq_limit_max(ht_t *ht, ipc_t *ipc, const double *value)
 
 	TRACE2_ENTER("ht = %p, ipc = %p, value = %p", ht, ipc, value);
 
-	path = g_strdup_printf(HT_FREQ_LIMIT_MAX_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_FREQ_LIMIT_MAX_PATH,
+			POLICY_FREQ_LIMIT_MAX_PATH);
 	if (!path) {
 		goto failure_return;
 	}
@@ -290,7 +406,8 @@ x86_ht_get_governor(ht_t *ht, uint64_t *value, struct timespec *ts)
 
 	TRACE2_ENTER("ht = %p, value = %p, ts = %p", ht, value, ts);
 
-	path = g_strdup_printf(HT_GOVERNOR_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_GOVERNOR_PATH,
+			POLICY_GOVERNOR_PATH);
 	if (!path) {
 		goto failure_return;
 	}
@@ -319,7 +436,8 @@ x86_ht_set_governor(ht_t *ht, ipc_t *ipc, const uint64_t *value)
 
 	TRACE2_ENTER("ht = %p, ipc = %p, value = %p", ht, ipc, value);
 
-	path = g_strdup_printf(HT_GOVERNOR_PATH, ht->obj.os_id);
+	path = x86_ht_freq_path(ht, HT_GOVERNOR_PATH,
+			POLICY_GOVERNOR_PATH);
 	if (!path) {
 		goto failure_return;
 	}
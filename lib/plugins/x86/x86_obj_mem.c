@@ -64,17 +64,11 @@
 void
 x86_del_mem(mem_t *mem)
 {
-	x86_mem_t *x86_mem = NULL;
-
 	if (!mem) {
 		return;
 	}
 
-	x86_mem = mem->plugin_data;
-	if (x86_mem) {
-		g_free(x86_mem);
-	}
-
+	// The x86_mem is freed with the hierarchy
 	mem->plugin_data = NULL;
 }
 
@@ -84,15 +78,13 @@ x86_new_mem(mem_t *mem)
 	int status = PWR_RET_SUCCESS;
 	x86_mem_t *x86_mem = NULL;
 
-	x86_mem = g_new0(x86_mem_t, 1);
+	x86_mem = mem->plugin_data;
 	if (!x86_mem) {
-		LOG_FAULT("Failed to alloc x86_mem for %s", mem->obj.name);
+		LOG_FAULT("No x86_mem allocated for %s", mem->obj.name);
 		status = PWR_RET_FAILURE;
 		goto status_return;
 	}
 
-	mem->plugin_data = x86_mem;
-
 	x86_mem->power_time_window_meta = x86_metadata.pm_counters_time_window;
 
 status_return:
@@ -131,7 +123,9 @@ x86_mem_get_power(mem_t *mem, double *value, struct timespec *ts)
 		goto failure_return;
 	}
 
-	retval = x86_get_power(path, x86_mem->power_time_window_meta, value,
+	retval = x86_get_power(path,
+			__atomic_load_n(&x86_mem->power_time_window_meta,
+				__ATOMIC_RELAXED), value,
 			ts);
 
 failure_return:
@@ -317,7 +311,9 @@ x86_mem_power_get_meta(mem_t *mem, PWR_MetaName meta,
 		*(double *)value = x86_metadata.pm_counters_update_rate;
 		break;
 	case PWR_MD_TIME_WINDOW:
-		*(PWR_Time *)value = x86_mem->power_time_window_meta;
+		*(PWR_Time *)value = __atomic_load_n(
+				&x86_mem->power_time_window_meta,
+				__ATOMIC_RELAXED);
 		break;
 	case PWR_MD_TS_LATENCY:
 		*(PWR_Time *)value = 0;
@@ -607,7 +603,8 @@ x86_mem_power_set_meta(mem_t *mem, ipc_t *ipc,
 				break; // out of switch
 			}
 
-			x86_mem->power_time_window_meta = rval;
+			__atomic_store_n(&x86_mem->power_time_window_meta,
+					rval, __ATOMIC_RELAXED);
 			break;
 		}
 	case PWR_MD_TS_LATENCY:
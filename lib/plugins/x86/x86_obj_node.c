@@ -44,6 +44,7 @@
 #include <glib.h>
 
 #include <cray-powerapi/types.h>
+#include <cray-powerapi/powerapid.h>
 #include <common.h>
 #include <log.h>
 
@@ -65,17 +66,11 @@
 void
 x86_del_node(node_t *node)
 {
-	x86_node_t *x86_node = NULL;
-
 	if (!node) {
 		return;
 	}
 
-	x86_node = node->plugin_data;
-	if (x86_node) {
-		g_free(x86_node);
-	}
-
+	// The x86_node is freed with the hierarchy
 	node->plugin_data = NULL;
 }
 
@@ -87,17 +82,13 @@ x86_new_node(node_t *node)
 
 	TRACE2_ENTER("node = %p", node);
 
-	x86_node = g_new0(x86_node_t, 1);
+	x86_node = node->plugin_data;
 	if (!x86_node) {
-		LOG_FAULT("Failed to alloc x86_node for %s", node->obj.name);
+		LOG_FAULT("No x86_node allocated for %s", node->obj.name);
 		status = PWR_RET_FAILURE;
 		goto status_return;
 	}
 
-	// Setup was successful. Set the reference from the node to the x86
-	// plugin data
-	node->plugin_data = x86_node;
-
 status_return:
 	// Error cleanup
 	if (status) {
@@ -127,6 +118,8 @@ x86_node_get_power(node_t *node, double *value, struct timespec *ts)
 	return retval;
 }
 
+// The node power cap is a budget enforced by powerapid across the RAPL
+// limits when one has been set, and otherwise the one in pm_counters.
 int
 x86_node_get_power_limit_max(node_t *node, double *value, struct timespec *ts)
 {
@@ -135,15 +128,61 @@ x86_node_get_power_limit_max(node_t *node, double *value, struct timespec *ts)
 
 	TRACE2_ENTER("node = %p, value = %p, ts = %p", node, value, ts);
 
+	if (access(PWR_NODE_BUDGET_PATH, R_OK) == 0) {
+		retval = read_uint64_from_file(PWR_NODE_BUDGET_PATH,
+				&ivalue, ts);
+		if (retval == PWR_RET_SUCCESS &&
+				ivalue != POWERAPID_NODE_BUDGET_NONE) {
+			*value = ivalue * 1.0e-6; // convert from uw to w
+			goto done;
+		}
+	}
+
 	retval = read_uint64_from_file(NODE_POWER_CAP_PATH, &ivalue, ts);
 
 	*value = ivalue;
 
+done:
 	TRACE2_EXIT("retval = %d, *value = %lf", retval, *value);
 
 	return retval;
 }
 
+// A value of 0 removes the node power budget.  Without a power cap
+// controller in powerapid to hold a budget, the value is set on each
+// socket and memory object instead.
+int
+x86_node_set_power_limit_max(node_t *node, ipc_t *ipc, const double *value)
+{
+	int retval = PWR_RET_FAILURE;
+	uint64_t ivalue = POWERAPID_NODE_BUDGET_NONE;
+
+	TRACE2_ENTER("node = %p, ipc = %p, value = %p", node, ipc, value);
+
+	if (*value < 0.0) {
+		retval = PWR_RET_BAD_VALUE;
+		goto done;
+	}
+
+	if (access(PWR_NODE_BUDGET_PATH, R_OK) != 0) {
+		retval = PWR_RET_NOT_IMPLEMENTED;
+		goto done;
+	}
+
+	if (*value > 0.0) {
+		ivalue = *value * 1.0e6; // convert from w to uw
+	}
+
+	retval = ipc->ops->set_uint64(ipc, PWR_OBJ_NODE,
+			PWR_ATTR_POWER_LIMIT_MAX, PWR_MD_NOT_SPECIFIED,
+			&ivalue, PWR_NODE_BUDGET_PATH);
+
+done:
+	TRACE2_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
 int
 x86_node_get_energy(node_t *node, double *value, struct timespec *ts)
 {
@@ -161,6 +200,29 @@ x86_node_get_energy(node_t *node, double *value, struct timespec *ts)
 	return retval;
 }
 
+// A node C-state limit is held by powerapid as a single PM QoS request
+// when it was started to do so, and otherwise set on each hyperthread.
+int
+x86_node_set_cstate_limit(node_t *node, ipc_t *ipc, const uint64_t *value)
+{
+	int retval = PWR_RET_NOT_IMPLEMENTED;
+
+	TRACE2_ENTER("node = %p, ipc = %p, value = %p", node, ipc, value);
+
+	if (access(PWR_NODE_CSTATE_PATH, R_OK) != 0) {
+		goto done;
+	}
+
+	retval = ipc->ops->set_uint64(ipc, PWR_OBJ_NODE,
+			PWR_ATTR_CSTATE_LIMIT, PWR_MD_NOT_SPECIFIED,
+			value, PWR_NODE_CSTATE_PATH);
+
+done:
+	TRACE2_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
 // Metadata Functions -----------------------------------------------//
 
 static int
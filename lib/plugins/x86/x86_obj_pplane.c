@@ -73,39 +73,60 @@ x86_new_pplane(pplane_t *pplane)
 	return 0;
 }
 
+//
+// x86_pplane_set_sub_type - Set the sub-object type of a power plane and
+// find its pm_counters files.  Older node types don't have this data, so
+// the power plane is marked as not supporting it.
+//
+void
+x86_pplane_set_sub_type(pplane_t *pplane, PWR_ObjType sub_type)
+{
+	x86_pplane_t *x86_pplane = pplane->plugin_data;
+
+	TRACE2_ENTER("pplane = %p, sub_type = %d", pplane, sub_type);
+
+	pplane->sub_type = sub_type;
+
+	if (sub_type == PWR_OBJ_SOCKET) {
+		x86_pplane->power_path = NODE_CPU_POWER_PATH;
+		x86_pplane->energy_path = NODE_CPU_ENERGY_PATH;
+	} else if (sub_type == PWR_OBJ_MEM) {
+		x86_pplane->power_path = NODE_MEM_POWER_PATH;
+		x86_pplane->energy_path = NODE_MEM_ENERGY_PATH;
+	}
+
+	if (!x86_pplane->power_path ||
+			!g_file_test(x86_pplane->power_path,
+				G_FILE_TEST_EXISTS)) {
+		x86_pplane->power_path = NULL;
+		BITMASK_CLEAR(&pplane->obj.attrs, PWR_ATTR_POWER);
+	}
+	if (!x86_pplane->energy_path ||
+			!g_file_test(x86_pplane->energy_path,
+				G_FILE_TEST_EXISTS)) {
+		x86_pplane->energy_path = NULL;
+		BITMASK_CLEAR(&pplane->obj.attrs, PWR_ATTR_ENERGY);
+	}
+
+	TRACE2_EXIT("power_path = '%s', energy_path = '%s'",
+			x86_pplane->power_path, x86_pplane->energy_path);
+}
+
 // Attribute Functions -----------------------------------------------//
 int
 x86_pplane_get_power(pplane_t *pplane, double *value, struct timespec *ts)
 {
 	int retval = PWR_RET_NOT_IMPLEMENTED;
-	const char *path = NULL;
+	x86_pplane_t *x86_pplane = pplane->plugin_data;
 	uint64_t ivalue = 0;
 
 	TRACE2_ENTER("pplane = %p, value = %p, ts = %p", pplane, value, ts);
 
-	//
-	// The data source depends on the sub-object type
-	//
-	if (pplane->sub_type == PWR_OBJ_SOCKET) {
-		path = NODE_CPU_POWER_PATH;
-	} else if (pplane->sub_type == PWR_OBJ_MEM) {
-		path = NODE_MEM_POWER_PATH;
-	} else {
+	if (!x86_pplane->power_path) {
 		goto failure_return;
 	}
 
-	//
-	// Older node types don't have this data.  Ensure the data is present
-	// by checking the existence of the pm_counters file
-	//
-	if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
-		goto failure_return;
-	}
-
-	//
-	// Read and return the data
-	//
-	retval = read_uint64_from_file(path, &ivalue, ts);
+	retval = read_uint64_from_file(x86_pplane->power_path, &ivalue, ts);
 
 	*value = ivalue;
 
@@ -120,34 +141,16 @@ int
 x86_pplane_get_energy(pplane_t *pplane, double *value, struct timespec *ts)
 {
 	int retval = PWR_RET_NOT_IMPLEMENTED;
-	const char *path = NULL;
+	x86_pplane_t *x86_pplane = pplane->plugin_data;
 	uint64_t ivalue = 0;
 
 	TRACE2_ENTER("pplane = %p, value = %p, ts = %p", pplane, value, ts);
 
-	//
-	// The data source depends on the sub-object type
-	//
-	if (pplane->sub_type == PWR_OBJ_SOCKET) {
-		path = NODE_CPU_ENERGY_PATH;
-	} else if (pplane->sub_type == PWR_OBJ_MEM) {
-		path = NODE_MEM_ENERGY_PATH;
-	} else {
-		goto failure_return;
-	}
-
-	//
-	// Older node types don't have this data.  Ensure the data is present
-	// by checking the existence of the pm_counters file
-	//
-	if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+	if (!x86_pplane->energy_path) {
 		goto failure_return;
 	}
 
-	//
-	// Read and return the data
-	//
-	retval = read_uint64_from_file(path, &ivalue, ts);
+	retval = read_uint64_from_file(x86_pplane->energy_path, &ivalue, ts);
 
 	*value = ivalue;
 
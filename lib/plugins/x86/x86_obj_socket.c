@@ -74,7 +74,6 @@ x86_del_socket(socket_t *socket)
 	if (x86_socket) {
 		g_free(x86_socket->temp_input);
 		g_free(x86_socket->temp_max);
-		g_free(x86_socket);
 	}
 
 	socket->plugin_data = NULL;
@@ -86,15 +85,13 @@ x86_new_socket(socket_t *socket)
 	int status = PWR_RET_SUCCESS;
 	x86_socket_t *x86_socket = NULL;
 
-	x86_socket = g_new0(x86_socket_t, 1);
+	x86_socket = socket->plugin_data;
 	if (!x86_socket) {
-		LOG_FAULT("Failed to alloc x86_socket for %s", socket->obj.name);
+		LOG_FAULT("No x86_socket allocated for %s", socket->obj.name);
 		status = PWR_RET_FAILURE;
 		goto status_return;
 	}
 
-	socket->plugin_data = x86_socket;
-
 	x86_socket->power_time_window_meta =
 		x86_metadata.pm_counters_time_window;
 
@@ -155,7 +152,9 @@ x86_socket_get_power(socket_t *socket, double *value, struct timespec *ts)
 		goto failure_return;
 	}
 
-	retval = x86_get_power(path, x86_socket->power_time_window_meta,
+	retval = x86_get_power(path,
+			__atomic_load_n(&x86_socket->power_time_window_meta,
+				__ATOMIC_RELAXED),
 			value, ts);
 
 failure_return:
@@ -344,7 +343,9 @@ x86_socket_power_get_meta(socket_t *socket,
 		*(double *)value = x86_metadata.pm_counters_update_rate;
 		break;
 	case PWR_MD_TIME_WINDOW:
-		*(PWR_Time *)value = x86_socket->power_time_window_meta;
+		*(PWR_Time *)value = __atomic_load_n(
+				&x86_socket->power_time_window_meta,
+				__ATOMIC_RELAXED);
 		break;
 	case PWR_MD_TS_LATENCY:
 		*(PWR_Time *)value = 0;
@@ -685,7 +686,8 @@ x86_socket_power_set_meta(socket_t *socket, ipc_t *ipc,
 				break; // out of switch
 			}
 
-			x86_socket->power_time_window_meta = rval;
+			__atomic_store_n(&x86_socket->power_time_window_meta,
+					rval, __ATOMIC_RELAXED);
 			break;
 		}
 	case PWR_MD_TS_LATENCY:
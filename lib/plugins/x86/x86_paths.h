@@ -77,6 +77,13 @@ typedef struct {
 	sysentry_t ht_cstate_limit_path;                // %lu=cpunum, %lu=statenum
 	sysentry_t ht_governor_path;                    // %lu=cpunum
 	sysentry_t ht_governor_list_path;               // %lu=cpunum
+	sysentry_t ht_freq_policy_path;                 // %lu=cpunum
+
+	// cpufreq policy paths
+	sysentry_t policy_freq_req_path;                // %lu=policynum
+	sysentry_t policy_freq_limit_min_path;          // %lu=policynum
+	sysentry_t policy_freq_limit_max_path;          // %lu=policynum
+	sysentry_t policy_governor_path;                // %lu=policynum
 
 	// MSR paths
 	sysentry_t msr_path;                            // %lu=cpunum, %x=register
@@ -134,6 +141,12 @@ typedef struct {
 #define HT_CSTATE_LIMIT_PATH		X86_SYSFILES->ht_cstate_limit_path.val
 #define HT_GOVERNOR_PATH		X86_SYSFILES->ht_governor_path.val
 #define HT_GOVERNOR_LIST_PATH		X86_SYSFILES->ht_governor_list_path.val
+#define HT_FREQ_POLICY_PATH		X86_SYSFILES->ht_freq_policy_path.val
+
+#define POLICY_FREQ_REQ_PATH		X86_SYSFILES->policy_freq_req_path.val
+#define POLICY_FREQ_LIMIT_MIN_PATH	X86_SYSFILES->policy_freq_limit_min_path.val
+#define POLICY_FREQ_LIMIT_MAX_PATH	X86_SYSFILES->policy_freq_limit_max_path.val
+#define POLICY_GOVERNOR_PATH		X86_SYSFILES->policy_governor_path.val
 
 #define MSR_PATH			X86_SYSFILES->msr_path.val
 #define MSR_PKG_POWER_SKU_UNIT_PATH	X86_SYSFILES->msr_pkg_power_sku_unit_path.val
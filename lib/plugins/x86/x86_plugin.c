@@ -52,12 +52,19 @@
 
 #include "../common/file.h"
 
+// x86_metadata is shared by the hierarchies of all contexts.  It is read
+// by the first, freed with the last, and left alone in between, so that
+// contexts on other threads can use it while one is built or torn down.
+static GMutex x86_metadata_lock;
+static int x86_metadata_refs = 0;
 
 static const struct node_ops x86_node_ops = {
 	// Attribute functions
 	.get_power = x86_node_get_power,
 	.get_power_limit_max = x86_node_get_power_limit_max,
+	.set_power_limit_max = x86_node_set_power_limit_max,
 	.get_energy = x86_node_get_energy,
+	.set_cstate_limit = x86_node_set_cstate_limit,
 
 	// Metadata functions
 	.get_meta = x86_node_get_meta,
@@ -203,6 +210,12 @@ static x86_sysfiles_t x86_sysfile_catalog = {
 	_ini(ht_cstate_limit_path, _SYSFS_CPU "/cpu%lu/cpuidle/state%lu/disable"),
 	_ini(ht_governor_path, _SYSFS_CPU "/cpu%lu/cpufreq/scaling_governor"),
 		_ini(ht_governor_list_path, _SYSFS_CPU "/cpu%lu/cpufreq/scaling_available_governors"),
+	_ini(ht_freq_policy_path, _SYSFS_CPU "/cpu%lu/cpufreq"),
+
+	_ini(policy_freq_req_path, _SYSFS_CPU "/cpufreq/policy%lu/scaling_setspeed"),
+	_ini(policy_freq_limit_min_path, _SYSFS_CPU "/cpufreq/policy%lu/scaling_min_freq"),
+	_ini(policy_freq_limit_max_path, _SYSFS_CPU "/cpufreq/policy%lu/scaling_max_freq"),
+	_ini(policy_governor_path, _SYSFS_CPU "/cpufreq/policy%lu/scaling_governor"),
 
 	_ini(msr_path, _SYSFS_CPU "/cpu%lu/msr/%xr"),
 	_ini(msr_pkg_power_sku_unit_path, _SYSFS_CPU "/cpu%lu/msr/606r"),
@@ -296,28 +309,35 @@ x86_construct_hierarchy(hierarchy_t *hierarchy)
 
 	TRACE2_ENTER("hierarchy = %p", hierarchy);
 
+	// Taken for this hierarchy whatever happens, since it is always
+	// destructed
+	g_mutex_lock(&x86_metadata_lock);
+	x86_metadata_refs++;
+
 	if (hierarchy->tree != NULL || g_hash_table_size(hierarchy->map) != 0) {
 		LOG_FAULT("Construct hierarhcy failed, tree was not empty");
 		status = PWR_RET_FAILURE;
 		goto status_return;
 	}
 
-	// (re)set the metadata to zeros
-	memset(&x86_metadata, 0, sizeof(x86_metadata));
-
-	// Read in the pm_counters metadata so it is available to 
-	// objects populating the hierarchy.
-	status = x86_read_pm_counters_metadata();
-	if (status) {
-		LOG_FAULT("Failed to read pm_counters metadata");
-		status = PWR_RET_FAILURE;
-		goto status_return;
+	if (!x86_metadata.loaded) {
+		// (re)set the metadata to zeros
+		memset(&x86_metadata, 0, sizeof(x86_metadata));
+
+		// Read in the pm_counters metadata so it is available to
+		// objects populating the hierarchy.
+		status = x86_read_pm_counters_metadata();
+		if (status) {
+			LOG_FAULT("Failed to read pm_counters metadata");
+			status = PWR_RET_FAILURE;
+			goto status_return;
+		}
 	}
 
 	// Add node object to the hierarchy tree. Since this should be the
 	// first insert, it will be the root node.
 	node_id = 0;
-	node = new_node(node_id, "node.%lu", node_id);
+	node = new_node(hierarchy, node_id, "node.%lu", node_id);
 	if (!node) {
 		LOG_FAULT("Failed to alloc node.%.lu", node_id);
 		status = PWR_RET_FAILURE;
@@ -328,7 +348,8 @@ x86_construct_hierarchy(hierarchy_t *hierarchy)
 		LOG_FAULT("Failed to insert %s into hierarchy", node->obj.name);
 		goto status_return;
 	}
-	x86_read_node_metadata();	// read node-specific metadata
+	if (!x86_metadata.loaded)
+		x86_read_node_metadata();	// read node-specific metadata
 
 	// Node inserted into hierarchy, drop the reference.
 	root = node->obj.gnode;
@@ -340,13 +361,14 @@ x86_construct_hierarchy(hierarchy_t *hierarchy)
 	// names reflect the node. Each pplane object is given a
 	// unique os_id for PWR_OBJ_POWER_PLANE objects.
 	pplane_id = 0;
-	pplane = new_pplane(pplane_id, "pm_counters.cpu.%lu", node_id);
+	pplane = new_pplane(hierarchy, pplane_id, "pm_counters.cpu.%lu",
+			node_id);
 	if (!pplane) {
 		LOG_FAULT("Failed to alloc pm_counters.cpu.%lu", node_id);
 		status = PWR_RET_FAILURE;
 		goto status_return;
 	}
-	pplane->sub_type = PWR_OBJ_SOCKET;
+	x86_pplane_set_sub_type(pplane, PWR_OBJ_SOCKET);
 	status = hierarchy_insert(hierarchy, root, &pplane->obj);
 	if (status) {
 		LOG_FAULT("Failed to insert %s into hierarchy",
@@ -359,13 +381,14 @@ x86_construct_hierarchy(hierarchy_t *hierarchy)
 
 	// Get next os_id for a power plane
 	pplane_id = 1;
-	pplane = new_pplane(pplane_id, "pm_counters.mem.%lu", node_id);
+	pplane = new_pplane(hierarchy, pplane_id, "pm_counters.mem.%lu",
+			node_id);
 	if (!pplane) {
 		LOG_FAULT("Failed to alloc pm_counters.mem.%lu", node_id);
 		status = PWR_RET_FAILURE;
 		goto status_return;
 	}
-	pplane->sub_type = PWR_OBJ_MEM;
+	x86_pplane_set_sub_type(pplane, PWR_OBJ_MEM);
 	status = hierarchy_insert(hierarchy, root, &pplane->obj);
 	if (status) {
 		LOG_FAULT("Failed to insert %s into hierarchy",
@@ -377,8 +400,12 @@ x86_construct_hierarchy(hierarchy_t *hierarchy)
 	pplane = NULL;
 
 	status = x86_read_hierarchy(hierarchy);
+	if (status == PWR_RET_SUCCESS)
+		x86_metadata.loaded = TRUE;
 
 status_return:
+	g_mutex_unlock(&x86_metadata_lock);
+
 	// If there was an error, clean up any objects not
 	// inserted into the hierarchy.
 	if (status) {
@@ -399,6 +426,12 @@ x86_destruct_hierarchy(hierarchy_t *hierarchy)
 
 	TRACE2_ENTER("hierarchy = %p", hierarchy);
 
+	g_mutex_lock(&x86_metadata_lock);
+
+	// Only the last hierarchy cleans up
+	if (--x86_metadata_refs > 0)
+		goto unlock;
+
 	// Clean up all memory allocations
 	pwr_list_free_uint64(&md->ht_cstate);
 
@@ -406,9 +439,15 @@ x86_destruct_hierarchy(hierarchy_t *hierarchy)
 
 	pwr_list_free_string(&md->ht_gov);
 
+	g_free(md->node_vendor_info);
+	g_free(md->socket_vendor_info);
+
 	// Zero the struct
 	memset(&x86_metadata, 0, sizeof(x86_metadata));
 
+unlock:
+	g_mutex_unlock(&x86_metadata_lock);
+
 	TRACE2_EXIT("");
 
 	return 0;
@@ -569,6 +608,13 @@ x86_construct_plugin(plugin_t *plugin)
 {
 	plugin->sysfile_catalog = (sysentry_t *)&x86_sysfile_catalog;
 
+	plugin->node_data_size = sizeof(x86_node_t);
+	plugin->socket_data_size = sizeof(x86_socket_t);
+	plugin->mem_data_size = sizeof(x86_mem_t);
+	plugin->pplane_data_size = sizeof(x86_pplane_t);
+	plugin->core_data_size = sizeof(x86_core_t);
+	plugin->ht_data_size = sizeof(x86_ht_t);
+
 	plugin->construct_hierarchy = x86_construct_hierarchy;
 	plugin->destruct_hierarchy = x86_destruct_hierarchy;
 
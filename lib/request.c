@@ -0,0 +1,561 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains the functions for asynchronous attribute reads.  A
+ * request is run on one of its context's worker threads, and its
+ * completion can be learned from a callback, from the context's eventfd,
+ * or by testing or waiting on the request.
+ */
+
+#include <cray-powerapi/api.h>
+#include <log.h>
+
+#include "request.h"
+#include "context.h"
+
+request_t *
+new_request(void)
+{
+	request_t *request = NULL;
+	int error_state = 0;
+
+	TRACE2_ENTER("");
+
+	request = g_new0(request_t, 1);
+	if (!request) {
+		++error_state;
+		goto error_handling;
+	}
+	g_mutex_init(&request->lock);
+	g_cond_init(&request->cond);
+
+	// Since requests get returned to users, they need to
+	// go into the opaque map so they have an opaque key.
+	if (!opaque_map_insert(opaque_map, OPAQUE_REQUEST, &request->opaque)) {
+		++error_state;
+		goto error_handling;
+	}
+
+error_handling:
+	// If any errors were encountered, clean up
+	if (error_state) {
+		del_request(request);
+		request = NULL;
+	}
+
+	TRACE2_EXIT("request = %p", request);
+	return request;
+}
+
+void
+del_request(request_t *request)
+{
+	TRACE2_ENTER("request = %p", request);
+
+	if (request) {
+		if (request->opaque.key) {
+			opaque_map_remove(opaque_map, request->opaque.key);
+		}
+		g_cond_clear(&request->cond);
+		g_mutex_clear(&request->lock);
+		g_free(request);
+	}
+
+	TRACE2_EXIT("");
+}
+
+void
+request_destroy_callback(gpointer data)
+{
+	request_t *request = (request_t *)data;
+
+	TRACE3_ENTER("data = %p", data);
+
+	del_request(request);
+
+	TRACE3_EXIT("");
+}
+
+//
+// This function runs on a context's worker threads to carry out a request.
+//
+void
+request_run(gpointer data, gpointer user_data)
+{
+	request_t *request = (request_t *)data;
+	context_t *ctx = (context_t *)user_data;
+	CRAYPWR_RequestCallback callback = request->callback;
+	void *cbdata = request->data;
+	bool detached = request->detached;
+	CRAYPWR_Request handle = NULL;
+	int retval;
+
+	TRACE2_ENTER("data = %p, user_data = %p", data, user_data);
+
+	handle = OPAQUE_GENERATE(request->context_key, request->opaque.key);
+
+	if (request->obj) {
+		retval = PWR_ObjAttrGetValue(request->obj, request->attr,
+				request->values, request->ts);
+	} else {
+		retval = PWR_GrpAttrGetValue(request->grp, request->attr,
+				request->values, request->ts, request->status);
+	}
+
+	// Once it is done, a waiting thread may destroy the request
+	g_mutex_lock(&request->lock);
+	request->retval = retval;
+	request->done = true;
+	g_cond_broadcast(&request->cond);
+	g_mutex_unlock(&request->lock);
+
+	context_notify_request(ctx);
+
+	if (callback) {
+		callback(handle, retval, cbdata);
+	}
+
+	if (detached) {
+		context_del_request(ctx, request);
+	}
+
+	TRACE2_EXIT("retval = %d", retval);
+}
+
+// Block until a request is done, and return its result
+static int
+wait_request(request_t *request)
+{
+	int retval;
+
+	g_mutex_lock(&request->lock);
+	while (!request->done) {
+		g_cond_wait(&request->cond, &request->lock);
+	}
+	retval = request->retval;
+	g_mutex_unlock(&request->lock);
+
+	return retval;
+}
+
+//
+// Queue a filled in request on its context's workers. With no handle to
+// return, the request deletes itself once done.
+//
+static int
+submit_request(context_t *ctx, request_t *request, CRAYPWR_Request *handle)
+{
+	int status = PWR_RET_FAILURE;
+
+	TRACE2_ENTER("ctx = %p, request = %p, handle = %p",
+			ctx, request, handle);
+
+	// The request may complete before it is queued, so everything
+	// the worker uses has to be set first
+	request->detached = (handle == NULL);
+	if (handle) {
+		*handle = OPAQUE_GENERATE(ctx->opaque.key,
+				request->opaque.key);
+	}
+
+	status = context_queue_request(ctx, request);
+	if (status != PWR_RET_SUCCESS) {
+		if (handle) {
+			*handle = NULL;
+		}
+		context_del_request(ctx, request);
+	}
+
+	TRACE2_EXIT("status = %d", status);
+
+	return status;
+}
+
+//----------------------------------------------------------------------//
+//              External Request Interfaces                             //
+//----------------------------------------------------------------------//
+
+/*
+ * CRAYPWR_ObjAttrGetValueAsync - Start reading an attribute of an object,
+ *				  as PWR_ObjAttrGetValue() would, on a
+ *				  library thread.
+ *
+ * Argument(s):
+ *
+ *	object	 - The target object
+ *	attr	 - The target attribute
+ *	value	 - Pointer to caller-allocated storage for the 8 byte value,
+ *		   which must stay valid until the request is done
+ *	ts	 - Pointer to storage for the timestamp, or NULL
+ *	callback - Function called when the read is done, or NULL
+ *	data	 - Passed to the callback
+ *	request	 - Returned request handle, to test, wait on and destroy the
+ *		   request with.  If NULL, a callback is required, and the
+ *		   request is destroyed after the callback returns.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - The read was started
+ *	PWR_RET_FAILURE - The read could not be started
+ */
+int
+CRAYPWR_ObjAttrGetValueAsync(PWR_Obj object, PWR_AttrName attr, void *value,
+		PWR_Time *ts, CRAYPWR_RequestCallback callback, void *data,
+		CRAYPWR_Request *request)
+{
+	int status = PWR_RET_FAILURE;
+	context_t *ctx = NULL;
+	request_t *req = NULL;
+
+	TRACE1_ENTER("object = %p, attr = %d, value = %p, ts = %p, "
+			"callback = %p, data = %p, request = %p",
+			object, attr, value, ts, callback, data, request);
+
+	if (!value) {
+		LOG_FAULT("NULL value pointer");
+		goto error_handling;
+	}
+
+	if (!request && !callback) {
+		LOG_FAULT("no request pointer or callback");
+		goto error_handling;
+	}
+
+	if (!opaque_map_lookup_object(opaque_map,
+			OPAQUE_GET_DATA_KEY(object))) {
+		LOG_FAULT("Invalid PWR_Obj reference %p", object);
+		goto error_handling;
+	}
+
+	// Find the context
+	ctx = opaque_map_lookup_context(opaque_map,
+			OPAQUE_GET_CONTEXT_KEY(object));
+	if (!ctx) {
+		LOG_FAULT("context not found!");
+		goto error_handling;
+	}
+
+	req = context_new_request(ctx);
+	if (!req) {
+		LOG_FAULT("unable to create new request!");
+		goto error_handling;
+	}
+
+	req->obj	= object;
+	req->attr	= attr;
+	req->values	= value;
+	req->ts		= ts;
+	req->callback	= callback;
+	req->data	= data;
+
+	status = submit_request(ctx, req, request);
+
+error_handling:
+	TRACE1_EXIT("status = %d", status);
+
+	return status;
+}
+
+/*
+ * CRAYPWR_GrpAttrGetValueAsync - Start reading an attribute of every object
+ *				  in a group, as PWR_GrpAttrGetValue() would,
+ *				  on a library thread.
+ *
+ * Argument(s):
+ *
+ *	group	 - The target group
+ *	attr	 - The target attribute
+ *	values	 - Storage for an 8 byte value per object, which must stay
+ *		   valid until the request is done
+ *	ts	 - Storage for a timestamp per object, or NULL
+ *	status	 - Status the read reports errors to, or NULL
+ *	callback - Function called when the read is done, or NULL
+ *	data	 - Passed to the callback
+ *	request	 - Returned request handle, as for
+ *		   CRAYPWR_ObjAttrGetValueAsync()
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - The read was started
+ *	PWR_RET_FAILURE - The read could not be started
+ */
+int
+CRAYPWR_GrpAttrGetValueAsync(PWR_Grp group, PWR_AttrName attr, void *values,
+		PWR_Time ts[], PWR_Status status,
+		CRAYPWR_RequestCallback callback, void *data,
+		CRAYPWR_Request *request)
+{
+	int retval = PWR_RET_FAILURE;
+	context_t *ctx = NULL;
+	request_t *req = NULL;
+
+	TRACE1_ENTER("group = %p, attr = %d, values = %p, ts = %p, "
+			"status = %p, callback = %p, data = %p, request = %p",
+			group, attr, values, ts, status, callback, data,
+			request);
+
+	if (!values) {
+		LOG_FAULT("NULL values pointer");
+		goto error_handling;
+	}
+
+	if (!request && !callback) {
+		LOG_FAULT("no request pointer or callback");
+		goto error_handling;
+	}
+
+	if (!opaque_map_lookup_group(opaque_map,
+			OPAQUE_GET_DATA_KEY(group))) {
+		LOG_FAULT("Invalid PWR_Grp reference %p", group);
+		goto error_handling;
+	}
+
+	// Find the context
+	ctx = opaque_map_lookup_context(opaque_map,
+			OPAQUE_GET_CONTEXT_KEY(group));
+	if (!ctx) {
+		LOG_FAULT("context not found!");
+		goto error_handling;
+	}
+
+	req = context_new_request(ctx);
+	if (!req) {
+		LOG_FAULT("unable to create new request!");
+		goto error_handling;
+	}
+
+	req->grp	= group;
+	req->status	= status;
+	req->attr	= attr;
+	req->values	= values;
+	req->ts		= ts;
+	req->callback	= callback;
+	req->data	= data;
+
+	retval = submit_request(ctx, req, request);
+
+error_handling:
+	TRACE1_EXIT("retval = %d", retval);
+
+	return retval;
+}
+
+/*
+ * CRAYPWR_RequestTest - Check whether a request is done, without blocking.
+ *
+ * Argument(s):
+ *
+ *	request - The request
+ *	done	- Set non-zero if the request is done
+ *	retval	- If the request is done, set to the return code of its read.
+ *		  May be NULL.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+int
+CRAYPWR_RequestTest(CRAYPWR_Request request, int *done, int *retval)
+{
+	int status = PWR_RET_FAILURE;
+	request_t *req = NULL;
+
+	TRACE1_ENTER("request = %p, done = %p, retval = %p",
+			request, done, retval);
+
+	if (!done) {
+		LOG_FAULT("NULL done pointer");
+		goto error_handling;
+	}
+
+	req = opaque_map_lookup_request(opaque_map,
+			OPAQUE_GET_DATA_KEY(request));
+	if (!req) {
+		LOG_FAULT("request not found!");
+		goto error_handling;
+	}
+
+	g_mutex_lock(&req->lock);
+	*done = req->done;
+	if (req->done && retval) {
+		*retval = req->retval;
+	}
+	g_mutex_unlock(&req->lock);
+
+	status = PWR_RET_SUCCESS;
+
+error_handling:
+	TRACE1_EXIT("status = %d", status);
+
+	return status;
+}
+
+/*
+ * CRAYPWR_RequestWait - Block until a request is done.
+ *
+ * Argument(s):
+ *
+ *	request - The request
+ *	retval	- Set to the return code of the request's read.  May be NULL.
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+int
+CRAYPWR_RequestWait(CRAYPWR_Request request, int *retval)
+{
+	int status = PWR_RET_FAILURE;
+	request_t *req = NULL;
+	int result;
+
+	TRACE1_ENTER("request = %p, retval = %p", request, retval);
+
+	req = opaque_map_lookup_request(opaque_map,
+			OPAQUE_GET_DATA_KEY(request));
+	if (!req) {
+		LOG_FAULT("request not found!");
+		goto error_handling;
+	}
+
+	result = wait_request(req);
+	if (retval) {
+		*retval = result;
+	}
+
+	status = PWR_RET_SUCCESS;
+
+error_handling:
+	TRACE1_EXIT("status = %d", status);
+
+	return status;
+}
+
+/*
+ * CRAYPWR_RequestDestroy - Destroy a request, first waiting for it to be
+ *			    done if it isn't.
+ *
+ * Argument(s):
+ *
+ *	request - The request
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+int
+CRAYPWR_RequestDestroy(CRAYPWR_Request request)
+{
+	int status = PWR_RET_FAILURE;
+	request_t *req = NULL;
+	context_t *ctx = NULL;
+
+	TRACE1_ENTER("request = %p", request);
+
+	req = opaque_map_lookup_request(opaque_map,
+			OPAQUE_GET_DATA_KEY(request));
+	if (!req) {
+		LOG_FAULT("request not found!");
+		goto error_handling;
+	}
+
+	// Find the context
+	ctx = opaque_map_lookup_context(opaque_map,
+			OPAQUE_GET_CONTEXT_KEY(request));
+	if (!ctx) {
+		LOG_FAULT("context not found!");
+		goto error_handling;
+	}
+
+	wait_request(req);
+	context_del_request(ctx, req);
+
+	status = PWR_RET_SUCCESS;
+
+error_handling:
+	TRACE1_EXIT("status = %d", status);
+
+	return status;
+}
+
+/*
+ * CRAYPWR_CntxtGetRequestFd - Get an eventfd that counts the requests of a
+ *			       context as they are done, for poll(), select()
+ *			       or epoll.  Reading it resets the count; the
+ *			       requests can then be checked with
+ *			       CRAYPWR_RequestTest().  It is closed by
+ *			       PWR_CntxtDestroy().
+ *
+ * Argument(s):
+ *
+ *	context - The context
+ *	fd	- Set to the eventfd
+ *
+ * Return Code(s):
+ *
+ *	PWR_RET_SUCCESS - Upon SUCCESS
+ *	PWR_RET_FAILURE - Upon FAILURE
+ */
+int
+CRAYPWR_CntxtGetRequestFd(PWR_Cntxt context, int *fd)
+{
+	int status = PWR_RET_FAILURE;
+	context_t *ctx = NULL;
+
+	TRACE1_ENTER("context = %p, fd = %p", context, fd);
+
+	if (!fd) {
+		LOG_FAULT("NULL fd pointer");
+		goto error_handling;
+	}
+
+	// Find the context
+	ctx = opaque_map_lookup_context(opaque_map,
+			OPAQUE_GET_CONTEXT_KEY(context));
+	if (!ctx) {
+		LOG_FAULT("context not found!");
+		goto error_handling;
+	}
+
+	*fd = context_request_fd(ctx);
+	if (*fd < 0) {
+		goto error_handling;
+	}
+
+	status = PWR_RET_SUCCESS;
+
+error_handling:
+	TRACE1_EXIT("status = %d", status);
+
+	return status;
+}
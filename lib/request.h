@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * This file contains the structure definitions and prototypes for internal
+ * use of the asynchronous request interface.
+ */
+
+#ifndef _PWR_REQUEST_H
+#define _PWR_REQUEST_H
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/types.h>
+
+#include "typedefs.h"
+#include "opaque.h"
+
+// Most worker threads a context reads with at once
+#define REQUEST_WORKERS		4
+
+//
+// request_t is the internal implementation of CRAYPWR_Request opaque type.
+//
+// See typedefs.h for:
+// typedef struct request_s request_t;
+struct request_s {
+	opaque_ref_t	opaque;		// Always first: opaque reference
+	gpointer	context_key;	// Context request was made under
+	GList		*link;		// Link into the context's request list
+
+	PWR_Obj		obj;		// Object read, or NULL for a group
+	PWR_Grp		grp;		// Group read, or NULL for an object
+	PWR_Status	status;		// Status for group errors, or NULL
+	PWR_AttrName	attr;
+	void		*values;	// Caller's storage for the results
+	PWR_Time	*ts;
+
+	CRAYPWR_RequestCallback callback; // Completion callback, or NULL
+	void		*data;		// Passed to the callback
+	bool		detached;	// Deleted once complete, no handle
+
+	GMutex		lock;		// Guards done and retval
+	GCond		cond;		// Signaled when done
+	bool		done;
+	int		retval;
+};
+
+request_t *new_request(void);
+void del_request(request_t *request);
+void request_destroy_callback(gpointer data);
+void request_run(gpointer data, gpointer context);
+
+#endif /* _PWR_REQUEST_H */
@@ -114,10 +114,12 @@ _del_hint(void *hintptr)
 	if (hint) {
 		GSequenceIter *iter;
 		// Remove the context name, if it exists
+		g_rec_mutex_lock(&hint->ctxptr->lock);
 		iter = g_sequence_lookup(hint->ctxptr->hintnames,
 				hint->name, _sortnames, NULL);
 		if (iter)
 			g_sequence_remove(iter);
+		g_rec_mutex_unlock(&hint->ctxptr->lock);
 		// Remove the opaque key, if it exists
 		if (hint->opaque.key)
 			opaque_map_remove(opaque_map, hint->opaque.key);
@@ -262,6 +264,9 @@ PWR_AppHintCreate(PWR_Obj obj, const char *hint_region_name,
 		goto done;
 	}
 
+	// Name checks and both insertions happen under the context lock
+	g_rec_mutex_lock(&ctxptr->lock);
+
 	// Check the region name
 	if (!hint_region_name) {
 		// Auto-generate a unique name
@@ -275,14 +280,14 @@ PWR_AppHintCreate(PWR_Obj obj, const char *hint_region_name,
 			_sortnames, NULL)) {
 		// Specified name already exists, fail
 		LOG_FAULT("hint name '%s' already exists!", hint_region_name);
-		goto done;
+		goto unlock;
 	}
 
 	// Create the hint
 	hintptr = _new_hint();
 	if (!hintptr) {
 		LOG_FAULT("unable to create new hint!");
-		goto done;
+		goto unlock;
 	}
 	hintptr->objptr = objptr;
 	hintptr->ctxptr = ctxptr;
@@ -295,7 +300,7 @@ PWR_AppHintCreate(PWR_Obj obj, const char *hint_region_name,
 	if (!g_sequence_insert_sorted(ctxptr->hintnames, hintptr->name,
 			_sortnames, NULL)) {
 		LOG_FAULT("unable to insert hint name into context sequence");
-		goto done;
+		goto unlock;
 	}
 
 	/*
@@ -305,7 +310,7 @@ PWR_AppHintCreate(PWR_Obj obj, const char *hint_region_name,
 	if (!g_sequence_insert_sorted(objptr->hints, hintptr,
 			_sorthints, NULL)) {
 		LOG_FAULT("unable to insert hint into object sequence");
-		goto done;
+		goto unlock;
 	}
 
 	// Provide opaque_key to the caller
@@ -314,6 +319,9 @@ PWR_AppHintCreate(PWR_Obj obj, const char *hint_region_name,
 
 	status = PWR_RET_SUCCESS;
 
+unlock:
+	g_rec_mutex_unlock(&ctxptr->lock);
+
 done:
 	/*
 	 * On failure, unmake the hint. Note that since the last thing done is
@@ -365,6 +373,7 @@ int PWR_AppHintDestroy(uint64_t hint_region_id)
 	}
 
 	// Find the hint in the object list
+	g_rec_mutex_lock(&hintptr->ctxptr->lock);
 	iter = g_sequence_lookup(hintptr->objptr->hints, hintptr,
 			_sorthints, NULL);
 	if (!iter) {
@@ -377,6 +386,7 @@ int PWR_AppHintDestroy(uint64_t hint_region_id)
 		 * free-floating hints.
 		 */
 		LOG_FAULT("hint found, but not linked to object");
+		g_rec_mutex_unlock(&hintptr->ctxptr->lock);
 		_del_hint(hintptr);
 		goto done;
 	}
@@ -386,6 +396,7 @@ int PWR_AppHintDestroy(uint64_t hint_region_id)
 	 * del_hint() function on the hint as it removes it from the list.
 	 */
 	g_sequence_remove(iter);
+	g_rec_mutex_unlock(&hintptr->ctxptr->lock);
 	status = PWR_RET_SUCCESS;
 
 done:
@@ -39,6 +39,8 @@
 
 #include "statistics.h"
 #include "context.h"
+#include "group.h"
+#include "plan.h"
 #include "timer.h"
 #include "utility.h"
 
@@ -90,6 +92,7 @@ del_stat(stat_t *stat)
 		if (stat->opaque.key) {
 			opaque_map_remove(opaque_map, stat->opaque.key);
 		}
+		plan_unref(stat->plan);
 		g_free(stat->values);
 		g_free(stat->instants);
 		g_free(stat);
@@ -122,6 +125,8 @@ stat_invalidate_callback(gpointer data)
 			stop_thread(stat);
 		}
 
+		plan_unref(stat->plan);
+		stat->plan = NULL;
 		stat->obj = stat->grp = NULL;
 	}
 
@@ -189,13 +194,7 @@ calculate_stat(gpointer statptr)
 	while (stat->die == false) {
 		int retval = 0;
 
-		if (stat->obj) {
-			retval = PWR_ObjAttrGetValue(stat->obj, stat->attr,
-					reading, readtime);
-		} else {
-			retval = PWR_GrpAttrGetValue(stat->grp, stat->attr,
-					reading, readtime, NULL);
-		}
+		retval = plan_run(stat->plan, reading, readtime, NULL);
 		if (retval != PWR_RET_SUCCESS) {
 			// Exit thread?
 			LOG_FAULT("Can't get value! %d", retval);
@@ -279,6 +278,46 @@ stop_thread(stat_t *stat)
 	return status;
 }
 
+//
+// Make the plan the monitoring thread reads the statistic's object or
+// group with, so each sample is taken without looking anything up.
+//
+static plan_t *
+new_stat_plan(stat_t *stat)
+{
+	plan_t *plan = NULL;
+	obj_t *obj = NULL;
+	group_t *grp = NULL;
+
+	TRACE2_ENTER("stat = %p", stat);
+
+	if (stat->obj) {
+		obj = opaque_map_lookup_object(opaque_map,
+				OPAQUE_GET_DATA_KEY(stat->obj));
+		if (!obj) {
+			LOG_FAULT("object not found!");
+			goto error_handling;
+		}
+		plan = plan_new(stat->attr, 1, true);
+		if (plan) {
+			plan_add_obj(plan, obj, stat->obj);
+		}
+	} else {
+		grp = opaque_map_lookup_group(opaque_map,
+				OPAQUE_GET_DATA_KEY(stat->grp));
+		if (!grp) {
+			LOG_FAULT("group not found!");
+			goto error_handling;
+		}
+		plan = group_new_plan(grp, stat->attr, true);
+	}
+
+error_handling:
+	TRACE2_EXIT("plan = %p", plan);
+
+	return plan;
+}
+
 int
 start_thread(stat_t *stat)
 {
@@ -292,6 +331,14 @@ start_thread(stat_t *stat)
 		}
 	}
 
+	if (!stat->plan) {
+		stat->plan = new_stat_plan(stat);
+		if (!stat->plan) {
+			LOG_FAULT("unable to plan statistics reads!");
+			goto error_handling;
+		}
+	}
+
 	stat->thread = g_thread_try_new(NULL, calculate_stat, stat, NULL);
 	if (!stat->thread) {
 		LOG_FAULT("unable to start statistics monitoring thread!");
@@ -690,7 +737,9 @@ PWR_StatStart(PWR_Stat statObj)
 		goto error_handling;
 	}
 	stat->stop = 0;
-	start_thread(stat);
+	if (start_thread(stat) != PWR_RET_SUCCESS) {
+		goto error_handling;
+	}
 
 	status = PWR_RET_SUCCESS;
 
@@ -66,6 +66,7 @@ struct stat_s {
 	PWR_Time	*instants;
 	GMutex		val_lock; // lock to access values and instants
 
+	plan_t		*plan; // Read made by the thread, NULL until started
 	GThread		*thread;
 	bool		die;
 };
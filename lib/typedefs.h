@@ -50,6 +50,10 @@ typedef struct stat_s stat_t;
 
 typedef struct group_s group_t;
 
+typedef struct plan_s plan_t;
+
+typedef struct request_s request_t;
+
 typedef struct obj_s obj_t;
 typedef struct node_s node_t;
 typedef struct socket_s socket_t;
@@ -53,15 +53,25 @@
 bool
 global_init(void)
 {
-	static bool init = false;
+	static gint done = 0;
+	static GMutex lock;
+	bool init = false;
 
-	TRACE2_ENTER("init = %d", init);
+	TRACE2_ENTER("done = %d", g_atomic_int_get(&done));
 
-	if (init) {
+	// Contexts may be created on several threads at once; only the
+	// first does the work, and a failed attempt may be retried later.
+	if (g_atomic_int_get(&done)) {
 		TRACE2_EXIT("");
 		return true;
 	}
 
+	g_mutex_lock(&lock);
+	if (g_atomic_int_get(&done)) {
+		init = true;
+		goto unlock;
+	}
+
 	// Initialize the global opaque map
 	opaque_map = opaque_map_new();
 	if (!opaque_map) {
@@ -80,6 +90,7 @@ global_init(void)
 	configure_sysfiles();
 
 	init = true;
+	g_atomic_int_set(&done, 1);
 
 failure_return:
 	// If init failed, cleanup anything that was allocated
@@ -95,6 +106,9 @@ failure_return:
 		}
 	}
 
+unlock:
+	g_mutex_unlock(&lock);
+
 	TRACE2_EXIT("init = %d", init);
 
 	return init;
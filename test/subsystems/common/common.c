@@ -34,9 +34,16 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <glib.h>
 
 #include <cray-powerapi/api.h>
+#include <cray-powerapi/powerapid.h>
+#include <common.h>
 
 #include "common.h"
 
@@ -1174,3 +1181,293 @@ TST_SetPerfState(PWR_Obj obj, PWR_PerfState state, int expected_retval)
 	check_int_equal(retval, expected_retval,
 			EC_APPOS_SET_PERF_STATE);
 }
+
+// powerapid started by start_powerapid(), if still running
+static pid_t sim_pid = -1;
+
+// private directory for its socket and working files, once made
+static gchar *sim_rundir = NULL;
+
+//
+// sim_tree_present - Determine if the simulated sysfs tree made by makesys
+// is in place, and this test may run a powerapid of its own against it.
+//
+// Argument(s):
+//
+//	void
+//
+// Return Code(s):
+//
+//	bool - true if the simulated tree can be tested
+//
+bool
+sim_tree_present(void)
+{
+	return geteuid() == 0 &&
+		access(SIM_ROOT SIM_RAPL_PATH, R_OK) == 0 &&
+		access(POWERAPID_BIN_PATH, X_OK) == 0;
+}
+
+//
+// powerapid_ready - Wait for powerapid to accept connections.
+//
+// Argument(s):
+//
+//	void
+//
+// Return Code(s):
+//
+//	bool - true if powerapid is accepting connections
+//
+static bool
+powerapid_ready(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int tries;
+
+	g_strlcpy(addr.sun_path, PWR_SOCKET_PATH, sizeof(addr.sun_path));
+
+	for (tries = 0; tries < SIM_START_TRIES; tries++) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		int status;
+
+		if (fd < 0) {
+			return false;
+		}
+
+		status = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+		close(fd);
+		if (status == 0) {
+			return true;
+		}
+
+		g_usleep(SIM_POLL_USEC);
+	}
+
+	return false;
+}
+
+//
+// restore_powerapid - At exit, stop any powerapid the test left running
+// and remove its private directory.
+//
+// Argument(s):
+//
+//	void
+//
+// Return Code(s):
+//
+//	void
+//
+static void
+restore_powerapid(void)
+{
+	gchar *cmd;
+
+	if (sim_pid > 0) {
+		kill(sim_pid, SIGTERM);
+		waitpid(sim_pid, NULL, 0);
+		sim_pid = -1;
+	}
+
+	cmd = g_strdup_printf("/bin/rm -rf '%s'", sim_rundir);
+	if (system(cmd) != 0) {
+		printf("Unable to remove %s\n", sim_rundir);
+	}
+	g_free(cmd);
+}
+
+//
+// make_rundir - Make a private directory for the socket and working files
+// of the test's powerapid, and point this process's library at it.  This
+// must happen before the first context is made, since the library only
+// looks at PWR_RUNDIR once.
+//
+// Argument(s):
+//
+//	void
+//
+// Return Code(s):
+//
+//	void
+//
+static void
+make_rundir(void)
+{
+	gchar *workdir;
+
+	sim_rundir = g_strdup(SIM_RUNDIR_TEMPLATE);
+	if (g_mkdtemp(sim_rundir) == NULL) {
+		printf("FAIL (unable to make %s)\n", SIM_RUNDIR_TEMPLATE);
+		exit(EC_POWERAPID_START);
+	}
+	atexit(restore_powerapid);
+
+	workdir = g_strconcat(sim_rundir, POWERAPID_WORKDIR_PATH +
+			strlen(POWERAPI_RUNDIR_PATH), NULL);
+	if (mkdir(workdir, 0755) != 0) {
+		printf("FAIL (unable to make %s)\n", workdir);
+		exit(EC_POWERAPID_START);
+	}
+	g_free(workdir);
+
+	setenv(PWR_RUNDIR_ENV, sim_rundir, 1);
+}
+
+//
+// start_powerapid - Start a powerapid in the foreground against the
+// simulated tree, on a socket and working directory of its own, so the
+// system's powerapid is left alone.  It is stopped when the test exits.
+//
+// Argument(s):
+//
+//	args - NULL terminated list of more arguments for powerapid
+//
+// Return Code(s):
+//
+//	pid_t - Process ID of the powerapid started
+//
+pid_t
+start_powerapid(const char *const args[])
+{
+	GPtrArray *argv = g_ptr_array_new();
+
+	if (sim_rundir == NULL) {
+		make_rundir();
+	}
+
+	g_ptr_array_add(argv, (gpointer)POWERAPID_BIN_PATH);
+	g_ptr_array_add(argv, (gpointer)"--nodaemon");
+	g_ptr_array_add(argv, (gpointer)"--sysfs-root");
+	g_ptr_array_add(argv, (gpointer)SIM_ROOT);
+	g_ptr_array_add(argv, (gpointer)"--rundir");
+	g_ptr_array_add(argv, sim_rundir);
+	for (; args && *args; args++) {
+		g_ptr_array_add(argv, (gpointer)*args);
+	}
+	g_ptr_array_add(argv, NULL);
+
+	printf("Start %s: ", POWERAPID_BIN_PATH);
+	fflush(stdout);
+
+	sim_pid = fork();
+	if (sim_pid == 0) {
+		execv(POWERAPID_BIN_PATH, (char **)argv->pdata);
+		_exit(127);
+	}
+	g_ptr_array_free(argv, TRUE);
+
+	if (sim_pid < 0 || !powerapid_ready()) {
+		printf("FAIL\n");
+		exit(EC_POWERAPID_START);
+	}
+
+	printf("PASS (pid %d)\n", sim_pid);
+
+	return sim_pid;
+}
+
+//
+// wait_powerapid - Wait for a powerapid that was signalled to hand over
+// to a new one to accept connections again.
+//
+// Argument(s):
+//
+//	void
+//
+// Return Code(s):
+//
+//	void
+//
+void
+wait_powerapid(void)
+{
+	printf("Wait for powerapid: ");
+
+	if (!powerapid_ready()) {
+		printf("FAIL\n");
+		exit(EC_POWERAPID_START);
+	}
+
+	printf("PASS\n");
+}
+
+//
+// stop_powerapid - Stop the powerapid from start_powerapid() with a signal.
+//
+// Argument(s):
+//
+//	pid - Process ID of the powerapid
+//	sig - SIGTERM to shut it down, or SIGKILL to leave its journal
+//	      to be recovered from
+//
+// Return Code(s):
+//
+//	void
+//
+void
+stop_powerapid(pid_t pid, int sig)
+{
+	printf("Stop powerapid (pid %d) with signal %d: ", pid, sig);
+
+	if (kill(pid, sig) != 0 || waitpid(pid, NULL, 0) != pid) {
+		printf("FAIL\n");
+		exit(EC_POWERAPID_STOP);
+	}
+	sim_pid = -1;
+
+	printf("PASS\n");
+}
+
+//
+// read_sim_uint64 - Read a value from a file of the simulated tree.
+//
+// Argument(s):
+//
+//	path - Path of the file
+//
+// Return Code(s):
+//
+//	uint64_t - Value read
+//
+uint64_t
+read_sim_uint64(const char *path)
+{
+	gchar *contents = NULL;
+	uint64_t value;
+
+	if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+		printf("FAIL (unable to read %s)\n", path);
+		exit(EC_SIM_FILE);
+	}
+
+	value = g_ascii_strtoull(contents, NULL, 10);
+	g_free(contents);
+
+	return value;
+}
+
+//
+// write_sim_string - Write a value to a file of the simulated tree, as the
+// kernel would update it.  The file is rewritten in place, since powerapid
+// may hold it open.
+//
+// Argument(s):
+//
+//	path - Path of the file
+//	value - Value to write
+//
+// Return Code(s):
+//
+//	void
+//
+void
+write_sim_string(const char *path, const char *value)
+{
+	FILE *fp = fopen(path, "w");
+
+	if (!fp || fputs(value, fp) == EOF || fclose(fp) != 0) {
+		printf("FAIL (unable to write %s)\n", path);
+		exit(EC_SIM_FILE);
+	}
+}
@@ -33,6 +33,10 @@
 #ifndef __TEST_LIB_COMMON_H
 #define __TEST_LIB_COMMON_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
 #include <cray-powerapi/api.h>
 
 /*
@@ -84,9 +88,24 @@
 #define EC_APPOS_RECOMMEND_SLEEP_STATE	52
 #define EC_APPOS_GET_PERF_STATE		53
 #define EC_APPOS_SET_PERF_STATE		54
+#define EC_POWERAPID_START		55
+#define EC_POWERAPID_STOP		56
+#define EC_SIM_FILE			57
 
 #define EC_TEST_UNIQUE_START		64	// unique exit codes start here
 
+/*
+ * Simulated sysfs tree made by makesys, which a test can run a powerapid of
+ * its own against.
+ */
+#define POWERAPID_BIN_PATH	"/opt/cray/powerapi/default/sbin/powerapid"
+#define SIM_ROOT		"/tmp"
+#define SIM_RAPL_PATH		"/sys/class/powercap/intel-rapl"
+#define SIM_PM_COUNTERS_PATH	"/sys/cray/pm_counters"
+#define SIM_RUNDIR_TEMPLATE	"/tmp/powerapid-test-XXXXXX"
+#define SIM_START_TRIES		100	// times to try connecting
+#define SIM_POLL_USEC		100000	// between tries, and file polls
+
 void check_int_equal(int value, int expected, int exit_code);
 void check_int_greater_than(int value, int target, int exit_code);
 void check_int_greater_than_equal(int value, int target, int exit_code);
@@ -167,4 +186,11 @@ void TST_RecommendSleepState(PWR_Obj obj, PWR_Time latency,
 void TST_GetPerfState(PWR_Obj obj, PWR_PerfState *state, int expected_retval);
 void TST_SetPerfState(PWR_Obj obj, PWR_PerfState state, int expected_retval);
 
+bool sim_tree_present(void);
+pid_t start_powerapid(const char *const args[]);
+void wait_powerapid(void);
+void stop_powerapid(pid_t pid, int sig);
+uint64_t read_sim_uint64(const char *path);
+void write_sim_string(const char *path, const char *value);
+
 #endif /* ifndef __TEST_LIB_COMMON_H */
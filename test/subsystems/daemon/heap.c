@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Check the priority heap that orders competing set requests, and the set
+ * table functions built on it, apart from the rest of the daemon.  The
+ * orders expected are worked out independently of attr_value_comp().
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <log.h>
+
+#include "powerapid.h"
+#include "pwrapi_set.h"
+#include "pwrapi_heap.h"
+#include "pwrapi_journal.h"
+
+#define NUM_SETS        257     // enough for several levels of heap
+#define NUM_SESSIONS    64
+#define NUM_PATHS       4
+#define ADVISORY_EVERY  8       // every so many sessions is advisory
+#define TEST_SEED       20180501
+
+// the set tables of the daemon, which pwrapi_set.c works on
+GHashTable *all_changes;
+GHashTable *advisory_changes;
+GMutex      changes_lock;
+
+static GRand *rand_gen;
+static guint  num_cleared = 0;
+
+// rollbacks journal the sets they clear, which is only counted here
+void
+journal_clear(const set_info_t *setp)
+{
+	num_cleared++;
+}
+
+static void
+check(gboolean ok, const char *what)
+{
+	if (!ok) {
+		printf("FAIL: %s\n", what);
+		exit(1);
+	}
+}
+
+static set_info_t *
+new_set(PWR_AttrName attr, PWR_AttrDataType data_type, uint64_t value,
+		uint64_t timestamp, socket_info_t *skinfo, const char *path)
+{
+	powerapi_setreq_t setreq = {
+		.object    = PWR_OBJ_HT,
+		.attribute = attr,
+		.data_type = data_type,
+		.metadata  = PWR_MD_NOT_SPECIFIED,
+	};
+	set_info_t *setp;
+
+	if (data_type == PWR_ATTR_DATA_DOUBLE) {
+		setreq.value.fvalue = value;
+	} else {
+		setreq.value.ivalue = value;
+	}
+	g_strlcpy(setreq.path, path, sizeof(setreq.path));
+
+	setp = set_create_item(&setreq, skinfo);
+	setp->timestamp = timestamp;
+
+	return setp;
+}
+
+static double
+set_value(const set_info_t *setp)
+{
+	if (setp->setreq.data_type == PWR_ATTR_DATA_DOUBLE) {
+		return setp->setreq.value.fvalue;
+	}
+	return setp->setreq.value.ivalue;
+}
+
+// every item knows its place, and no child outranks its parent
+static void
+check_heap(const set_heap_t *heap)
+{
+	guint i;
+
+	for (i = 0; i < heap->len; i++) {
+		check(heap->items[i]->heap_index == i, "heap index of item");
+		if (i > 0) {
+			check(attr_value_comp(heap->items[(i - 1) / 2],
+					heap->items[i]) <= 0, "heap order");
+		}
+	}
+}
+
+// the set of the live ones that ought to be on top
+static set_info_t *
+expected_top(GPtrArray *live)
+{
+	set_info_t *best = NULL;
+	guint i;
+
+	for (i = 0; i < live->len; i++) {
+		set_info_t *setp = g_ptr_array_index(live, i);
+		gboolean better;
+
+		if (best == NULL) {
+			better = TRUE;
+		} else if (setp->setreq.attribute == PWR_ATTR_GOV) {
+			// userspace first, then the newest request
+			uint64_t gov = setp->setreq.value.ivalue;
+			uint64_t best_gov = best->setreq.value.ivalue;
+
+			if (best_gov == PWR_GOV_LINUX_USERSPACE) {
+				better = FALSE;
+			} else if (gov == PWR_GOV_LINUX_USERSPACE) {
+				better = TRUE;
+			} else {
+				better = setp->timestamp > best->timestamp;
+			}
+		} else if (setp->setreq.attribute == PWR_ATTR_FREQ_LIMIT_MIN ||
+				setp->setreq.attribute ==
+				PWR_ATTR_POWER_LIMIT_MIN) {
+			better = set_value(setp) > set_value(best);
+		} else {
+			better = set_value(setp) < set_value(best);
+		}
+
+		if (better) {
+			best = setp;
+		}
+	}
+
+	return best;
+}
+
+// the top is the expected set, or one ranking the same
+static void
+check_top(const set_heap_t *heap, GPtrArray *live)
+{
+	set_info_t *top = set_heap_top(heap);
+	set_info_t *best = expected_top(live);
+
+	check(set_heap_length(heap) == live->len, "heap length");
+	if (best == NULL) {
+		check(top == NULL, "empty heap has no top");
+		return;
+	}
+	check(top != NULL, "heap has a top");
+	if (best->setreq.attribute == PWR_ATTR_GOV) {
+		check(top->setreq.value.ivalue == best->setreq.value.ivalue,
+				"governor on top");
+		if (best->setreq.value.ivalue != PWR_GOV_LINUX_USERSPACE) {
+			check(top == best, "newest governor on top");
+		}
+	} else {
+		check(set_value(top) == set_value(best), "value on top");
+	}
+}
+
+static uint64_t
+random_value(PWR_AttrName attr)
+{
+	// few enough values that there are ties
+	if (attr == PWR_ATTR_GOV) {
+		return g_rand_int_range(rand_gen, PWR_GOV_LINUX_ONDEMAND,
+				PWR_GOV_LINUX_USERSPACE + 1);
+	}
+	return g_rand_int_range(rand_gen, 0, 32);
+}
+
+//
+// test_heap - Insert many requests for an attribute, then remove them in
+// random order, mostly from the middle, checking the heap all the while.
+//
+static void
+test_heap(PWR_AttrName attr, PWR_AttrDataType data_type, const char *name)
+{
+	set_heap_t *heap = set_heap_new();
+	GPtrArray *live = g_ptr_array_new();
+	guint i;
+
+	printf("Heap of %s requests: ", name);
+
+	for (i = 0; i < NUM_SETS; i++) {
+		set_info_t *setp = new_set(attr, data_type, random_value(attr),
+				i + 1, NULL, "/heap");
+
+		set_heap_insert(heap, setp);
+		g_ptr_array_add(live, setp);
+		check_heap(heap);
+		check_top(heap, live);
+	}
+
+	// the top, the last item, then the rest in random order
+	while (live->len > 0) {
+		set_info_t *setp;
+		guint index;
+
+		if (live->len == NUM_SETS) {
+			setp = set_heap_top(heap);
+		} else if (live->len == NUM_SETS - 1) {
+			setp = heap->items[heap->len - 1];
+		} else {
+			setp = g_ptr_array_index(live,
+				g_rand_int_range(rand_gen, 0, live->len));
+		}
+
+		set_heap_remove(heap, setp);
+		for (index = 0; g_ptr_array_index(live, index) != setp; index++)
+			;
+		g_ptr_array_remove_index_fast(live, index);
+		set_destroy(setp);
+		check_heap(heap);
+		check_top(heap, live);
+	}
+
+	g_ptr_array_free(live, TRUE);
+	set_heap_free(heap);
+
+	printf("PASS\n");
+}
+
+//
+// test_governor - The userspace governor outranks the rest, which rank
+// by when they were requested.
+//
+static void
+test_governor(void)
+{
+	set_heap_t *heap = set_heap_new();
+	set_info_t *perf = new_set(PWR_ATTR_GOV, PWR_ATTR_DATA_UINT64,
+			PWR_GOV_LINUX_PERFORMANCE, 1, NULL, "/gov");
+	set_info_t *save = new_set(PWR_ATTR_GOV, PWR_ATTR_DATA_UINT64,
+			PWR_GOV_LINUX_POWERSAVE, 2, NULL, "/gov");
+	set_info_t *user = new_set(PWR_ATTR_GOV, PWR_ATTR_DATA_UINT64,
+			PWR_GOV_LINUX_USERSPACE, 0, NULL, "/gov");
+	set_info_t *demand = new_set(PWR_ATTR_GOV, PWR_ATTR_DATA_UINT64,
+			PWR_GOV_LINUX_ONDEMAND, 3, NULL, "/gov");
+
+	printf("Governor requests: ");
+
+	set_heap_insert(heap, perf);
+	set_heap_insert(heap, save);
+	check(set_heap_top(heap) == save, "newer governor wins");
+
+	set_heap_insert(heap, user);
+	check(set_heap_top(heap) == user, "older userspace governor wins");
+
+	set_heap_insert(heap, demand);
+	check(set_heap_top(heap) == user, "userspace governor still wins");
+
+	set_heap_remove(heap, user);
+	check(set_heap_top(heap) == demand, "newest governor wins");
+
+	set_heap_remove(heap, save);
+	check(set_heap_top(heap) == demand, "removal below the top");
+
+	set_heap_remove(heap, demand);
+	check(set_heap_top(heap) == perf, "last governor left");
+
+	set_heap_remove(heap, perf);
+	check(set_heap_top(heap) == NULL, "no governor left");
+
+	set_destroy(perf);
+	set_destroy(save);
+	set_destroy(user);
+	set_destroy(demand);
+	set_heap_free(heap);
+
+	printf("PASS\n");
+}
+
+// what set_top() ought to give for a path: the top of the client and
+// default sets, unless that's a default and there's an advisory set
+static set_info_t *
+expected_set_top(GPtrArray *live, set_info_t *advisory)
+{
+	set_info_t *top = expected_top(live);
+
+	if ((top == NULL || top->skinfo == NULL) && advisory) {
+		top = advisory;
+	}
+
+	return top;
+}
+
+static void
+check_set_tops(GPtrArray **live, set_info_t **advisory)
+{
+	guint p;
+
+	for (p = 0; p < NUM_PATHS; p++) {
+		char path[16];
+		set_info_t *top;
+		set_info_t *best;
+
+		snprintf(path, sizeof(path), "/path%u", p);
+		top = set_top(path);
+		best = expected_set_top(live[p], advisory[p]);
+
+		if (best == NULL || best == advisory[p]) {
+			check(top == best, "set_top() of advisory or none");
+		} else {
+			check(top != NULL && top != advisory[p] &&
+					(top->skinfo == NULL) ==
+					(best->skinfo == NULL) &&
+					set_value(top) == set_value(best),
+					"set_top() of client or default");
+		}
+	}
+}
+
+//
+// test_sessions - Many sessions, some of them advisory, set every path,
+// over a default held on each, then are rolled back in random order.
+//
+static void
+test_sessions(void)
+{
+	socket_info_t *sessions[NUM_SESSIONS];
+	GPtrArray *live[NUM_PATHS];
+	set_info_t *advisory[NUM_PATHS] = { NULL };
+	set_info_t *defaults[NUM_PATHS];
+	guint num_sets = 0;
+	guint i, p;
+
+	printf("Competing sessions: ");
+
+	all_changes = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, set_heap_free);
+	advisory_changes = g_hash_table_new(g_str_hash, g_str_equal);
+
+	// defaults rank in the middle, and never tie with a client's set
+	for (p = 0; p < NUM_PATHS; p++) {
+		char path[16];
+
+		snprintf(path, sizeof(path), "/path%u", p);
+		live[p] = g_ptr_array_new();
+		defaults[p] = new_set(PWR_ATTR_FREQ_LIMIT_MAX,
+				PWR_ATTR_DATA_UINT64, 32, 0, NULL, path);
+		set_insert(defaults[p], NULL);
+		g_ptr_array_add(live[p], defaults[p]);
+	}
+	check_set_tops(live, advisory);
+
+	for (i = 0; i < NUM_SESSIONS; i++) {
+		socket_info_t *skinfo = g_new0(socket_info_t, 1);
+
+		skinfo->sockid = i;
+		skinfo->advisory = (i % ADVISORY_EVERY) == 0;
+		skinfo->my_changes = g_hash_table_new(g_str_hash, g_str_equal);
+		sessions[i] = skinfo;
+
+		for (p = 0; p < NUM_PATHS; p++) {
+			char path[16];
+			uint64_t value;
+			set_info_t *setp;
+
+			snprintf(path, sizeof(path), "/path%u", p);
+			value = 2 * g_rand_int_range(rand_gen, 0, 32) + 1;
+			setp = new_set(PWR_ATTR_FREQ_LIMIT_MAX,
+					PWR_ATTR_DATA_UINT64, value, i + 1,
+					skinfo, path);
+			set_insert(setp, skinfo->my_changes);
+			if (skinfo->advisory) {
+				advisory[p] = setp;
+			} else {
+				g_ptr_array_add(live[p], setp);
+			}
+			num_sets++;
+		}
+		check_set_tops(live, advisory);
+	}
+
+	// roll back the sessions in random order
+	for (i = NUM_SESSIONS; i > 0; i--) {
+		guint pick = g_rand_int_range(rand_gen, 0, i);
+		socket_info_t *skinfo = sessions[pick];
+
+		sessions[pick] = sessions[i - 1];
+
+		for (p = 0; p < NUM_PATHS; p++) {
+			char path[16];
+			set_info_t *setp;
+
+			snprintf(path, sizeof(path), "/path%u", p);
+			setp = g_hash_table_lookup(skinfo->my_changes, path);
+			check(setp != NULL, "session holds its set");
+
+			if (advisory[p] == setp) {
+				advisory[p] = NULL;
+			}
+			g_ptr_array_remove_fast(live[p], setp);
+			set_rollback(setp);
+		}
+		check(g_hash_table_size(skinfo->my_changes) == 0,
+				"session sets all rolled back");
+		check_set_tops(live, advisory);
+
+		g_hash_table_destroy(skinfo->my_changes);
+		g_free(skinfo);
+	}
+	check(num_cleared == num_sets, "every rollback journaled");
+
+	// earlier advisory sets were replaced, so none is left to step in
+	for (p = 0; p < NUM_PATHS; p++) {
+		check(set_top(defaults[p]->setreq.path) == defaults[p],
+				"default left on top");
+		set_remove(defaults[p], NULL);
+		check(set_top(defaults[p]->setreq.path) == NULL,
+				"nothing left");
+		set_destroy(defaults[p]);
+		g_ptr_array_free(live[p], TRUE);
+	}
+
+	g_hash_table_destroy(advisory_changes);
+	g_hash_table_destroy(all_changes);
+
+	printf("PASS\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	rand_gen = g_rand_new_with_seed(TEST_SEED);
+
+	test_heap(PWR_ATTR_FREQ_LIMIT_MAX, PWR_ATTR_DATA_UINT64,
+			"PWR_ATTR_FREQ_LIMIT_MAX");
+	test_heap(PWR_ATTR_FREQ_LIMIT_MIN, PWR_ATTR_DATA_DOUBLE,
+			"PWR_ATTR_FREQ_LIMIT_MIN");
+	test_heap(PWR_ATTR_POWER_LIMIT_MAX, PWR_ATTR_DATA_DOUBLE,
+			"PWR_ATTR_POWER_LIMIT_MAX");
+	test_heap(PWR_ATTR_GOV, PWR_ATTR_DATA_UINT64, "PWR_ATTR_GOV");
+	test_governor();
+	test_sessions();
+
+	g_rand_free(rand_gen);
+
+	return 0;
+}
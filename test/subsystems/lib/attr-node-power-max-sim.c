@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Verify that powerapid's power cap controller holds the node to a budget
+ * in the simulated tree made by makesys.  Node power is faked by writing
+ * pm_counters/power: above the budget, every RAPL limit must fall to its
+ * minimum; below it, every limit must rise to its maximum; and removing
+ * the budget must put the limits back as they were.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/api.h>
+
+#include "../common/common.h"
+
+#define EC_NODE_POWER_MAX_SET		64
+#define EC_NODE_POWER_LIMIT		65
+
+#define CONTEXT_NAME	"test_node_power_max_sim"
+#define MAX_DOMAINS	64
+#define SETTLE_USEC	(10 * G_USEC_PER_SEC)	// for the limits to settle
+#define MIN_FRACTION	0.25		// lowest limit, as part of the max
+#define DEADBAND	1000000		// uW a limit may be left short by
+
+#define NODE_POWER_PATH	SIM_ROOT SIM_PM_COUNTERS_PATH "/power"
+
+typedef enum {
+	LIMIT_MIN,
+	LIMIT_MAX,
+	LIMIT_INITIAL
+} limit_t;
+
+// A RAPL domain of the simulated tree.  Limits are in uW.
+typedef struct {
+	char     *limit_path;
+	uint64_t  initial;
+	uint64_t  min;
+	uint64_t  max;
+} domain_t;
+
+static domain_t domains[MAX_DOMAINS];
+static int num_domains = 0;
+
+static void
+add_domain(const char *dir)
+{
+	domain_t *domain = &domains[num_domains++];
+	char *max_path = g_build_filename(dir, "constraint_0_max_power_uw",
+			NULL);
+
+	domain->limit_path = g_build_filename(dir,
+			"constraint_0_power_limit_uw", NULL);
+	domain->initial = read_sim_uint64(domain->limit_path);
+	domain->max = read_sim_uint64(max_path);
+	domain->min = domain->max * MIN_FRACTION;
+
+	g_free(max_path);
+}
+
+// Find the package domain of each socket and the DRAM domain under it.
+static void
+find_domains(void)
+{
+	int sock;
+
+	for (sock = 0; num_domains + 2 <= MAX_DOMAINS; sock++) {
+		char *dir = g_strdup_printf(SIM_ROOT SIM_RAPL_PATH
+				"/intel-rapl:%d", sock);
+		char *sub = g_strdup_printf("%s/intel-rapl:%d:0", dir, sock);
+		gboolean found = g_file_test(dir, G_FILE_TEST_IS_DIR);
+
+		if (found) {
+			add_domain(dir);
+			add_domain(sub);
+		}
+
+		g_free(sub);
+		g_free(dir);
+
+		if (!found) {
+			break;
+		}
+	}
+}
+
+static uint64_t
+domain_target(const domain_t *domain, limit_t which)
+{
+	switch (which) {
+	case LIMIT_MIN:
+		return domain->min;
+	case LIMIT_MAX:
+		return domain->max;
+	default:
+		return domain->initial;
+	}
+}
+
+static gboolean
+domain_settled(const domain_t *domain, limit_t which, uint64_t tolerance,
+		uint64_t *limit)
+{
+	uint64_t target = domain_target(domain, which);
+
+	*limit = read_sim_uint64(domain->limit_path);
+
+	return *limit <= target + tolerance && *limit + tolerance >= target;
+}
+
+//
+// check_limits - Wait for the controller to settle every domain's limit
+// within tolerance of its minimum, maximum or initial value, then verify
+// that it did.
+//
+static void
+check_limits(limit_t which, uint64_t tolerance)
+{
+	gint64 deadline = g_get_monotonic_time() + SETTLE_USEC;
+	uint64_t limit;
+	int idx;
+
+	for (idx = 0; idx < num_domains; idx++) {
+		while (!domain_settled(&domains[idx], which, tolerance, &limit)
+				&& g_get_monotonic_time() < deadline) {
+			g_usleep(SIM_POLL_USEC);
+		}
+	}
+
+	for (idx = 0; idx < num_domains; idx++) {
+		domain_t *domain = &domains[idx];
+		gboolean settled = domain_settled(domain, which, tolerance,
+				&limit);
+
+		printf("Verify %s (%lu) is within %lu of %lu: ",
+				domain->limit_path, limit, tolerance,
+				domain_target(domain, which));
+		if (!settled) {
+			printf("FAIL\n");
+			exit(EC_NODE_POWER_LIMIT);
+		}
+		printf("PASS\n");
+	}
+}
+
+static void
+set_budget(PWR_Obj node, double budget)
+{
+	PWR_Time tspec;
+	double power_max;
+
+	TST_ObjAttrSetValue(node, PWR_ATTR_POWER_LIMIT_MAX, &budget,
+			PWR_RET_SUCCESS);
+
+	TST_ObjAttrGetValue(node, PWR_ATTR_POWER_LIMIT_MAX, &power_max,
+			&tspec, PWR_RET_SUCCESS);
+	if (budget > 0.0) {
+		printf("Verify node power max (%lf) is the budget (%lf): ",
+				power_max, budget);
+		check_double_equal(power_max, budget, EC_NODE_POWER_MAX_SET);
+	}
+}
+
+//
+// main - Main entry point.
+//
+// Argument(s):
+//
+//	argc - Number of arguments
+//	argv - Arguments
+//
+// Return Code(s):
+//
+//	int - Zero for success, non-zero for failure
+//
+int
+main(int argc, char **argv)
+{
+	const char *const args[] = { "--powercap", "pi", NULL };
+	PWR_Cntxt context;
+	PWR_Obj node;
+	pid_t pid;
+
+	if (!sim_tree_present()) {
+		printf("SKIP attr-node-power-max-sim: simulated tree and root "
+				"permissions required for test\n");
+		exit(EC_SUCCESS);
+	}
+
+	find_domains();
+
+	pid = start_powerapid(args);
+
+	TST_CntxtInit(PWR_CNTXT_DEFAULT, PWR_ROLE_APP, CONTEXT_NAME, &context,
+			PWR_RET_SUCCESS);
+
+	TST_CntxtGetEntryPoint(context, &node, PWR_RET_SUCCESS);
+
+	// Over budget, the controller cuts every domain to its minimum.
+	write_sim_string(NODE_POWER_PATH, "300 W\n");
+	set_budget(node, 200.0);
+	check_limits(LIMIT_MIN, 0);
+
+	// Under budget, it raises every domain to its maximum, a little at
+	// a time, and leaves a limit be when it's within the deadband.
+	write_sim_string(NODE_POWER_PATH, "100 W\n");
+	check_limits(LIMIT_MAX, DEADBAND);
+
+	// A budget of 0 removes it, and the limits are rolled back.
+	set_budget(node, 0.0);
+	check_limits(LIMIT_INITIAL, 0);
+
+	TST_CntxtDestroy(context, PWR_RET_SUCCESS);
+
+	stop_powerapid(pid, SIGTERM);
+
+	write_sim_string(NODE_POWER_PATH, "43 W\n");
+
+	exit(EC_SUCCESS);
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Verify that powerapid holds the node to a power cap set on the node
+ * object by adjusting the socket and memory power limits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/api.h>
+
+#include "../common/common.h"
+
+#define EC_NODE_POWER_MAX_NO_MEMORY	64
+#define EC_NODE_POWER_MAX_NO_THREAD	65
+#define EC_NODE_POWER_MAX_SET		66
+#define EC_NODE_POWER_USE		67
+
+#define NUM_VAR (4 * 1024 * 1024)
+
+static volatile gint thread_run = 0;
+static volatile gint zero = 0;
+static volatile gint *var_array;
+
+static gpointer
+worker_thread(gpointer arg)
+{
+	int *run = arg;
+	int idx;
+
+	g_atomic_int_add(&thread_run, 1);
+
+	while (*run) {
+		for (idx = 0; idx < NUM_VAR; idx++) {
+			g_atomic_int_add(var_array + idx, 1);
+		}
+		g_thread_yield();
+		for (idx = 0; idx < NUM_VAR; idx++) {
+			if (g_atomic_int_dec_and_test(var_array + idx)) {
+				g_atomic_int_add(&zero, 1);
+			}
+		}
+		g_thread_yield();
+	}
+
+	g_atomic_int_add(&thread_run, -1);
+
+	return NULL;
+}
+
+//
+// main - Main entry point.
+//
+// Argument(s):
+//
+//	argc - Number of arguments
+//	argv - Arguments
+//
+// Return Code(s):
+//
+//	int - Zero for success, non-zero for failure
+//
+int
+main(int argc, char **argv)
+{
+	PWR_Cntxt context;
+	PWR_Obj node;
+	PWR_Time tspec;
+	GThread **thread_array;
+	int num_thread = g_get_num_processors() * 5 / 2;
+	double power_max_ini;
+	double power_max_set;
+	double power_max_none = 0.0;
+	double power_use_ini;
+	double power_use;
+	double power_max;
+	int run;
+	int idx;
+
+	TST_CntxtInit(PWR_CNTXT_DEFAULT, PWR_ROLE_APP, "test_role", &context,
+			PWR_RET_SUCCESS);
+
+	TST_CntxtGetEntryPoint(context, &node, PWR_RET_SUCCESS);
+
+	TST_ObjAttrGetValue(node, PWR_ATTR_POWER_LIMIT_MAX,
+			&power_max_ini, &tspec, PWR_RET_SUCCESS);
+
+	TST_ObjAttrGetValue(node, PWR_ATTR_POWER,
+			&power_use_ini, &tspec, PWR_RET_SUCCESS);
+
+	printf("Allocate memory: ");
+	thread_array = g_new0(GThread *, num_thread);
+	var_array = g_new0(gint, NUM_VAR);
+	if (!thread_array || !var_array) {
+		printf("FAIL\n");
+		exit(EC_NODE_POWER_MAX_NO_MEMORY);
+	}
+	printf("PASS\n");
+
+	printf("Start %d worker threads: ", num_thread);
+	run = 1;
+	for (idx = 0; idx < num_thread; idx++) {
+		thread_array[idx] = g_thread_new("worker", worker_thread, &run);
+		if (!thread_array[idx]) {
+			printf("FAIL\n");
+			exit(EC_NODE_POWER_MAX_NO_THREAD);
+		}
+	}
+	printf("PASS\n");
+
+	// wait for threads to start
+	while (g_atomic_int_get(&thread_run) < num_thread) {
+		g_thread_yield();
+	}
+
+	sleep(15); // give threads time to crank up power use
+
+	TST_ObjAttrGetValue(node, PWR_ATTR_POWER,
+			&power_use, &tspec, PWR_RET_SUCCESS);
+	printf("Verify node power use (%lf) is more than initial (%lf): ",
+			power_use, power_use_ini);
+	check_double_greater_than(power_use, power_use_ini, EC_NODE_POWER_USE);
+
+	// limit power use to 90% of what is being used right now, which
+	// leaves room above what the memory and the rest of the node need
+	power_max_set = power_use * 0.9;
+
+	TST_ObjAttrSetValue(node, PWR_ATTR_POWER_LIMIT_MAX,
+			&power_max_set, PWR_RET_SUCCESS);
+
+	TST_ObjAttrGetValue(node, PWR_ATTR_POWER_LIMIT_MAX,
+			&power_max, &tspec, PWR_RET_SUCCESS);
+	printf("Verify node power max (%lf) is what was set (%lf): ",
+			power_max, power_max_set);
+	check_double_equal(power_max, power_max_set, EC_NODE_POWER_MAX_SET);
+
+	sleep(15); // give the daemon time to settle on the cap
+
+	TST_ObjAttrGetValue(node, PWR_ATTR_POWER,
+			&power_use, &tspec, PWR_RET_SUCCESS);
+
+	// allow power use to be up to 105% of max
+	power_max = power_max_set * 1.05;
+	printf("Verify node power use (%lf) is less than max (%lf): ",
+			power_use, power_max);
+	check_double_greater_than(power_max, power_use, EC_NODE_POWER_USE);
+
+	// wait for threads to stop
+	run = 0;
+	while (g_atomic_int_get(&thread_run) > 0) {
+		g_thread_yield();
+	}
+
+	// a cap of 0 removes the budget
+	TST_ObjAttrSetValue(node, PWR_ATTR_POWER_LIMIT_MAX,
+			&power_max_none, PWR_RET_SUCCESS);
+
+	TST_ObjAttrGetValue(node, PWR_ATTR_POWER_LIMIT_MAX,
+			&power_max, &tspec, PWR_RET_SUCCESS);
+	printf("Verify node power max (%lf) is back to initial (%lf): ",
+			power_max, power_max_ini);
+	check_double_equal(power_max, power_max_ini, EC_NODE_POWER_MAX_SET);
+
+	g_free(thread_array);
+	g_free((gpointer)var_array);
+
+	TST_CntxtDestroy(context, PWR_RET_SUCCESS);
+
+	exit(EC_SUCCESS);
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Benchmark group reads of hyperthread and socket attributes with the read
+ * sets of the file layer off, batched with pread, and batched with io_uring,
+ * and then with the read prepared by CRAYPWR_GrpPrepareRead().  Run it
+ * against a simulated sysfs tree (see makesys) to compare the modes without
+ * the noise of real hardware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include <cray-powerapi/api.h>
+
+#include "../common/common.h"
+
+#define EC_GRP_ATTR_GET_VALUE		64
+#define EC_GRP_PREPARE_READ		65
+
+#define BENCH_ITERATIONS	200
+
+typedef struct {
+	const char	*name;		// what is read
+	PWR_ObjType	type;		// objects in the group
+	PWR_AttrName	attr;		// attribute read
+} bench_read_t;
+
+static const bench_read_t bench_reads[] = {
+	{ "ht freq",		PWR_OBJ_HT,	PWR_ATTR_FREQ },
+	{ "ht cstate limit",	PWR_OBJ_HT,	PWR_ATTR_CSTATE_LIMIT },
+	{ "socket temp",	PWR_OBJ_SOCKET,	PWR_ATTR_TEMP },
+};
+
+// PWR_READ_BATCH settings to compare; NULL is the default, io_uring
+static const char *bench_modes[] = { "off", "pread", NULL };
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+//
+// bench_group - Time group reads of an attribute in one batching mode.
+//
+// Argument(s):
+//
+//	group - Group of objects to read
+//	attr - Attribute to read
+//	values - Storage for a value per object
+//	ts - Storage for a timestamp per object
+//
+// Return Code(s):
+//
+//	double - Microseconds per group read
+//
+static double
+bench_group(PWR_Grp group, PWR_AttrName attr, uint64_t *values, PWR_Time *ts)
+{
+	double start = 0.0;
+	int retval;
+	int i;
+
+	// The first read teaches the read set the group's files.
+	for (i = -1; i < BENCH_ITERATIONS; i++) {
+		if (i == 0) {
+			start = bench_now();
+		}
+
+		retval = PWR_GrpAttrGetValue(group, attr, values, ts, NULL);
+		if (retval != PWR_RET_SUCCESS) {
+			printf("PWR_GrpAttrGetValue returned %d\n", retval);
+			exit(EC_GRP_ATTR_GET_VALUE);
+		}
+	}
+
+	return (bench_now() - start) * 1.0e6 / BENCH_ITERATIONS;
+}
+
+//
+// main - Main entry point.
+//
+// Argument(s):
+//
+//	argc - Number of arguments
+//	argv - Arguments
+//
+// Return Code(s):
+//
+//	int - Zero for success, non-zero for failure
+//
+int
+main(int argc, char **argv)
+{
+	PWR_Cntxt context;
+	PWR_Obj entry_point;
+	PWR_Grp group;
+	unsigned int num_objs;
+	uint64_t *values;
+	PWR_Time *ts;
+	int i, j;
+
+	TST_CntxtInit(PWR_CNTXT_DEFAULT, PWR_ROLE_APP, "test_role", &context,
+			PWR_RET_SUCCESS);
+
+	TST_CntxtGetEntryPoint(context, &entry_point, PWR_RET_SUCCESS);
+
+	for (i = 0; i < G_N_ELEMENTS(bench_reads); i++) {
+		TST_GrpCreate(context, &group, PWR_RET_SUCCESS);
+		find_objects_of_type(entry_point, bench_reads[i].type, group);
+		TST_GrpGetNumObjs(group, &num_objs, PWR_RET_SUCCESS);
+
+		values = g_new0(uint64_t, num_objs);
+		ts = g_new0(PWR_Time, num_objs);
+
+		printf("%s, %u objects:", bench_reads[i].name, num_objs);
+		for (j = 0; j < G_N_ELEMENTS(bench_modes); j++) {
+			if (bench_modes[j]) {
+				setenv("PWR_READ_BATCH", bench_modes[j], 1);
+			} else {
+				unsetenv("PWR_READ_BATCH");
+			}
+
+			printf(" %s %.1f us", bench_modes[j] ? bench_modes[j] : "io_uring",
+					bench_group(group, bench_reads[i].attr,
+						values, ts));
+		}
+
+		if (CRAYPWR_GrpPrepareRead(group, bench_reads[i].attr)
+				!= PWR_RET_SUCCESS) {
+			printf("CRAYPWR_GrpPrepareRead failed\n");
+			exit(EC_GRP_PREPARE_READ);
+		}
+		printf(" prepared %.1f us",
+				bench_group(group, bench_reads[i].attr,
+					values, ts));
+		printf("\n");
+
+		g_free(values);
+		g_free(ts);
+		TST_GrpDestroy(group, PWR_RET_SUCCESS);
+	}
+
+	TST_CntxtDestroy(context, PWR_RET_SUCCESS);
+
+	exit(EC_SUCCESS);
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Verify that the values set through powerapid survive it being killed
+ * and restarted, and it handing over to a new powerapid on SIGUSR2, in
+ * the simulated tree made by makesys.  The new powerapid must recover the
+ * sets from its journal without writing the files, rolling anything back
+ * or changing any range, and the context must reclaim its session, so
+ * that destroying the context still rolls its sets back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <cray-powerapi/api.h>
+
+#include "../common/common.h"
+
+#define EC_RESTART_VALUE		64
+#define EC_RESTART_WRITTEN		65
+#define EC_RESTART_ROLLBACK		66
+
+#define CONTEXT_NAME	"test_daemon_restart_sim"
+#define QUIET_USEC	(2 * G_USEC_PER_SEC)	// for stray writes to show
+#define SETTLE_USEC	(10 * G_USEC_PER_SEC)	// for the rollback
+#define SOCKET_LIMIT	100.0			// W
+
+#define SIM_CPU_PATH	SIM_ROOT "/sys/devices/system/cpu"
+
+// A file of the simulated tree: the value it held before the test, and
+// the value and modification time it had once the test set it.
+typedef struct {
+	char            *path;
+	uint64_t         initial;
+	uint64_t         value;
+	struct timespec  mtime;
+} sim_file_t;
+
+enum {
+	FILE_POWER_LIMIT,
+	FILE_FREQ_MAX,
+	FILE_FREQ_MIN,
+	NUM_FILES
+};
+
+static sim_file_t files[NUM_FILES];
+
+static struct timespec
+file_mtime(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		printf("FAIL (unable to stat %s)\n", path);
+		exit(EC_SIM_FILE);
+	}
+
+	return st.st_mtim;
+}
+
+static void
+add_file(int idx, char *path)
+{
+	files[idx].path = path;
+	files[idx].initial = read_sim_uint64(path);
+}
+
+static void
+record_files(void)
+{
+	int idx;
+
+	for (idx = 0; idx < NUM_FILES; idx++) {
+		files[idx].value = read_sim_uint64(files[idx].path);
+		files[idx].mtime = file_mtime(files[idx].path);
+	}
+}
+
+//
+// check_files - Give a new powerapid time to do any writes it shouldn't,
+// then verify that every file holds the value it had before the restart,
+// and wasn't written since.
+//
+static void
+check_files(const char *when)
+{
+	int idx;
+
+	g_usleep(QUIET_USEC);
+
+	for (idx = 0; idx < NUM_FILES; idx++) {
+		sim_file_t *file = &files[idx];
+		uint64_t value = read_sim_uint64(file->path);
+		struct timespec mtime = file_mtime(file->path);
+
+		printf("Verify %s (%lu) is unchanged %s: ", file->path, value,
+				when);
+		if (value != file->value) {
+			printf("FAIL (was %lu)\n", file->value);
+			exit(EC_RESTART_VALUE);
+		}
+		if (mtime.tv_sec != file->mtime.tv_sec ||
+				mtime.tv_nsec != file->mtime.tv_nsec) {
+			printf("FAIL (written)\n");
+			exit(EC_RESTART_WRITTEN);
+		}
+		printf("PASS\n");
+	}
+}
+
+//
+// check_rollback - Wait for every file to be rolled back to the value it
+// held before the test, then verify that it was.
+//
+static void
+check_rollback(void)
+{
+	gint64 deadline = g_get_monotonic_time() + SETTLE_USEC;
+	int idx;
+
+	for (idx = 0; idx < NUM_FILES; idx++) {
+		while (read_sim_uint64(files[idx].path) != files[idx].initial
+				&& g_get_monotonic_time() < deadline) {
+			g_usleep(SIM_POLL_USEC);
+		}
+	}
+
+	for (idx = 0; idx < NUM_FILES; idx++) {
+		sim_file_t *file = &files[idx];
+		uint64_t value = read_sim_uint64(file->path);
+
+		printf("Verify %s (%lu) is rolled back to %lu: ", file->path,
+				value, file->initial);
+		if (value != file->initial) {
+			printf("FAIL\n");
+			exit(EC_RESTART_ROLLBACK);
+		}
+		printf("PASS\n");
+	}
+}
+
+//
+// set_values - Set the socket's power limit and the HT's frequency limit,
+// which reconnects to a new powerapid and reclaims the session.
+//
+static void
+set_values(PWR_Obj socket, PWR_Obj ht, double freq)
+{
+	double power = SOCKET_LIMIT;
+	double value;
+	PWR_Time tspec;
+
+	TST_ObjAttrSetValue(socket, PWR_ATTR_POWER_LIMIT_MAX, &power,
+			PWR_RET_SUCCESS);
+	TST_ObjAttrSetValue(ht, PWR_ATTR_FREQ_LIMIT_MAX, &freq,
+			PWR_RET_SUCCESS);
+
+	TST_ObjAttrGetValue(socket, PWR_ATTR_POWER_LIMIT_MAX, &value, &tspec,
+			PWR_RET_SUCCESS);
+	printf("Verify socket power limit max is set: ");
+	check_double_equal(value, power, EC_RESTART_VALUE);
+
+	TST_ObjAttrGetValue(ht, PWR_ATTR_FREQ_LIMIT_MAX, &value, &tspec,
+			PWR_RET_SUCCESS);
+	printf("Verify HT freq limit max is set: ");
+	check_double_equal(value, freq, EC_RESTART_VALUE);
+}
+
+//
+// main - Main entry point.
+//
+// Argument(s):
+//
+//	argc - Number of arguments
+//	argv - Arguments
+//
+// Return Code(s):
+//
+//	int - Zero for success, non-zero for failure
+//
+int
+main(int argc, char **argv)
+{
+	const char *const args[] = { "--powercap", "none", NULL };
+	PWR_Cntxt context;
+	PWR_Obj entry_point;
+	PWR_Obj socket;
+	PWR_Obj ht;
+	uint64_t socket_id;
+	uint64_t ht_id;
+	double freq_min;
+	PWR_Time tspec;
+	pid_t pid;
+
+	if (!sim_tree_present()) {
+		printf("SKIP daemon-restart-sim: simulated tree and root "
+				"permissions required for test\n");
+		exit(EC_SUCCESS);
+	}
+
+	pid = start_powerapid(args);
+
+	TST_CntxtInit(PWR_CNTXT_DEFAULT, PWR_ROLE_APP, CONTEXT_NAME, &context,
+			PWR_RET_SUCCESS);
+
+	TST_CntxtGetEntryPoint(context, &entry_point, PWR_RET_SUCCESS);
+
+	get_socket_obj(context, entry_point, &socket);
+	get_ht_obj(context, entry_point, &ht);
+
+	TST_ObjAttrGetValue(socket, PWR_ATTR_OS_ID, &socket_id, &tspec,
+			PWR_RET_SUCCESS);
+	TST_ObjAttrGetValue(ht, PWR_ATTR_OS_ID, &ht_id, &tspec,
+			PWR_RET_SUCCESS);
+	TST_ObjAttrGetValue(ht, PWR_ATTR_FREQ_LIMIT_MIN, &freq_min, &tspec,
+			PWR_RET_SUCCESS);
+
+	add_file(FILE_POWER_LIMIT, g_strdup_printf(SIM_ROOT SIM_RAPL_PATH
+			"/intel-rapl:%lu/constraint_0_power_limit_uw",
+			socket_id));
+	add_file(FILE_FREQ_MAX, g_strdup_printf(SIM_CPU_PATH
+			"/cpu%lu/cpufreq/scaling_max_freq", ht_id));
+	add_file(FILE_FREQ_MIN, g_strdup_printf(SIM_CPU_PATH
+			"/cpu%lu/cpufreq/scaling_min_freq", ht_id));
+
+	set_values(socket, ht, freq_min);
+	record_files();
+
+	// A killed powerapid leaves its journal for the next to recover
+	// from, which must hold the values without writing them again.
+	stop_powerapid(pid, SIGKILL);
+	pid = start_powerapid(args);
+	check_files("after a restart");
+
+	set_values(socket, ht, freq_min);
+	record_files();
+
+	// On SIGUSR2 powerapid hands over to a new one in the same process.
+	kill(pid, SIGUSR2);
+	wait_powerapid();
+	check_files("after a handover");
+
+	set_values(socket, ht, freq_min);
+	record_files();
+
+	// The session was reclaimed, so its sets are rolled back now, not
+	// when an orphan would time out.
+	TST_CntxtDestroy(context, PWR_RET_SUCCESS);
+	check_rollback();
+
+	stop_powerapid(pid, SIGTERM);
+
+	exit(EC_SUCCESS);
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2018, Cray Inc.
+ *  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Stress test of the library's thread-safe mode.  Several threads share one
+ * context, reading attributes, groups and snapshots through it, directly and
+ * with asynchronous requests, while they create and destroy groups,
+ * statistics and hints in it, and now and then contexts of their own.  Run it against a simulated sysfs tree (see
+ * makesys), and build with --enable-thread-sanitizer to have data races
+ * reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <cray-powerapi/api.h>
+
+#include "../common/common.h"
+
+#define EC_THREAD_CALL			64
+#define EC_THREAD_CREATE		65
+
+#define STRESS_THREADS		8
+#define STRESS_ITERATIONS	200
+#define STRESS_CNTXT_EVERY	25	// iterations between private contexts
+
+#define SNAPSHOT_LEN		1024
+
+typedef struct {
+	int		id;		// thread number
+	PWR_Cntxt	context;	// shared context
+	PWR_Grp		hts;		// shared group of every hyperthread
+	PWR_Obj		ht;		// a hyperthread of the shared context
+} stress_arg_t;
+
+//
+// stress_check - Fail the whole test if a call didn't return as expected.
+// The TST_* helpers print every call, which is too much from a loop.
+//
+static void
+stress_check(int id, const char *call, int retval, int expected)
+{
+	if (retval != expected) {
+		printf("thread %d: %s returned %d, expected %d\n",
+				id, call, retval, expected);
+		exit(EC_THREAD_CALL);
+	}
+}
+
+//
+// stress_async_done - Completion callback of asynchronous group reads.
+//
+static void
+stress_async_done(CRAYPWR_Request request, int retval, void *data)
+{
+	stress_arg_t *arg = data;
+
+	stress_check(arg->id, "CRAYPWR_GrpAttrGetValueAsync callback",
+			retval, PWR_RET_SUCCESS);
+}
+
+//
+// stress_private_context - Create a context, read through it and destroy
+// it, while other threads use theirs.
+//
+static void
+stress_private_context(stress_arg_t *arg)
+{
+	char name[32];
+	PWR_Cntxt context;
+	PWR_Obj entry_point;
+	double value;
+	PWR_Time ts;
+
+	snprintf(name, sizeof(name), "test_threads.%d", arg->id);
+
+	stress_check(arg->id, "PWR_CntxtInit",
+			PWR_CntxtInit(PWR_CNTXT_DEFAULT, PWR_ROLE_APP, name,
+				&context), PWR_RET_SUCCESS);
+	stress_check(arg->id, "PWR_CntxtGetEntryPoint",
+			PWR_CntxtGetEntryPoint(context, &entry_point),
+			PWR_RET_SUCCESS);
+	stress_check(arg->id, "PWR_ObjAttrGetValue",
+			PWR_ObjAttrGetValue(entry_point, PWR_ATTR_POWER,
+				&value, &ts), PWR_RET_SUCCESS);
+	stress_check(arg->id, "PWR_CntxtDestroy",
+			PWR_CntxtDestroy(context), PWR_RET_SUCCESS);
+}
+
+//
+// stress_thread - Body of each thread.
+//
+// Argument(s):
+//
+//	data - The thread's stress_arg_t
+//
+// Return Code(s):
+//
+//	gpointer - NULL
+//
+static gpointer
+stress_thread(gpointer data)
+{
+	stress_arg_t *arg = data;
+	uint64_t *values = g_new0(uint64_t, SNAPSHOT_LEN);
+	PWR_Time *times = g_new0(PWR_Time, SNAPSHOT_LEN);
+	CRAYPWR_Snapshot snap = {
+		.type = PWR_OBJ_HT,
+		.attr = PWR_ATTR_FREQ,
+		.len = SNAPSHOT_LEN,
+		.values = values,
+		.ts = times,
+	};
+	PWR_Grp group;
+	PWR_Stat stat;
+	CRAYPWR_Request request;
+	CRAYPWR_Request grp_request;
+	uint64_t hint;
+	double value;
+	PWR_Time ts;
+	int retval;
+	int i;
+
+	for (i = 0; i < STRESS_ITERATIONS; i++) {
+		stress_check(arg->id, "PWR_ObjAttrGetValue",
+				PWR_ObjAttrGetValue(arg->ht, PWR_ATTR_FREQ,
+					&value, &ts), PWR_RET_SUCCESS);
+
+		// Shared group: contends for its read set
+		stress_check(arg->id, "PWR_GrpAttrGetValue",
+				PWR_GrpAttrGetValue(arg->hts, PWR_ATTR_FREQ,
+					values, times, NULL), PWR_RET_SUCCESS);
+
+		// Asynchronous reads, run by the context's worker threads
+		stress_check(arg->id, "CRAYPWR_ObjAttrGetValueAsync",
+				CRAYPWR_ObjAttrGetValueAsync(arg->ht,
+					PWR_ATTR_FREQ, &value, &ts, NULL, NULL,
+					&request), PWR_RET_SUCCESS);
+		stress_check(arg->id, "CRAYPWR_GrpAttrGetValueAsync",
+				CRAYPWR_GrpAttrGetValueAsync(arg->hts,
+					PWR_ATTR_FREQ, values, times, NULL,
+					stress_async_done, arg, &grp_request),
+				PWR_RET_SUCCESS);
+		stress_check(arg->id, "CRAYPWR_RequestWait",
+				CRAYPWR_RequestWait(request, &retval),
+				PWR_RET_SUCCESS);
+		stress_check(arg->id, "CRAYPWR_ObjAttrGetValueAsync read",
+				retval, PWR_RET_SUCCESS);
+		stress_check(arg->id, "CRAYPWR_RequestDestroy",
+				CRAYPWR_RequestDestroy(request),
+				PWR_RET_SUCCESS);
+		stress_check(arg->id, "CRAYPWR_RequestDestroy",
+				CRAYPWR_RequestDestroy(grp_request),
+				PWR_RET_SUCCESS);
+
+		// Private group in the shared context
+		stress_check(arg->id, "PWR_GrpCreate",
+				PWR_GrpCreate(arg->context, &group),
+				PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_GrpAddObj",
+				PWR_GrpAddObj(group, arg->ht), PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_GrpCreateStat",
+				PWR_GrpCreateStat(group, PWR_ATTR_FREQ,
+					PWR_ATTR_STAT_AVG, &stat),
+				PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_StatStart",
+				PWR_StatStart(stat), PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_StatStop",
+				PWR_StatStop(stat), PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_StatDestroy",
+				PWR_StatDestroy(stat), PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_GrpDestroy",
+				PWR_GrpDestroy(group), PWR_RET_SUCCESS);
+
+		// Statistic on an object shared by every thread
+		stress_check(arg->id, "PWR_ObjCreateStat",
+				PWR_ObjCreateStat(arg->ht, PWR_ATTR_FREQ,
+					PWR_ATTR_STAT_MAX, &stat),
+				PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_StatDestroy",
+				PWR_StatDestroy(stat), PWR_RET_SUCCESS);
+
+		// Hint names are unique across the context
+		stress_check(arg->id, "PWR_AppHintCreate",
+				PWR_AppHintCreate(arg->ht, NULL, &hint,
+					PWR_REGION_COMPUTE,
+					PWR_REGION_INT_MEDIUM),
+				PWR_RET_SUCCESS);
+		stress_check(arg->id, "PWR_AppHintDestroy",
+				PWR_AppHintDestroy(hint), PWR_RET_SUCCESS);
+
+		retval = CRAYPWR_CntxtSnapshot(arg->context, 1, &snap);
+		stress_check(arg->id, "CRAYPWR_CntxtSnapshot",
+				retval == PWR_RET_WARN_TRUNC
+					? PWR_RET_SUCCESS : retval,
+				PWR_RET_SUCCESS);
+
+		if (i % STRESS_CNTXT_EVERY == arg->id % STRESS_CNTXT_EVERY)
+			stress_private_context(arg);
+	}
+
+	g_free(values);
+	g_free(times);
+
+	return NULL;
+}
+
+//
+// main - Main entry point.
+//
+// Argument(s):
+//
+//	argc - Number of arguments
+//	argv - Arguments
+//
+// Return Code(s):
+//
+//	int - Zero for success, non-zero for failure
+//
+int
+main(int argc, char **argv)
+{
+	stress_arg_t args[STRESS_THREADS];
+	GThread *threads[STRESS_THREADS];
+	PWR_Cntxt context;
+	PWR_Obj entry_point;
+	PWR_Obj ht;
+	PWR_Grp hts;
+	int i;
+
+	TST_CntxtInit(PWR_CNTXT_DEFAULT, PWR_ROLE_APP, "test_threads",
+			&context, PWR_RET_SUCCESS);
+
+	TST_CntxtGetEntryPoint(context, &entry_point, PWR_RET_SUCCESS);
+
+	get_ht_obj(context, entry_point, &ht);
+
+	TST_GrpCreate(context, &hts, PWR_RET_SUCCESS);
+	find_objects_of_type(entry_point, PWR_OBJ_HT, hts);
+
+	printf("Running %d threads of %d iterations: ", STRESS_THREADS,
+			STRESS_ITERATIONS);
+	fflush(stdout);
+
+	for (i = 0; i < STRESS_THREADS; i++) {
+		args[i].id = i;
+		args[i].context = context;
+		args[i].hts = hts;
+		args[i].ht = ht;
+
+		threads[i] = g_thread_try_new("stress", stress_thread,
+				&args[i], NULL);
+		if (!threads[i]) {
+			printf("Failed to create thread %d\n", i);
+			exit(EC_THREAD_CREATE);
+		}
+	}
+
+	for (i = 0; i < STRESS_THREADS; i++) {
+		g_thread_join(threads[i]);
+	}
+
+	printf("PASS\n");
+
+	TST_GrpDestroy(hts, PWR_RET_SUCCESS);
+
+	TST_CntxtDestroy(context, PWR_RET_SUCCESS);
+
+	exit(EC_SUCCESS);
+}